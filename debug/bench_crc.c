@@ -0,0 +1,135 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "CD.h"
+#include "crc.h"
+
+// Microbenchmark del CRC del subcanal Q. Compara l'algorisme byte a
+// byte original amb CD_crc_subq_calc i les versions per lots. Compilar
+// amb:
+//   gcc -O2 -I../src bench_crc.c ../src/crc.c -lpthread
+
+#define NBLOCKS 4096
+
+static uint16_t _tab[256];
+
+static void
+init_tab ( void )
+{
+
+  int i,j;
+  uint16_t v;
+
+
+  for ( i= 0; i < 256; ++i )
+    {
+      v= (uint16_t) (i<<8);
+      for ( j= 0; j < 8; ++j )
+        v= (v&0x8000) ? (uint16_t) ((v<<1)^0x1021) : (uint16_t) (v<<1);
+      _tab[i]= v;
+    }
+
+}
+
+static uint16_t
+old_calc (
+          const uint8_t subq[CD_SUBCH_SIZE]
+          )
+{
+
+  uint16_t ret;
+  int i;
+
+
+  ret= 0;
+  for ( i= 1; i <= 10; ++i )
+    ret= _tab[(ret>>8)^subq[i]] ^ (uint16_t) (ret<<8);
+
+  return ~ret;
+
+}
+
+static double
+now ( void )
+{
+
+  struct timespec ts;
+
+
+  clock_gettime ( CLOCK_MONOTONIC, &ts );
+
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+
+}
+
+static void
+report (
+        const char   *name,
+        const double  t,
+        const long    n
+        )
+{
+
+  printf ( "%-12s %8.1f Mblocks/s %8.2f ns/block\n",
+           name, n/t/1e6, t*1e9/n );
+
+}
+
+int main ( int argc, const char *argv[] )
+{
+
+  static uint8_t q[NBLOCKS][CD_SUBCH_SIZE];
+  static uint16_t crc[NBLOCKS];
+  long i,j,iters;
+  double t0;
+  uint16_t acc;
+  size_t nok;
+
+
+  iters= argc > 1 ? atol ( argv[1] ) : 2000;
+  init_tab ();
+  srand ( 1 );
+  for ( i= 0; i < NBLOCKS; ++i )
+    for ( j= 0; j < CD_SUBCH_SIZE; ++j )
+      q[i][j]= (uint8_t) rand ();
+  
+  // Original.
+  acc= 0;
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    for ( j= 0; j < NBLOCKS; ++j )
+      acc^= old_calc ( q[j] );
+  report ( "BYTE", now ()-t0, iters*NBLOCKS );
+
+  // Slice-by-10.
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    for ( j= 0; j < NBLOCKS; ++j )
+      acc^= CD_crc_subq_calc ( q[j] );
+  report ( "SLICE", now ()-t0, iters*NBLOCKS );
+
+  // Per lots.
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    {
+      CD_crc_subq_calc_batch ( &q[0][1], NBLOCKS, CD_SUBCH_SIZE, crc );
+      acc^= crc[i%NBLOCKS];
+    }
+  report ( "BATCH", now ()-t0, iters*NBLOCKS );
+
+  // Comprovació per lots.
+  nok= 0;
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    nok+= CD_crc_subq_check_batch ( &q[0][1], NBLOCKS, CD_SUBCH_SIZE, NULL );
+  report ( "CHECK", now ()-t0, iters*NBLOCKS );
+
+  printf ( "(%04X %zu)\n", acc, nok );
+
+  return EXIT_SUCCESS;
+
+}
@@ -0,0 +1,154 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "CD.h"
+#include "deemph.h"
+
+// Microbenchmark del filtre de desènfasi. Compara CD_deemph_sector amb
+// un filtre de referència en double, mostra a mostra, i amb la còpia
+// d'un sector (memcpy), i comprova que la diferència amb la
+// referència no supera 1. Compilar amb:
+//   gcc -O2 -I../src bench_deemph.c ../src/deemph.c
+// (afegint -DCD_NO_SSE2 per mesurar la versió escalar).
+
+#define NSECS 1024
+
+static void
+ref_deemph (
+            double  st[4],
+            int16_t out[CD_STREAM_FRAMES*2],
+            const uint8_t *buf
+            )
+{
+
+  const double t1= 50e-6, t2= 15e-6, k= 2.0*44100.0;
+  const double b0= (1.0 + k*t2)/(1.0 + k*t1);
+  const double b1= (1.0 - k*t2)/(1.0 + k*t1);
+  const double a1= (1.0 - k*t1)/(1.0 + k*t1);
+  double x,y;
+  int i,c;
+
+
+  for ( i= 0; i < CD_STREAM_FRAMES; ++i )
+    for ( c= 0; c < 2; ++c )
+      {
+        x= (int16_t) (uint16_t) (buf[4*i+2*c] | (buf[4*i+2*c+1]<<8));
+        y= b0*x + b1*st[c] - a1*st[2+c];
+        st[c]= x; st[2+c]= y;
+        y= y>=0 ? y+0.5 : y-0.5;
+        out[2*i+c]= y > 32767 ? 32767 : (y < -32768 ? -32768 : (int16_t) y);
+      }
+
+} // end ref_deemph
+
+static double
+now ( void )
+{
+
+  struct timespec ts;
+
+
+  clock_gettime ( CLOCK_MONOTONIC, &ts );
+
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+
+}
+
+static void
+report (
+        const char   *name,
+        const double  t,
+        const long    n
+        )
+{
+
+  printf ( "%-12s %8.2f Msecs/s %8.1f ns/sec\n",
+           name, n/t/1e6, t*1e9/n );
+
+}
+
+int main ( int argc, const char *argv[] )
+{
+
+  static uint8_t orig[NSECS][CD_SEC_SIZE],buf[NSECS][CD_SEC_SIZE];
+  static int16_t ref[CD_STREAM_FRAMES*2];
+  CD_Deemph st;
+  double rst[4];
+  long i,j,iters;
+  double t0;
+  int k,d,maxd;
+  int16_t s;
+  uint8_t acc;
+
+
+  iters= argc > 1 ? atol ( argv[1] ) : 50;
+  srand ( 1 );
+  // Senyal amb soroll i pics (per provar la saturació).
+  for ( i= 0; i < NSECS; ++i )
+    for ( k= 0; k < CD_STREAM_FRAMES*2; ++k )
+      {
+        s= (int16_t) ((rand ()%2000) - 1000 + (((i*CD_STREAM_FRAMES+k/2)/40)%2 ?
+                                              30000 : -30000));
+        if ( rand ()%50 == 0 ) s= (rand ()%2) ? 32767 : -32768;
+        orig[i][2*k]= (uint8_t) s; orig[i][2*k+1]= (uint8_t) (s>>8);
+      }
+
+  // Comprovacions.
+  memcpy ( buf, orig, sizeof(buf) );
+  CD_deemph_reset ( &st );
+  rst[0]= rst[1]= rst[2]= rst[3]= 0.0;
+  maxd= 0;
+  for ( i= 0; i < NSECS; ++i )
+    {
+      CD_deemph_sector ( &st, buf[i] );
+      ref_deemph ( rst, ref, orig[i] );
+      for ( k= 0; k < CD_STREAM_FRAMES*2; ++k )
+        {
+          d= (int16_t) (uint16_t) (buf[i][2*k] | (buf[i][2*k+1]<<8)) - ref[k];
+          if ( d < 0 ) d= -d;
+          if ( d > maxd ) maxd= d;
+        }
+    }
+  if ( maxd > 1 )
+    {
+      fprintf ( stderr, "ERROR: max difference %d\n", maxd );
+      return EXIT_FAILURE;
+    }
+
+  // Mesures.
+  acc= 0;
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    for ( j= 0; j < NSECS; ++j )
+      {
+        memcpy ( buf[j], orig[(j+i)%NSECS], CD_SEC_SIZE );
+        acc^= buf[j][i%CD_SEC_SIZE];
+      }
+  report ( "COPY", now ()-t0, iters*NSECS );
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    for ( j= 0; j < NSECS; ++j )
+      {
+        ref_deemph ( rst, ref, buf[j] );
+        acc^= (uint8_t) ref[i%CD_STREAM_FRAMES];
+      }
+  report ( "DOUBLE", now ()-t0, iters*NSECS );
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    for ( j= 0; j < NSECS; ++j )
+      {
+        CD_deemph_sector ( &st, buf[j] );
+        acc^= buf[j][i%CD_SEC_SIZE];
+      }
+  report ( "DEEMPH", now ()-t0, iters*NSECS );
+
+  printf ( "(%02X) max diff %d\n", acc, maxd );
+
+  return EXIT_SUCCESS;
+
+}
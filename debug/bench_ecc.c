@@ -0,0 +1,86 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "CD.h"
+#include "ecc.h"
+
+// Microbenchmark de la generació d'EDC/ECC. Compilar amb:
+//   gcc -O2 -I../src bench_ecc.c ../src/ecc.c -lpthread
+
+#define NSECS 1024
+
+static double
+now ( void )
+{
+
+  struct timespec ts;
+
+
+  clock_gettime ( CLOCK_MONOTONIC, &ts );
+
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+
+}
+
+static void
+report (
+        const char   *name,
+        const double  t,
+        const long    nsecs
+        )
+{
+
+  double sps;
+
+
+  sps= nsecs/t;
+  printf ( "%-12s %10.0f sectors/s %8.1f MB/s %8.0fx\n",
+           name, sps, sps*CD_SEC_SIZE/1e6, sps/75 );
+
+}
+
+int main ( int argc, const char *argv[] )
+{
+
+  static uint8_t secs[NSECS][CD_SEC_SIZE];
+  long i,j,iters;
+  double t0;
+  uint32_t edc;
+
+
+  iters= argc > 1 ? atol ( argv[1] ) : 50;
+  srand ( 1 );
+  for ( i= 0; i < NSECS; ++i )
+    for ( j= 0; j < CD_SEC_SIZE; ++j )
+      secs[i][j]= (uint8_t) rand ();
+
+  // EDC.
+  edc= 0;
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    for ( j= 0; j < NSECS; ++j )
+      edc^= CD_edc_calc ( 0, secs[j], 0x810 );
+  report ( "EDC", now ()-t0, iters*NSECS );
+
+  // MODE 1 complet (EDC + P + Q).
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    for ( j= 0; j < NSECS; ++j )
+      CD_ecc_mode1 ( secs[j] );
+  report ( "MODE1", now ()-t0, iters*NSECS );
+
+  // MODE 2 FORM 1.
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    for ( j= 0; j < NSECS; ++j )
+      CD_ecc_mode2_form1 ( secs[j] );
+  report ( "MODE2 FORM1", now ()-t0, iters*NSECS );
+
+  printf ( "(%08X)\n", edc^secs[0][0x810] );
+
+  return EXIT_SUCCESS;
+
+}
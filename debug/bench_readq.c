@@ -0,0 +1,151 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "CD.h"
+
+// Microbenchmark de la lectura de sector + subcanal Q tal com la fa un
+// emulador. Compara el parell CD_disc_read + CD_disc_read_q amb
+// CD_disc_read_with_q amb un sector, i el parell CD_disc_read_n +
+// CD_disc_read_q_range amb CD_disc_read_with_q per lots, recorrent
+// tota la imatge, i comprova que donen el mateix resultat. Compilar amb:
+//   gcc -O2 -I../src bench_readq.c ../src/*.c -lpthread -lz -llzma -lm
+// Ús: ./a.out IMATGE [ITERACIONS]
+
+#define BATCH 64
+
+static double
+now ( void )
+{
+
+  struct timespec ts;
+
+
+  clock_gettime ( CLOCK_MONOTONIC, &ts );
+
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+
+}
+
+static void
+report (
+        const char   *name,
+        const double  t,
+        const long    n
+        )
+{
+
+  printf ( "%-12s %8.1f Ksecs/s %8.1f ns/sec\n",
+           name, n/t/1e3, t*1e9/n );
+
+}
+
+int main ( int argc, const char *argv[] )
+{
+
+  static uint8_t buf[BATCH][CD_SEC_SIZE],q[BATCH][CD_SUBCH_SIZE];
+  static uint8_t buf2[CD_SEC_SIZE],q2[CD_SUBCH_SIZE];
+  char *err;
+  CD_Disc *d,*d2;
+  bool audio[BATCH],crc_ok[BATCH],audio2,crc_ok2;
+  long i,n,nsecs,iters;
+  double t0;
+  uint8_t acc;
+  int bad,r,j;
+
+
+  if ( argc < 2 )
+    {
+      fprintf ( stderr, "Usage: %s IMAGE [ITERS]\n", argv[0] );
+      return EXIT_FAILURE;
+    }
+  iters= argc > 2 ? atol ( argv[2] ) : 20;
+  d= CD_disc_new ( argv[1], &err );
+  if ( d == NULL )
+    {
+      fprintf ( stderr, "[EE] %s\n", err );
+      free ( err );
+      return EXIT_FAILURE;
+    }
+  d2= CD_disc_clone ( d );
+
+  // Comprovacions.
+  bad= 0;
+  CD_disc_reset ( d );
+  CD_disc_reset ( d2 );
+  for ( nsecs= 0;
+        CD_disc_read_with_q ( d, buf[0], q[0], crc_ok, audio, 1, true ) == 1;
+        ++nsecs )
+    {
+      if ( !CD_disc_read ( d2, buf2, &audio2, false ) ||
+           !CD_disc_read_q ( d2, q2, &crc_ok2, true ) ||
+           memcmp ( buf[0], buf2, CD_SEC_SIZE ) ||
+           memcmp ( q[0], q2, CD_SUBCH_SIZE ) ||
+           audio[0] != audio2 || crc_ok[0] != crc_ok2 )
+        ++bad;
+    }
+  if ( bad || nsecs == 0 )
+    {
+      fprintf ( stderr, "ERROR: %d mismatches (%ld sectors)\n", bad, nsecs );
+      return EXIT_FAILURE;
+    }
+  n= iters*nsecs;
+
+  // Parell read + read_q.
+  acc= 0;
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    {
+      CD_disc_reset ( d );
+      while ( CD_disc_read ( d, buf[0], &audio[0], false ) &&
+              CD_disc_read_q ( d, q[0], &crc_ok[0], true ) )
+        acc^= buf[0][i%CD_SEC_SIZE] ^ q[0][2];
+    }
+  report ( "READ+Q", now ()-t0, n );
+
+  // Un sector.
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    {
+      CD_disc_reset ( d );
+      while ( CD_disc_read_with_q ( d, buf[0], q[0], crc_ok, audio,
+                                    1, true ) == 1 )
+        acc^= buf[0][i%CD_SEC_SIZE] ^ q[0][2];
+    }
+  report ( "WITH_Q", now ()-t0, n );
+
+  // Parell read_n + read_q_range per lots.
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    {
+      CD_disc_reset ( d );
+      while ( (r= CD_disc_read_n ( d, &buf[0][0], audio, BATCH, false )) > 0 &&
+              CD_disc_read_q_range ( d, &q[0][0], crc_ok, r, true ) == r )
+        for ( j= 0; j < r; ++j )
+          acc^= buf[j][i%CD_SEC_SIZE] ^ q[j][2];
+    }
+  report ( "N+Q_RANGE", now ()-t0, n );
+
+  // Per lots.
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    {
+      CD_disc_reset ( d );
+      while ( (r= CD_disc_read_with_q ( d, &buf[0][0], &q[0][0], crc_ok,
+                                        audio, BATCH, true )) > 0 )
+        for ( j= 0; j < r; ++j )
+          acc^= buf[j][i%CD_SEC_SIZE] ^ q[j][2];
+    }
+  report ( "WITH_Q BATCH", now ()-t0, n );
+
+  printf ( "(%02X)\n", acc );
+  CD_disc_free ( d2 );
+  CD_disc_free ( d );
+
+  return EXIT_SUCCESS;
+
+}
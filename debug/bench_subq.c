@@ -0,0 +1,181 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "CD.h"
+#include "subq.h"
+
+// Microbenchmark del desintercalat dels subcanals P-W. Compara el bucle
+// bit a bit (com 'get_q' de tools/mds2cue.py) amb CD_subpw_get_q,
+// CD_subpw_deinterleave i les versions per lots, i comprova que
+// tots donen el mateix resultat. Compilar amb:
+//   gcc -O2 -I../src bench_subq.c ../src/subq.c ../src/crc.c -lpthread
+// (afegint -DCD_NO_SSE2 per mesurar la versió escalar).
+
+#define NSECS 4096
+
+// Com en un .mdf amb subcanal.
+#define STRIDE (CD_SEC_SIZE+CD_SUBPW_SIZE)
+
+static void
+old_get_q (
+           const uint8_t *pw,
+           uint8_t        q[12]
+           )
+{
+
+  int i;
+
+
+  memset ( q, 0, 12 );
+  for ( i= 0; i < CD_SUBPW_SIZE; ++i )
+    if ( pw[i]&0x40 )
+      q[i>>3]|= (uint8_t) (0x80>>(i&7));
+
+}
+
+static void
+old_deinterleave (
+                  const uint8_t *pw,
+                  uint8_t        packed[CD_SUBPW_SIZE]
+                  )
+{
+
+  int i,c;
+
+
+  memset ( packed, 0, CD_SUBPW_SIZE );
+  for ( c= 0; c < 8; ++c )
+    for ( i= 0; i < CD_SUBPW_SIZE; ++i )
+      if ( pw[i]&(0x80>>c) )
+        packed[c*12 + (i>>3)]|= (uint8_t) (0x80>>(i&7));
+
+}
+
+static double
+now ( void )
+{
+
+  struct timespec ts;
+
+
+  clock_gettime ( CLOCK_MONOTONIC, &ts );
+
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+
+}
+
+static void
+report (
+        const char   *name,
+        const double  t,
+        const long    n
+        )
+{
+
+  printf ( "%-12s %8.1f Msecs/s %8.2f ns/sec\n",
+           name, n/t/1e6, t*1e9/n );
+
+}
+
+int main ( int argc, const char *argv[] )
+{
+
+  static uint8_t mdf[NSECS*STRIDE];
+  static uint8_t q[NSECS][12],q2[NSECS][12];
+  static uint8_t packed[NSECS][CD_SUBPW_SIZE],packed2[NSECS][CD_SUBPW_SIZE];
+  static uint8_t pw[CD_SUBPW_SIZE];
+  long i,j,iters;
+  double t0;
+  uint8_t acc;
+  int bad;
+
+
+  iters= argc > 1 ? atol ( argv[1] ) : 500;
+  srand ( 1 );
+  for ( i= 0; i < NSECS*STRIDE; ++i )
+    mdf[i]= (uint8_t) rand ();
+#define SUB(I) (&mdf[(I)*STRIDE + CD_SEC_SIZE])
+
+  // Comprovacions.
+  bad= 0;
+  CD_subpw_get_q_batch ( SUB(0), NSECS, STRIDE, &q2[0][0], 12 );
+  CD_subpw_deinterleave_batch ( SUB(0), NSECS, STRIDE, &packed2[0][0] );
+  for ( i= 0; i < NSECS; ++i )
+    {
+      old_get_q ( SUB(i), q[i] );
+      old_deinterleave ( SUB(i), packed[i] );
+      if ( memcmp ( q[i], q2[i], 12 ) ||
+           memcmp ( packed[i], packed2[i], CD_SUBPW_SIZE ) )
+        ++bad;
+      CD_subpw_get_q ( SUB(i), q2[i] );
+      CD_subpw_interleave ( packed[i], pw );
+      if ( memcmp ( q[i], q2[i], 12 ) || memcmp ( pw, SUB(i), CD_SUBPW_SIZE ) )
+        ++bad;
+    }
+  if ( bad )
+    {
+      fprintf ( stderr, "ERROR: %d mismatches\n", bad );
+      return EXIT_FAILURE;
+    }
+
+  // Q.
+  acc= 0;
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    for ( j= 0; j < NSECS; ++j )
+      {
+        old_get_q ( SUB(j), q[j] );
+        acc^= q[j][i%12];
+      }
+  report ( "Q BIT", now ()-t0, iters*NSECS );
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    for ( j= 0; j < NSECS; ++j )
+      {
+        CD_subpw_get_q ( SUB(j), q[j] );
+        acc^= q[j][i%12];
+      }
+  report ( "Q", now ()-t0, iters*NSECS );
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    {
+      CD_subpw_get_q_batch ( SUB(0), NSECS, STRIDE, &q[0][0], 12 );
+      acc^= q[i%NSECS][i%12];
+    }
+  report ( "Q BATCH", now ()-t0, iters*NSECS );
+
+  // Tots els canals.
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    for ( j= 0; j < NSECS; ++j )
+      {
+        old_deinterleave ( SUB(j), packed[j] );
+        acc^= packed[j][i%CD_SUBPW_SIZE];
+      }
+  report ( "PW BIT", now ()-t0, iters*NSECS );
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    for ( j= 0; j < NSECS; ++j )
+      {
+        CD_subpw_deinterleave ( SUB(j), packed[j] );
+        acc^= packed[j][i%CD_SUBPW_SIZE];
+      }
+  report ( "PW", now ()-t0, iters*NSECS );
+  t0= now ();
+  for ( i= 0; i < iters; ++i )
+    {
+      CD_subpw_deinterleave_batch ( SUB(0), NSECS, STRIDE, &packed[0][0] );
+      acc^= packed[i%NSECS][i%CD_SUBPW_SIZE];
+    }
+  report ( "PW BATCH", now ()-t0, iters*NSECS );
+
+  printf ( "(%02X)\n", acc );
+
+  return EXIT_SUCCESS;
+
+}
@@ -31,6 +31,8 @@
 
 #define CD_SEC_SIZE 0x930
 #define CD_SUBCH_SIZE 13 /* En realitat 12.15 (98 bits)*/
+#define CD_SUBPW_SIZE 96 /* Subcanals P-W intercalats, 1 byte per símbol */
+#define CD_USER_DATA_SIZE 2336 /* Buffer de CD_disc_read_user_data */
 
 // És un tipus global, igual cal definir més tipos.
 typedef enum
@@ -112,6 +114,26 @@ CD_info_free (
               CD_Info *info
               );
 
+// Estadístiques de la lectura anticipada.
+typedef struct
+{
+
+  uint64_t hits; // Sectors servits directament des de l'anell.
+  uint64_t misses; // Sectors que s'han hagut de llegir o esperar.
+  
+} CD_ReadAheadStats;
+
+// Petició de lectura per a CD_disc_read_batch.
+typedef struct
+{
+
+  int      sec; // Sector absolut (00:00:00 és el 0).
+  uint8_t *buf; // CD_SEC_SIZE bytes.
+  bool     audio; // (Eixida) Cert si és un sector d'audio.
+  bool     ok; // (Eixida) Cert si s'ha llegit.
+  
+} CD_SectorReq;
+
 // Estructura principal
 typedef struct CD_Disc_ CD_Disc;
 
@@ -132,6 +154,20 @@ typedef struct
   uint8_t (*get_current_index) (CD_Disc *);
   bool (*move_to_leadin) (CD_Disc *);
   CD_Position (*tell) (CD_Disc *);
+  const uint8_t * (*read_view) (CD_Disc *,bool *audio,const bool move);
+  int (*read_n) (CD_Disc *,uint8_t *buf,bool *audio,const int n,
+                 const bool move);
+  CD_Disc * (*clone) (CD_Disc *);
+  bool (*set_readahead) (CD_Disc *,const int depth);
+  void (*get_readahead_stats) (CD_Disc *,CD_ReadAheadStats *stats);
+  int (*read_batch) (CD_Disc *,CD_SectorReq *reqs,const int n);
+  int (*read_q_range) (CD_Disc *,uint8_t *buf,bool *crc_ok,const int n,
+                       const bool move);
+  bool (*read_pw) (CD_Disc *,uint8_t buf[CD_SUBPW_SIZE],const bool move);
+  bool (*read_user_data) (CD_Disc *,uint8_t buf[CD_USER_DATA_SIZE],
+                          int *length,const bool move);
+  int (*read_with_q) (CD_Disc *,uint8_t *buf,uint8_t *q,bool *crc_ok,
+                      bool *audio,const int n,const bool move);
 } CD_Disc_Meths;
 
 #define CD_DISC_CLS CD_Disc_Meths _m;
@@ -149,9 +185,239 @@ CD_disc_new (
              char       **err
              );
 
+// Cache de sectors compartida.
+typedef struct CD_Cache_ CD_Cache;
+
+// Estadístiques d'una cache.
+typedef struct
+{
+
+  uint64_t hits;
+  uint64_t misses;
+  
+} CD_CacheStats;
+
+// Crea una cache LRU de sectors de com a màxim MAX_BYTES bytes. La
+// cache està dividida en NSHARDS fragments (16 si és <=0) amb el seu
+// propi bloqueig, per tant pot gastar-se des de diversos fils i
+// compartir-se entre diversos discs. Si MAX_BYTES no arriba per a una
+// entrada en cada fragment es fan servir menys fragments (com a
+// mínim 1).
+CD_Cache *
+CD_cache_new (
+              const size_t max_bytes,
+              const int    nshards
+              );
+
+// Allibera la cache. Les dades no s'alliberen fins que no s'alliberen
+// també tots els discs que la gasten.
+void
+CD_cache_free (
+               CD_Cache *cache
+               );
+
+void
+CD_cache_get_stats (
+                    CD_Cache      *cache,
+                    CD_CacheStats *stats
+                    );
+
+// Embolica DISC amb CACHE. El disc tornat és propietari de DISC i es
+// comporta igual que ell (incloent el camp 'audio' i el subcanal Q,
+// que sempre es llig de DISC), però els sectors es lligen de la cache
+// quan és possible. Els clons comparteixen les entrades de la cache.
+CD_Disc *
+CD_cache_disc_new (
+                   CD_Cache *cache,
+                   CD_Disc  *disc
+                   );
+
+// Embolica DISC amb el filtre de desènfasi. El disc tornat és
+// propietari de DISC i es comporta igual que ell, però els sectors
+// d'àudio de les pistes amb preènfasi (CD_TrackInfo.audio_preemphasis)
+// que es lligen amb CD_disc_read, CD_disc_read_view, CD_disc_read_n,
+// CD_disc_read_batch i CD_disc_read_with_q es tornen filtrats. L'estat
+// del filtre es manté mentre els sectors són consecutius. El filtre
+// costa uns 0.7-1.0 us per sector amb SSE2 (uns 3.7 us sense), entre
+// tres i quatre vegades el que costa copiar el sector (0.2 us).
+CD_Disc *
+CD_deemph_disc_new (
+                    CD_Disc *disc
+                    );
+
+// Crea (o actualitza) un índex binari al costat de la imatge (FN.idx)
+// amb tot el que cal per a obrir-la, de manera que CD_disc_new sols
+// ha de projectar-lo en memòria i comprovar que les grandàries i
+// dates de modificació dels fitxers no han canviat. Si no és vàlid
+// s'ignora. Sols està suportat per a CUE. Torna fals en cas d'error.
+bool
+CD_disc_write_index (
+                     const char  *fn,
+                     char       **err
+                     );
+
+// Errors d'un sector en CD_disc_verify.
+#define CD_VERIFY_READ 0x01 // No s'ha pogut llegir.
+#define CD_VERIFY_SYNC 0x02 // 'Sync' incorrecte.
+#define CD_VERIFY_EDC  0x04
+#define CD_VERIFY_ECC  0x08 // Paritats P i Q.
+
+typedef struct
+{
+
+  int sec; // Sector absolut (00:00:00 és el 0).
+  int errors; // Combinació de CD_VERIFY_*.
+  
+} CD_BadSector;
+
+// Resultat de CD_disc_verify.
+typedef struct
+{
+
+  long          checked; // Sectors MODE 1 i MODE 2 comprovats.
+  long          skipped; // Sectors de les pistes de dades que no
+                         // es poden comprovar (MODE 0, àudio).
+  int           nbad;
+  CD_BadSector *bad; // Ordenats per sector.
+  
+} CD_VerifyReport;
+
+// Comprova l'EDC i les paritats P i Q de tots els sectors de dades
+// de DISC (MODE 1 i MODE 2 FORM 1/2), sense els pregaps ni les pistes
+// d'àudio. El treball es reparteix en NTHREADS fils (un per CPU si és
+// <=0), cadascun amb el seu cursor. No canvia la posició de DISC. El
+// resultat s'ha d'alliberar.
+CD_VerifyReport *
+CD_disc_verify (
+                CD_Disc   *disc,
+                const int  nthreads
+                );
+
+void
+CD_verify_report_free (
+                       CD_VerifyReport *report
+                       );
+
+// Flux d'àudio CD-DA (16 bits estèreo) per a reproduir en temps real.
+typedef struct CD_Stream_ CD_Stream;
+
+#define CD_STREAM_FRAMES 588 // Frames per sector.
+
+// Canvi de pista o d'índex dins dels frames tornats per
+// CD_stream_pull.
+typedef struct
+{
+
+  int         frame; // Primer frame (dins de BUF) de la pista/índex.
+  int         track; // Pista (1..99) (no és BCD), o 0 si s'acaba el
+                     // flux (fi del disc, sector de dades o error).
+  uint8_t     index; // En BCD.
+  CD_Position pos; // Posició absoluta del primer sector.
+
+} CD_StreamMark;
+
+// Estadístiques d'un flux.
+typedef struct
+{
+
+  uint64_t frames; // Frames tornats.
+  uint64_t underruns; // Crides a CD_stream_pull que han tornat menys
+                      // frames dels demanats perquè el fil encara
+                      // no els havia llegit.
+
+} CD_StreamStats;
+
+// Obri un flux d'àudio a partir de la posició absoluta AMM:ASS:ASECT
+// (no és BCD). Un fil propi llig els sectors amb un cursor nou
+// (CD_disc_clone) i els deixa en un buffer de NSECS sectors (32 si és
+// <=0), per tant DISC es pot continuar gastant i no es pot alliberar
+// abans que el flux. El flux s'acaba en el primer sector que no és
+// d'àudio. Torna NULL en cas d'error.
+CD_Stream *
+CD_stream_new (
+               CD_Disc    *disc,
+               const int   amm,
+               const int   ass,
+               const int   asect,
+               const int   nsecs,
+               char      **err
+               );
+
+void
+CD_stream_free (
+                CD_Stream *stream
+                );
+
+// Copia en BUF[N*2] fins a N frames (mostres de 16 bits amb signe,
+// esquerra i dreta) sense bloquejar-se mai. Si no s'han llegit encara
+// prou sectors torna menys frames i el que falta s'ha d'omplir amb
+// silenci. Si MARKS no és NULL, en *NMARKS s'indica quants elements
+// té i es tornen els canvis de pista o índex (el primer frame tornat
+// després d'obrir o fer un seek sempre en té un); si no hi ha lloc
+// per a un canvi es tornen sols els frames anteriors. Torna el número
+// de frames copiats. Les funcions de consulta del flux (pull, seek i
+// estadístiques) s'han de cridar des d'un únic fil.
+int
+CD_stream_pull (
+                CD_Stream     *stream,
+                int16_t       *buf,
+                const int      n,
+                CD_StreamMark *marks,
+                int           *nmarks
+                );
+
+// Descarta el buffer i continua des de la posició absoluta
+// AMM:ASS:ASECT (no és BCD). Si la posició no existeix el flux
+// s'acaba.
+void
+CD_stream_seek (
+                CD_Stream *stream,
+                const int  amm,
+                const int  ass,
+                const int  asect
+                );
+
+// Activa o desactiva el filtre de desènfasi per a les pistes amb
+// preènfasi (CD_TrackInfo.audio_preemphasis). Per defecte està
+// desactivat. Sols afecta als sectors que encara no s'han llegit. Es
+// fa en el fil del flux, amb el cost indicat en CD_deemph_disc_new.
+void
+CD_stream_set_deemphasis (
+                          CD_Stream  *stream,
+                          const bool  enable
+                          );
+
+void
+CD_stream_get_stats (
+                     const CD_Stream *stream,
+                     CD_StreamStats  *stats
+                     );
+
 // Allibera la memòria.
 #define CD_disc_free(DISC) ((DISC)->_m.free ( (DISC) ))
 
+// Crea un nou cursor sobre el mateix disc, inicialment en la mateixa
+// posició. Les dades del disc (tracks, mapes, fitxers) es comparteixen
+// i no es modifiquen, cada cursor té la seua posició i llig sense
+// dependre de la posició dels fitxers. Per tant, diferents fils poden
+// llegir alhora el mateix disc sense bloquejos sempre que cadascun
+// gaste el seu cursor (un cursor no s'ha de compartir entre fils). Les
+// dades es lliberen quan s'allibera l'últim cursor.
+#define CD_disc_clone(DISC) ((DISC)->_m.clone ( (DISC) ))
+
+// Activa (DEPTH>0) o desactiva (DEPTH==0) la lectura anticipada. Un
+// fil d'E/S llig en segon pla fins a DEPTH sectors a partir de la
+// posició actual, i CD_disc_read es limita a agafar-los mentre la
+// lectura siga seqüencial. Qualsevol canvi de posició descarta els
+// sectors llegits. Torna fals si no s'ha pogut activar.
+#define CD_disc_set_readahead(DISC,DEPTH)        \
+  ((DISC)->_m.set_readahead ( (DISC), (DEPTH) ))
+
+// Ompli STATS amb els encerts i fallades de la lectura anticipada
+// des que es va activar.
+#define CD_disc_get_readahead_stats(DISC,STATS)        \
+  ((DISC)->_m.get_readahead_stats ( (DISC), (STATS) ))
+
 // Mou la posició de lectura al principi de la SESS indicat
 // (1..?). Torna cert si s'ha pogut moure sense cap problema, o fals
 // en cas d'error (no existeix la sessió). Internament llig el TOC.
@@ -182,6 +448,32 @@ CD_disc_new (
 #define CD_disc_read(DISC,BUF,AUDIO,MOVE)        	\
   ((DISC)->_m.read ( (DISC), (BUF), (AUDIO), (MOVE) ))
 
+// Com CD_disc_read però sense còpia: torna un punter (sols lectura)
+// als CD_SEC_SIZE bytes del sector actual, o NULL en cas d'error. El
+// punter pot apuntar directament a la imatge projectada en memòria o
+// a un buffer intern del disc, per tant sols és vàlid fins a la
+// següent operació sobre el disc (o fins alliberar-lo).
+#define CD_disc_read_view(DISC,AUDIO,MOVE)        	\
+  ((DISC)->_m.read_view ( (DISC), (AUDIO), (MOVE) ))
+
+// Llig en BUF[N*CD_SEC_SIZE] N sectors consecutius a partir del
+// sector actual i avança després de l'últim llegit si MOVE. Si AUDIO
+// no és NULL ha de tindre N elements i s'indica per a cada sector si
+// és d'audio. Torna el número de sectors llegits, que sols és menor
+// que N si s'arriba al final del disc, o -1 en cas d'error (i no es
+// mou).
+#define CD_disc_read_n(DISC,BUF,AUDIO,N,MOVE)        	\
+  ((DISC)->_m.read_n ( (DISC), (BUF), (AUDIO), (N), (MOVE) ))
+
+// Llig els N sectors indicats en REQS enviant totes les lectures
+// alhora (io_uring en Linux, 'pread' en la resta), pensat per a
+// processar imatges senceres. Les peticions poden estar en qualsevol
+// ordre, però les consecutives en la imatge es fusionen si també ho
+// són en REQS. No canvia la posició actual. Torna el número de
+// peticions amb 'ok' a cert.
+#define CD_disc_read_batch(DISC,REQS,N)        	\
+  ((DISC)->_m.read_batch ( (DISC), (REQS), (N) ))
+
 // Llig en BUF el subcanal Q del sector actual (98 bits, 12.25 bytes)
 // i avança al següent sector si MOVE. ATENCIÓ!!! El primer byte sols
 // conté els 2 primer bits, els de sincronització, d'aquesta manera la
@@ -189,6 +481,52 @@ CD_disc_new (
 #define CD_disc_read_q(DISC,BUF,PTR_CRC_OK,MOVE)        \
   ((DISC)->_m.read_q ( (DISC), (BUF), (PTR_CRC_OK), (MOVE) ))
 
+// Com CD_disc_read_q però omple en BUF[N*CD_SUBCH_SIZE] el subcanal Q
+// de N sectors consecutius a partir de l'actual, i avança després de
+// l'últim si MOVE. Si CRC_OK no és NULL ha de tindre N elements. Torna
+// el número de sectors omplits, que sols és menor que N si s'arriba al
+// final del disc, o -1 en cas d'error (i no es mou).
+#define CD_disc_read_q_range(DISC,BUF,CRC_OK,N,MOVE)        	\
+  ((DISC)->_m.read_q_range ( (DISC), (BUF), (CRC_OK), (N), (MOVE) ))
+
+// Llig en BUF els subcanals P-W en cru del sector actual i avança al
+// següent sector si MOVE. Cada byte és un símbol: el bit 7 és P, el 6
+// és Q, ... i el 0 és W. Si la imatge no té el subcanal desat es
+// sintetitza a partir del subcanal Q (P actiu en les pauses i R-W a
+// 0).
+#define CD_disc_read_pw(DISC,BUF,MOVE)        	\
+  ((DISC)->_m.read_pw ( (DISC), (BUF), (MOVE) ))
+
+// Llig en BUF[CD_USER_DATA_SIZE] sols les dades d'usuari del sector
+// actual, sense sync, capçalera, subheader ni EDC/ECC, i avança al
+// següent sector si MOVE. El mode i la forma es detecten a partir de
+// la capçalera i el subheader XA, i en LENGTH es torna la grandària:
+// 2048 (MODE 1 i MODE 2 FORM 1) o 2324 (MODE 2 FORM 2). Torna fals en
+// cas d'error o si el sector no és de dades (àudio o MODE 0), i en eixe
+// cas no es mou. El buffer ha de tindre CD_USER_DATA_SIZE bytes
+// perquè alguns formats hi llegeixen també el subheader.
+#define CD_disc_read_user_data(DISC,BUF,LENGTH,MOVE)        	\
+  ((DISC)->_m.read_user_data ( (DISC), (BUF), (LENGTH), (MOVE) ))
+
+// Combina CD_disc_read_n i CD_disc_read_q_range en una única crida:
+// llig en BUF[N*CD_SEC_SIZE] N sectors consecutius a partir de
+// l'actual i en Q[N*CD_SUBCH_SIZE] el seu subcanal Q, recorrent el
+// mapa de sectors una única vegada per a les dues coses. Si CRC_OK o
+// AUDIO no són NULL han de tindre N elements. Avança després de
+// l'últim si MOVE. Torna el número de sectors llegits, que sols és
+// menor que N si s'arriba al final del disc, o -1 en cas d'error (i
+// no es mou). Amb N=1 substitueix el parell CD_disc_read +
+// CD_disc_read_q que fa un emulador per cada sector, i passa per la
+// lectura anticipada. Mesurat (debug/bench_readq.c): amb N=1 en
+// imatges CUE/BIN en cru el cost per sector baixa al voltant d'un 10%,
+// i en la resta de formats la còpia del sector (o la descompressió i
+// l'EDC/ECC) domina i no hi ha diferència apreciable. Per lots costa
+// el mateix que CD_disc_read_n + CD_disc_read_q_range, o fins a un 5%
+// menys.
+#define CD_disc_read_with_q(DISC,BUF,Q,CRC_OK,AUDIO,N,MOVE)        	\
+  ((DISC)->_m.read_with_q ( (DISC), (BUF), (Q), (CRC_OK), (AUDIO),      \
+                            (N), (MOVE) ))
+
 // Retorna una estructura amb informació sobre l'estructura del
 // CD. Aquesta estructura s'ha d'alliberar.
 #define CD_disc_get_info(DISC)        		\
@@ -0,0 +1,1085 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  cache.c - Cache de sectors compartida.
+ *
+ */
+/*
+ *  Les entrades s'identifiquen per (disc, sector), on 'disc' és un
+ *  identificador que assigna la cache a cada disc embolicat (i que
+ *  hereten els seus clons). Els identificadors no es reutilitzen mai,
+ *  per tant les entrades d'un disc alliberat simplement envelleixen.
+ *
+ *  El disc embolicat porta la posició pel seu compte i sols mou el
+ *  disc intern quan cal (fallada, subcanal Q, consultes de posició,
+ *  etc.).
+ */
+
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CD.h"
+#include "utils.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define DEFAULT_NSHARDS 16
+
+// Màxim de fallades consecutives que 'read_with_q' llig d'una vegada.
+#define MISS_RUN 32
+
+#define CACHE_LINE 64
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+typedef struct entry_ entry_t;
+
+struct entry_
+{
+
+  uint64_t  id; // Disc.
+  size_t    sec;
+  bool      audio;
+  entry_t  *prev; // Més recent.
+  entry_t  *next; // Menys recent.
+  entry_t  *hnext; // Següent en la taula hash.
+  uint8_t   data[CD_SEC_SIZE];
+  
+};
+
+typedef struct
+{
+
+  pthread_mutex_t   mutex;
+  entry_t         **buckets;
+  size_t            mask; // Número de 'buckets' menys 1.
+  entry_t          *head; // Més recent.
+  entry_t          *tail; // Menys recent.
+  size_t            N; // Entrades.
+  size_t            cap; // Màxim d'entrades.
+  uint64_t          hits;
+  uint64_t          misses;
+  uint8_t           pad[CACHE_LINE]; // Evita compartir línia de cache.
+  
+} shard_t;
+
+struct CD_Cache_
+{
+
+  atomic_int            refs; // Usuari més discs.
+  atomic_uint_least64_t next_id;
+  int                   nshards;
+  shard_t              *shards;
+  
+};
+
+typedef struct
+{
+
+  CD_DISC_CLS;
+
+  CD_Cache *cache;
+  CD_Disc  *disc; // Disc embolicat.
+  uint64_t  id;
+  size_t    pos; // Sector actual.
+  bool      pos_ok; // Fals si no es coneix (lead-in).
+  bool      synced; // Cert si 'disc' està en 'pos'.
+  uint8_t   sec_buf[CD_SEC_SIZE]; // Per a 'read_view'.
+  
+} CD_CacheDisc;
+
+#define CDISC(DISC) ((CD_CacheDisc *) (DISC))
+#define INNER(DISC) (CDISC(DISC)->disc)
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static uint64_t
+hash (
+      const uint64_t id,
+      const size_t   sec
+      )
+{
+
+  uint64_t h;
+
+  
+  // Finalitzador de SplitMix64.
+  h= id*0x9E3779B97F4A7C15ULL + (uint64_t) sec;
+  h^= h>>30; h*= 0xBF58476D1CE4E5B9ULL;
+  h^= h>>27; h*= 0x94D049BB133111EBULL;
+  h^= h>>31;
+  
+  return h;
+  
+} // end hash
+
+
+static void
+lru_unlink (
+            shard_t *s,
+            entry_t *e
+            )
+{
+
+  if ( e->prev != NULL ) e->prev->next= e->next;
+  else s->head= e->next;
+  if ( e->next != NULL ) e->next->prev= e->prev;
+  else s->tail= e->prev;
+  
+} // end lru_unlink
+
+
+static void
+lru_push (
+          shard_t *s,
+          entry_t *e
+          )
+{
+
+  e->prev= NULL;
+  e->next= s->head;
+  if ( s->head != NULL ) s->head->prev= e;
+  else s->tail= e;
+  s->head= e;
+  
+} // end lru_push
+
+
+// Torna l'apuntador a l'apuntador de l'entrada (o a NULL si no està).
+static entry_t **
+find (
+      shard_t        *s,
+      const uint64_t  h,
+      const uint64_t  id,
+      const size_t    sec
+      )
+{
+
+  entry_t **p;
+
+  
+  for ( p= &(s->buckets[(h>>16)&s->mask]);
+        *p != NULL && ((*p)->id != id || (*p)->sec != sec);
+        p= &((*p)->hnext) );
+  
+  return p;
+  
+} // end find
+
+
+static shard_t *
+get_shard (
+           CD_Cache       *c,
+           const uint64_t  h
+           )
+{
+  return &(c->shards[h%(uint64_t) c->nshards]);
+} // end get_shard
+
+
+static bool
+cache_lookup (
+              CD_Cache       *c,
+              const uint64_t  id,
+              const size_t    sec,
+              uint8_t         buf[CD_SEC_SIZE],
+              bool           *audio
+              )
+{
+
+  shard_t *s;
+  entry_t *e;
+  uint64_t h;
+  
+
+  h= hash ( id, sec );
+  s= get_shard ( c, h );
+  pthread_mutex_lock ( &(s->mutex) );
+  e= *find ( s, h, id, sec );
+  if ( e != NULL )
+    {
+      memcpy ( buf, e->data, CD_SEC_SIZE );
+      *audio= e->audio;
+      lru_unlink ( s, e );
+      lru_push ( s, e );
+      ++(s->hits);
+    }
+  else ++(s->misses);
+  pthread_mutex_unlock ( &(s->mutex) );
+  
+  return e!=NULL;
+  
+} // end cache_lookup
+
+
+static void
+cache_insert (
+              CD_Cache       *c,
+              const uint64_t  id,
+              const size_t    sec,
+              const uint8_t   buf[CD_SEC_SIZE],
+              const bool      audio
+              )
+{
+
+  shard_t *s;
+  entry_t *e,**p;
+  uint64_t h;
+  
+
+  h= hash ( id, sec );
+  s= get_shard ( c, h );
+  if ( s->cap == 0 ) return;
+  pthread_mutex_lock ( &(s->mutex) );
+  p= find ( s, h, id, sec );
+  if ( *p != NULL ) // Un altre fil ja l'ha afegida.
+    {
+      e= *p;
+      lru_unlink ( s, e );
+    }
+  else
+    {
+
+      // Obté una entrada, nova o la menys recent.
+      if ( s->N < s->cap )
+        {
+          e= mem_alloc ( entry_t, 1 );
+          ++(s->N);
+        }
+      else
+        {
+          e= s->tail;
+          lru_unlink ( s, e );
+          *find ( s, hash ( e->id, e->sec ), e->id, e->sec )= e->hnext;
+          p= find ( s, h, id, sec ); // Pot haver canviat.
+        }
+      e->id= id;
+      e->sec= sec;
+      e->hnext= NULL;
+      *p= e;
+      
+    }
+  memcpy ( e->data, buf, CD_SEC_SIZE );
+  e->audio= audio;
+  lru_push ( s, e );
+  pthread_mutex_unlock ( &(s->mutex) );
+  
+} // end cache_insert
+
+
+static void
+cache_unref (
+             CD_Cache *c
+             )
+{
+
+  shard_t *s;
+  entry_t *e,*next;
+  int i;
+  
+  
+  if ( atomic_fetch_sub ( &(c->refs), 1 ) != 1 ) return;
+  for ( i= 0; i < c->nshards; ++i )
+    {
+      s= &(c->shards[i]);
+      for ( e= s->head; e != NULL; e= next )
+        {
+          next= e->next;
+          free ( e );
+        }
+      free ( s->buckets );
+      pthread_mutex_destroy ( &(s->mutex) );
+    }
+  free ( c->shards );
+  free ( c );
+  
+} // end cache_unref
+
+
+// Mou el disc intern a 'pos'. Torna fals si no existeix.
+static bool
+seek_pos (
+          CD_CacheDisc *d
+          )
+{
+  return CD_disc_seek ( d->disc, (int) (d->pos/(60*75)),
+                        (int) ((d->pos/75)%60), (int) (d->pos%75) );
+} // end seek_pos
+
+
+// Mou el disc intern a la posició actual si cal.
+static void
+sync_disc (
+           CD_CacheDisc *d
+           )
+{
+
+  uint8_t q[CD_SUBCH_SIZE];
+  bool crc_ok;
+
+  
+  if ( d->synced ) return;
+  // Després de llegir l'últim sector la posició és just el final del
+  // disc, on no es pot fer un seek.
+  if ( !seek_pos ( d ) && d->pos > 0 )
+    {
+      --(d->pos);
+      if ( seek_pos ( d ) ) CD_disc_read_q ( d->disc, q, &crc_ok, true );
+      ++(d->pos);
+    }
+  d->synced= true;
+  
+} // end sync_disc
+
+
+// Cal cridar-la després de moure el disc intern.
+static void
+update_pos (
+            CD_CacheDisc *d
+            )
+{
+
+  d->pos= CD_get_sec_ind ( CD_disc_tell ( d->disc ) );
+  d->pos_ok= true;
+  d->synced= true;
+  
+} // end update_pos
+
+
+static CD_CacheDisc *
+new_cache_disc (
+                CD_Cache       *cache,
+                CD_Disc        *disc,
+                const uint64_t  id
+                );
+
+
+
+
+/***********/
+/* MÈTODES */
+/***********/
+
+static void
+free_ (
+       CD_Disc *d
+       )
+{
+
+  CD_disc_free ( INNER(d) );
+  cache_unref ( CDISC(d)->cache );
+  free ( d );
+  
+} // end free_
+
+
+static bool
+move_to_session (
+                 CD_Disc   *d,
+                 const int  sess
+                 )
+{
+
+  sync_disc ( CDISC(d) );
+  if ( !CD_disc_move_to_session ( INNER(d), sess ) ) return false;
+  update_pos ( CDISC(d) );
+
+  return true;
+  
+} // end move_to_session
+
+
+static bool
+move_to_track (
+               CD_Disc   *d,
+               const int  track
+               )
+{
+
+  sync_disc ( CDISC(d) );
+  if ( !CD_disc_move_to_track ( INNER(d), track ) ) return false;
+  update_pos ( CDISC(d) );
+
+  return true;
+  
+} // end move_to_track
+
+
+static void
+reset (
+       CD_Disc *d
+       )
+{
+
+  CD_disc_reset ( INNER(d) );
+  update_pos ( CDISC(d) );
+  
+} // end reset
+
+
+static bool
+seek (
+      CD_Disc *d,
+      int      amm,
+      int      ass,
+      int      asect
+      )
+{
+
+  sync_disc ( CDISC(d) );
+  if ( !CD_disc_seek ( INNER(d), amm, ass, asect ) ) return false;
+  update_pos ( CDISC(d) );
+  
+  return true;
+  
+} // end seek
+
+
+static int
+get_num_sessions (
+                  CD_Disc *d
+                  )
+{
+  return CD_disc_get_num_sessions ( INNER(d) );
+} // end get_num_sessions
+
+
+static bool
+read (
+      CD_Disc    *d,
+      uint8_t     buf[CD_SEC_SIZE],
+      bool       *audio,
+      const bool  move
+      )
+{
+
+  CD_CacheDisc *cd;
+
+  
+  cd= CDISC(d);
+  if ( !cd->pos_ok ) return CD_disc_read ( cd->disc, buf, audio, move );
+  
+  // Encert.
+  if ( cache_lookup ( cd->cache, cd->id, cd->pos, buf, audio ) )
+    {
+      if ( move )
+        {
+          ++(cd->pos);
+          cd->synced= false;
+        }
+      return true;
+    }
+
+  // Fallada.
+  sync_disc ( cd );
+  if ( !CD_disc_read ( cd->disc, buf, audio, move ) ) return false;
+  cache_insert ( cd->cache, cd->id, cd->pos, buf, *audio );
+  if ( move ) ++(cd->pos);
+  
+  return true;
+  
+} // end read
+
+
+static bool
+read_q (
+        CD_Disc    *d,
+        uint8_t     buf[CD_SUBCH_SIZE],
+        bool       *crc_ok,
+        const bool  move
+        )
+{
+
+  sync_disc ( CDISC(d) );
+  if ( !CD_disc_read_q ( INNER(d), buf, crc_ok, move ) ) return false;
+  if ( move ) ++(CDISC(d)->pos);
+  
+  return true;
+  
+} // end read_q
+
+
+static CD_Info *
+get_info (
+          CD_Disc *d
+          )
+{
+  return CD_disc_get_info ( INNER(d) );
+} // end get_info
+
+
+static int
+get_current_session (
+                     CD_Disc *d
+                     )
+{
+
+  sync_disc ( CDISC(d) );
+  
+  return CD_disc_get_current_session ( INNER(d) );
+  
+} // end get_current_session
+
+
+static int
+get_current_track (
+                   CD_Disc *d
+                   )
+{
+
+  sync_disc ( CDISC(d) );
+  
+  return CD_disc_get_current_track ( INNER(d) );
+  
+} // end get_current_track
+
+
+static uint8_t
+get_current_index (
+                   CD_Disc *d
+                   )
+{
+
+  sync_disc ( CDISC(d) );
+  
+  return CD_disc_get_current_index ( INNER(d) );
+  
+} // end get_current_index
+
+
+static bool
+move_to_leadin (
+                CD_Disc *d
+                )
+{
+
+  sync_disc ( CDISC(d) );
+  if ( !CD_disc_move_to_leadin ( INNER(d) ) ) return false;
+  // NOTA!! La posició dins del lead-in no té per què correspondre's
+  // amb un sector del disc, fins al següent moviment no es gasta la
+  // cache.
+  CDISC(d)->pos_ok= false;
+  CDISC(d)->synced= true;
+  
+  return true;
+  
+} // end move_to_leadin
+
+
+static CD_Position
+tell (
+      CD_Disc *d
+      )
+{
+
+  sync_disc ( CDISC(d) );
+  
+  return CD_disc_tell ( INNER(d) );
+  
+} // end tell
+
+
+static const uint8_t *
+read_view (
+           CD_Disc    *d,
+           bool       *audio,
+           const bool  move
+           )
+{
+  return read ( d, CDISC(d)->sec_buf, audio, move ) ?
+    CDISC(d)->sec_buf : NULL;
+} // end read_view
+
+
+static int
+read_n (
+        CD_Disc    *d,
+        uint8_t    *buf,
+        bool       *audio,
+        const int   n,
+        const bool  move
+        )
+{
+
+  CD_CacheDisc *cd;
+  size_t pos;
+  bool au;
+  int i;
+
+  
+  cd= CDISC(d);
+  if ( n < 0 ) return -1;
+  if ( !cd->pos_ok ) return CD_disc_read_n ( cd->disc, buf, audio, n, move );
+
+  // NOTA!! Les fallades es lligen d'una en una, però el disc intern ja
+  // està en la posició correcta després de la primera.
+  pos= cd->pos;
+  for ( i= 0; i < n; ++i, buf+= CD_SEC_SIZE )
+    {
+      if ( !read ( d, buf, &au, true ) )
+        {
+          // Si no es pot fer un seek és el final del disc.
+          cd->synced= false;
+          if ( seek_pos ( cd ) )
+            {
+              cd->pos= pos;
+              cd->synced= false;
+              return -1;
+            }
+          break;
+        }
+      if ( audio != NULL ) audio[i]= au;
+    }
+  if ( !move )
+    {
+      cd->pos= pos;
+      cd->synced= false;
+    }
+  
+  return i;
+  
+} // end read_n
+
+
+static CD_Disc *
+clone (
+       CD_Disc *d
+       )
+{
+
+  CD_CacheDisc *new;
+  CD_Disc *disc;
+  
+
+  sync_disc ( CDISC(d) );
+  disc= CD_disc_clone ( INNER(d) );
+  atomic_fetch_add ( &(CDISC(d)->cache->refs), 1 );
+  new= new_cache_disc ( CDISC(d)->cache, disc, CDISC(d)->id );
+  new->pos= CDISC(d)->pos;
+  new->pos_ok= CDISC(d)->pos_ok;
+  
+  return (CD_Disc *) new;
+  
+} // end clone
+
+
+static bool
+set_readahead (
+               CD_Disc   *d,
+               const int  depth
+               )
+{
+
+  sync_disc ( CDISC(d) );
+  
+  return CD_disc_set_readahead ( INNER(d), depth );
+  
+} // end set_readahead
+
+
+static void
+get_readahead_stats (
+                     CD_Disc           *d,
+                     CD_ReadAheadStats *stats
+                     )
+{
+  CD_disc_get_readahead_stats ( INNER(d), stats );
+} // end get_readahead_stats
+
+
+static int
+read_batch (
+            CD_Disc      *d,
+            CD_SectorReq *reqs,
+            const int     n
+            )
+{
+
+  CD_CacheDisc *cd;
+  CD_SectorReq *miss;
+  int *ids,i,nmiss,ret;
+  
+  
+  if ( n <= 0 ) return 0;
+  cd= CDISC(d);
+
+  // Busca en la cache.
+  miss= mem_alloc ( CD_SectorReq, n );
+  ids= mem_alloc ( int, n );
+  for ( i= nmiss= ret= 0; i < n; ++i )
+    {
+      reqs[i].ok= reqs[i].sec >= 0 &&
+        cache_lookup ( cd->cache, cd->id, (size_t) reqs[i].sec,
+                       reqs[i].buf, &(reqs[i].audio) );
+      if ( reqs[i].ok ) ++ret;
+      else
+        {
+          miss[nmiss]= reqs[i];
+          ids[nmiss++]= i;
+        }
+    }
+
+  // Llig la resta.
+  if ( nmiss > 0 )
+    {
+      ret+= CD_disc_read_batch ( cd->disc, miss, nmiss );
+      for ( i= 0; i < nmiss; ++i )
+        {
+          reqs[ids[i]].ok= miss[i].ok;
+          reqs[ids[i]].audio= miss[i].audio;
+          if ( miss[i].ok )
+            cache_insert ( cd->cache, cd->id, (size_t) miss[i].sec,
+                           miss[i].buf, miss[i].audio );
+        }
+    }
+  free ( ids );
+  free ( miss );
+  
+  return ret;
+  
+} // end read_batch
+
+
+static int
+read_q_range (
+              CD_Disc    *d,
+              uint8_t    *buf,
+              bool       *crc_ok,
+              const int   n,
+              const bool  move
+              )
+{
+
+  int ret;
+
+  
+  sync_disc ( CDISC(d) );
+  ret= CD_disc_read_q_range ( INNER(d), buf, crc_ok, n, move );
+  if ( ret > 0 && move ) CDISC(d)->pos+= (size_t) ret;
+  
+  return ret;
+  
+} // end read_q_range
+
+
+static bool
+read_pw (
+         CD_Disc    *d,
+         uint8_t     buf[CD_SUBPW_SIZE],
+         const bool  move
+         )
+{
+
+  sync_disc ( CDISC(d) );
+  if ( !CD_disc_read_pw ( INNER(d), buf, move ) ) return false;
+  if ( move ) ++(CDISC(d)->pos);
+  
+  return true;
+  
+} // end read_pw
+
+
+static bool
+read_user_data (
+                CD_Disc    *d,
+                uint8_t     buf[CD_USER_DATA_SIZE],
+                int        *length,
+                const bool  move
+                )
+{
+
+  CD_CacheDisc *cd;
+  bool audio;
+  
+  
+  cd= CDISC(d);
+  if ( !cd->pos_ok )
+    return CD_disc_read_user_data ( cd->disc, buf, length, move );
+  
+  // Es parteix del sector complet, que pot estar en la cache.
+  if ( !read ( d, cd->sec_buf, &audio, false ) || audio ) return false;
+  *length= CD_get_user_data ( cd->sec_buf, buf );
+  if ( *length == -1 ) return false;
+  if ( move )
+    {
+      ++(cd->pos);
+      cd->synced= false;
+    }
+  
+  return true;
+  
+} // end read_user_data
+
+
+// Els sectors passen per la cache i el subcanal Q sempre es llig del
+// disc intern, que recorre cada sector una única vegada: dels trams
+// d'encerts sols es demana el subcanal Q, i els trams de fallades es
+// lligen amb el seu subcanal Q d'una vegada.
+static int
+read_with_q (
+             CD_Disc    *d,
+             uint8_t    *buf,
+             uint8_t    *q,
+             bool       *crc_ok,
+             bool       *audio,
+             const int   n,
+             const bool  move
+             )
+{
+
+  CD_CacheDisc *cd;
+  size_t pos;
+  bool au[MISS_RUN],a,hit;
+  int i,j,k,r;
+  
+  
+  cd= CDISC(d);
+  if ( n < 0 ) return -1;
+  if ( !cd->pos_ok )
+    return CD_disc_read_with_q ( cd->disc, buf, q, crc_ok, audio, n, move );
+
+  pos= cd->pos;
+  sync_disc ( cd );
+  hit= false; // El sector 'i' ja s'ha trobat en la cache.
+  for ( i= j= 0; i < n; i= j )
+    {
+
+      // Encerts.
+      for ( j= i; j < n; ++j )
+        if ( j != i || !hit )
+          {
+            if ( !cache_lookup ( cd->cache, cd->id, pos+(size_t) j,
+                                 buf + j*CD_SEC_SIZE, &a ) )
+              break;
+            if ( audio != NULL ) audio[j]= a;
+          }
+      hit= false;
+      if ( j > i )
+        {
+          r= CD_disc_read_q_range ( cd->disc, q + i*CD_SUBCH_SIZE,
+                                    crc_ok!=NULL ? &crc_ok[i] : NULL,
+                                    j-i, true );
+          if ( r == -1 ) goto error;
+          if ( r < j-i ) { j= i+r; break; }
+          continue;
+        }
+
+      // Fallades fins al següent encert.
+      for ( k= i+1; k < n && k-i < MISS_RUN; ++k )
+        if ( cache_lookup ( cd->cache, cd->id, pos+(size_t) k,
+                            buf + k*CD_SEC_SIZE, &a ) )
+          {
+            if ( audio != NULL ) audio[k]= a;
+            hit= true;
+            break;
+          }
+      r= CD_disc_read_with_q ( cd->disc, buf + i*CD_SEC_SIZE,
+                               q + i*CD_SUBCH_SIZE,
+                               crc_ok!=NULL ? &crc_ok[i] : NULL,
+                               au, k-i, true );
+      if ( r == -1 ) goto error;
+      for ( j= i; j < i+r; ++j )
+        {
+          cache_insert ( cd->cache, cd->id, pos+(size_t) j,
+                         buf + j*CD_SEC_SIZE, au[j-i] );
+          if ( audio != NULL ) audio[j]= au[j-i];
+        }
+      if ( r < k-i ) break; // Final del disc.
+      
+    }
+  if ( move ) cd->pos= pos+(size_t) j;
+  else
+    {
+      cd->pos= pos;
+      cd->synced= false;
+    }
+  
+  return j;
+
+ error:
+  cd->pos= pos;
+  cd->synced= false;
+  return -1;
+  
+} // end read_with_q
+
+
+static CD_CacheDisc *
+new_cache_disc (
+                CD_Cache       *cache,
+                CD_Disc        *disc,
+                const uint64_t  id
+                )
+{
+
+  CD_CacheDisc *new;
+
+
+  new= mem_alloc ( CD_CacheDisc, 1 );
+  new->cache= cache;
+  new->disc= disc;
+  new->id= id;
+  new->_m.free= free_;
+  new->_m.move_to_session= move_to_session;
+  new->_m.move_to_track= move_to_track;
+  new->_m.reset= reset;
+  new->_m.seek= seek;
+  new->_m.get_num_sessions= get_num_sessions;
+  new->_m.read= read;
+  new->_m.read_q= read_q;
+  new->_m.get_info= get_info;
+  new->_m.get_current_session= get_current_session;
+  new->_m.get_current_track= get_current_track;
+  new->_m.get_current_index= get_current_index;
+  new->_m.move_to_leadin= move_to_leadin;
+  new->_m.tell= tell;
+  new->_m.read_view= read_view;
+  new->_m.read_n= read_n;
+  new->_m.clone= clone;
+  new->_m.set_readahead= set_readahead;
+  new->_m.get_readahead_stats= get_readahead_stats;
+  new->_m.read_batch= read_batch;
+  new->_m.read_q_range= read_q_range;
+  new->_m.read_pw= read_pw;
+  new->_m.read_user_data= read_user_data;
+  new->_m.read_with_q= read_with_q;
+  update_pos ( new );
+  
+  return new;
+  
+} // end new_cache_disc
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+CD_Cache *
+CD_cache_new (
+              const size_t max_bytes,
+              const int    nshards
+              )
+{
+
+  CD_Cache *new;
+  shard_t *s;
+  size_t total,cap,nbuckets;
+  int i;
+  
+  
+  new= mem_alloc ( CD_Cache, 1 );
+  atomic_init ( &(new->refs), 1 );
+  atomic_init ( &(new->next_id), 0 );
+  new->nshards= nshards>0 ? nshards : DEFAULT_NSHARDS;
+
+  // Si no hi ha entrades per a tots els fragments se'n fan menys, així
+  // mai es supera MAX_BYTES. Amb menys d'una entrada no es guarda res.
+  total= max_bytes/sizeof(entry_t);
+  if ( (size_t) new->nshards > total )
+    new->nshards= total>0 ? (int) total : 1;
+  new->shards= mem_alloc ( shard_t, new->nshards );
+  cap= total/(size_t) new->nshards;
+  for ( nbuckets= 1; nbuckets < cap; nbuckets<<= 1 );
+  for ( i= 0; i < new->nshards; ++i )
+    {
+      s= &(new->shards[i]);
+      pthread_mutex_init ( &(s->mutex), NULL );
+      s->buckets= mem_alloc ( entry_t *, nbuckets );
+      memset ( s->buckets, 0, sizeof(entry_t *)*nbuckets );
+      s->mask= nbuckets-1;
+      s->head= s->tail= NULL;
+      s->N= 0;
+      s->cap= cap;
+      s->hits= s->misses= 0;
+    }
+  
+  return new;
+  
+} // end CD_cache_new
+
+
+void
+CD_cache_free (
+               CD_Cache *cache
+               )
+{
+  cache_unref ( cache );
+} // end CD_cache_free
+
+
+void
+CD_cache_get_stats (
+                    CD_Cache      *cache,
+                    CD_CacheStats *stats
+                    )
+{
+
+  shard_t *s;
+  int i;
+
+  
+  stats->hits= stats->misses= 0;
+  for ( i= 0; i < cache->nshards; ++i )
+    {
+      s= &(cache->shards[i]);
+      pthread_mutex_lock ( &(s->mutex) );
+      stats->hits+= s->hits;
+      stats->misses+= s->misses;
+      pthread_mutex_unlock ( &(s->mutex) );
+    }
+  
+} // end CD_cache_get_stats
+
+
+CD_Disc *
+CD_cache_disc_new (
+                   CD_Cache *cache,
+                   CD_Disc  *disc
+                   )
+{
+
+  atomic_fetch_add ( &(cache->refs), 1 );
+  
+  return (CD_Disc *) new_cache_disc ( cache, disc,
+                                      atomic_fetch_add ( &(cache->next_id),
+                                                         1 ) );
+  
+} // end CD_cache_disc_new
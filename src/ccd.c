@@ -0,0 +1,749 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  ccd.c - Implementació de 'ccd.h'.
+ *
+ */
+/*
+ *  El fitxer CCD és un INI amb el TOC complet del disc ([Entry N]) i
+ *  una secció [TRACK N] per track amb el mode i els índexs. Els
+ *  sectors s'adrecen pel LBA, però en discs multisessió el lead-out
+ *  i el lead-in entre sessions poden estar o no en el .img, per tant
+ *  es dedueix a partir de la grandària del fitxer. El .img i el .sub
+ *  es projecten en memòria (el .sub es carrega sencer si no es pot),
+ *  de manera que el subcanal Q de cada sector es llig directament del
+ *  .sub sense fer E/S. Ací sols es llig el .ccd i es calcula on està
+ *  cada sector, la resta està en 'img.c'.
+ */
+
+
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CD.h"
+#include "ccd.h"
+#include "img.h"
+#include "utils.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define BCD(NUM) ((uint8_t) (((NUM)/10)*0x10 + (NUM)%10))
+
+#define MAX_INDEXES 100
+
+#define POINT_FIRST 0xA0
+#define POINT_LEADOUT 0xA2
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+// Entrada del TOC ([Entry N]).
+typedef struct
+{
+
+  bool ok; // S'ha definit.
+  long session;
+  long point;
+  long adr;
+  long control;
+  long plba;
+  long pmin,psec,pframe;
+  bool has_plba;
+  
+} toc_entry_t;
+
+// Secció [TRACK N].
+typedef struct
+{
+
+  long mode; // -1 si no s'especifica.
+  long index[MAX_INDEXES]; // LBA
+  bool has_index[MAX_INDEXES];
+  
+} ccd_track_t;
+
+// Contingut del fitxer CCD.
+typedef struct
+{
+
+  long         nsessions;
+  toc_entry_t *entries;
+  int          NE;
+  ccd_track_t  tracks[CD_IMG_MAX_TRACKS];
+  
+} ccd_t;
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static char *
+trim (
+      char *str
+      )
+{
+
+  char *end;
+
+  
+  for ( ; *str && isspace ( (unsigned char) *str ); ++str );
+  end= str + strlen ( str );
+  for ( ; end != str && isspace ( (unsigned char) end[-1] ); --end );
+  *end= '\0';
+  
+  return str;
+  
+} // end trim
+
+
+static void
+to_upper (
+          char *str
+          )
+{
+  for ( ; *str; ++str )
+    *str= (char) toupper ( (unsigned char) *str );
+} // end to_upper
+
+
+// Els números poden ser decimals o hexadecimals ('0x').
+static bool
+parse_num (
+           const char *str,
+           long       *val
+           )
+{
+
+  char *end;
+  int base;
+  
+
+  base= (str[0]=='0' && (str[1]=='x' || str[1]=='X')) ? 16 : 10;
+  *val= strtol ( str, &end, base );
+  
+  return end != str && *end == '\0';
+  
+} // end parse_num
+
+
+static toc_entry_t *
+get_entry (
+           ccd_t      *ccd,
+           const long  n
+           )
+{
+
+  int i;
+
+  
+  if ( n < 0 || n > 0xFFFF ) return NULL;
+  if ( n >= ccd->NE )
+    {
+      ccd->entries= mem_realloc ( toc_entry_t, ccd->entries, n+1 );
+      for ( i= ccd->NE; i <= n; ++i )
+        ccd->entries[i].ok= false;
+      ccd->NE= (int) n+1;
+    }
+  
+  return &(ccd->entries[n]);
+  
+} // end get_entry
+
+
+static void
+init_entry (
+            toc_entry_t *e
+            )
+{
+
+  e->ok= true;
+  e->session= 1;
+  e->point= -1;
+  e->adr= 1;
+  e->control= 0;
+  e->plba= 0;
+  e->pmin= e->psec= e->pframe= 0;
+  e->has_plba= false;
+  
+} // end init_entry
+
+
+// Sols es tenen en compte les claus conegudes, que han de ser
+// numèriques.
+static bool
+parse_entry_key (
+                 toc_entry_t *e,
+                 const char  *key,
+                 const char  *str
+                 )
+{
+
+  long *dst,val;
+  
+  
+  if ( !strcmp ( key, "SESSION" ) ) dst= &(e->session);
+  else if ( !strcmp ( key, "POINT" ) ) dst= &(e->point);
+  else if ( !strcmp ( key, "ADR" ) ) dst= &(e->adr);
+  else if ( !strcmp ( key, "CONTROL" ) ) dst= &(e->control);
+  else if ( !strcmp ( key, "PLBA" ) ) { dst= &(e->plba); e->has_plba= true; }
+  else if ( !strcmp ( key, "PMIN" ) ) dst= &(e->pmin);
+  else if ( !strcmp ( key, "PSEC" ) ) dst= &(e->psec);
+  else if ( !strcmp ( key, "PFRAME" ) ) dst= &(e->pframe);
+  else return true;
+  if ( !parse_num ( str, &val ) ) return false;
+  *dst= val;
+  
+  return true;
+  
+} // end parse_entry_key
+
+
+static bool
+parse_track_key (
+                 ccd_track_t *t,
+                 const char  *key,
+                 const char  *str
+                 )
+{
+
+  long n,val;
+  
+  
+  if ( !strcmp ( key, "MODE" ) )
+    {
+      if ( !parse_num ( str, &val ) || val < 0 || val > 2 ) return false;
+      t->mode= val;
+    }
+  else if ( !strncmp ( key, "INDEX", 5 ) )
+    {
+      if ( !parse_num ( trim ( (char *) &key[5] ), &n ) ||
+           n < 0 || n >= MAX_INDEXES ||
+           !parse_num ( str, &val ) )
+        return false;
+      t->index[n]= val;
+      t->has_index[n]= true;
+    }
+  
+  return true;
+  
+} // end parse_track_key
+
+
+// Llig el fitxer CCD.
+static bool
+read_ccd (
+          ccd_t       *ccd,
+          const char  *fn,
+          char       **err
+          )
+{
+
+  enum {
+    SECT_NONE,
+    SECT_DISC,
+    SECT_ENTRY,
+    SECT_TRACK,
+    SECT_OTHER
+  } sect;
+  FILE *f;
+  CD_Buffer *buf;
+  char *line,*key,*str,*p;
+  toc_entry_t *entry;
+  ccd_track_t *track;
+  long val;
+  
+
+  // Inicialitza.
+  buf= NULL;
+  f= fopen ( fn, "r" );
+  if ( f == NULL )
+    {
+      CD_msgerror ( err, "cannot open '%s'", fn );
+      return false;
+    }
+  buf= CD_buffer_new ();
+
+  // Llig línia a línia.
+  sect= SECT_NONE;
+  entry= NULL; track= NULL;
+  while ( CD_gline ( f, buf ) )
+    {
+      line= trim ( buf->v );
+      if ( *line == '\0' || *line == ';' ) continue;
+      
+      // Secció.
+      if ( *line == '[' )
+        {
+          p= strchr ( line, ']' );
+          if ( p == NULL ) goto error_format;
+          *p= '\0';
+          key= trim ( line+1 );
+          to_upper ( key );
+          if ( !strcmp ( key, "DISC" ) ) sect= SECT_DISC;
+          else if ( !strncmp ( key, "ENTRY", 5 ) )
+            {
+              if ( !parse_num ( trim ( key+5 ), &val ) ||
+                   (entry= get_entry ( ccd, val )) == NULL )
+                goto error_format;
+              init_entry ( entry );
+              sect= SECT_ENTRY;
+            }
+          else if ( !strncmp ( key, "TRACK", 5 ) )
+            {
+              if ( !parse_num ( trim ( key+5 ), &val ) ||
+                   val < 1 || val > CD_IMG_MAX_TRACKS )
+                goto error_format;
+              track= &(ccd->tracks[val-1]);
+              sect= SECT_TRACK;
+            }
+          else sect= SECT_OTHER;
+          continue;
+        }
+
+      // Clau=valor. La resta de seccions (CloneCD, Session, CDText,
+      // ...) s'ignoren.
+      if ( sect == SECT_NONE || sect == SECT_OTHER ) continue;
+      p= strchr ( line, '=' );
+      if ( p == NULL ) goto error_format;
+      *p= '\0';
+      key= trim ( line );
+      to_upper ( key );
+      str= trim ( p+1 );
+      switch ( sect )
+        {
+        case SECT_DISC:
+          if ( !strcmp ( key, "SESSIONS" ) )
+            {
+              if ( !parse_num ( str, &(ccd->nsessions) ) ) goto error_format;
+            }
+          else if ( !strcmp ( key, "DATATRACKSSCRAMBLED" ) &&
+                    (!parse_num ( str, &val ) || val != 0) )
+            {
+              CD_msgerror ( err, "unable to load '%s': scrambled data"
+                            " tracks are not supported", fn );
+              goto error;
+            }
+          break;
+        case SECT_ENTRY:
+          if ( !parse_entry_key ( entry, key, str ) ) goto error_format;
+          break;
+        case SECT_TRACK:
+          if ( !parse_track_key ( track, key, str ) ) goto error_format;
+          break;
+        default: break;
+        }
+    }
+  
+  // Allibera.
+  CD_buffer_free ( buf );
+  fclose ( f );
+  
+  return true;
+
+ error_format:
+  CD_msgerror ( err, "unable to load '%s': wrong CCD format: %s", fn, line );
+ error:
+  CD_buffer_free ( buf );
+  fclose ( f );
+  return false;
+  
+} // end read_ccd
+
+
+static long
+entry_plba (
+            const toc_entry_t *e
+            )
+{
+  return e->has_plba ?
+    e->plba : (e->pmin*60 + e->psec)*75 + e->pframe - CD_IMG_IGAP;
+} // end entry_plba
+
+
+// Crea els tracks, índexs i sessions a partir del TOC. Torna fals si
+// el TOC no és coherent.
+static bool
+build_toc (
+           CD_ImgCore  *core,
+           const ccd_t *ccd
+           )
+{
+
+  const toc_entry_t *points[CD_IMG_MAX_TRACKS],*leadouts[CD_IMG_MAX_TRACKS],
+    *firsts[CD_IMG_MAX_TRACKS],*e;
+  const ccd_track_t *ct;
+  CD_ImgTrack *track;
+  CD_ImgSession *sess;
+  size_t t,prev;
+  long s,lba;
+  int i;
+  
+  
+  // Entrades amb ADR 1 del TOC.
+  memset ( points, 0, sizeof(points) );
+  memset ( leadouts, 0, sizeof(leadouts) );
+  memset ( firsts, 0, sizeof(firsts) );
+  for ( i= 0; i < ccd->NE; ++i )
+    {
+      e= &(ccd->entries[i]);
+      if ( !e->ok || e->adr != 1 ) continue;
+      if ( e->session < 1 || e->session > CD_IMG_MAX_TRACKS ) return false;
+      if ( e->point >= 1 && e->point <= CD_IMG_MAX_TRACKS )
+        {
+          if ( points[e->point-1] != NULL ) return false;
+          points[e->point-1]= e;
+        }
+      else if ( e->point == POINT_LEADOUT )
+        leadouts[e->session-1]= e;
+      else if ( e->point == POINT_FIRST )
+        firsts[e->session-1]= e;
+    }
+  for ( core->NT= 0;
+        core->NT < CD_IMG_MAX_TRACKS && points[core->NT] != NULL;
+        ++(core->NT) );
+  if ( core->NT == 0 ) return false;
+  for ( t= core->NT; t < CD_IMG_MAX_TRACKS; ++t )
+    if ( points[t] != NULL ) return false;
+  core->NS= (size_t) points[core->NT-1]->session;
+  if ( ccd->nsessions > 0 && (size_t) ccd->nsessions != core->NS )
+    return false;
+
+  // Reserva.
+  core->tracks= mem_alloc ( CD_ImgTrack, core->NT );
+  core->indexes= mem_alloc ( CD_ImgIndex, core->NT*MAX_INDEXES );
+  core->sessions= mem_alloc ( CD_ImgSession, core->NS );
+  core->NI= 0;
+  for ( s= 0; s < (long) core->NS; ++s )
+    {
+      if ( leadouts[s] == NULL ) return false;
+      core->sessions[s].ntracks= 0;
+    }
+
+  // Tracks i índexs. Les sessions han d'estar en ordre. Tots els
+  // sectors del .img estan en cru.
+  prev= 0;
+  for ( t= 0; t < core->NT; ++t )
+    {
+      e= points[t];
+      ct= &(ccd->tracks[t]);
+      track= &(core->tracks[t]);
+      s= e->session-1;
+      sess= &(core->sessions[s]);
+      if ( (t == 0 && s != 0) ||
+           (t > 0 && s != core->tracks[t-1].session &&
+            s != core->tracks[t-1].session+1) )
+        return false;
+      if ( sess->ntracks++ == 0 ) sess->first_track= (int) t;
+      track->session= (int) s;
+      track->ctrl= (uint8_t) (e->control&0xF);
+      if ( ct->mode == 0 ) track->type= CD_IMG_AUDIO;
+      else if ( ct->mode == 1 ) track->type= CD_IMG_MODE1;
+      else if ( ct->mode == 2 ) track->type= CD_IMG_MODE2;
+      else track->type= (track->ctrl&0x4) ? CD_IMG_MODE1 : CD_IMG_AUDIO;
+      track->format= CD_IMG_RAW;
+      track->data_size= track->stride= CD_SEC_SIZE;
+      track->sub= false;
+      track->offset= 0;
+      track->stored_first= track->nstored= 0;
+      lba= entry_plba ( e );
+      if ( lba < 0 ) return false;
+      track->sector_index01= (size_t) lba + CD_IMG_IGAP;
+      
+      // Pregap. El primer track de cada sessió sempre en té.
+      if ( ct->has_index[0] )
+        {
+          if ( ct->index[0] < 0 ) return false;
+          track->first= (size_t) ct->index[0] + CD_IMG_IGAP;
+        }
+      else if ( t == 0 || sess->first_track == (int) t )
+        track->first= track->sector_index01 < CD_IMG_IGAP ?
+          0 : track->sector_index01 - CD_IMG_IGAP;
+      else track->first= track->sector_index01;
+      if ( t == 0 ) track->first= 0;
+      if ( track->first < prev || track->first > track->sector_index01 )
+        return false;
+      
+      // Índexs.
+      track->p= (int) core->NI;
+      track->N= 0;
+      if ( track->first < track->sector_index01 )
+        CD_img_add_index ( core, track, 0x00, track->first );
+      CD_img_add_index ( core, track, 0x01, track->sector_index01 );
+      prev= track->sector_index01;
+      for ( i= 2; i < MAX_INDEXES; ++i )
+        if ( ct->has_index[i] )
+          {
+            if ( ct->index[i] < 0 ||
+                 (size_t) ct->index[i] + CD_IMG_IGAP <= prev )
+              return false;
+            prev= (size_t) ct->index[i] + CD_IMG_IGAP;
+            CD_img_add_index ( core, track, BCD ( i ), prev );
+          }
+      prev++;
+    }
+
+  // Sessions.
+  for ( s= 0; s < (long) core->NS; ++s )
+    {
+      sess= &(core->sessions[s]);
+      lba= entry_plba ( leadouts[s] );
+      if ( lba < 0 ) return false;
+      sess->leadout= (size_t) lba + CD_IMG_IGAP;
+      sess->disc_type= firsts[s] != NULL ?
+        (uint8_t) firsts[s]->psec : CD_IMG_DISC_TYPE_CDROM;
+    }
+  
+  return CD_img_build_toc ( core, false );
+  
+} // end build_toc
+
+
+static void
+add_extent (
+            CD_ImgCore       *core,
+            const size_t      first,
+            const size_t      nsecs,
+            const int         track_id,
+            const uint8_t     index_id,
+            const CD_ImgArea  area
+            )
+{
+  
+  if ( nsecs == 0 ) return;
+
+  // Els primers IGAP sectors mai estan desats.
+  if ( first < CD_IMG_IGAP && first+nsecs > CD_IMG_IGAP )
+    {
+      add_extent ( core, first, CD_IMG_IGAP-first, track_id, index_id, area );
+      add_extent ( core, CD_IMG_IGAP, first+nsecs-CD_IMG_IGAP,
+                   track_id, index_id, area );
+      return;
+    }
+  CD_img_add_extent ( core, first, nsecs, -1, track_id, index_id, area );
+  
+} // end add_extent
+
+
+// Crea el mapa de sectors i decideix on està desat cada un a partir
+// de la grandària del .img. Torna el número de sectors que ha de tindre
+// el .img, o 0 si és massa menut.
+static size_t
+build_extents (
+               CD_ImgCore *core
+               )
+{
+
+  const CD_ImgTrack *track;
+  const CD_ImgIndex *idx;
+  CD_ImgExtent *ext;
+  size_t t,x,end,total,gaps,skipped;
+  int i;
+  bool compact;
+  
+  
+  core->exts= mem_alloc ( CD_ImgExtent, core->NI + 2*core->NS + 1 );
+  core->NX= 0;
+  for ( t= 0; t < core->NT; ++t )
+    {
+      track= &(core->tracks[t]);
+      for ( i= 0; i < track->N; ++i )
+        {
+          idx= &(core->indexes[track->p+i]);
+          end= i+1 < track->N ? idx[1].sec : track->end;
+          add_extent ( core, idx->sec, end-idx->sec, (int) t, idx->id,
+                       CD_IMG_DATA );
+        }
+      CD_img_add_gaps ( core, t );
+    }
+
+  // Els lead-out/lead-in poden no estar desats.
+  total= core->N - CD_IMG_IGAP;
+  for ( x= 0, gaps= 0; x < core->NX; ++x )
+    if ( core->exts[x].area != CD_IMG_DATA )
+      gaps+= core->exts[x].nsecs;
+  if ( core->size/CD_SEC_SIZE >= total ) compact= false;
+  else if ( core->size/CD_SEC_SIZE >= total-gaps ) compact= true;
+  else return 0;
+  for ( x= 0, skipped= 0; x < core->NX; ++x )
+    {
+      ext= &(core->exts[x]);
+      if ( ext->first < CD_IMG_IGAP ) ext->offset= -1;
+      else if ( ext->area != CD_IMG_DATA && compact )
+        {
+          ext->offset= -1;
+          skipped+= ext->nsecs;
+        }
+      else
+        ext->offset= (long) ((ext->first - CD_IMG_IGAP - skipped)*CD_SEC_SIZE);
+    }
+  
+  return compact ? total-gaps : total;
+  
+} // end build_extents
+
+
+// Carrega el .sub si n'hi ha i té la grandària correcta.
+static void
+load_sub (
+          CD_ImgCore   *core,
+          const char   *fn,
+          const size_t  nsecs
+          )
+{
+
+  uint8_t *mem;
+  long size;
+
+  
+  core->sub_fd= CD_img_open_companion ( fn, ".sub", &size );
+  if ( core->sub_fd == -1 ) return;
+  if ( (size_t) size/CD_SUBPW_SIZE < nsecs )
+    {
+      fprintf ( stderr, "[WW] '%s': SUB file too small, ignoring it\n", fn );
+      goto error;
+    }
+  core->sub_size= nsecs*CD_SUBPW_SIZE;
+  core->sub= CD_file_map ( core->sub_fd, core->sub_size );
+  if ( core->sub != NULL ) core->sub_mapped= true;
+  else
+    {
+      mem= mem_alloc ( uint8_t, core->sub_size );
+      if ( !CD_read_at ( core->sub_fd, mem, core->sub_size, 0 ) )
+        {
+          free ( mem );
+          goto error;
+        }
+      core->sub= mem;
+      CD_file_close ( core->sub_fd );
+      core->sub_fd= -1;
+    }
+  
+  return;
+  
+ error:
+  CD_file_close ( core->sub_fd );
+  core->sub_fd= -1;
+  
+} // end load_sub
+
+
+static bool
+load_ccd (
+          CD_ImgCore  *core,
+          const char  *fn,
+          char       **err
+          )
+{
+
+  ccd_t *ccd;
+  size_t nsecs;
+  long size;
+  int t;
+  bool ret;
+  
+
+  // Fitxer CCD.
+  ccd= mem_alloc ( ccd_t, 1 );
+  ccd->nsessions= 0;
+  ccd->entries= NULL;
+  ccd->NE= 0;
+  for ( t= 0; t < CD_IMG_MAX_TRACKS; ++t )
+    {
+      ccd->tracks[t].mode= -1;
+      memset ( ccd->tracks[t].has_index, 0,
+               sizeof(ccd->tracks[t].has_index) );
+    }
+  ret= false;
+  if ( !read_ccd ( ccd, fn, err ) ) goto end;
+  if ( !build_toc ( core, ccd ) )
+    {
+      CD_msgerror ( err, "unable to load '%s': invalid TOC", fn );
+      goto end;
+    }
+
+  // Imatge.
+  core->fd= CD_img_open_companion ( fn, ".img", &size );
+  if ( core->fd == -1 )
+    {
+      CD_msgerror ( err, "unable to load '%s': IMG file not found", fn );
+      goto end;
+    }
+  core->size= (size_t) size;
+  nsecs= build_extents ( core );
+  if ( nsecs == 0 )
+    {
+      CD_msgerror ( err, "unable to load '%s': IMG file too small", fn );
+      goto end;
+    }
+  core->mem= CD_file_map ( core->fd, core->size );
+
+  // Subcanal.
+  load_sub ( core, fn, nsecs );
+  ret= true;
+  
+ end:
+  free ( ccd->entries );
+  free ( ccd );
+  return ret;
+  
+} // end load_ccd
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+CD_Disc *
+CD_ccd_disc_new (
+                 const char  *fn,
+                 char       **err // Pot ser NULL
+                 )
+{
+
+  CD_ImgCore *core;
+
+
+  core= CD_img_core_new ( "CCD" );
+  if ( !load_ccd ( core, fn, err ) )
+    {
+      CD_img_core_free ( core );
+      return NULL;
+    }
+  
+  return CD_img_disc_new ( core );
+  
+} // end CD_ccd_disc_new
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  ccd.h - Imatges CloneCD (CCD/IMG/SUB).
+ *
+ */
+/*
+ * NOTA!! El fitxer .img conté els sectors en cru (2352 bytes) a partir
+ * del LBA 0, i el .sub (opcional) els 96 bytes de subcanal de cada
+ * sector amb els canals P-W desats un darrere de l'altre.
+ */
+
+
+#ifndef __CD_CCD_H__
+#define __CD_CCD_H__
+
+#include "CD.h"
+
+// Torna NULL en cas d'error
+CD_Disc *
+CD_ccd_disc_new (
+                 const char  *fn,
+                 char       **err // Pot ser NULL
+                 );
+
+#endif // __CD_CCD_H__
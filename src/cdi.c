@@ -0,0 +1,426 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  cdi.c - Implementació de 'cdi.h'.
+ *
+ */
+/*
+ *  Al final del fitxer hi ha la versió i la posició de la capçalera
+ *  (relativa al final en la versió 3.5). La capçalera, little-endian,
+ *  té el número de sessions i, per a cada sessió, el número de tracks
+ *  i un descriptor per track. Els tracks estan desats en ordre al
+ *  principi del fitxer, pregap inclòs, cadascun amb la seua grandària
+ *  de sector: 2048 (MODE 1 o MODE 2 FORM 1), 2336 (MODE 2 sense
+ *  capçalera), 2352, o 2352 seguits de 96 bytes de subcanal P-W
+ *  intercalat. Ací sols es llig la capçalera, la lectura dels sectors
+ *  està en 'img.c'.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CD.h"
+#include "cdi.h"
+#include "img.h"
+#include "utils.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+// Versions.
+#define CDI_V2 0x80000004
+#define CDI_V3 0x80000005
+#define CDI_V35 0x80000006
+
+#define FOOTER_SIZE 8
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+// Per a llegir la capçalera.
+typedef struct
+{
+
+  const uint8_t *buf;
+  size_t         size;
+  size_t         p;
+  
+} header_t;
+
+
+
+
+/*************/
+/* CONSTANTS */
+/*************/
+
+// Marca que precedeix (dos vegades) cada descriptor de track.
+static const uint8_t TRACK_MARK[10]=
+  { 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF };
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static uint32_t
+get_u32 (
+         const uint8_t *p
+         )
+{
+  return ((uint32_t) p[0]) | (((uint32_t) p[1])<<8) |
+    (((uint32_t) p[2])<<16) | (((uint32_t) p[3])<<24);
+} // end get_u32
+
+
+static bool
+skip (
+      header_t     *h,
+      const size_t  n
+      )
+{
+
+  if ( n > h->size - h->p ) return false;
+  h->p+= n;
+  
+  return true;
+  
+} // end skip
+
+
+static bool
+read_u32 (
+          header_t *h,
+          uint32_t *val
+          )
+{
+
+  if ( h->size - h->p < 4 ) return false;
+  *val= get_u32 ( &(h->buf[h->p]) );
+  h->p+= 4;
+  
+  return true;
+  
+} // end read_u32
+
+
+static bool
+read_u16 (
+          header_t *h,
+          uint16_t *val
+          )
+{
+
+  if ( h->size - h->p < 2 ) return false;
+  *val= (uint16_t) (h->buf[h->p] | (h->buf[h->p+1]<<8));
+  h->p+= 2;
+  
+  return true;
+  
+} // end read_u16
+
+
+// Assigna el tipus i el format del track. Torna fals si no es
+// suporta.
+static bool
+set_format (
+            CD_ImgTrack    *track,
+            const uint32_t  mode,
+            const uint32_t  sector_size
+            )
+{
+
+  switch ( mode )
+    {
+    case 0: track->type= CD_IMG_AUDIO; break;
+    case 1: track->type= CD_IMG_MODE1; break;
+    case 2: track->type= CD_IMG_MODE2; break;
+    default: return false;
+    }
+  track->ctrl= track->type == CD_IMG_AUDIO ? 0x0 : 0x4;
+  track->sub= false;
+  switch ( sector_size )
+    {
+    case 0: // 2048
+      if ( track->type == CD_IMG_AUDIO ) return false;
+      track->format= track->type==CD_IMG_MODE2 ? CD_IMG_MODE2_FORM1_2048 : CD_IMG_MODE1_2048;
+      track->data_size= 2048;
+      break;
+    case 1: // 2336
+      if ( track->type != CD_IMG_MODE2 ) return false;
+      track->format= CD_IMG_MODE2_2336;
+      track->data_size= 2336;
+      break;
+    case 4: // 2448
+      track->sub= true;
+      // fall through
+    case 2: // 2352
+      track->format= CD_IMG_RAW;
+      track->data_size= CD_SEC_SIZE;
+      break;
+    default: return false;
+    }
+  track->stride= track->data_size + (track->sub ? CD_SUBPW_SIZE : 0);
+  
+  return true;
+  
+} // end set_format
+
+
+// Llig el descriptor del track T. OFFSET és la posició en el fitxer
+// del primer sector desat del track i PREV el sector següent a
+// l'últim del track anterior.
+static bool
+parse_track (
+             CD_ImgCore     *core,
+             header_t       *h,
+             const uint32_t  version,
+             const size_t    t,
+             const uint64_t  offset,
+             const size_t    prev
+             )
+{
+
+  CD_ImgTrack *track;
+  uint32_t val,pregap,length,mode,start,total,sector_size;
+  int i;
+  
+
+  // Marques i nom del fitxer.
+  if ( !read_u32 ( h, &val ) ) return false;
+  if ( val != 0 && !skip ( h, 8 ) ) return false;
+  for ( i= 0; i < 2; ++i )
+    {
+      if ( h->size - h->p < sizeof(TRACK_MARK) ||
+           memcmp ( &(h->buf[h->p]), TRACK_MARK, sizeof(TRACK_MARK) ) )
+        return false;
+      h->p+= sizeof(TRACK_MARK);
+    }
+  if ( !skip ( h, 4 ) || h->p == h->size ||
+       !skip ( h, 1 + h->buf[h->p] + 11 + 4 + 4 ) ||
+       !read_u32 ( h, &val ) )
+    return false;
+  if ( val == 0x80000000 && !skip ( h, 8 ) ) return false;
+
+  // Track.
+  if ( !skip ( h, 2 ) ||
+       !read_u32 ( h, &pregap ) ||
+       !read_u32 ( h, &length ) ||
+       !skip ( h, 6 ) ||
+       !read_u32 ( h, &mode ) ||
+       !skip ( h, 12 ) ||
+       !read_u32 ( h, &start ) ||
+       !read_u32 ( h, &total ) ||
+       !skip ( h, 16 ) ||
+       !read_u32 ( h, &sector_size ) ||
+       !skip ( h, 29 ) )
+    return false;
+  if ( version != CDI_V2 )
+    {
+      if ( !skip ( h, 5 ) || !read_u32 ( h, &val ) ) return false;
+      if ( val == 0xFFFFFFFF && !skip ( h, 78 ) ) return false;
+    }
+
+  // Sectors. L'adreça del pregap ja és absoluta.
+  track= &(core->tracks[t]);
+  if ( !set_format ( track, mode, sector_size ) || length == 0 ||
+       (size_t) start < prev )
+    return false;
+  track->first= t == 0 ? 0 : (size_t) start;
+  track->sector_index01= (size_t) start + pregap;
+  track->end= track->sector_index01 + length;
+  track->p= (int) core->NI;
+  track->N= 0;
+  if ( track->first < track->sector_index01 )
+    CD_img_add_index ( core, track, 0x00, track->first );
+  CD_img_add_index ( core, track, 0x01, track->sector_index01 );
+  track->offset= offset;
+  track->stored_first= (size_t) start;
+  track->nstored= (size_t) total;
+  
+  return true;
+  
+} // end parse_track
+
+
+// Llig la capçalera i crea els tracks i les sessions.
+static bool
+parse_header (
+              CD_ImgCore     *core,
+              header_t       *h,
+              const uint32_t  version
+              )
+{
+
+  CD_ImgSession *sess;
+  CD_ImgTrack *track;
+  uint16_t nsess,ntracks;
+  uint64_t offset;
+  size_t s,prev;
+  int i;
+  
+
+  if ( !read_u16 ( h, &nsess ) || nsess == 0 ) return false;
+  core->tracks= mem_alloc ( CD_ImgTrack, CD_IMG_MAX_TRACKS );
+  core->indexes= mem_alloc ( CD_ImgIndex, 2*CD_IMG_MAX_TRACKS );
+  core->sessions= mem_alloc ( CD_ImgSession, nsess );
+  offset= 0;
+  prev= 0;
+  for ( s= 0; s < nsess; ++s )
+    {
+
+      // L'última sessió pot estar oberta (sense tracks).
+      if ( !read_u16 ( h, &ntracks ) ) return false;
+      if ( ntracks == 0 ) break;
+      if ( ntracks > CD_IMG_MAX_TRACKS - core->NT ) return false;
+      sess= &(core->sessions[core->NS++]);
+      sess->first_track= (int) core->NT;
+      sess->ntracks= ntracks;
+      for ( i= 0; i < ntracks; ++i )
+        {
+          if ( !parse_track ( core, h, version, core->NT, offset, prev ) )
+            return false;
+          track= &(core->tracks[core->NT++]);
+          track->session= (int) s;
+          offset+= (uint64_t) track->nstored*track->stride;
+          prev= track->end;
+        }
+      sess->leadout= prev;
+      if ( !skip ( h, version == CDI_V2 ? 12 : 13 ) ) return false;
+    }
+  
+  return core->NS > 0;
+  
+} // end parse_header
+
+
+static bool
+load_cdi (
+          CD_ImgCore  *core,
+          const char  *fn,
+          char       **err
+          )
+{
+
+  uint8_t footer[FOOTER_SIZE];
+  header_t h;
+  uint32_t version,offset;
+  size_t data_size;
+  long size;
+  bool ret;
+  
+
+  // Peu.
+  ret= false;
+  h.buf= NULL;
+  core->fd= CD_file_open ( fn, &size );
+  if ( core->fd == -1 )
+    {
+      CD_msgerror ( err, "unable to open '%s'", fn );
+      return false;
+    }
+  core->size= (size_t) size;
+  if ( size < FOOTER_SIZE ||
+       !CD_read_at ( core->fd, footer, FOOTER_SIZE, size - FOOTER_SIZE ) )
+    goto not_cdi;
+  version= get_u32 ( footer );
+  offset= get_u32 ( &footer[4] );
+  if ( version != CDI_V2 && version != CDI_V3 && version != CDI_V35 )
+    goto not_cdi;
+  if ( version == CDI_V35 )
+    {
+      if ( offset > core->size ) goto not_cdi;
+      data_size= core->size - offset;
+    }
+  else data_size= offset;
+  if ( data_size >= core->size - FOOTER_SIZE ) goto not_cdi;
+
+  // Capçalera.
+  h.size= core->size - FOOTER_SIZE - data_size;
+  h.p= 0;
+  h.buf= mem_alloc ( uint8_t, h.size );
+  if ( !CD_read_at ( core->fd, (uint8_t *) h.buf, h.size,
+                     (long) data_size ) )
+    {
+      CD_msgerror ( err, "error while reading '%s'", fn );
+      goto end;
+    }
+  if ( !parse_header ( core, &h, version ) || !CD_img_build_toc ( core, true ) )
+    {
+      CD_msgerror ( err, "unable to load '%s': invalid header or unsupported"
+                    " track format", fn );
+      goto end;
+    }
+  if ( !CD_img_build_extents ( core, (uint64_t) data_size ) )
+    {
+      CD_msgerror ( err, "unable to load '%s': track data out of bounds",
+                    fn );
+      goto end;
+    }
+  core->mem= CD_file_map ( core->fd, core->size );
+  ret= true;
+  
+ end:
+  free ( (uint8_t *) h.buf );
+  return ret;
+
+ not_cdi:
+  CD_msgerror ( err, "unable to load '%s': not a CDI file", fn );
+  return false;
+  
+} // end load_cdi
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+CD_Disc *
+CD_cdi_disc_new (
+                 const char  *fn,
+                 char       **err // Pot ser NULL
+                 )
+{
+
+  CD_ImgCore *core;
+
+
+  core= CD_img_core_new ( "CDI" );
+  if ( !load_cdi ( core, fn, err ) )
+    {
+      CD_img_core_free ( core );
+      return NULL;
+    }
+  
+  return CD_img_disc_new ( core );
+  
+} // end CD_cdi_disc_new
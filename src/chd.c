@@ -0,0 +1,2481 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  chd.c - Implementació de 'chd.h'.
+ *
+ */
+/*
+ *  Un CHD de CD és una seqüència de frames de 2448 bytes (2352 de
+ *  dades i 96 de subcanal) agrupats en "hunks" comprimits de manera
+ *  independent. Cada track comença en un frame múltiple de 4 i l'àudio
+ *  està desat en big-endian. Els pregaps poden estar desats o no (el
+ *  tipus comença per 'V' quan ho estan). El mapa de hunks i els
+ *  tracks formen part del nucli compartit, però cada cursor té la seua
+ *  pròpia cache LRU de hunks descomprimits i el seu estat dels
+ *  descompressors, per tant no calen bloquejos.
+ */
+
+
+#include <assert.h>
+#include <lzma.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "CD.h"
+#include "chd.h"
+#include "crc.h"
+#include "ecc.h"
+#include "flac.h"
+#include "readahead.h"
+#include "subq.h"
+#include "utils.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define IGAP (2*75)
+
+#define BCD(NUM) ((uint8_t) (((NUM)/10)*0x10 + (NUM)%10))
+
+#define FRAME_SIZE 2448
+#define FRAME_DATA 2352
+#define FRAME_SUB 96
+
+#define TRACK_PADDING 4
+
+#define HEADER_SIZE 124
+#define MAP_HEADER_SIZE 16
+#define META_HEADER_SIZE 16
+
+// Hunks descomprimits que guarda cada cursor.
+#define HUNK_CACHE 8
+
+// Màxim de metadades a recórrer (evita cicles en fitxers corruptes).
+#define MAX_META 4096
+
+// Màxim de referències SELF encadenades.
+#define MAX_SELF_CHAIN 16
+
+#define TAG(A,B,C,D)                                                    \
+  ((((uint32_t) (A))<<24) | (((uint32_t) (B))<<16) |                    \
+   (((uint32_t) (C))<<8) | ((uint32_t) (D)))
+
+#define CODEC_NONE 0
+#define CODEC_CDZL TAG('c','d','z','l')
+#define CODEC_CDLZ TAG('c','d','l','z')
+#define CODEC_CDFL TAG('c','d','f','l')
+
+#define META_CHT2 TAG('C','H','T','2')
+#define META_CHTR TAG('C','H','T','R')
+#define META_CHGD TAG('C','H','G','D')
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+// Tipus de hunk en el mapa. Els valors 0..13 són els del fitxer.
+enum {
+  COMP_TYPE0= 0, // 0..3: còdec corresponent de la capçalera.
+  COMP_NONE= 4,
+  COMP_SELF= 5,
+  COMP_PARENT= 6,
+  COMP_RLE_SMALL= 7,
+  COMP_RLE_LARGE= 8,
+  COMP_SELF_0= 9,
+  COMP_SELF_1= 10,
+  COMP_PARENT_SELF= 11,
+  COMP_PARENT_0= 12,
+  COMP_PARENT_1= 13,
+  COMP_ZERO= 16 // (Intern) Hunk buit d'un CHD sense comprimir.
+};
+
+// Entrada del mapa de hunks.
+typedef struct
+{
+
+  uint8_t  type;
+  bool     check_crc;
+  uint16_t crc; // CRC-16 del hunk descomprimit.
+  uint32_t length; // Bytes comprimits.
+  uint64_t offset; // Offset en el fitxer, o hunk en COMP_SELF.
+  
+} hunk_t;
+
+// Format en què estan desades les dades d'un track.
+typedef enum
+  {
+    FMT_RAW, // 2352
+    FMT_AUDIO, // 2352 (big-endian)
+    FMT_MODE1, // 2048
+    FMT_MODE2, // 2336
+    FMT_MODE2_FORM1, // 2048
+    FMT_MODE2_FORM2 // 2324
+  } format_t;
+
+typedef struct
+{
+
+  enum {
+    AUDIO,
+    MODE1,
+    MODE2
+  }        type; // Tipus de track.
+  format_t format;
+  bool     subq; // El subcanal desat inclou el Q (RW_RAW).
+  size_t   first; // Primer sector (pregap inclòs).
+  size_t   first_stored; // Primer sector desat (com en CUE, és on
+                         // comença el track per a 'move_to_track').
+  size_t   sector_index01; // Primer sector de l'índex 01.
+  
+} track_t;
+
+// Metadades d'un track tal qual.
+typedef struct
+{
+
+  bool     ok;
+  int      type;
+  format_t format;
+  bool     subq;
+  int      frames;
+  int      pregap;
+  bool     pregap_stored; // PGTYPE comença per 'V'.
+  int      postgap;
+  
+} track_meta_t;
+
+// Tram de sectors consecutius d'un mateix índex (o pregap) que estan
+// desats en frames consecutius.
+typedef struct
+{
+
+  size_t  first; // Primer sector (absolut).
+  size_t  nsecs; // Número de sectors.
+  long    frame; // Frame del primer sector (-1 si no està desat).
+  int     track_id;
+  uint8_t index_id;
+  
+} extent_t;
+
+// Part immutable del disc, compartida per tots els cursors.
+typedef struct
+{
+
+  // Referències.
+  atomic_int refs;
+
+  // Fitxer.
+  int            fd;
+  const uint8_t *mem; // Fitxer projectat en memòria (NULL si no es pot).
+  size_t         size;
+
+  // Hunks.
+  uint32_t  codecs[4];
+  uint32_t  hunk_bytes;
+  uint32_t  frames_per_hunk;
+  size_t    nhunks;
+  hunk_t   *map;
+  
+  // Tracks.
+  track_t *tracks;
+  size_t   NT;
+
+  // Mapa sectors (ordenat per sector).
+  extent_t *exts;
+  size_t    NX;
+  size_t    N; // Sectors totals.
+  
+} chd_core_t;
+
+// Hunk descomprimit.
+typedef struct
+{
+
+  long      hunk; // -1 si està buida.
+  uint64_t  stamp; // Últim ús.
+  uint8_t  *data;
+  
+} cache_entry_t;
+
+// Cursor. Cada fil ha de tindre el seu.
+typedef struct
+{
+
+  CD_DISC_CLS;
+
+  // Dades del disc.
+  chd_core_t *core;
+
+  // Posició actual.
+  size_t current_sec;
+  size_t current_ext; // Últim extent consultat.
+
+  // Buffer per a 'read_view'.
+  uint8_t sec_buf[CD_SEC_SIZE];
+
+  // Cache de hunks.
+  cache_entry_t cache[HUNK_CACHE];
+  uint64_t      stamp;
+
+  // Descompressió.
+  uint8_t      *cbuf; // Dades comprimides quan no hi ha projecció.
+  size_t        cbuf_size;
+  uint8_t      *tmp; // Dades i subcanal separats.
+  z_stream      z;
+  bool          z_init;
+  lzma_stream   lz;
+  CD_FlacFrame *flac;
+
+  // Lectura anticipada (NULL si no està activada).
+  CD_ReadAhead *ra;
+  
+} CD_CHD_Disc;
+
+#define CHD(DISC) ((CD_CHD_Disc *) (DISC))
+#define CORE(DISC) (CHD(DISC)->core)
+
+// Lector de bits del mapa comprimit.
+typedef struct
+{
+
+  const uint8_t *buf;
+  size_t         size;
+  size_t         pos; // Bits.
+  
+} bits_t;
+
+
+
+
+/*************/
+/* CONSTANTS */
+/*************/
+
+static const uint8_t SYNC[12]=
+  {0x00,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0x00};
+
+static const uint8_t ZERO_SEC[CD_SEC_SIZE]= {0};
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static uint32_t
+get_u16 (
+         const uint8_t *p
+         )
+{
+  return (((uint32_t) p[0])<<8) | p[1];
+} // end get_u16
+
+
+static uint32_t
+get_u24 (
+         const uint8_t *p
+         )
+{
+  return (((uint32_t) p[0])<<16) | (((uint32_t) p[1])<<8) | p[2];
+} // end get_u24
+
+
+static uint32_t
+get_u32 (
+         const uint8_t *p
+         )
+{
+  return (get_u16 ( p )<<16) | get_u16 ( p+2 );
+} // end get_u32
+
+
+static uint64_t
+get_u48 (
+         const uint8_t *p
+         )
+{
+  return (((uint64_t) get_u16 ( p ))<<32) | get_u32 ( p+2 );
+} // end get_u48
+
+
+static uint64_t
+get_u64 (
+         const uint8_t *p
+         )
+{
+  return (((uint64_t) get_u32 ( p ))<<32) | get_u32 ( p+4 );
+} // end get_u64
+
+
+static void
+put_u16 (
+         uint8_t        *p,
+         const uint32_t  val
+         )
+{
+  p[0]= (uint8_t) (val>>8);
+  p[1]= (uint8_t) val;
+} // end put_u16
+
+
+// CRC-16-CCITT (0x1021, valor inicial 0xFFFF) del mapa i dels hunks.
+static uint16_t
+crc16 (
+       const uint8_t *buf,
+       const size_t   size
+       )
+{
+
+  size_t i;
+  uint16_t crc;
+  int j;
+
+
+  crc= 0xFFFF;
+  for ( i= 0; i < size; ++i )
+    {
+      crc^= (uint16_t) (buf[i]<<8);
+      for ( j= 0; j < 8; ++j )
+        crc= (crc&0x8000) ? (uint16_t) ((crc<<1)^0x1021) : (uint16_t) (crc<<1);
+    }
+
+  return crc;
+  
+} // end crc16
+
+
+static uint32_t
+read_bits (
+           bits_t    *b,
+           const int  n
+           )
+{
+
+  uint32_t ret;
+  int i;
+  size_t byte;
+  
+
+  // NOTA!! Més enllà del final es lligen zeros, com en MAME.
+  for ( ret= 0, i= 0; i < n; ++i, ++(b->pos) )
+    {
+      byte= b->pos>>3;
+      ret<<= 1;
+      if ( byte < b->size )
+        ret|= (b->buf[byte]>>(7-(b->pos&7)))&1;
+    }
+  
+  return ret;
+  
+} // end read_bits
+
+
+// Copia SIZE bytes del fitxer a partir de OFFSET.
+static bool
+read_file (
+           const chd_core_t *core,
+           void             *buf,
+           const size_t      size,
+           const uint64_t    offset
+           )
+{
+  
+  if ( offset > core->size || size > core->size - offset ) return false;
+  if ( core->mem != NULL ) memcpy ( buf, core->mem + offset, size );
+  else if ( !CD_read_at ( core->fd, buf, size, (long) offset ) ) return false;
+  
+  return true;
+  
+} // end read_file
+
+
+static bool
+read_header (
+             chd_core_t  *core,
+             const char  *fn,
+             char       **err
+             )
+{
+
+  uint8_t h[HEADER_SIZE];
+  uint64_t logical;
+  uint32_t version,unit_bytes;
+  int i;
+  bool parent;
+  
+  
+  if ( !read_file ( core, h, HEADER_SIZE, 0 ) ||
+       memcmp ( h, "MComprHD", 8 ) != 0 )
+    {
+      CD_msgerror ( err, "unable to load '%s': not a CHD file", fn );
+      return false;
+    }
+  version= get_u32 ( &h[12] );
+  if ( version != 5 || get_u32 ( &h[8] ) != HEADER_SIZE )
+    {
+      CD_msgerror ( err, "unable to load '%s': unsupported CHD version %u",
+                    fn, version );
+      return false;
+    }
+  for ( i= 0; i < 4; ++i )
+    {
+      core->codecs[i]= get_u32 ( &h[16+i*4] );
+      if ( core->codecs[i] != CODEC_NONE && core->codecs[i] != CODEC_CDZL &&
+           core->codecs[i] != CODEC_CDLZ && core->codecs[i] != CODEC_CDFL )
+        {
+          CD_msgerror ( err, "unable to load '%s': unsupported CHD codec"
+                        " '%c%c%c%c'", fn, h[16+i*4], h[17+i*4],
+                        h[18+i*4], h[19+i*4] );
+          return false;
+        }
+    }
+  logical= get_u64 ( &h[32] );
+  core->hunk_bytes= get_u32 ( &h[56] );
+  unit_bytes= get_u32 ( &h[60] );
+  if ( unit_bytes != FRAME_SIZE || core->hunk_bytes == 0 ||
+       core->hunk_bytes%FRAME_SIZE != 0 || core->hunk_bytes > (1<<24) )
+    {
+      CD_msgerror ( err, "unable to load '%s': not a CD-ROM CHD", fn );
+      return false;
+    }
+  core->frames_per_hunk= core->hunk_bytes/FRAME_SIZE;
+  core->nhunks= (size_t) ((logical + core->hunk_bytes - 1)/core->hunk_bytes);
+  for ( parent= false, i= 104; i < 124; ++i )
+    if ( h[i] != 0 ) parent= true;
+  if ( parent )
+    {
+      CD_msgerror ( err, "unable to load '%s': parent CHD files are not"
+                    " supported", fn );
+      return false;
+    }
+
+  return true;
+  
+} // end read_header
+
+
+// Mapa d'un CHD sense comprimir: un offset (en hunks) per hunk.
+static bool
+read_raw_map (
+              chd_core_t     *core,
+              const uint64_t  offset
+              )
+{
+
+  uint8_t *raw;
+  size_t i;
+  uint64_t off;
+  bool ret;
+  
+  
+  raw= mem_alloc ( uint8_t, core->nhunks*4 );
+  ret= read_file ( core, raw, core->nhunks*4, offset );
+  for ( i= 0; ret && i < core->nhunks; ++i )
+    {
+      off= ((uint64_t) get_u32 ( &raw[i*4] ))*core->hunk_bytes;
+      core->map[i].type= off==0 ? COMP_ZERO : COMP_NONE;
+      core->map[i].check_crc= false;
+      core->map[i].crc= 0;
+      core->map[i].length= core->hunk_bytes;
+      core->map[i].offset= off;
+    }
+  free ( raw );
+  
+  return ret;
+  
+} // end read_raw_map
+
+
+// Llig la taula de Huffman (16 símbols, 8 bits com a màxim) codificada
+// amb RLE i construeix la taula de cerca. Torna fals si no és vàlida.
+static bool
+read_huffman (
+              bits_t   *b,
+              uint16_t  lookup[256]
+              )
+{
+
+  int nbits[16],histo[33],cur,val,rep,len,code,i,start,next,shift;
+  uint32_t codes[16];
+  
+  
+  // Longituds.
+  for ( cur= 0; cur < 16; )
+    {
+      val= (int) read_bits ( b, 4 );
+      if ( val != 1 ) nbits[cur++]= val;
+      else
+        {
+          val= (int) read_bits ( b, 4 );
+          if ( val == 1 ) nbits[cur++]= val;
+          else
+            {
+              rep= (int) read_bits ( b, 4 ) + 3;
+              if ( cur+rep > 16 ) return false;
+              while ( rep-- ) nbits[cur++]= val;
+            }
+        }
+    }
+  for ( i= 0; i < 16; ++i )
+    if ( nbits[i] > 8 ) return false;
+
+  // Codis canònics.
+  memset ( histo, 0, sizeof(histo) );
+  for ( i= 0; i < 16; ++i ) ++histo[nbits[i]];
+  for ( start= 0, len= 32; len > 0; --len )
+    {
+      next= (start + histo[len])>>1;
+      if ( len != 1 && next*2 != start + histo[len] ) return false;
+      histo[len]= start;
+      start= next;
+    }
+  for ( i= 0; i < 16; ++i )
+    codes[i]= nbits[i]>0 ? (uint32_t) histo[nbits[i]]++ : 0;
+
+  // Taula de cerca: (símbol<<5)|bits.
+  memset ( lookup, 0, sizeof(uint16_t)*256 );
+  for ( i= 0; i < 16; ++i )
+    if ( nbits[i] > 0 )
+      {
+        shift= 8-nbits[i];
+        for ( code= (int) (codes[i]<<shift);
+              code < (int) ((codes[i]+1)<<shift); ++code )
+          lookup[code]= (uint16_t) ((i<<5) | nbits[i]);
+      }
+  
+  return true;
+  
+} // end read_huffman
+
+
+static int
+decode_huffman (
+                bits_t         *b,
+                const uint16_t  lookup[256]
+                )
+{
+
+  size_t pos;
+  uint16_t val;
+  
+
+  pos= b->pos;
+  val= lookup[read_bits ( b, 8 )];
+  b->pos= pos + (val&0x1f);
+  
+  return val>>5;
+  
+} // end decode_huffman
+
+
+// Mapa comprimit. Primer van els tipus (Huffman i RLE) i després la
+// resta de camps de cada hunk.
+static bool
+read_compressed_map (
+                     chd_core_t     *core,
+                     const uint64_t  offset
+                     )
+{
+
+  uint8_t h[MAP_HEADER_SIZE],*comp,*raw;
+  uint16_t lookup[256];
+  bits_t b;
+  uint64_t cur_offset,off,last_self;
+  uint32_t map_bytes,length;
+  uint16_t crc;
+  int length_bits,self_bits,rep,val;
+  uint8_t last;
+  size_t i;
+  bool ret;
+  hunk_t *hunk;
+  
+  
+  // Capçalera.
+  if ( !read_file ( core, h, MAP_HEADER_SIZE, offset ) ) return false;
+  map_bytes= get_u32 ( &h[0] );
+  cur_offset= get_u48 ( &h[4] );
+  length_bits= h[12];
+  self_bits= h[13];
+  if ( length_bits > 32 || self_bits > 32 ) return false;
+  comp= mem_alloc ( uint8_t, map_bytes>0 ? map_bytes : 1 );
+  raw= mem_alloc ( uint8_t, core->nhunks*12 );
+  ret= false;
+  if ( !read_file ( core, comp, map_bytes, offset+MAP_HEADER_SIZE ) )
+    goto end;
+  b.buf= comp; b.size= map_bytes; b.pos= 0;
+  if ( !read_huffman ( &b, lookup ) ) goto end;
+
+  // Tipus.
+  last= 0; rep= 0;
+  for ( i= 0; i < core->nhunks; ++i )
+    {
+      if ( rep > 0 )
+        {
+          raw[i*12]= last;
+          --rep;
+        }
+      else
+        {
+          val= decode_huffman ( &b, lookup );
+          if ( val == COMP_RLE_SMALL )
+            {
+              raw[i*12]= last;
+              rep= 2 + decode_huffman ( &b, lookup );
+            }
+          else if ( val == COMP_RLE_LARGE )
+            {
+              raw[i*12]= last;
+              rep= 2 + 16 + (decode_huffman ( &b, lookup )<<4);
+              rep+= decode_huffman ( &b, lookup );
+            }
+          else raw[i*12]= last= (uint8_t) val;
+        }
+    }
+  
+  // Camps.
+  last_self= 0;
+  for ( i= 0; i < core->nhunks; ++i )
+    {
+      hunk= &(core->map[i]);
+      off= cur_offset; length= 0; crc= 0;
+      switch ( raw[i*12] )
+        {
+        case COMP_TYPE0:
+        case COMP_TYPE0+1:
+        case COMP_TYPE0+2:
+        case COMP_TYPE0+3:
+          length= read_bits ( &b, length_bits );
+          cur_offset+= length;
+          crc= (uint16_t) read_bits ( &b, 16 );
+          break;
+        case COMP_NONE:
+          length= core->hunk_bytes;
+          cur_offset+= length;
+          crc= (uint16_t) read_bits ( &b, 16 );
+          break;
+        case COMP_SELF:
+          last_self= off= read_bits ( &b, self_bits );
+          break;
+        case COMP_SELF_1:
+          ++last_self;
+          // fall through
+        case COMP_SELF_0:
+          raw[i*12]= COMP_SELF;
+          off= last_self;
+          break;
+        default: goto end; // CHD pare o tipus desconegut.
+        }
+      hunk->type= raw[i*12];
+      hunk->check_crc= true;
+      hunk->crc= crc;
+      hunk->length= length;
+      hunk->offset= off;
+      raw[i*12+1]= (uint8_t) (length>>16);
+      raw[i*12+2]= (uint8_t) (length>>8);
+      raw[i*12+3]= (uint8_t) length;
+      raw[i*12+4]= (uint8_t) (off>>40);
+      raw[i*12+5]= (uint8_t) (off>>32);
+      raw[i*12+6]= (uint8_t) (off>>24);
+      raw[i*12+7]= (uint8_t) (off>>16);
+      raw[i*12+8]= (uint8_t) (off>>8);
+      raw[i*12+9]= (uint8_t) off;
+      put_u16 ( &raw[i*12+10], crc );
+    }
+
+  // Comprova.
+  ret= crc16 ( raw, core->nhunks*12 ) == get_u16 ( &h[10] );
+  
+ end:
+  free ( raw );
+  free ( comp );
+  return ret;
+  
+} // end read_compressed_map
+
+
+// Llig el mapa de hunks i comprova que totes les referències són
+// vàlides. Les referències SELF es resolen fins al hunk final.
+static bool
+read_map (
+          chd_core_t  *core,
+          const char  *fn,
+          char       **err
+          )
+{
+
+  uint8_t h[HEADER_SIZE];
+  uint64_t offset,target;
+  size_t i;
+  int n;
+  bool ok;
+  hunk_t *hunk;
+  
+
+  if ( !read_file ( core, h, HEADER_SIZE, 0 ) ) goto error;
+  offset= get_u64 ( &h[40] );
+  core->map= mem_alloc ( hunk_t, core->nhunks>0 ? core->nhunks : 1 );
+  ok= core->codecs[0]==CODEC_NONE ?
+    read_raw_map ( core, offset ) :
+    read_compressed_map ( core, offset );
+  if ( !ok ) goto error;
+  for ( i= 0; i < core->nhunks; ++i )
+    {
+      hunk= &(core->map[i]);
+      if ( hunk->type == COMP_SELF )
+        {
+          target= hunk->offset;
+          for ( n= 0; n < MAX_SELF_CHAIN && target < core->nhunks &&
+                  core->map[target].type == COMP_SELF; ++n )
+            target= core->map[target].offset;
+          if ( target >= core->nhunks || core->map[target].type == COMP_SELF )
+            goto error;
+          hunk->offset= target;
+        }
+      else if ( hunk->type < COMP_NONE )
+        {
+          if ( core->codecs[hunk->type] == CODEC_NONE ||
+               hunk->offset > core->size ||
+               hunk->length > core->size - hunk->offset )
+            goto error;
+        }
+      else if ( hunk->type == COMP_NONE )
+        {
+          if ( hunk->offset > core->size ||
+               core->hunk_bytes > core->size - hunk->offset )
+            goto error;
+        }
+    }
+  
+  return true;
+
+ error:
+  CD_msgerror ( err, "unable to load '%s': invalid CHD hunk map", fn );
+  return false;
+  
+} // end read_map
+
+
+static bool
+parse_track_type (
+                  const char   *str,
+                  track_meta_t *t
+                  )
+{
+
+  if ( !strcmp ( str, "AUDIO" ) )
+    { t->type= AUDIO; t->format= FMT_AUDIO; }
+  else if ( !strcmp ( str, "MODE1" ) )
+    { t->type= MODE1; t->format= FMT_MODE1; }
+  else if ( !strcmp ( str, "MODE1_RAW" ) )
+    { t->type= MODE1; t->format= FMT_RAW; }
+  else if ( !strcmp ( str, "MODE2" ) || !strcmp ( str, "MODE2_FORM_MIX" ) )
+    { t->type= MODE2; t->format= FMT_MODE2; }
+  else if ( !strcmp ( str, "MODE2_FORM1" ) )
+    { t->type= MODE2; t->format= FMT_MODE2_FORM1; }
+  else if ( !strcmp ( str, "MODE2_FORM2" ) )
+    { t->type= MODE2; t->format= FMT_MODE2_FORM2; }
+  else if ( !strcmp ( str, "MODE2_RAW" ) )
+    { t->type= MODE2; t->format= FMT_RAW; }
+  else return false;
+
+  return true;
+  
+} // end parse_track_type
+
+
+// Interpreta una entrada CHT2 o CHTR i la desa en TRACKS.
+static bool
+parse_track (
+             const uint32_t  tag,
+             const char     *str,
+             track_meta_t   *tracks,
+             size_t         *NT
+             )
+{
+
+  char type[32],subtype[32],pgtype[32],pgsub[32];
+  int n,id,frames,pregap,postgap;
+  track_meta_t *t;
+  
+  
+  pregap= postgap= 0;
+  pgtype[0]= '\0';
+  if ( tag == META_CHT2 )
+    {
+      n= sscanf ( str, "TRACK:%d TYPE:%31s SUBTYPE:%31s FRAMES:%d PREGAP:%d"
+                  " PGTYPE:%31s PGSUB:%31s POSTGAP:%d", &id, type, subtype,
+                  &frames, &pregap, pgtype, pgsub, &postgap );
+      if ( n != 8 ) return false;
+    }
+  else
+    {
+      n= sscanf ( str, "TRACK:%d TYPE:%31s SUBTYPE:%31s FRAMES:%d",
+                  &id, type, subtype, &frames );
+      if ( n != 4 ) return false;
+    }
+  if ( id < 1 || id > 99 || tracks[id-1].ok || frames <= 0 ||
+       pregap < 0 || postgap < 0 )
+    return false;
+  t= &(tracks[id-1]);
+  if ( !parse_track_type ( type, t ) ) return false;
+  // NOTA!! "RW" és el subcanal R-W empaquetat, sense P ni Q.
+  if ( !strcmp ( subtype, "RW_RAW" ) ) t->subq= true;
+  else if ( !strcmp ( subtype, "RW" ) || !strcmp ( subtype, "NONE" ) )
+    t->subq= false;
+  else return false;
+  t->frames= frames;
+  t->pregap= pregap;
+  t->pregap_stored= pgtype[0]=='V';
+  t->postgap= postgap;
+  if ( t->pregap_stored && pregap > frames ) return false;
+  t->ok= true;
+  if ( (size_t) id > *NT ) *NT= (size_t) id;
+  
+  return true;
+  
+} // end parse_track
+
+
+static void
+add_extent (
+            chd_core_t    *core,
+            const size_t   first,
+            const size_t   nsecs,
+            const long     frame,
+            const int      track_id,
+            const uint8_t  index_id
+            )
+{
+
+  extent_t *ext;
+
+  
+  if ( nsecs == 0 ) return;
+  ext= &(core->exts[core->NX++]);
+  ext->first= first;
+  ext->nsecs= nsecs;
+  ext->frame= frame;
+  ext->track_id= track_id;
+  ext->index_id= index_id;
+  
+} // end add_extent
+
+
+// Llig les metadades dels tracks i crea el mapa de sectors.
+static bool
+read_tracks (
+             chd_core_t  *core,
+             const char  *fn,
+             char       **err
+             )
+{
+
+  uint8_t h[META_HEADER_SIZE];
+  char str[256];
+  track_meta_t tracks[99];
+  uint64_t offset;
+  uint32_t tag,length;
+  size_t t,sec,frame,nframes;
+  int n;
+  track_t *track;
+  
+
+  // Metadades.
+  memset ( tracks, 0, sizeof(tracks) );
+  core->NT= 0;
+  if ( !read_file ( core, h, 8, 48 ) ) goto error;
+  offset= get_u64 ( h );
+  for ( n= 0; offset != 0 && n < MAX_META; ++n )
+    {
+      if ( !read_file ( core, h, META_HEADER_SIZE, offset ) ) goto error;
+      tag= get_u32 ( &h[0] );
+      length= get_u24 ( &h[5] );
+      if ( tag == META_CHGD )
+        {
+          CD_msgerror ( err, "unable to load '%s': GD-ROM CHD files are not"
+                        " supported", fn );
+          return false;
+        }
+      if ( tag == META_CHT2 || tag == META_CHTR )
+        {
+          if ( length >= sizeof(str) ||
+               !read_file ( core, str, length, offset+META_HEADER_SIZE ) )
+            goto error;
+          str[length]= '\0';
+          if ( !parse_track ( tag, str, tracks, &(core->NT) ) ) goto error;
+        }
+      offset= get_u64 ( &h[8] );
+    }
+  if ( core->NT == 0 ) goto error;
+  for ( t= 0; t < core->NT; ++t )
+    if ( !tracks[t].ok ) goto error;
+
+  // Tracks i sectors.
+  core->tracks= mem_alloc ( track_t, core->NT );
+  core->exts= mem_alloc ( extent_t, 3*core->NT + 1 );
+  core->NX= 0;
+  add_extent ( core, 0, IGAP, -1, 0, 0x00 );
+  sec= IGAP; frame= 0;
+  for ( t= 0; t < core->NT; ++t )
+    {
+      track= &(core->tracks[t]);
+      track->type= tracks[t].type;
+      track->format= tracks[t].format;
+      track->subq= tracks[t].subq;
+      track->first= sec;
+      if ( tracks[t].pregap_stored )
+        {
+          add_extent ( core, sec, tracks[t].pregap, (long) frame, t, 0x00 );
+          track->first_stored= sec;
+          sec+= tracks[t].pregap;
+          nframes= tracks[t].frames - tracks[t].pregap;
+          track->sector_index01= sec;
+          add_extent ( core, sec, nframes, (long) (frame+tracks[t].pregap),
+                       t, 0x01 );
+        }
+      else
+        {
+          add_extent ( core, sec, tracks[t].pregap, -1, t, 0x00 );
+          sec+= tracks[t].pregap;
+          nframes= tracks[t].frames;
+          track->first_stored= track->sector_index01= sec;
+          add_extent ( core, sec, nframes, (long) frame, t, 0x01 );
+        }
+      sec+= nframes;
+      add_extent ( core, sec, tracks[t].postgap, -1, t, 0x01 );
+      sec+= tracks[t].postgap;
+      frame+= ((tracks[t].frames + TRACK_PADDING - 1)/TRACK_PADDING)*
+        TRACK_PADDING;
+    }
+  core->N= sec;
+  if ( frame > core->nhunks*core->frames_per_hunk &&
+       (frame - core->nhunks*core->frames_per_hunk) >= TRACK_PADDING )
+    goto error;
+  
+  return true;
+
+ error:
+  CD_msgerror ( err, "unable to load '%s': invalid CHD track metadata", fn );
+  return false;
+  
+} // end read_tracks
+
+
+static bool
+load_chd (
+          chd_core_t  *core,
+          const char  *fn,
+          char       **err
+          )
+{
+
+  long size;
+
+  
+  core->fd= CD_file_open ( fn, &size );
+  if ( core->fd == -1 )
+    {
+      CD_msgerror ( err, "cannot open '%s'", fn );
+      return false;
+    }
+  core->size= (size_t) size;
+  core->mem= CD_file_map ( core->fd, core->size );
+  
+  return read_header ( core, fn, err ) &&
+    read_map ( core, fn, err ) &&
+    read_tracks ( core, fn, err );
+  
+} // end load_chd
+
+
+static void
+free_core (
+           chd_core_t *core
+           )
+{
+
+  free ( core->exts );
+  free ( core->tracks );
+  free ( core->map );
+  CD_file_unmap ( core->mem, core->size );
+  CD_file_close ( core->fd );
+  free ( core );
+  
+} // end free_core
+
+
+static chd_core_t *
+new_core (void)
+{
+
+  chd_core_t *core;
+
+  
+  core= mem_alloc ( chd_core_t, 1 );
+  atomic_init ( &(core->refs), 1 );
+  core->fd= -1;
+  core->mem= NULL;
+  core->size= 0;
+  core->nhunks= 0;
+  core->map= NULL;
+  core->tracks= NULL;
+  core->NT= 0;
+  core->exts= NULL;
+  core->NX= 0;
+  core->N= 0;
+  
+  return core;
+  
+} // end new_core
+
+
+// Grandària del diccionari que fa servir el compressor LZMA (nivell 9
+// ajustat a la grandària de les dades).
+static uint32_t
+lzma_dict_size (
+                const uint32_t size
+                )
+{
+
+  int i;
+  
+
+  for ( i= 11; i <= 30; ++i )
+    {
+      if ( size <= (2u<<i) ) return 2u<<i;
+      if ( size <= (3u<<i) ) return 3u<<i;
+    }
+  
+  return 1u<<26;
+  
+} // end lzma_dict_size
+
+
+// Descomprimeix amb 'deflate' sense capçalera.
+static bool
+inflate_data (
+              CD_CHD_Disc   *d,
+              const uint8_t *src,
+              const size_t   src_size,
+              uint8_t       *dst,
+              const size_t   dst_size
+              )
+{
+
+  if ( !d->z_init )
+    {
+      memset ( &(d->z), 0, sizeof(d->z) );
+      if ( inflateInit2 ( &(d->z), -MAX_WBITS ) != Z_OK ) return false;
+      d->z_init= true;
+    }
+  else if ( inflateReset ( &(d->z) ) != Z_OK ) return false;
+  d->z.next_in= (Bytef *) src;
+  d->z.avail_in= (uInt) src_size;
+  d->z.next_out= dst;
+  d->z.avail_out= (uInt) dst_size;
+  inflate ( &(d->z), Z_FINISH );
+  
+  return d->z.total_out == dst_size;
+  
+} // end inflate_data
+
+
+// Descomprimeix un flux LZMA1 sense capçalera (lc=3, lp=0, pb=2).
+static bool
+unlzma_data (
+             CD_CHD_Disc   *d,
+             const uint8_t *src,
+             const size_t   src_size,
+             uint8_t       *dst,
+             const size_t   dst_size
+             )
+{
+
+  lzma_options_lzma opts;
+  lzma_filter filters[2];
+  lzma_ret ret;
+  size_t avail;
+  
+
+  memset ( &opts, 0, sizeof(opts) );
+  opts.dict_size= lzma_dict_size ( (uint32_t) dst_size );
+  opts.lc= 3;
+  opts.lp= 0;
+  opts.pb= 2;
+  filters[0].id= LZMA_FILTER_LZMA1;
+  filters[0].options= &opts;
+  filters[1].id= LZMA_VLI_UNKNOWN;
+  filters[1].options= NULL;
+  if ( lzma_raw_decoder ( &(d->lz), filters ) != LZMA_OK ) return false;
+  d->lz.next_in= src;
+  d->lz.avail_in= src_size;
+  d->lz.next_out= dst;
+  d->lz.avail_out= dst_size;
+  do {
+    avail= d->lz.avail_out;
+    ret= lzma_code ( &(d->lz), LZMA_RUN );
+  } while ( ret == LZMA_OK && d->lz.avail_out > 0 && d->lz.avail_out < avail );
+  
+  return (ret == LZMA_OK || ret == LZMA_STREAM_END) && d->lz.avail_out == 0;
+  
+} // end unlzma_data
+
+
+// Descomprimeix frames FLAC (estèreo de 16 bits) fins a omplir DST
+// amb mostres big-endian. Torna els bytes consumits o 0.
+static size_t
+unflac_data (
+             CD_CHD_Disc   *d,
+             const uint8_t *src,
+             const size_t   src_size,
+             uint8_t       *dst,
+             const size_t   dst_size
+             )
+{
+
+  size_t pos,n,k,nsamples,i;
+  int32_t l,r;
+  
+
+  if ( d->flac == NULL ) d->flac= CD_flac_frame_new ();
+  nsamples= dst_size/4;
+  for ( pos= 0, k= 0; k < nsamples; pos+= n )
+    {
+      n= CD_flac_decode_frame ( d->flac, src+pos, src_size-pos, 16, 44100 );
+      if ( n == 0 || d->flac->channels != 2 || d->flac->bps != 16 )
+        return 0;
+      for ( i= 0; i < (size_t) d->flac->block_size && k < nsamples;
+            ++i, ++k, dst+= 4 )
+        {
+          l= d->flac->samples[0][i];
+          r= d->flac->samples[1][i];
+          dst[0]= (uint8_t) (l>>8); dst[1]= (uint8_t) l;
+          dst[2]= (uint8_t) (r>>8); dst[3]= (uint8_t) r;
+        }
+    }
+  
+  return pos;
+  
+} // end unflac_data
+
+
+// Descomprimeix un hunk amb un còdec de CD. Les dades i el subcanal
+// estan comprimits per separat i cal tornar a intercalar-los.
+static bool
+decode_cd_hunk (
+                CD_CHD_Disc    *d,
+                const uint32_t  codec,
+                const uint8_t  *src,
+                const size_t    size,
+                uint8_t        *dst
+                )
+{
+
+  size_t frames,ecc_bytes,header,base,used,f;
+  const uint8_t *ecc;
+  uint8_t *tmp;
+  bool ok;
+  
+
+  frames= CORE(d)->frames_per_hunk;
+  if ( d->tmp == NULL ) d->tmp= mem_alloc ( uint8_t, frames*FRAME_SIZE );
+  tmp= d->tmp;
+  if ( codec == CODEC_CDFL )
+    {
+      ecc= NULL;
+      used= unflac_data ( d, src, size, tmp, frames*FRAME_DATA );
+      ok= used > 0 &&
+        inflate_data ( d, src+used, size-used,
+                       tmp+frames*FRAME_DATA, frames*FRAME_SUB );
+    }
+  else
+    {
+      ecc= src;
+      ecc_bytes= (frames+7)/8;
+      header= ecc_bytes + (CORE(d)->hunk_bytes < 65536 ? 2 : 3);
+      if ( size < header ) return false;
+      base= get_u16 ( &src[ecc_bytes] );
+      if ( header-ecc_bytes == 3 ) base= (base<<8) | src[ecc_bytes+2];
+      if ( base > size-header ) return false;
+      ok= codec == CODEC_CDZL ?
+        inflate_data ( d, src+header, base, tmp, frames*FRAME_DATA ) :
+        unlzma_data ( d, src+header, base, tmp, frames*FRAME_DATA );
+      ok= ok && inflate_data ( d, src+header+base, size-header-base,
+                               tmp+frames*FRAME_DATA, frames*FRAME_SUB );
+    }
+  if ( !ok ) return false;
+
+  // Intercala i reconstrueix els sectors amb ECC.
+  for ( f= 0; f < frames; ++f, dst+= FRAME_SIZE )
+    {
+      memcpy ( dst, tmp + f*FRAME_DATA, FRAME_DATA );
+      memcpy ( dst + FRAME_DATA, tmp + frames*FRAME_DATA + f*FRAME_SUB,
+               FRAME_SUB );
+      if ( ecc != NULL && (ecc[f/8]&(1<<(f%8))) )
+        {
+          memcpy ( dst, SYNC, 12 );
+          CD_ecc_generate ( dst, false );
+        }
+    }
+  
+  return true;
+  
+} // end decode_cd_hunk
+
+
+// Obté les dades comprimides (sense còpia si el fitxer està
+// projectat).
+static const uint8_t *
+get_compressed (
+                CD_CHD_Disc  *d,
+                const hunk_t *hunk
+                )
+{
+
+  if ( CORE(d)->mem != NULL ) return CORE(d)->mem + hunk->offset;
+  if ( d->cbuf_size < hunk->length )
+    {
+      d->cbuf= mem_realloc ( uint8_t, d->cbuf, hunk->length );
+      d->cbuf_size= hunk->length;
+    }
+  if ( !read_file ( CORE(d), d->cbuf, hunk->length, hunk->offset ) )
+    return NULL;
+  
+  return d->cbuf;
+  
+} // end get_compressed
+
+
+static bool
+decode_hunk (
+             CD_CHD_Disc  *d,
+             const size_t  n,
+             uint8_t      *dst
+             )
+{
+
+  const hunk_t *hunk;
+  const uint8_t *src;
+  bool ok;
+  
+  
+  hunk= &(CORE(d)->map[n]);
+  switch ( hunk->type )
+    {
+    case COMP_ZERO:
+      memset ( dst, 0, CORE(d)->hunk_bytes );
+      return true;
+    case COMP_NONE:
+      ok= read_file ( CORE(d), dst, CORE(d)->hunk_bytes, hunk->offset );
+      break;
+    default:
+      src= get_compressed ( d, hunk );
+      ok= src != NULL &&
+        decode_cd_hunk ( d, CORE(d)->codecs[hunk->type],
+                         src, hunk->length, dst );
+      break;
+    }
+  if ( ok && hunk->check_crc )
+    ok= crc16 ( dst, CORE(d)->hunk_bytes ) == hunk->crc;
+  
+  return ok;
+  
+} // end decode_hunk
+
+
+// Torna el hunk N descomprimit (o NULL en cas d'error). Les
+// referències SELF comparteixen l'entrada del hunk original.
+static const uint8_t *
+get_hunk (
+          CD_CHD_Disc *d,
+          size_t       n
+          )
+{
+
+  cache_entry_t *e,*victim;
+  int i;
+  
+
+  if ( CORE(d)->map[n].type == COMP_SELF ) n= CORE(d)->map[n].offset;
+  ++(d->stamp);
+  victim= &(d->cache[0]);
+  for ( i= 0; i < HUNK_CACHE; ++i )
+    {
+      e= &(d->cache[i]);
+      if ( e->hunk == (long) n )
+        {
+          e->stamp= d->stamp;
+          return e->data;
+        }
+      if ( e->stamp < victim->stamp ) victim= e;
+    }
+
+  // Descomprimeix sobre l'entrada menys usada.
+  if ( victim->data == NULL )
+    victim->data= mem_alloc ( uint8_t, CORE(d)->hunk_bytes );
+  victim->hunk= -1;
+  if ( !decode_hunk ( d, n, victim->data ) ) return NULL;
+  victim->hunk= (long) n;
+  victim->stamp= d->stamp;
+  
+  return victim->data;
+  
+} // end get_hunk
+
+
+// Torna el frame F (FRAME_SIZE bytes) o NULL en cas d'error.
+static const uint8_t *
+get_frame (
+           CD_CHD_Disc  *d,
+           const size_t  f
+           )
+{
+
+  const uint8_t *hunk;
+  size_t n;
+  
+
+  n= f/CORE(d)->frames_per_hunk;
+  if ( n >= CORE(d)->nhunks ) return NULL;
+  hunk= get_hunk ( d, n );
+  if ( hunk == NULL ) return NULL;
+  
+  return hunk + (f%CORE(d)->frames_per_hunk)*FRAME_SIZE;
+  
+} // end get_frame
+
+
+// Torna l'extent que conté el sector SEC (< N). Com les lectures
+// solen ser seqüencials primer es comprova l'últim extent consultat
+// pel cursor i el següent, i si no es fa una cerca binària.
+static const extent_t *
+get_extent (
+            CD_CHD_Disc  *d,
+            const size_t  sec
+            )
+{
+
+  const extent_t *exts;
+  size_t lo,hi,mid;
+  
+  
+  exts= d->core->exts;
+  lo= d->current_ext;
+  if ( sec >= exts[lo].first )
+    {
+      if ( sec < exts[lo].first + exts[lo].nsecs ) return &(exts[lo]);
+      if ( lo+1 < d->core->NX && sec < exts[lo+1].first + exts[lo+1].nsecs )
+        {
+          d->current_ext= lo+1;
+          return &(exts[lo+1]);
+        }
+    }
+  
+  // Cerca binària.
+  lo= 0; hi= d->core->NX;
+  while ( hi-lo > 1 )
+    {
+      mid= (lo+hi)/2;
+      if ( exts[mid].first <= sec ) lo= mid;
+      else                          hi= mid;
+    }
+  d->current_ext= lo;
+  
+  return &(exts[lo]);
+  
+} // end get_extent
+
+
+// Escriu la capçalera (Sync, MSF i mode) del sector NSEC.
+static void
+write_header (
+              uint8_t       buf[CD_SEC_SIZE],
+              const size_t  nsec,
+              const uint8_t mode
+              )
+{
+
+  memcpy ( buf, SYNC, 12 );
+  buf[12]= BCD ( nsec/(60*75) );
+  buf[13]= BCD ( (nsec/75)%60 );
+  buf[14]= BCD ( nsec%75 );
+  buf[15]= mode;
+  
+} // end write_header
+
+
+// Escriu la subcapçalera MODE 2 amb el SUBMODE indicat.
+static void
+write_subheader (
+                 uint8_t       buf[CD_SEC_SIZE],
+                 const uint8_t submode
+                 )
+{
+
+  memset ( &buf[16], 0, 8 );
+  buf[18]= buf[22]= submode;
+  
+} // end write_subheader
+
+
+// Reconstrueix en BUF el sector SEC a partir de les dades desades en
+// FRAME segons el format del track.
+static void
+build_sector (
+              const track_t *track,
+              const uint8_t *frame,
+              const size_t   sec,
+              uint8_t        buf[CD_SEC_SIZE]
+              )
+{
+
+  int i;
+
+  
+  switch ( track->format )
+    {
+    case FMT_RAW:
+      memcpy ( buf, frame, CD_SEC_SIZE );
+      break;
+    case FMT_AUDIO:
+      for ( i= 0; i < CD_SEC_SIZE; i+= 2 )
+        {
+          buf[i]= frame[i+1];
+          buf[i+1]= frame[i];
+        }
+      break;
+    case FMT_MODE1:
+      write_header ( buf, sec, 0x01 );
+      memcpy ( &buf[16], frame, 2048 );
+      CD_ecc_mode1 ( buf );
+      break;
+    case FMT_MODE2:
+      write_header ( buf, sec, 0x02 );
+      memcpy ( &buf[16], frame, 2336 );
+      break;
+    case FMT_MODE2_FORM1:
+      write_header ( buf, sec, 0x02 );
+      write_subheader ( buf, 0x08 );
+      memcpy ( &buf[24], frame, 2048 );
+      CD_ecc_mode2_form1 ( buf );
+      break;
+    case FMT_MODE2_FORM2:
+      write_header ( buf, sec, 0x02 );
+      write_subheader ( buf, 0x20 );
+      memcpy ( &buf[24], frame, 2324 );
+      CD_ecc_mode2_form2 ( buf );
+      break;
+    }
+  
+} // end build_sector
+
+
+// Llig el sector SEC (< N) sense passar per la lectura anticipada.
+static bool
+read_sector (
+             CD_CHD_Disc  *d,
+             const size_t  sec,
+             uint8_t       buf[CD_SEC_SIZE],
+             bool         *audio
+             )
+{
+
+  const extent_t *ext;
+  const track_t *track;
+  const uint8_t *frame;
+  
+
+  ext= get_extent ( d, sec );
+  track= &(d->core->tracks[ext->track_id]);
+  *audio= track->type==AUDIO;
+  if ( ext->frame == -1 )
+    memset ( buf, 0, CD_SEC_SIZE );
+  else
+    {
+      frame= get_frame ( d, (size_t) ext->frame + (sec-ext->first) );
+      if ( frame == NULL ) return false;
+      build_sector ( track, frame, sec, buf );
+    }
+  
+  return true;
+  
+} // end read_sector
+
+
+// Llig el sector actual. Si la lectura anticipada està activada
+// l'intenta agafar de l'anell i si no està el llig i reinicia la
+// lectura anticipada a partir del següent.
+static bool
+read_sector_ra (
+                CD_CHD_Disc *d,
+                uint8_t      buf[CD_SEC_SIZE],
+                bool        *audio
+                )
+{
+  
+  if ( d->ra == NULL ) return read_sector ( d, d->current_sec, buf, audio );
+  if ( CD_readahead_pop ( d->ra, d->current_sec, buf, audio ) ) return true;
+  if ( !read_sector ( d, d->current_sec, buf, audio ) ) return false;
+  CD_readahead_restart ( d->ra, d->current_sec+1 );
+  
+  return true;
+  
+} // end read_sector_ra
+
+
+// Cal cridar-la cada vegada que es canvia la posició del cursor fora
+// de la lectura seqüencial.
+static void
+update_readahead (
+                  CD_CHD_Disc *d
+                  )
+{
+  if ( d->ra != NULL ) CD_readahead_restart ( d->ra, d->current_sec );
+} // end update_readahead
+
+
+// Extrau el subcanal Q desat (P-W intercalats, Q és el bit 6 de cada
+// byte) del sector SEC en BUF. Torna fals si no n'hi ha o és tot
+// zeros.
+static bool
+get_stored_q (
+              CD_CHD_Disc    *d,
+              const extent_t *ext,
+              const size_t    sec,
+              uint8_t         buf[CD_SUBCH_SIZE]
+              )
+{
+
+  const uint8_t *frame;
+  uint8_t q[12],nz;
+  int i;
+  
+
+  if ( ext->frame == -1 || !d->core->tracks[ext->track_id].subq )
+    return false;
+  frame= get_frame ( d, (size_t) ext->frame + (sec-ext->first) );
+  if ( frame == NULL ) return false;
+  CD_subpw_get_q ( frame + FRAME_DATA, q );
+  for ( nz= 0, i= 0; i < 12; ++i ) nz|= q[i];
+  if ( nz == 0 ) return false;
+  memcpy ( &buf[1], q, 12 );
+  
+  return true;
+  
+} // end get_stored_q
+
+
+// Llig en BUF els NSECS sectors de EXT a partir de SEC sense passar
+// per la lectura anticipada.
+static bool
+read_run (
+          CD_CHD_Disc    *d,
+          const extent_t *ext,
+          const size_t    sec,
+          const size_t    nsecs,
+          uint8_t        *buf
+          )
+{
+
+  const track_t *track;
+  const uint8_t *frame;
+  size_t i;
+  
+
+  if ( ext->frame == -1 )
+    {
+      memset ( buf, 0, nsecs*CD_SEC_SIZE );
+      return true;
+    }
+  track= &(d->core->tracks[ext->track_id]);
+  for ( i= 0; i < nsecs; ++i, buf+= CD_SEC_SIZE )
+    {
+      frame= get_frame ( d, (size_t) ext->frame + (sec+i-ext->first) );
+      if ( frame == NULL ) return false;
+      build_sector ( track, frame, sec+i, buf );
+    }
+  
+  return true;
+  
+} // end read_run
+
+
+// Omple en BUF el subcanal Q dels NSECS sectors de EXT a partir de
+// SEC (com en CUE). Si hi ha subcanal desat substitueix l'inventat i
+// es comprova el CRC de tot el tram (el dels sectors inventats sempre
+// és correcte).
+static void
+fill_q (
+        CD_CHD_Disc    *d,
+        const extent_t *ext,
+        const size_t    sec,
+        const size_t    nsecs,
+        uint8_t        *buf,
+        bool           *crc_ok
+        )
+{
+
+  const track_t *track;
+  CD_SubQRun run;
+  size_t done,nrun,i;
+  uint8_t *p;
+  bool stored;
+  
+
+  track= &(d->core->tracks[ext->track_id]);
+  run.ctrl=
+    (0x1) | // ADR
+    (track->type==AUDIO ? 0x00 : 0x40);
+  run.track= BCD ( ext->track_id+1 );
+  run.index= ext->index_id;
+  for ( done= 0; done < nsecs; done+= nrun )
+    {
+      nrun= nsecs-done;
+      run.abs= sec+done;
+      if ( run.abs >= track->sector_index01 )
+        {
+          run.pregap= false;
+          run.rel= run.abs - track->sector_index01;
+        }
+      else
+        {
+          run.pregap= true;
+          run.rel= track->sector_index01 - 1 - run.abs;
+          if ( nrun > track->sector_index01-run.abs )
+            nrun= track->sector_index01-run.abs;
+        }
+      p= buf + done*CD_SUBCH_SIZE;
+      CD_subq_fill ( p, &run, nrun, crc_ok!=NULL ? &crc_ok[done] : NULL );
+      if ( ext->frame != -1 && track->subq )
+        {
+          for ( stored= false, i= 0; i < nrun; ++i )
+            if ( get_stored_q ( d, ext, run.abs+i, p + i*CD_SUBCH_SIZE ) )
+              stored= true;
+          if ( stored && crc_ok != NULL )
+            CD_crc_subq_check_batch ( p+1, nrun, CD_SUBCH_SIZE,
+                                      &crc_ok[done] );
+        }
+    }
+  
+} // end fill_q
+
+
+// Llig N sectors a partir de l'actual recorrent el mapa de sectors
+// una única vegada. Si Q no és NULL també s'hi llig el subcanal
+// Q. Cada hunk es descomprimeix una vegada gràcies a la cache.
+static int
+read_secs (
+           CD_CHD_Disc *d,
+           uint8_t     *buf,
+           uint8_t     *q,
+           bool        *crc_ok,
+           bool        *audio,
+           const int    n,
+           const bool   move
+           )
+{
+
+  const extent_t *ext;
+  size_t first,sec,end,nrun,i;
+  bool is_audio;
+  int ret;
+  
+  
+  if ( n < 0 ) return -1;
+  
+  // Rang a llegir.
+  first= d->current_sec;
+  end= first + (size_t) n;
+  if ( end > d->core->N ) end= d->core->N;
+  if ( first > end ) first= end;
+  ret= (int) (end-first);
+
+  // Per trams.
+  for ( sec= first; sec < end; sec+= nrun )
+    {
+      ext= get_extent ( d, sec );
+      nrun= ext->first + ext->nsecs - sec;
+      if ( nrun > end-sec ) nrun= end-sec;
+      if ( !read_run ( d, ext, sec, nrun, buf + (sec-first)*CD_SEC_SIZE ) )
+        return -1;
+      if ( audio != NULL )
+        for ( is_audio= d->core->tracks[ext->track_id].type==AUDIO, i= 0;
+              i < nrun; ++i )
+          audio[sec-first+i]= is_audio;
+      if ( q != NULL )
+        fill_q ( d, ext, sec, nrun, q + (sec-first)*CD_SUBCH_SIZE,
+                 crc_ok!=NULL ? &crc_ok[sec-first] : NULL );
+    }
+  if ( move )
+    {
+      d->current_sec= end;
+      update_readahead ( d );
+    }
+  
+  return ret;
+  
+} // end read_secs
+
+
+// Crea un nou cursor sobre CORE. No modifica les referències.
+static CD_CHD_Disc *
+new_cursor (
+            chd_core_t *core
+            );
+
+
+
+
+/***********/
+/* MÈTODES */
+/***********/
+
+static void
+free_ (
+       CD_Disc *d
+       )
+{
+
+  int i;
+
+  
+  if ( CHD(d)->ra != NULL ) CD_readahead_free ( CHD(d)->ra );
+  for ( i= 0; i < HUNK_CACHE; ++i )
+    free ( CHD(d)->cache[i].data );
+  free ( CHD(d)->cbuf );
+  free ( CHD(d)->tmp );
+  if ( CHD(d)->z_init ) inflateEnd ( &(CHD(d)->z) );
+  lzma_end ( &(CHD(d)->lz) );
+  if ( CHD(d)->flac != NULL ) CD_flac_frame_free ( CHD(d)->flac );
+  
+  // L'últim cursor allibera les dades compartides.
+  if ( atomic_fetch_sub ( &(CORE(d)->refs), 1 ) == 1 )
+    free_core ( CORE(d) );
+  free ( d );
+  
+} // end free_
+
+
+static bool
+move_to_session (
+                 CD_Disc   *d,
+                 const int  sess
+                 )
+{
+
+  if ( sess != 1 ) return false;
+
+  CHD(d)->current_sec= IGAP; // Primer sector amb contingut primer track.
+  update_readahead ( CHD(d) );
+
+  return true;
+  
+} // end move_to_session
+
+
+static bool
+move_to_track (
+               CD_Disc   *d,
+               const int  track
+               )
+{
+
+  if ( track < 1 || (size_t) track > CORE(d)->NT ) return false;
+  CHD(d)->current_sec= CORE(d)->tracks[track-1].first_stored;
+  update_readahead ( CHD(d) );
+
+  return true;
+  
+} // end move_to_track
+
+
+static void
+reset (
+       CD_Disc *d
+       )
+{
+  CHD(d)->current_sec= 0;
+  update_readahead ( CHD(d) );
+} // end reset
+
+
+static bool
+seek (
+      CD_Disc *d,
+      int      amm,
+      int      ass,
+      int      asect
+      )
+{
+
+  long pos;
+
+
+  pos= amm*60*75 + ass*75 + asect;
+  if ( pos < 0 || (size_t) pos >= CORE(d)->N ) return false;
+
+  CHD(d)->current_sec= (size_t) pos;
+  update_readahead ( CHD(d) );
+  
+  return true;
+  
+} // end seek
+
+
+static int
+get_num_sessions (
+                  CD_Disc *d
+                  )
+{
+  return 1;
+} // end get_num_sessions
+
+
+static bool
+read_ (
+       CD_Disc    *d,
+       uint8_t     buf[CD_SEC_SIZE],
+       bool       *audio,
+       const bool  move
+       )
+{
+
+  if ( CHD(d)->current_sec >= CORE(d)->N ) return false;
+
+  // Intenta llegir.
+  if ( !read_sector_ra ( CHD(d), buf, audio ) ) return false;
+  if ( move ) ++(CHD(d)->current_sec);
+  
+  return true;
+  
+} // end read_
+
+
+static bool
+read_q (
+        CD_Disc    *d,
+        uint8_t     buf[CD_SUBCH_SIZE],
+        bool       *crc_ok,
+        const bool  move
+        )
+{
+
+  const extent_t *ext;
+  const track_t *track;
+  size_t tmp,sec;
+  uint16_t crc;
+  
+
+  // CRC ok!!!
+  *crc_ok= true;
+  
+  sec= CHD(d)->current_sec;
+  if ( sec >= CORE(d)->N ) return false;
+  ext= get_extent ( CHD(d), sec );
+  track= &(CORE(d)->tracks[ext->track_id]);
+
+  // En el primer byte fiquem els 2 bits de "Sub-channel
+  // synchronization field".
+  buf[0]= 0x00; // ¿¿????
+
+  // Si el subcanal està desat gastem eixe.
+  if ( get_stored_q ( CHD(d), ext, sec, buf ) )
+    {
+      crc= CD_crc_subq_calc ( buf );
+      *crc_ok= buf[11] == ((crc>>8)&0xFF) && buf[12] == (crc&0xFF);
+    }
+
+  // Invenció normal (com en CUE).
+  else
+    {
+      
+      // ADR/Control
+      // --> Assumisc ADR 1 in Data region
+      buf[1]=
+        (0x1) | // ADR
+        (track->type==AUDIO ? 0x00 : 0x40);
+      
+      // Track and index.
+      buf[2]= BCD ( ext->track_id+1 );
+      buf[3]= ext->index_id; // Ja està transformat i és 00 per als pregap
+      
+      // Track relative MSF address
+      if ( sec >= track->sector_index01 )
+        tmp= sec - track->sector_index01;
+      else // Distància a track->sector_index01 (estem en un pregap)
+        // El -1 està copiat de mednafen.
+        tmp= track->sector_index01 - 1 - sec;
+      buf[4]= BCD ( tmp/(60*75) ); tmp%= 60*75; // MM
+      buf[5]= BCD ( tmp/75 ); tmp%= 75; // SS
+      buf[6]= BCD ( tmp ); // FF
+      
+      // Reserved
+      buf[7]= 0x00;
+      
+      // Absolute MSF address
+      tmp= sec;
+      buf[8]= BCD ( tmp/(60*75) ); tmp%= 60*75; // MM
+      buf[9]= BCD ( tmp/75 ); tmp%= 75; // SS
+      buf[10]= BCD ( tmp ); // FF
+      
+      // CRC-16-CCITT error detection code (big-endian: bytes ordered MSB,
+      // LSB)
+      crc= CD_crc_subq_calc ( buf );
+      buf[11]= (crc>>8)&0xFF;
+      buf[12]= crc&0xFF;
+
+    }
+  
+  // Mou.
+  if ( move ) ++(CHD(d)->current_sec);
+  
+  return true;
+  
+} // end read_q
+
+
+static CD_Info *
+get_info (
+          CD_Disc *d
+          )
+{
+
+  CD_Info *ret;
+  CD_SessionInfo *sess;
+  CD_TrackInfo *tracks;
+  CD_IndexInfo *indexes;
+  size_t t;
+  const track_t *tp;
+  
+  
+  // Reserva memòria.
+  ret= mem_alloc ( CD_Info, 1 );
+  ret->_mem_sessions= sess= mem_alloc ( CD_SessionInfo, 1 );
+  ret->_mem_tracks= tracks= mem_alloc ( CD_TrackInfo, CORE(d)->NT );
+  ret->_mem_indexes= indexes= mem_alloc ( CD_IndexInfo, 2*CORE(d)->NT );
+  
+  // Sesions.
+  ret->nsessions= 1;
+  ret->sessions= sess;
+  sess[0].ntracks= CORE(d)->NT;
+  sess[0].tracks= tracks;
+
+  // Tracks i índexs.
+  ret->ntracks= CORE(d)->NT;
+  ret->tracks= tracks;
+  for ( t= 0; t < CORE(d)->NT; ++t )
+    {
+      tp= &(CORE(d)->tracks[t]);
+      tracks[t].id= BCD ( t+1 );
+      tracks[t].nindexes= 0;
+      tracks[t].indexes= indexes;
+      tracks[t].is_audio= (tp->type == AUDIO);
+      tracks[t].audio_four_channel= false;
+      tracks[t].audio_preemphasis= false;
+      tracks[t].digital_copy_allowed= false; // No hi ha FLAGS.
+      if ( t > 0 )
+        tracks[t-1].pos_last_sector= CD_get_position ( tp->first - 1 );
+      if ( tp->first < tp->sector_index01 )
+        {
+          indexes->id= 0x00;
+          indexes->pos= CD_get_position ( tp->first );
+          ++indexes; ++(tracks[t].nindexes);
+        }
+      indexes->id= 0x01;
+      indexes->pos= CD_get_position ( tp->sector_index01 );
+      ++indexes; ++(tracks[t].nindexes);
+    }
+  tracks[CORE(d)->NT-1].pos_last_sector= CD_get_position ( CORE(d)->N-1 );
+
+  // Disk type. (Açò és com un resum)
+  switch ( CORE(d)->tracks[0].type )
+    {
+    case AUDIO: ret->type= CD_DISK_TYPE_AUDIO; break;
+    case MODE1: ret->type= CD_DISK_TYPE_MODE1; break;
+    case MODE2: ret->type= CD_DISK_TYPE_MODE2; break;
+    }
+  for ( t= 1; t < CORE(d)->NT; ++t )
+    {
+      tp= &(CORE(d)->tracks[t]);
+      if ( ret->type == CD_DISK_TYPE_AUDIO ) // Sols audio
+        {
+          if ( tp->type != AUDIO )
+            {
+              ret->type= CD_DISK_TYPE_UNK;
+              break;
+            }
+        }
+      else if ( ret->type == CD_DISK_TYPE_MODE1 ||
+                ret->type == CD_DISK_TYPE_MODE1_AUDIO )
+        {
+          if ( tp->type == AUDIO ) ret->type= CD_DISK_TYPE_MODE1_AUDIO;
+          else if ( tp->type == MODE2 )
+            {
+              ret->type= CD_DISK_TYPE_UNK;
+              break;
+            }
+        }
+      else if ( ret->type == CD_DISK_TYPE_MODE2 ||
+                ret->type == CD_DISK_TYPE_MODE2_AUDIO )
+        {
+          if ( tp->type == AUDIO ) ret->type= CD_DISK_TYPE_MODE2_AUDIO;
+          else if ( tp->type == MODE1 )
+            {
+              ret->type= CD_DISK_TYPE_UNK;
+              break;
+            }
+        }
+    }
+  
+  return ret;
+  
+} // end get_info
+
+
+static int
+get_current_session (
+                     CD_Disc *d
+                     )
+{
+  return 0;
+} // end get_current_session
+
+
+static int
+get_current_track (
+                   CD_Disc *d
+                   )
+{
+  return (int)
+    (CHD(d)->current_sec>=CORE(d)->N ?
+     CORE(d)->NT :
+     (size_t) (get_extent ( CHD(d), CHD(d)->current_sec )->track_id + 1));
+} // end get_current_track
+
+
+static uint8_t
+get_current_index (
+                   CD_Disc *d
+                   )
+{
+  return CHD(d)->current_sec>=CORE(d)->N ?
+    0x00 : get_extent ( CHD(d), CHD(d)->current_sec )->index_id;
+} // end get_current_index
+
+
+static bool
+move_to_leadin (
+                CD_Disc *d
+                )
+{
+
+  fprintf ( stderr, "[WW] lead-in not available in CHD format,"
+            " moving to sector 0 (Track 1)\n" );
+  CHD(d)->current_sec= 0;
+  update_readahead ( CHD(d) );
+  
+  return true;
+  
+} // end move_to_leadin
+
+
+static CD_Position
+tell (
+      CD_Disc *d
+      )
+{
+  return CD_get_position ( CHD(d)->current_sec );
+} // end tell
+
+
+static const uint8_t *
+read_view (
+           CD_Disc    *d,
+           bool       *audio,
+           const bool  move
+           )
+{
+
+  const uint8_t *ret;
+  const extent_t *ext;
+  
+  
+  if ( CHD(d)->current_sec >= CORE(d)->N ) return NULL;
+
+  // Els sectors sense dades no cal construir-los.
+  ext= get_extent ( CHD(d), CHD(d)->current_sec );
+  if ( CHD(d)->ra == NULL && ext->frame == -1 )
+    {
+      *audio= CORE(d)->tracks[ext->track_id].type==AUDIO;
+      ret= ZERO_SEC;
+    }
+  else
+    {
+      if ( !read_sector_ra ( CHD(d), CHD(d)->sec_buf, audio ) ) return NULL;
+      ret= CHD(d)->sec_buf;
+    }
+  if ( move ) ++(CHD(d)->current_sec);
+  
+  return ret;
+  
+} // end read_view
+
+
+static int
+read_n (
+        CD_Disc    *d,
+        uint8_t    *buf,
+        bool       *audio,
+        const int   n,
+        const bool  move
+        )
+{
+  return read_secs ( CHD(d), buf, NULL, NULL, audio, n, move );
+} // end read_n
+
+
+static CD_Disc *
+clone (
+       CD_Disc *d
+       )
+{
+
+  CD_CHD_Disc *new;
+
+  
+  atomic_fetch_add ( &(CORE(d)->refs), 1 );
+  new= new_cursor ( CORE(d) );
+  new->current_sec= CHD(d)->current_sec;
+
+  return (CD_Disc *) new;
+  
+} // end clone
+
+
+static bool
+set_readahead (
+               CD_Disc   *d,
+               const int  depth
+               )
+{
+
+  CD_Disc *producer;
+  
+  
+  if ( CHD(d)->ra != NULL )
+    {
+      CD_readahead_free ( CHD(d)->ra );
+      CHD(d)->ra= NULL;
+    }
+  if ( depth <= 0 ) return true;
+
+  // El fil d'E/S llig (i descomprimeix) amb el seu propi cursor.
+  producer= clone ( d );
+  CHD(d)->ra= CD_readahead_new ( producer, depth, CHD(d)->current_sec );
+  if ( CHD(d)->ra == NULL )
+    {
+      CD_disc_free ( producer );
+      return false;
+    }
+  
+  return true;
+  
+} // end set_readahead
+
+
+static void
+get_readahead_stats (
+                     CD_Disc           *d,
+                     CD_ReadAheadStats *stats
+                     )
+{
+
+  if ( CHD(d)->ra != NULL ) CD_readahead_get_stats ( CHD(d)->ra, stats );
+  else stats->hits= stats->misses= 0;
+  
+} // end get_readahead_stats
+
+
+static int
+read_batch (
+            CD_Disc      *d,
+            CD_SectorReq *reqs,
+            const int     n
+            )
+{
+
+  int i,ret;
+  
+
+  // NOTA!! Ací el cost és descomprimir, no llegir, per tant les
+  // peticions es serveixen una a una des de la cache de hunks.
+  for ( i= ret= 0; i < n; ++i )
+    {
+      reqs[i].ok= false;
+      reqs[i].audio= false;
+      if ( reqs[i].sec < 0 || (size_t) reqs[i].sec >= CORE(d)->N ) continue;
+      reqs[i].ok= read_sector ( CHD(d), (size_t) reqs[i].sec,
+                                reqs[i].buf, &(reqs[i].audio) );
+      if ( reqs[i].ok ) ++ret;
+    }
+  
+  return ret;
+  
+} // end read_batch
+
+
+static int
+read_q_range (
+              CD_Disc    *d,
+              uint8_t    *buf,
+              bool       *crc_ok,
+              const int   n,
+              const bool  move
+              )
+{
+
+  const extent_t *ext;
+  size_t first,sec,end,nrun;
+  int ret;
+  
+
+  if ( n < 0 ) return -1;
+
+  // Rang.
+  first= CHD(d)->current_sec;
+  end= first + (size_t) n;
+  if ( end > CORE(d)->N ) end= CORE(d)->N;
+  if ( first > end ) first= end;
+  ret= (int) (end-first);
+
+  // Per trams.
+  for ( sec= first; sec < end; sec+= nrun )
+    {
+      ext= get_extent ( CHD(d), sec );
+      nrun= ext->first + ext->nsecs - sec;
+      if ( nrun > end-sec ) nrun= end-sec;
+      fill_q ( CHD(d), ext, sec, nrun, buf + (sec-first)*CD_SUBCH_SIZE,
+               crc_ok!=NULL ? &crc_ok[sec-first] : NULL );
+    }
+  
+  if ( move )
+    {
+      CHD(d)->current_sec= end;
+      update_readahead ( CHD(d) );
+    }
+  
+  return ret;
+  
+} // end read_q_range
+
+
+static bool
+read_pw (
+         CD_Disc    *d,
+         uint8_t     buf[CD_SUBPW_SIZE],
+         const bool  move
+         )
+{
+
+  const extent_t *ext;
+  const uint8_t *frame;
+  uint8_t q[CD_SUBCH_SIZE];
+  size_t sec;
+  bool crc_ok;
+  
+
+  sec= CHD(d)->current_sec;
+  if ( sec >= CORE(d)->N ) return false;
+  ext= get_extent ( CHD(d), sec );
+
+  // Si està desat en cru es torna tal qual.
+  frame= NULL;
+  if ( ext->frame != -1 && CORE(d)->tracks[ext->track_id].subq )
+    frame= get_frame ( CHD(d), (size_t) ext->frame + (sec-ext->first) );
+  if ( frame != NULL )
+    {
+      memcpy ( buf, frame + FRAME_DATA, CD_SUBPW_SIZE );
+      if ( move ) ++(CHD(d)->current_sec);
+    }
+
+  // Sintetitzat a partir del Q.
+  else
+    {
+      if ( !read_q ( d, q, &crc_ok, move ) ) return false;
+      CD_subq_to_pw ( q, buf );
+    }
+  
+  return true;
+  
+} // end read_pw
+
+
+static bool
+read_user_data (
+                CD_Disc    *d,
+                uint8_t     buf[CD_USER_DATA_SIZE],
+                int        *length,
+                const bool  move
+                )
+{
+
+  const uint8_t *sec;
+  bool audio;
+  
+
+  // Els hunks es descomprimeixen sencers, per tant es parteix del
+  // sector complet.
+  sec= read_view ( d, &audio, false );
+  if ( sec == NULL || audio ) return false;
+  *length= CD_get_user_data ( sec, buf );
+  if ( *length == -1 ) return false;
+  if ( move ) ++(CHD(d)->current_sec);
+  
+  return true;
+  
+} // end read_user_data
+
+
+// Un únic sector (el cas habitual en un emulador) es llig com en
+// 'read_' i 'read_q' però amb una única crida, passant per la lectura
+// anticipada. La resta es llig amb un únic recorregut del mapa.
+static int
+read_with_q (
+             CD_Disc    *d,
+             uint8_t    *buf,
+             uint8_t    *q,
+             bool       *crc_ok,
+             bool       *audio,
+             const int   n,
+             const bool  move
+             )
+{
+
+  bool au,ok;
+  
+
+  if ( n != 1 )
+    return read_secs ( CHD(d), buf, q, crc_ok, audio, n, move );
+  if ( CHD(d)->current_sec >= CORE(d)->N ) return 0;
+  if ( !read_sector_ra ( CHD(d), buf, &au ) ) return -1;
+  if ( audio != NULL ) *audio= au;
+  read_q ( d, q, crc_ok!=NULL ? crc_ok : &ok, move );
+  
+  return 1;
+  
+} // end read_with_q
+
+
+static CD_CHD_Disc *
+new_cursor (
+            chd_core_t *core
+            )
+{
+
+  CD_CHD_Disc *new;
+  int i;
+  
+  
+  new= mem_alloc ( CD_CHD_Disc, 1 );
+  new->_m.free= free_;
+  new->_m.move_to_session= move_to_session;
+  new->_m.move_to_track= move_to_track;
+  new->_m.reset= reset;
+  new->_m.seek= seek;
+  new->_m.get_num_sessions= get_num_sessions;
+  new->_m.read= read_;
+  new->_m.read_q= read_q;
+  new->_m.get_info= get_info;
+  new->_m.get_current_session= get_current_session;
+  new->_m.get_current_track= get_current_track;
+  new->_m.get_current_index= get_current_index;
+  new->_m.move_to_leadin= move_to_leadin;
+  new->_m.tell= tell;
+  new->_m.read_view= read_view;
+  new->_m.read_n= read_n;
+  new->_m.clone= clone;
+  new->_m.set_readahead= set_readahead;
+  new->_m.get_readahead_stats= get_readahead_stats;
+  new->_m.read_batch= read_batch;
+  new->_m.read_q_range= read_q_range;
+  new->_m.read_pw= read_pw;
+  new->_m.read_user_data= read_user_data;
+  new->_m.read_with_q= read_with_q;
+  new->core= core;
+  new->current_sec= 0;
+  new->current_ext= 0;
+  for ( i= 0; i < HUNK_CACHE; ++i )
+    {
+      new->cache[i].hunk= -1;
+      new->cache[i].stamp= 0;
+      new->cache[i].data= NULL;
+    }
+  new->stamp= 0;
+  new->cbuf= NULL;
+  new->cbuf_size= 0;
+  new->tmp= NULL;
+  new->z_init= false;
+  new->lz= (lzma_stream) LZMA_STREAM_INIT;
+  new->flac= NULL;
+  new->ra= NULL;
+  
+  return new;
+  
+} // end new_cursor
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+CD_Disc *
+CD_chd_disc_new (
+                 const char  *fn,
+                 char       **err // Pot ser NULL
+                 )
+{
+
+  chd_core_t *core;
+
+
+  core= new_core ();
+  if ( !load_chd ( core, fn, err ) )
+    {
+      free_core ( core );
+      return NULL;
+    }
+  
+  return (CD_Disc *) new_cursor ( core );
+  
+} // end CD_chd_disc_new
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  chd.h - Imatges CHD ("Compressed Hunks of Data") de CD-Rom.
+ *
+ */
+/*
+ * NOTA!! Sols es suporta la versió 5 del format amb els còdecs de CD
+ * ('cdzl', 'cdlz' i 'cdfl') o sense comprimir, i sense CHD pare. Cal
+ * enllaçar amb zlib i liblzma.
+ */
+
+
+#ifndef __CD_CHD_H__
+#define __CD_CHD_H__
+
+#include "CD.h"
+
+// Torna NULL en cas d'error
+CD_Disc *
+CD_chd_disc_new (
+                 const char  *fn,
+                 char       **err // Pot ser NULL
+                 );
+
+#endif // __CD_CHD_H__
@@ -24,6 +24,8 @@
 #ifndef __CD_CRC_H__
 #define __CD_CRC_H__
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "CD.h"
@@ -34,5 +36,28 @@ CD_crc_subq_calc (
                   const uint8_t subq[CD_SUBCH_SIZE]
                   );
 
+// Calcula el CRC (igual que CD_crc_subq_calc) de N blocs Q de 12 bytes
+// (els 10 de dades i els 2 del CRC, sense el byte de sincronització)
+// situats cada STRIDE bytes a partir de Q, i el desa en CRC. Si la CPU
+// ho permet es gasta PCLMULQDQ.
+void
+CD_crc_subq_calc_batch (
+                        const uint8_t *q,
+                        const size_t   n,
+                        const size_t   stride,
+                        uint16_t      *crc
+                        );
+
+// Com CD_crc_subq_calc_batch però compara el CRC amb el desat en els
+// bytes 10 i 11 de cada bloc. Si OK no és NULL desa el resultat de
+// cada bloc. Torna el número de blocs correctes.
+size_t
+CD_crc_subq_check_batch (
+                         const uint8_t *q,
+                         size_t         n,
+                         const size_t   stride,
+                         bool          *ok
+                         );
+
 #endif // __CD_CRC_H__
 
@@ -29,10 +29,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 
 #include "CD.h"
 #include "cue.h"
 #include "crc.h"
+#include "ecc.h"
+#include "ecm.h"
+#include "ioengine.h"
+#include "pcm.h"
+#include "readahead.h"
+#include "subq.h"
 #include "utils.h"
 
 
@@ -44,12 +51,38 @@
 
 #define SEC_SIZE 0x930
 
+// Grandària dels sectors "cuinats" (sols les dades, sense capçalera
+// ni EDC/ECC) de les pistes MODE1/2048, MODE2/2048 i MODE2/2336.
+#define COOKED_SIZE 0x800
+#define MODE2_SIZE 0x920
+
 #define IGAP (2*75)
 
 #define BCD(NUM) ((uint8_t) (((NUM)/10)*0x10 + (NUM)%10))
 
 #define LSD_ENTRY_SIZE 15
 
+// Extensió que es prova si no es troba el BIN.
+#define ECM_EXT ".ecm"
+
+// Índex binari.
+#define IDX_EXT ".idx"
+#define IDX_MAGIC "CDCUEIDX"
+#define IDX_VERSION 5
+#define IDX_ENDIAN 0x01020304
+#define IDX_ABI ((uint32_t) ((sizeof(size_t)<<16) | (sizeof(lsd_t)<<8) | \
+                             sizeof(long)))
+
+// Bits de control de les pistes (comanda FLAGS). Són els 4 bits alts
+// del primer byte del subcanal Q.
+#define CTRL_PRE  0x1 // Preènfasi.
+#define CTRL_DCP  0x2 // Còpia digital permesa.
+#define CTRL_DATA 0x4
+#define CTRL_4CH  0x8 // Quatre canals.
+
+// Lectures en vol de 'read_batch'.
+#define IO_DEPTH 64
+
 
 
 
@@ -57,15 +90,29 @@
 /* TIPUS */
 /*********/
 
+// Tipus de fitxer (comanda FILE).
+enum {
+  FILE_BINARY= 0,
+  FILE_WAVE,
+  FILE_MOTOROLA
+};
+
 typedef struct bin_file bin_file_t;
 struct bin_file
 {
   
-  FILE       *f;
-  size_t      bin_size; // En número de sectors.
-  size_t      asize; // Número de sectors acumulats de fitxers
-                     // anteriors sense incloure l'actual.
-  bin_file_t *next;
+  char          *fn; // Nom amb el qual s'ha obert.
+  int            type;
+  int            fd;
+  const uint8_t *mem; // Fitxer projectat en memòria (NULL si no es pot).
+  CD_ECM        *ecm; // Lector ECM (NULL si és un BIN normal).
+  CD_PCM        *pcm; // Lector d'àudio (NULL si és BINARY).
+  size_t         size; // Bytes (descodificats si és ECM o àudio).
+  size_t         stride; // Bytes per sector (0 fins al primer INDEX).
+  size_t         bin_size; // En número de sectors.
+  size_t         asize; // Número de sectors acumulats de fitxers
+                        // anteriors sense incloure l'actual.
+  bin_file_t    *next;
   
 };
 
@@ -77,6 +124,9 @@ typedef struct
     MODE1,
     MODE2
   }   type; // Tipus de track.
+  int    flags; // CTRL_PRE, CTRL_DCP i CTRL_4CH.
+  int    sec_size; // Bytes per sector en el fitxer (SEC_SIZE,
+                   // MODE2_SIZE o COOKED_SIZE).
   int    p; // Posició de la primera entrada en entries
   int    N; // Número d'entrades
   size_t sector_index01; // Primer sector de l'índex 01.
@@ -98,22 +148,135 @@ typedef struct
   const bin_file_t *file; // Fitxer on està desat esta entrada.
 } entry_t;
 
+// Tram de sectors consecutius d'un mateix índex (o pregap) que estan
+// desats de manera contigua en el mateix fitxer.
+typedef struct
+{
+
+  size_t            first; // Primer sector (absolut).
+  size_t            nsecs; // Número de sectors.
+  long              offset; // Offset del primer sector (-1 en pregaps).
+  int               track_id;
+  uint8_t           index_id;
+  const bin_file_t *file;
+  
+} extent_t;
+
+// Entrada de la taula de sectors amb subcanal Q del fitxer LSD.
+typedef struct
+{
+
+  size_t sec;
+  int    subq_ptr; // Punter a la taula subq.
+  
+} lsd_t;
+
+// Informació d'un sector concret.
 typedef struct
 {
 
   long              offset;
+  size_t            stride; // Bytes per sector en el fitxer.
   int               track_id;
   uint8_t           index_id;
   const bin_file_t *file;
-  int               subq_ptr; // Punter a la taula q_values.
+  int               subq_ptr; // Punter a la taula subq.
   
 } sec_map_t;
 
+// Estat de 'read_batch'.
 typedef struct
 {
 
-  CD_DISC_CLS;
+  CD_SectorReq   *reqs;
+  int            *ids; // Petició de cada lectura.
+  const track_t **tracks; // Track de cada lectura si cal reconstruir
+                          // el sector (NULL si està en cru).
+  
+} batch_t;
+
+// Índex binari (FITXER.cue.idx). Totes les seccions van seguides i
+// alineades a 8 bytes: capçalera, fitxers, tracks, entrades, extents,
+// taula LSD (lsd_t tal qual), entrades LSD i noms dels fitxers
+// (acabats en '\0'). Els apuntadors a fitxers es desen com l'índex
+// en la llista 'files' (-1 si és NULL).
+typedef struct
+{
+
+  char     magic[8];
+  uint32_t version;
+  uint32_t abi;
+  uint32_t endian;
+  uint32_t NF;
+  int64_t  cue_size;
+  int64_t  cue_mtime;
+  int64_t  lsd_size; // -1 si no hi ha fitxer LSD.
+  int64_t  lsd_mtime;
+  uint64_t NT;
+  uint64_t NE;
+  uint64_t NX;
+  uint64_t N;
+  uint64_t NL;
+  uint64_t NQ;
+  uint64_t names_size;
+  
+} idx_header_t;
+
+typedef struct
+{
+
+  int64_t  size; // Bytes.
+  int64_t  mtime;
+  int64_t  nsecs; // Sectors (descodificats si és ECM o àudio).
+  int32_t  type;
+  int32_t  stride;
+  
+} idx_file_t;
 
+typedef struct
+{
+
+  int32_t  type;
+  int32_t  p;
+  int32_t  N;
+  int32_t  flags;
+  int32_t  sec_size;
+  int32_t  pad;
+  uint64_t sector_index01;
+  
+} idx_track_t;
+
+typedef struct
+{
+
+  int32_t  type;
+  int32_t  id;
+  uint64_t time;
+  int32_t  file;
+  int32_t  pad;
+  
+} idx_entry_t;
+
+typedef struct
+{
+
+  uint64_t first;
+  uint64_t nsecs;
+  int64_t  offset;
+  int32_t  track_id;
+  int32_t  index_id;
+  int32_t  file;
+  int32_t  pad;
+  
+} idx_extent_t;
+
+// Part immutable del disc, compartida per tots els cursors.
+typedef struct
+{
+
+  // Referències.
+  atomic_int refs;
+  
   // Binary
   bin_file_t *files;
   
@@ -123,21 +286,71 @@ typedef struct
   entry_t *entries;
   size_t   NE;
 
-  // Mapa sectors
-  sec_map_t *maps;
-  size_t     N;
-
-  // Posició actual.
-  size_t current_sec;
+  // Mapa sectors (ordenat per sector).
+  extent_t *exts;
+  size_t    NX;
+  size_t    N; // Sectors totals.
 
   // Sectors subcanal_q erronis.
   // El format és literalment el del fitxer LSD:
   // 3B MIN SEC FRA || 12B QSUb (inclou CRC)
-  uint8_t **subq;
+  const uint8_t *subq; // Entrades de LSD_ENTRY_SIZE bytes.
+  const lsd_t   *lsd; // Ordenat per sector.
+  size_t         NL;
+  size_t         NQ; // Entrades en 'subq'.
+
+  // Índex binari del qual s'han obtingut 'subq' i 'lsd' (NULL si no
+  // s'ha gastat).
+  const uint8_t *idx_mem;
+  size_t         idx_size;
+  bool           idx_mapped;
+  
+} cue_core_t;
+
+// Cursor. Cada fil ha de tindre el seu.
+typedef struct
+{
+
+  CD_DISC_CLS;
+
+  // Dades del disc.
+  cue_core_t *core;
+  
+  // Posició actual.
+  size_t current_sec;
+  size_t current_ext; // Últim extent consultat (les lectures solen
+                      // ser seqüencials).
+
+  // Buffer per a 'read_view' quan el fitxer no està projectat.
+  uint8_t sec_buf[CD_SEC_SIZE];
+
+  // Lectura anticipada (NULL si no està activada).
+  CD_ReadAhead *ra;
+
+  // Motor per a 'read_batch' (es crea la primera vegada).
+  CD_IOEngine *io;
   
 } CD_CUE_Disc;
 
 #define CUE(DISC) ((CD_CUE_Disc *) (DISC))
+#define CORE(DISC) (CUE(DISC)->core)
+
+
+
+
+/*************/
+/* CONSTANTS */
+/*************/
+
+// Sector buit retornat per 'read_view' en els pregaps.
+static const uint8_t ZERO_SEC[CD_SEC_SIZE]= {0};
+
+static const uint8_t SYNC[12]=
+  {0x00,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0x00};
+
+// Subcapçalera dels sectors de les pistes MODE2/2048 (FORM 1, dades).
+static const uint8_t FORM1_SUBHEADER[8]=
+  {0x00,0x00,0x08,0x00,0x00,0x00,0x08,0x00};
 
 
 
@@ -146,32 +359,74 @@ typedef struct
 /* FUNCIONS PRIVADES */
 /*********************/
 
+// NSECS és la grandària en sectors si ja es coneix (índex binari) o
+// -1. En fitxers ECM així s'evita haver de recórrer-lo sencer. STRIDE
+// és la grandària dels sectors del fitxer, o 0 si encara no es coneix
+// (es fixa amb el primer INDEX i aleshores es crida a
+// 'finish_binary'). TYPE és el tipus de la comanda FILE.
 static bool
 try_open_binary (
-        	 CD_CUE_Disc *d,
-        	 const char  *fn
+        	 cue_core_t    *d,
+        	 const char    *fn,
+        	 const int64_t  nsecs,
+        	 const size_t   stride,
+        	 const int      type
         	 )
 {
 
   long size;
+  size_t dsize;
   bin_file_t *f;
   
 
   // Prepara.
   f= mem_alloc ( bin_file_t, 1 );
-  f->f= NULL;
+  f->mem= NULL;
+  f->ecm= NULL;
+  f->pcm= NULL;
+  f->fn= NULL;
+  f->type= type;
+  f->stride= type!=FILE_BINARY ? SEC_SIZE : stride;
   
   // Try open.
-  f->f= fopen ( fn, "rb" );
-  if ( f->f == NULL ) goto error;
+  f->fd= CD_file_open ( fn, &size );
+  if ( f->fd == -1 ) goto error;
+
+  // Àudio. L'últim sector pot estar incomplet.
+  if ( type != FILE_BINARY )
+    {
+      f->pcm= CD_pcm_new ( f->fd, size,
+                           type==FILE_WAVE ? CD_PCM_WAVE : CD_PCM_MOTOROLA );
+      if ( f->pcm == NULL ) goto error;
+      if ( stride != 0 && stride != SEC_SIZE ) goto error;
+      dsize= ((CD_pcm_get_size ( f->pcm ) + SEC_SIZE-1)/SEC_SIZE)*SEC_SIZE;
+      if ( nsecs >= 0 && dsize != (size_t) nsecs*SEC_SIZE ) goto error;
+    }
+  
+  // ECM.
+  else if ( (f->ecm= CD_ecm_new ( f->fd, size )) != NULL )
+    {
+      if ( nsecs >= 0 ) dsize= (size_t) nsecs*stride;
+      else if ( !CD_ecm_get_size ( f->ecm, &dsize ) ) goto error;
+    }
+  else // BIN.
+    {
+      dsize= (size_t) size;
+      if ( nsecs >= 0 && dsize != (size_t) nsecs*stride ) goto error;
+    }
   
   // Check size.
-  if ( fseek ( f->f, 0, SEEK_END ) == -1 ) goto error;
-  size= ftell ( f->f );
-  if ( size == -1 || size%SEC_SIZE ) goto error;
+  if ( f->stride != 0 && dsize%f->stride ) goto error;
+  
+  // Intenta projectar-lo en memòria.
+  if ( f->ecm == NULL && f->pcm == NULL )
+    f->mem= CD_file_map ( f->fd, dsize );
   
   // Return.
-  f->bin_size= (size_t) (size/SEC_SIZE);
+  f->fn= mem_alloc ( char, strlen(fn)+1 );
+  strcpy ( f->fn, fn );
+  f->size= dsize;
+  f->bin_size= f->stride!=0 ? dsize/f->stride : 0;
   f->next= d->files;
   d->files= f;
   f->asize= f->next!=NULL ? f->next->asize + f->next->bin_size : 0;
@@ -179,43 +434,95 @@ try_open_binary (
   return true;
 
  error:
-  if ( f->f != NULL ) fclose ( f->f );
+  if ( f->ecm != NULL ) CD_ecm_free ( f->ecm );
+  if ( f->pcm != NULL ) CD_pcm_free ( f->pcm );
+  CD_file_close ( f->fd );
   free ( f );
   return false;
   
 } // end try_open_binary
 
 
+// Fixa la grandària en sectors de l'últim fitxer obert quan no se
+// sabia la grandària dels sectors. Si el fitxer no té cap INDEX es
+// suposa SEC_SIZE.
+static bool
+finish_binary (
+               cue_core_t   *d,
+               char        **err
+               )
+{
+
+  bin_file_t *f;
+
+  
+  f= d->files;
+  if ( f == NULL || f->bin_size != 0 ) return true;
+  if ( f->stride == 0 ) f->stride= SEC_SIZE;
+  if ( f->size%f->stride )
+    {
+      CD_msgerror ( err, "binary file '%s' size is not a multiple of"
+                    " %d bytes", f->fn, (int) f->stride );
+      return false;
+    }
+  f->bin_size= f->size/f->stride;
+  
+  return true;
+  
+} // end finish_binary
+
+
 static bool
 open_binary (
-             CD_CUE_Disc  *d,
+             cue_core_t   *d,
              const char   *binfn,
+             const int     type,
              const char   *cuefn,
              char        **err
              )
 {
 
+  static const char *SUFFIXES[]= {"",ECM_EXT,NULL};
+  
   char *aux;
-  int endpos,i;
+  int endpos,i,s;
   bool ok;
 
   
-  // Default file.
-  if ( try_open_binary ( d, binfn ) ) return true;
-
-  // Based on cue PATH.
+  // Es prova també amb el BIN comprimit amb ECM.
   endpos= strlen ( cuefn ) - 1;
-  aux= mem_alloc ( char, strlen(binfn)+strlen(cuefn)+1 );
+  aux= mem_alloc ( char, strlen(binfn)+strlen(cuefn)+strlen(ECM_EXT)+1 );
   for ( ; endpos>=0 && cuefn[endpos]!='/' && cuefn[endpos]!='\\'; --endpos );
-  for ( i= 0; i <= endpos; ++i ) aux[i]= cuefn[i];
-  aux[i]= '\0';
-  strcat ( aux, binfn );
-  ok= try_open_binary ( d, aux );
+  for ( s= 0, ok= false;
+        !ok && SUFFIXES[s] != NULL && (s == 0 || type == FILE_BINARY);
+        ++s )
+    {
+      
+      // Default file.
+      strcpy ( aux, binfn );
+      strcat ( aux, SUFFIXES[s] );
+      if ( try_open_binary ( d, aux, -1, 0, type ) ) ok= true;
+      
+      // Based on cue PATH.
+      else
+        {
+          for ( i= 0; i <= endpos; ++i ) aux[i]= cuefn[i];
+          aux[i]= '\0';
+          strcat ( aux, binfn );
+          strcat ( aux, SUFFIXES[s] );
+          ok= try_open_binary ( d, aux, -1, 0, type );
+        }
+      
+    }
   free ( aux );
   if ( ok ) return true;
   
   // Error.
-  CD_msgerror ( err, "binary file '%s' not found or wrong size", binfn );
+  if ( type == FILE_BINARY )
+    CD_msgerror ( err, "binary file '%s' not found or wrong size", binfn );
+  else
+    CD_msgerror ( err, "audio file '%s' not found or not in CD-DA format"
+                  " (16-bit stereo at 44100 Hz)", binfn );
   
   return false;
   
@@ -225,7 +532,7 @@ open_binary (
 // Torna 0 si tot ha anat bé, -1 si EOF, 1 en cas d'error.
 static int
 read_file (
-            CD_CUE_Disc  *d,
+            cue_core_t   *d,
             char         *tok,
             const char   *cuefn,
             char        **err
@@ -233,6 +540,7 @@ read_file (
 {
 
   char *fname,*binfn,*aux;
+  int type;
   
   
   // Prepare.
@@ -255,10 +563,14 @@ read_file (
   aux= tok;
   for ( ; *tok && !isspace(*tok); ++tok ); // Find end
   *tok= '\0';
-  if ( strcmp ( aux, "BINARY" ) ) goto error_format;
-
-  // Obri el fitxer.
-  if ( !open_binary ( d, fname, cuefn, err ) )
+  if ( !strcmp ( aux, "BINARY" ) ) type= FILE_BINARY;
+  else if ( !strcmp ( aux, "WAVE" ) ) type= FILE_WAVE;
+  else if ( !strcmp ( aux, "MOTOROLA" ) ) type= FILE_MOTOROLA;
+  else goto error_format;
+
+  // Obri el fitxer. Abans cal tancar la grandària de l'anterior.
+  if ( !finish_binary ( d, err ) ||
+       !open_binary ( d, fname, type, cuefn, err ) )
     goto error;
 
   free ( fname );
@@ -277,7 +589,7 @@ read_file (
 // Torna 0 si tot ha anat bé, -1 si EOF, 1 en cas d'error.
 static int
 read_track (
-            CD_CUE_Disc  *d,
+            cue_core_t   *d,
             char         *tok,
             size_t       *st,
             char        **err
@@ -308,6 +620,8 @@ read_track (
       (*st)*= 2;
       d->tracks= mem_realloc ( track_t, d->tracks, *st );
     }
+  d->tracks[d->NT].flags= 0;
+  d->tracks[d->NT].sec_size= SEC_SIZE;
   d->tracks[d->NT].p= d->NE;
   d->tracks[d->NT].N= 0;
   tok+= 3;
@@ -321,6 +635,21 @@ read_track (
   if ( !strcmp ( mode, "AUDIO" ) ) d->tracks[d->NT].type= AUDIO;
   else if ( !strcmp ( mode, "MODE1/2352" ) ) d->tracks[d->NT].type= MODE1;
   else if ( !strcmp ( mode, "MODE2/2352" ) ) d->tracks[d->NT].type= MODE2;
+  else if ( !strcmp ( mode, "MODE1/2048" ) )
+    {
+      d->tracks[d->NT].type= MODE1;
+      d->tracks[d->NT].sec_size= COOKED_SIZE;
+    }
+  else if ( !strcmp ( mode, "MODE2/2048" ) )
+    {
+      d->tracks[d->NT].type= MODE2;
+      d->tracks[d->NT].sec_size= COOKED_SIZE;
+    }
+  else if ( !strcmp ( mode, "MODE2/2336" ) )
+    {
+      d->tracks[d->NT].type= MODE2;
+      d->tracks[d->NT].sec_size= MODE2_SIZE;
+    }
   else
     {
       CD_msgerror ( err, "TRACK format unknown: %s", mode );
@@ -342,7 +671,7 @@ read_track (
 static size_t
 process_time (
               char               *str,
-              const CD_CUE_Disc  *d,
+              const cue_core_t   *d,
               char              **err
               )
 {
@@ -383,7 +712,7 @@ process_time (
 // Torna 0 si tot ha anat bé, -1 si EOF, 1 en cas d'error.
 static int
 read_index (
-            CD_CUE_Disc  *d,
+            cue_core_t   *d,
             char         *tok,
             size_t       *se,
             char        **err
@@ -401,6 +730,18 @@ read_index (
   
   // Current track.
   track= &(d->tracks[d->NT-1]);
+
+  // Tots els sectors d'un fitxer han de tindre la mateixa grandària.
+  if ( d->files->stride == 0 )
+    d->files->stride= (size_t) track->sec_size;
+  else if ( d->files->stride != (size_t) track->sec_size )
+    {
+      CD_msgerror ( err, "track %d sector size (%d bytes) does not match"
+                    " previous tracks in '%s' (%d bytes)",
+                    (int) d->NT, track->sec_size, d->files->fn,
+                    (int) d->files->stride );
+      goto error;
+    }
   
   // Get index id.
   for ( ; *tok && isspace(*tok); ++tok ); // Skip spaces
@@ -453,7 +794,7 @@ read_index (
 // Torna 0 si tot ha anat bé, -1 si EOF, 1 en cas d'error.
 static int
 read_pregap (
-             CD_CUE_Disc  *d,
+             cue_core_t   *d,
              char         *tok,
              size_t       *se,
              char        **err
@@ -498,11 +839,56 @@ read_pregap (
 } // end read_pregap
 
 
+// Torna 0 si tot ha anat bé, -1 si EOF, 1 en cas d'error.
+static int
+read_flags (
+            cue_core_t   *d,
+            char         *tok,
+            char        **err
+            )
+{
+
+  char *flag;
+  track_t *track;
+  
+
+  // Current track.
+  if ( d->NT == 0 )
+    {
+      CD_msgerror ( err, "flags defined before specifying a track" );
+      return 1;
+    }
+  track= &(d->tracks[d->NT-1]);
+
+  // Flags. SCMS (Serial Copy Management System) no està en el
+  // subcanal Q i s'ignora.
+  for (;;)
+    {
+      for ( ; *tok && isspace(*tok); ++tok ); // Skip spaces
+      if ( *tok == '\0' ) break;
+      flag= tok;
+      for ( ; *tok && !isspace(*tok); ++tok ); // Find end
+      if ( *tok != '\0' ) *(tok++)= '\0';
+      if ( !strcmp ( flag, "PRE" ) ) track->flags|= CTRL_PRE;
+      else if ( !strcmp ( flag, "DCP" ) ) track->flags|= CTRL_DCP;
+      else if ( !strcmp ( flag, "4CH" ) ) track->flags|= CTRL_4CH;
+      else if ( strcmp ( flag, "SCMS" ) )
+        {
+          CD_msgerror ( err, "FLAGS value unknown: %s", flag );
+          return 1;
+        }
+    }
+  
+  return 0;
+  
+} // end read_flags
+
+
 // Torna 0 si tot ha anat bé, -1 si EOF, 1 en cas d'error.
 static int
 read_command (
               FILE         *f,
-              CD_CUE_Disc  *d,
+              cue_core_t   *d,
               size_t       *st,
               size_t       *se,
               CD_Buffer    *buf,
@@ -548,6 +934,11 @@ read_command (
       tok+= 7;
       return read_pregap ( d, tok, se, err );
     }
+  else if ( !strncmp ( tok, "FLAGS ", 6 ) )
+    {
+      tok+= 6;
+      return read_flags ( d, tok, err );
+    }
   else
     {
       CD_msgerror ( err, "unknown command: %s", tok );
@@ -560,7 +951,7 @@ read_command (
 static bool
 read_content (
               FILE         *f,
-              CD_CUE_Disc  *d,
+              cue_core_t   *d,
               CD_Buffer    *buf,
               const char   *cuefn,
               char        **err
@@ -579,7 +970,7 @@ read_content (
 
   // Llig comandaments.
   while ( (ret= read_command ( f, d, &st, &se, buf, cuefn, err )) == 0 );
-  if ( ret != -1 ) return false;
+  if ( ret != -1 || !finish_binary ( d, err ) ) return false;
 
   /*
   // Print.
@@ -623,7 +1014,7 @@ read_content (
 static bool
 read_cue (
           const char   *fn,
-          CD_CUE_Disc  *d,
+          cue_core_t   *d,
           char        **err
           )
 {
@@ -668,7 +1059,7 @@ read_cue (
 
 static size_t
 calc_total_gap (
-        	const CD_CUE_Disc *d
+        	const cue_core_t  *d
         	)
 {
 
@@ -688,7 +1079,7 @@ calc_total_gap (
 
 static size_t
 calc_files_size (
-        	const CD_CUE_Disc *d
+        	const cue_core_t  *d
         	)
 {
 
@@ -707,7 +1098,7 @@ calc_files_size (
 
 static bool
 check_indexes_in_range (
-                        const CD_CUE_Disc  *d,
+                        const cue_core_t   *d,
                         char              **err
                         )
 {
@@ -730,18 +1121,44 @@ check_indexes_in_range (
 } // end check_indexes_in_range
 
 
+// Afegeix un extent al final del mapa.
+static void
+add_extent (
+            cue_core_t       *d,
+            const size_t      first,
+            const size_t      nsecs,
+            const long        offset,
+            const int         track_id,
+            const uint8_t     index_id,
+            const bin_file_t *file
+            )
+{
+
+  extent_t *ext;
+
+  
+  ext= &(d->exts[d->NX++]);
+  ext->first= first;
+  ext->nsecs= nsecs;
+  ext->offset= offset;
+  ext->track_id= track_id;
+  ext->index_id= index_id;
+  ext->file= file;
+  
+} // end add_extent
+
+
 // També fixa el sector_index01 en track.
 // Torna cert si tot ha anat bé.
 static bool
 create_map_sectors (
-        	    CD_CUE_Disc  *d,
+        	    cue_core_t   *d,
         	    char        **err
         	    )
 {
 
   size_t gap,bin_size;
   size_t n,t,e,end;
-  sec_map_t *maps;
   track_t *track;
   entry_t *entry;
   long offset;
@@ -754,20 +1171,16 @@ create_map_sectors (
   bin_size= calc_files_size ( d );
   if ( !check_indexes_in_range ( d, err ) ) return false;
   
-  // Reserva memòria.
+  // Reserva memòria. Com a màxim un extent per entrada més el pregap
+  // inicial.
   d->N= bin_size + gap;
-  d->maps= maps= mem_alloc ( sec_map_t, d->N );
+  d->exts= mem_alloc ( extent_t, d->NE+1 );
+  d->NX= 0;
 
   // Ompli i reajusta 'entries[n].time'.
   // --> Index 00 Track1 (Pregap 2s)
-  for ( n= 0; n < 2*75; ++n )
-    {
-      maps[n].offset= -1;
-      maps[n].track_id= 0;
-      maps[n].index_id= 0x00;
-      maps[n].file= NULL;
-      maps[n].subq_ptr= -1;
-    }
+  add_extent ( d, 0, 2*75, -1, 0, 0x00, NULL );
+  n= 2*75;
   // Tracks
   gap= 2*75; prev_file= NULL;
   offset= 0; // CALLA !!!!
@@ -789,14 +1202,8 @@ create_map_sectors (
               if ( end <= n ) goto error;
               // Recalculate time and fill
               entry->time= n;
-              for ( ; n != end; ++n )
-        	{
-        	  maps[n].offset= -1;
-        	  maps[n].track_id= t;
-        	  maps[n].index_id= 0x00;
-                  maps[n].file= NULL;
-                  maps[n].subq_ptr= -1;
-        	}
+              add_extent ( d, n, end-n, -1, t, 0x00, NULL );
+              n= end;
               break;
             case INDEX: // Índex
               // Comprovacions d'index, el 0 és opcional
@@ -826,14 +1233,10 @@ create_map_sectors (
               if ( end <= n ) goto error;
               // Recalculate time and fill
               entry->time= n;
-              for ( ; n != end; ++n, offset+= SEC_SIZE )
-        	{
-        	  maps[n].offset= offset;
-        	  maps[n].track_id= t;
-        	  maps[n].index_id= BCD ( entry->id );
-                  maps[n].file= entry->file;
-                  maps[n].subq_ptr= -1;
-        	}
+              add_extent ( d, n, end-n, offset, t,
+                           BCD ( entry->id ), entry->file );
+              offset+= (long) ((end-n)*entry->file->stride);
+              n= end;
               break;
             }
         }
@@ -848,33 +1251,6 @@ create_map_sectors (
 } // end create_map_sectors
 
 
-// Força un seek en el fitxer, torna fals en cas d'error.
-static bool
-force_seek (
-            CD_CUE_Disc *d
-            )
-{
-
-  long coffset;
-  sec_map_t val;
-
-  
-  if ( d->current_sec >= d->N ) return true; // No fa res i no és error.
-  val= d->maps[d->current_sec];
-  if ( val.offset != -1 )
-    {
-      coffset= ftell ( val.file->f );
-      if ( coffset == -1 ) return false;
-      if ( coffset != val.offset &&
-           fseek ( val.file->f, val.offset, SEEK_SET ) != 0 )
-        return false;
-    }
-  
-  return true;
-  
-} // end try_seek
-
-
 static size_t
 mmssff_bcd2long (
                  const uint8_t mm,
@@ -889,40 +1265,76 @@ mmssff_bcd2long (
 } // mmssff_bcd2long
 
 
+// Torna el nom del fitxer LSD associat a CUEFN (s'ha d'alliberar), o
+// NULL si CUEFN no acaba en '.cue'.
+static char *
+get_lsd_fn (
+            const char *cuefn
+            )
+{
+
+  char *ret;
+  int endpos;
+
+  
+  endpos= strlen ( cuefn ) - 1;
+  if ( endpos < 4 || cuefn[endpos-3]!='.' || cuefn[endpos-2]!='c' ||
+       cuefn[endpos-1]!='u' || cuefn[endpos]!='e' )
+    return NULL;
+  ret= mem_alloc ( char, strlen(cuefn)+1 );
+  strcpy ( ret, cuefn );
+  ret[endpos-2]= 'l';
+  ret[endpos-1]= 's';
+  ret[endpos]= 'd';
+  
+  return ret;
+  
+} // end get_lsd_fn
+
+
+static int
+cmp_lsd (
+         const void *a,
+         const void *b
+         )
+{
+
+  const lsd_t *p,*q;
+
+  
+  p= (const lsd_t *) a;
+  q= (const lsd_t *) b;
+  if ( p->sec != q->sec ) return p->sec < q->sec ? -1 : 1;
+  else return p->subq_ptr - q->subq_ptr;
+  
+} // end cmp_lsd
+
+
 // Llig el contingut d'un fitxer LSD si és possible,
 // Torna fals si hi ha algun problema.
 static bool
 try_read_lsd (
-              CD_CUE_Disc  *d,
+              cue_core_t   *d,
               const char   *cuefn,
               char        **err
               )
 {
 
-  int endpos,i;
+  int i;
   char *fname;
   FILE *f;
   long size;
-  uint8_t *mem;
+  uint8_t *subq;
+  lsd_t *lsd;
   size_t sec;
   
 
   // Prepara.
   f= NULL;
-  fname= NULL;
   
   // Get lsd file.
-  // --> Si el nom del fitxer cue no acava en cue no intente llegir el lsd.
-  endpos= strlen ( cuefn ) - 1;
-  if ( endpos < 4 || cuefn[endpos-3]!='.' || cuefn[endpos-2]!='c' ||
-       cuefn[endpos-1]!='u' || cuefn[endpos]!='e' )
-    return true;
-  // --> Crea el fitxer.
-  fname= mem_alloc ( char, strlen(cuefn)+1 );
-  strcpy ( fname, cuefn );
-  fname[endpos-2]= 'l';
-  fname[endpos-1]= 's';
-  fname[endpos]= 'd';
+  fname= get_lsd_fn ( cuefn );
+  if ( fname == NULL ) return true;
   
   // Intenta llegir el fitxer.
   f= fopen ( fname, "rb" );
@@ -937,29 +1349,40 @@ try_read_lsd (
                     fname );
       goto error;
     }
+  if ( size == 0 ) { free ( fname ); fclose ( f ); return true; }
   
   // Reserva memòria.
-  d->subq= mem_alloc ( uint8_t *, size/LSD_ENTRY_SIZE );
-  mem= mem_alloc ( uint8_t, size );
-  for ( i= 0; i < size/LSD_ENTRY_SIZE; ++i, mem+= LSD_ENTRY_SIZE )
-    d->subq[i]= mem;
+  subq= mem_alloc ( uint8_t, size );
+  d->subq= subq;
+  d->NQ= size/LSD_ENTRY_SIZE;
   
   // Llig.
   rewind ( f );
-  if ( fread ( d->subq[0], size, 1, f ) != 1 )
+  if ( fread ( subq, size, 1, f ) != 1 )
     goto error_read;
   
-  // Assigna sectors a mapa.
-  for ( i= 0; i < size/LSD_ENTRY_SIZE; ++i )
+  // Crea la taula de sectors ordenada.
+  lsd= mem_alloc ( lsd_t, size/LSD_ENTRY_SIZE );
+  d->lsd= lsd;
+  for ( i= 0; i < size/LSD_ENTRY_SIZE; ++i, subq+= LSD_ENTRY_SIZE )
     {
-      sec= mmssff_bcd2long ( d->subq[i][0], d->subq[i][1], d->subq[i][2] );
+      sec= mmssff_bcd2long ( subq[0], subq[1], subq[2] );
       if ( sec >= d->N )
         {
           CD_msgerror ( err, "out of range sector in LSD file: '%s'",
                         fname );
           goto error;
         }
-      d->maps[sec].subq_ptr= i;
+      lsd[i].sec= sec;
+      lsd[i].subq_ptr= i;
+    }
+  qsort ( lsd, size/LSD_ENTRY_SIZE, sizeof(lsd_t), cmp_lsd );
+  // --> Si un sector apareix més d'una vegada es queda l'última entrada.
+  d->NL= 0;
+  for ( i= 0; i < size/LSD_ENTRY_SIZE; ++i )
+    {
+      if ( d->NL > 0 && lsd[d->NL-1].sec == lsd[i].sec ) --(d->NL);
+      lsd[d->NL++]= lsd[i];
     }
   
   // Allibera.
@@ -978,169 +1401,684 @@ try_read_lsd (
 } // end try_read_lsd
 
 
-
-
-/***********/
-/* MÈTODES */
-/***********/
-
-static void
-free_ (
-       CD_Disc *d
-       )
+static char *
+get_idx_fn (
+            const char *cuefn
+            )
 {
 
-  bin_file_t *p,*q;
+  char *ret;
 
   
-  if ( CUE(d)->subq != NULL )
-    {
-      free ( CUE(d)->subq[0] );
-      free ( CUE(d)->subq );
-    }
-  if ( CUE(d)->maps != NULL ) free ( CUE(d)->maps );
-  if ( CUE(d)->entries != NULL ) free ( CUE(d)->entries );
-  if ( CUE(d)->tracks != NULL ) free ( CUE(d)->tracks );
-  p= CUE(d)->files;
-  while ( p != NULL )
-    {
-      q= p;
-      p= p->next;
-      fclose ( q->f );
-      free ( q );
-    }
-  free ( d );
+  ret= mem_alloc ( char, strlen(cuefn)+strlen(IDX_EXT)+1 );
+  strcpy ( ret, cuefn );
+  strcat ( ret, IDX_EXT );
   
-} // end free_
+  return ret;
+  
+} // end get_idx_fn
 
 
-static bool
-move_to_session (
-        	 CD_Disc   *d,
-        	 const int  sess
-        	 )
+static size_t
+align8 (
+        const size_t size
+        )
 {
+  return (size+7)&~((size_t) 7);
+} // end align8
 
-  if ( sess != 1 ) return false;
 
-  CUE(d)->current_sec= IGAP; // Primer sector amb contingut primer track.
+// Ompli els camps de validació de la capçalera amb l'estat actual
+// del fitxer CUE i del LSD. Torna fals si no existeix el CUE.
+static bool
+init_idx_header (
+                 idx_header_t *h,
+                 const char   *cuefn
+                 )
+{
 
+  char *lsdfn;
+  long size;
+  int64_t mtime;
+
+  
+  memset ( h, 0, sizeof(*h) );
+  memcpy ( h->magic, IDX_MAGIC, 8 );
+  h->version= IDX_VERSION;
+  h->abi= IDX_ABI;
+  h->endian= IDX_ENDIAN;
+  if ( !CD_file_stat ( cuefn, &size, &mtime ) ) return false;
+  h->cue_size= size;
+  h->cue_mtime= mtime;
+  h->lsd_size= -1;
+  h->lsd_mtime= 0;
+  lsdfn= get_lsd_fn ( cuefn );
+  if ( lsdfn != NULL )
+    {
+      if ( CD_file_stat ( lsdfn, &size, &mtime ) )
+        {
+          h->lsd_size= size;
+          h->lsd_mtime= mtime;
+        }
+      free ( lsdfn );
+    }
+  
   return true;
   
-} // end move_to_session
+} // end init_idx_header
+
+
+static int32_t
+get_file_ind (
+              const cue_core_t *d,
+              const bin_file_t *file
+              )
+{
+
+  const bin_file_t *p;
+  int32_t ret;
+
+
+  if ( file == NULL ) return -1;
+  for ( p= d->files, ret= 0; p != file; p= p->next, ++ret );
+  
+  return ret;
+  
+} // end get_file_ind
 
 
 static bool
-move_to_track (
-               CD_Disc   *d,
-               const int  track
-               )
+write_zeros (
+             FILE         *f,
+             const size_t  n
+             )
 {
 
-  // NOTA!! Busque el primer no gap del track.
+  static const uint8_t ZEROS[8]= {0};
+
   
-  const track_t *tp;
-  size_t e,end;
+  return n==0 || fwrite ( ZEROS, n, 1, f ) == 1;
   
+} // end write_zeros
+
+
+// Desa l'índex de D. H ha d'estar inicialitzat amb init_idx_header
+// abans d'haver llegit el CUE.
+static bool
+write_index (
+             const cue_core_t  *d,
+             idx_header_t      *h,
+             const char        *cuefn,
+             char             **err
+             )
+{
+
+  char *fn,*tmpfn;
+  FILE *f;
+  const bin_file_t *p;
+  idx_file_t file;
+  idx_track_t track;
+  idx_entry_t entry;
+  idx_extent_t ext;
+  long size;
+  size_t n,subq_size;
   
-  if ( track < 1 || (size_t) track > CUE(d)->NT ) return false;
+
+  // Prepara.
+  fn= get_idx_fn ( cuefn );
+  tmpfn= mem_alloc ( char, strlen(fn)+5 );
+  strcpy ( tmpfn, fn );
+  strcat ( tmpfn, ".tmp" );
+  f= fopen ( tmpfn, "wb" );
+  if ( f == NULL ) goto error;
+
+  // Capçalera.
+  for ( p= d->files, h->NF= 0, h->names_size= 0; p != NULL; p= p->next )
+    {
+      ++(h->NF);
+      h->names_size+= strlen ( p->fn ) + 1;
+    }
+  h->NT= d->NT;
+  h->NE= d->NE;
+  h->NX= d->NX;
+  h->N= d->N;
+  h->NL= d->NL;
+  h->NQ= d->NQ;
+  if ( fwrite ( h, sizeof(*h), 1, f ) != 1 ) goto error;
+
+  // Fitxers.
+  for ( p= d->files; p != NULL; p= p->next )
+    {
+      if ( !CD_file_stat ( p->fn, &size, &(file.mtime) ) ) goto error;
+      file.size= size;
+      file.nsecs= (int64_t) p->bin_size;
+      file.type= p->type;
+      file.stride= (int32_t) p->stride;
+      if ( fwrite ( &file, sizeof(file), 1, f ) != 1 ) goto error;
+    }
   
-  tp= &(CUE(d)->tracks[track-1]);
-  end= tp->p + tp->N;
-  for ( e= tp->p; e != end; ++e )
-    if ( CUE(d)->entries[e].type == INDEX )
-      break;
-  if ( e == end ) return false;
-  CUE(d)->current_sec= CUE(d)->entries[e].time;
+  // Tracks i entrades.
+  for ( n= 0; n < d->NT; ++n )
+    {
+      memset ( &track, 0, sizeof(track) );
+      track.type= (int32_t) d->tracks[n].type;
+      track.p= d->tracks[n].p;
+      track.N= d->tracks[n].N;
+      track.flags= d->tracks[n].flags;
+      track.sec_size= d->tracks[n].sec_size;
+      track.sector_index01= d->tracks[n].sector_index01;
+      if ( fwrite ( &track, sizeof(track), 1, f ) != 1 ) goto error;
+    }
+  for ( n= 0; n < d->NE; ++n )
+    {
+      memset ( &entry, 0, sizeof(entry) );
+      entry.type= (int32_t) d->entries[n].type;
+      entry.id= d->entries[n].id;
+      entry.time= d->entries[n].time;
+      entry.file= get_file_ind ( d, d->entries[n].file );
+      if ( fwrite ( &entry, sizeof(entry), 1, f ) != 1 ) goto error;
+    }
+
+  // Mapa de sectors.
+  for ( n= 0; n < d->NX; ++n )
+    {
+      memset ( &ext, 0, sizeof(ext) );
+      ext.first= d->exts[n].first;
+      ext.nsecs= d->exts[n].nsecs;
+      ext.offset= d->exts[n].offset;
+      ext.track_id= d->exts[n].track_id;
+      ext.index_id= d->exts[n].index_id;
+      ext.file= get_file_ind ( d, d->exts[n].file );
+      if ( fwrite ( &ext, sizeof(ext), 1, f ) != 1 ) goto error;
+    }
+
+  // LSD.
+  if ( d->NL > 0 && fwrite ( d->lsd, sizeof(lsd_t), d->NL, f ) != d->NL )
+    goto error;
+  subq_size= d->NQ*LSD_ENTRY_SIZE;
+  if ( subq_size > 0 && fwrite ( d->subq, subq_size, 1, f ) != 1 )
+    goto error;
+  if ( !write_zeros ( f, align8 ( subq_size ) - subq_size ) ) goto error;
+
+  // Noms.
+  for ( p= d->files; p != NULL; p= p->next )
+    if ( fwrite ( p->fn, strlen ( p->fn ) + 1, 1, f ) != 1 )
+      goto error;
 
+  // Reemplaça l'índex anterior.
+  if ( fclose ( f ) != 0 ) { f= NULL; goto error; }
+  f= NULL;
+  if ( rename ( tmpfn, fn ) != 0 ) goto error;
+  free ( tmpfn );
+  free ( fn );
+  
   return true;
+
+ error:
+  CD_msgerror ( err, "cannot write index '%s'", fn );
+  if ( f != NULL ) fclose ( f );
+  remove ( tmpfn );
+  free ( tmpfn );
+  free ( fn );
+  return false;
   
-} // end move_to_track
+} // end write_index
 
 
-static void
-reset (
-       CD_Disc *d
-       )
+// Torna un apuntador a la següent secció de SIZE bytes de l'índex, o
+// NULL si no cap.
+static const uint8_t *
+idx_section (
+             const cue_core_t *d,
+             size_t           *off,
+             const uint64_t    n,
+             const size_t      elem_size
+             )
 {
-  CUE(d)->current_sec= 0;
-} // end reset
 
+  const uint8_t *ret;
+  size_t size;
 
+  
+  if ( n > (d->idx_size - *off)/elem_size ) return NULL;
+  size= (size_t) n*elem_size;
+  ret= d->idx_mem + *off;
+  *off+= align8 ( size );
+  if ( *off > d->idx_size ) *off= d->idx_size; // Última secció.
+  
+  return ret;
+  
+} // end idx_section
+
+
+// Intenta carregar el disc a partir de l'índex binari. Torna fals si
+// no existeix o no es correspon amb els fitxers actuals, en eixe cas
+// D pot estar a mitges i cal descartar-lo.
 static bool
-seek (
-      CD_Disc *d,
-      int      amm,
-      int      ass,
-      int      asect
-      )
+try_read_index (
+                cue_core_t *d,
+                const char *cuefn
+                )
 {
 
-  size_t pos;
+  idx_header_t cur;
+  const idx_header_t *h;
+  const idx_file_t *files;
+  const idx_track_t *tracks;
+  const idx_entry_t *entries;
+  const idx_extent_t *exts;
+  const char *names,*name;
+  const bin_file_t **fptr,*p;
+  char *fn;
+  uint8_t *buf;
+  int fd;
+  long size;
+  int64_t mtime;
+  size_t off,n,nsecs;
+  int32_t i;
+  
+  
+  // Projecta en memòria.
+  fn= get_idx_fn ( cuefn );
+  fd= CD_file_open ( fn, &size );
+  free ( fn );
+  if ( fd == -1 ) return false;
+  if ( size < (long) sizeof(idx_header_t) ) goto error_fd;
+  d->idx_size= (size_t) size;
+  d->idx_mem= CD_file_map ( fd, d->idx_size );
+  d->idx_mapped= d->idx_mem!=NULL;
+  if ( !d->idx_mapped )
+    {
+      buf= mem_alloc ( uint8_t, d->idx_size );
+      d->idx_mem= buf;
+      if ( !CD_read_at ( fd, buf, d->idx_size, 0 ) ) goto error_fd;
+    }
+  CD_file_close ( fd );
+  
+  // Capçalera.
+  h= (const idx_header_t *) d->idx_mem;
+  if ( memcmp ( h->magic, IDX_MAGIC, 8 ) || h->version != IDX_VERSION ||
+       h->abi != IDX_ABI || h->endian != IDX_ENDIAN )
+    return false;
+  if ( !init_idx_header ( &cur, cuefn ) ||
+       cur.cue_size != h->cue_size || cur.cue_mtime != h->cue_mtime ||
+       cur.lsd_size != h->lsd_size ||
+       (cur.lsd_size != -1 && cur.lsd_mtime != h->lsd_mtime) )
+    return false;
+
+  // Seccions.
+  off= sizeof(idx_header_t);
+  files= (const idx_file_t *) idx_section ( d, &off, h->NF,
+                                            sizeof(idx_file_t) );
+  tracks= (const idx_track_t *) idx_section ( d, &off, h->NT,
+                                              sizeof(idx_track_t) );
+  entries= (const idx_entry_t *) idx_section ( d, &off, h->NE,
+                                               sizeof(idx_entry_t) );
+  exts= (const idx_extent_t *) idx_section ( d, &off, h->NX,
+                                             sizeof(idx_extent_t) );
+  d->lsd= (const lsd_t *) idx_section ( d, &off, h->NL, sizeof(lsd_t) );
+  d->subq= idx_section ( d, &off, h->NQ, LSD_ENTRY_SIZE );
+  names= (const char *) idx_section ( d, &off, h->names_size, 1 );
+  if ( files == NULL || tracks == NULL || entries == NULL ||
+       exts == NULL || d->lsd == NULL || d->subq == NULL ||
+       names == NULL || h->NX == 0 ||
+       (h->names_size > 0 && names[h->names_size-1] != '\0') )
+    return false;
+  d->NT= (size_t) h->NT;
+  d->NE= (size_t) h->NE;
+  d->NX= (size_t) h->NX;
+  d->N= (size_t) h->N;
+  d->NL= (size_t) h->NL;
+  d->NQ= (size_t) h->NQ;
+  if ( d->NL == 0 ) d->lsd= NULL;
+  if ( d->NQ == 0 ) d->subq= NULL;
+  
+  // Obri els fitxers. Es desen en l'ordre de la llista, que és
+  // l'invers en què s'han d'obrir.
+  fptr= mem_alloc ( const bin_file_t *, h->NF );
+  for ( i= (int32_t) h->NF-1; i >= 0; --i )
+    {
+      for ( name= names, n= 0; n < (size_t) i; ++n )
+        name+= strlen ( name ) + 1;
+      if ( name >= names + h->names_size ||
+           !CD_file_stat ( name, &size, &mtime ) ||
+           size != files[i].size || mtime != files[i].mtime ||
+           files[i].nsecs < 0 ||
+           files[i].type < FILE_BINARY || files[i].type > FILE_MOTOROLA ||
+           (files[i].stride != SEC_SIZE && files[i].stride != MODE2_SIZE &&
+            files[i].stride != COOKED_SIZE) ||
+           !try_open_binary ( d, name, files[i].nsecs,
+                              (size_t) files[i].stride, files[i].type ) )
+        goto error_fptr;
+      fptr[i]= d->files;
+    }
+  
+  // Tracks, entrades i extents.
+  d->tracks= mem_alloc ( track_t, d->NT );
+  for ( n= 0; n < d->NT; ++n )
+    {
+      if ( tracks[n].type < AUDIO || tracks[n].type > MODE2 ||
+           tracks[n].p < 0 || tracks[n].N < 0 ||
+           (tracks[n].flags&~(CTRL_PRE|CTRL_DCP|CTRL_4CH)) != 0 ||
+           (tracks[n].sec_size != SEC_SIZE &&
+            !(tracks[n].sec_size == MODE2_SIZE && tracks[n].type == MODE2) &&
+            !(tracks[n].sec_size == COOKED_SIZE && tracks[n].type != AUDIO)) ||
+           (size_t) tracks[n].p + (size_t) tracks[n].N > d->NE )
+        goto error_fptr;
+      d->tracks[n].type= tracks[n].type;
+      d->tracks[n].p= tracks[n].p;
+      d->tracks[n].N= tracks[n].N;
+      d->tracks[n].flags= tracks[n].flags;
+      d->tracks[n].sec_size= tracks[n].sec_size;
+      d->tracks[n].sector_index01= (size_t) tracks[n].sector_index01;
+    }
+  d->entries= mem_alloc ( entry_t, d->NE );
+  for ( n= 0; n < d->NE; ++n )
+    {
+      if ( entries[n].type < PREGAP || entries[n].type > INDEX ||
+           entries[n].file < -1 || entries[n].file >= (int32_t) h->NF )
+        goto error_fptr;
+      d->entries[n].type= entries[n].type;
+      d->entries[n].id= entries[n].id;
+      d->entries[n].time= (size_t) entries[n].time;
+      d->entries[n].file= entries[n].file==-1 ? NULL : fptr[entries[n].file];
+    }
+  d->exts= mem_alloc ( extent_t, d->NX );
+  for ( n= 0, nsecs= 0; n < d->NX; ++n )
+    {
+      if ( exts[n].first != nsecs || exts[n].nsecs == 0 ||
+           exts[n].track_id < 0 || (size_t) exts[n].track_id >= d->NT ||
+           exts[n].file < -1 || exts[n].file >= (int32_t) h->NF ||
+           (exts[n].file == -1) != (exts[n].offset == -1) )
+        goto error_fptr;
+      p= exts[n].file==-1 ? NULL : fptr[exts[n].file];
+      if ( p != NULL &&
+           (exts[n].offset < 0 ||
+            (uint64_t) exts[n].offset + exts[n].nsecs*p->stride > p->size ||
+            (size_t) d->tracks[exts[n].track_id].sec_size != p->stride) )
+        goto error_fptr;
+      d->exts[n].first= (size_t) exts[n].first;
+      d->exts[n].nsecs= (size_t) exts[n].nsecs;
+      d->exts[n].offset= (long) exts[n].offset;
+      d->exts[n].track_id= exts[n].track_id;
+      d->exts[n].index_id= (uint8_t) exts[n].index_id;
+      d->exts[n].file= p;
+      nsecs+= d->exts[n].nsecs;
+    }
+  if ( nsecs != d->N ) goto error_fptr;
+  free ( fptr );
 
+  // LSD.
+  for ( n= 0; n < d->NL; ++n )
+    if ( d->lsd[n].sec >= d->N || d->lsd[n].subq_ptr < 0 ||
+         (size_t) d->lsd[n].subq_ptr >= d->NQ ||
+         (n > 0 && d->lsd[n].sec <= d->lsd[n-1].sec) )
+      return false;
+  
+  return true;
 
-  pos= amm*60*75 + ass*75 + asect;
-  if ( pos < 0 || pos >= CUE(d)->N ) return false;
+ error_fptr:
+  free ( fptr );
+  return false;
+ error_fd:
+  CD_file_close ( fd );
+  return false;
+  
+} // end try_read_index
 
-  CUE(d)->current_sec= pos;
-  force_seek ( CUE(d) );
+
+// Torna l'extent que conté el sector SEC (< N). Com les lectures
+// solen ser seqüencials primer es comprova l'últim extent consultat
+// pel cursor i el següent, i si no es fa una cerca binària.
+static const extent_t *
+get_extent (
+            CD_CUE_Disc  *d,
+            const size_t  sec
+            )
+{
+
+  const extent_t *exts;
+  size_t lo,hi,mid;
   
-  return true;
   
-} // end seek
+  exts= d->core->exts;
+  lo= d->current_ext;
+  if ( sec >= exts[lo].first )
+    {
+      if ( sec < exts[lo].first + exts[lo].nsecs ) return &(exts[lo]);
+      if ( lo+1 < d->core->NX && sec < exts[lo+1].first + exts[lo+1].nsecs )
+        {
+          d->current_ext= lo+1;
+          return &(exts[lo+1]);
+        }
+    }
+  
+  // Cerca binària.
+  lo= 0; hi= d->core->NX;
+  while ( hi-lo > 1 )
+    {
+      mid= (lo+hi)/2;
+      if ( exts[mid].first <= sec ) lo= mid;
+      else                          hi= mid;
+    }
+  d->current_ext= lo;
+  
+  return &(exts[lo]);
+  
+} // end get_extent
 
 
+// Torna la posició en la taula subq del sector SEC o -1 si no en té.
 static int
-get_num_sessions (
-        	  CD_Disc *d
-        	  )
+get_subq_ptr (
+              const cue_core_t *d,
+              const size_t      sec
+              )
+{
+
+  size_t lo,hi,mid;
+  
+  
+  lo= 0; hi= d->NL;
+  while ( lo < hi )
+    {
+      mid= (lo+hi)/2;
+      if ( d->lsd[mid].sec == sec ) return d->lsd[mid].subq_ptr;
+      else if ( d->lsd[mid].sec < sec ) lo= mid+1;
+      else hi= mid;
+    }
+  
+  return -1;
+  
+} // end get_subq_ptr
+
+
+// Obté la informació del sector SEC (< N).
+static void
+get_sec_map (
+             CD_CUE_Disc  *d,
+             const size_t  sec,
+             sec_map_t    *val
+             )
 {
-  return 1;
-} // end get_num_sessions
 
+  const extent_t *ext;
 
+  
+  ext= get_extent ( d, sec );
+  val->stride= ext->file!=NULL ? ext->file->stride : SEC_SIZE;
+  val->offset= ext->offset==-1 ?
+    -1 : ext->offset + (long) ((sec-ext->first)*val->stride);
+  val->track_id= ext->track_id;
+  val->index_id= ext->index_id;
+  val->file= ext->file;
+  val->subq_ptr= d->core->NL>0 ? get_subq_ptr ( d->core, sec ) : -1;
+  
+} // end get_sec_map
+
+
+// Llig SIZE bytes de FILE a partir de OFFSET quan no està projectat
+// en memòria.
 static bool
-read (
-      CD_Disc    *d,
-      uint8_t     buf[CD_SEC_SIZE],
-      bool       *audio,
-      const bool  move
-      )
+read_bin (
+          const bin_file_t *file,
+          void             *buf,
+          const size_t      size,
+          const long        offset
+          )
 {
 
-  sec_map_t val;
+  if ( file->ecm != NULL )
+    return CD_ecm_read_at ( file->ecm, buf, size, offset );
+  else if ( file->pcm != NULL )
+    return CD_pcm_read_at ( file->pcm, buf, size, offset );
+  else return CD_read_at ( file->fd, buf, size, offset );
   
+} // end read_bin
+
+
+// Posició dins del sector en cru dels bytes que es desen en el fitxer
+// per als sectors de TRACK.
+static size_t
+raw_offset (
+            const track_t *track
+            )
+{
+
+  switch ( track->sec_size )
+    {
+    case COOKED_SIZE: return track->type==MODE1 ? 0x10 : 0x18;
+    case MODE2_SIZE: return 0x10;
+    default: return 0;
+    }
   
-  if ( CUE(d)->current_sec >= CUE(d)->N ) return false;
+} // end raw_offset
 
-  // Intenta llegir.
-  val= CUE(d)->maps[CUE(d)->current_sec];
-  *audio= CUE(d)->tracks[val.track_id].type==AUDIO;
-  if ( val.offset == -1 )
-    memset ( buf, 0, CD_SEC_SIZE );
+
+// Reconstrueix el sector en cru SEC de TRACK quan el fitxer no el
+// desa sencer. Els bytes del fitxer ja han d'estar en
+// BUF+raw_offset(TRACK). Es generen la sincronització, la capçalera,
+// la subcapçalera (MODE2/2048) i l'EDC/ECC.
+static void
+build_raw_sector (
+                  const track_t *track,
+                  const size_t   sec,
+                  uint8_t        buf[CD_SEC_SIZE]
+                  )
+{
+
+  CD_Position pos;
+
+  
+  if ( track->sec_size == SEC_SIZE ) return;
+  memcpy ( buf, SYNC, sizeof(SYNC) );
+  pos= CD_get_position ( sec );
+  buf[12]= pos.mm;
+  buf[13]= pos.ss;
+  buf[14]= pos.sec;
+  if ( track->type == MODE1 )
+    {
+      buf[15]= 0x01;
+      CD_ecc_mode1 ( buf );
+    }
   else
     {
-      force_seek ( CUE(d) );
-      if ( fread ( buf, CD_SEC_SIZE, 1, val.file->f ) != 1 )
-        return false;
+      buf[15]= 0x02;
+      if ( track->sec_size == COOKED_SIZE )
+        {
+          memcpy ( &buf[16], FORM1_SUBHEADER, sizeof(FORM1_SUBHEADER) );
+          CD_ecc_mode2_form1 ( buf );
+        }
     }
-  if ( move ) ++(CUE(d)->current_sec);
+  
+} // end build_raw_sector
+
+
+// Llig el sector SEC a partir de la seua entrada VAL del mapa.
+static bool
+read_sector_map (
+                 CD_CUE_Disc     *d,
+                 const sec_map_t *val,
+                 const size_t     sec,
+                 uint8_t          buf[CD_SEC_SIZE]
+                 )
+{
+
+  const track_t *track;
+  uint8_t *data;
+  
+  
+  if ( val->offset == -1 )
+    {
+      memset ( buf, 0, CD_SEC_SIZE );
+      return true;
+    }
+  track= &(d->core->tracks[val->track_id]);
+  data= &buf[raw_offset ( track )];
+  if ( val->file->mem != NULL )
+    memcpy ( data, val->file->mem + val->offset, val->stride );
+  else if ( !read_bin ( val->file, data, val->stride, val->offset ) )
+    return false;
+  build_raw_sector ( track, sec, buf );
   
   return true;
   
-} // end read
+} // end read_sector_map
 
 
+// Llig el sector actual sense passar per la lectura anticipada.
 static bool
-read_q (
-        CD_Disc    *d,
-        uint8_t     buf[CD_SUBCH_SIZE],
-        bool       *crc_ok,
-        const bool  move
-        )
+read_sector (
+             CD_CUE_Disc *d,
+             uint8_t      buf[CD_SEC_SIZE],
+             bool        *audio
+             )
 {
 
   sec_map_t val;
+  
+  
+  get_sec_map ( d, d->current_sec, &val );
+  *audio= d->core->tracks[val.track_id].type==AUDIO;
+  
+  return read_sector_map ( d, &val, d->current_sec, buf );
+  
+} // end read_sector
+
+
+// Llig el sector actual. Si la lectura anticipada està activada
+// l'intenta agafar de l'anell i si no està el llig i reinicia la
+// lectura anticipada a partir del següent.
+static bool
+read_sector_ra (
+                CD_CUE_Disc *d,
+                uint8_t      buf[CD_SEC_SIZE],
+                bool        *audio
+                )
+{
+  
+  if ( d->ra == NULL ) return read_sector ( d, buf, audio );
+  if ( CD_readahead_pop ( d->ra, d->current_sec, buf, audio ) ) return true;
+  if ( !read_sector ( d, buf, audio ) ) return false;
+  CD_readahead_restart ( d->ra, d->current_sec+1 );
+  
+  return true;
+  
+} // end read_sector_ra
+
+
+// Omple en BUF el subcanal Q del sector SEC a partir de la seua
+// entrada VAL del mapa.
+static void
+get_q (
+       CD_CUE_Disc     *d,
+       const sec_map_t *val,
+       const size_t     sec,
+       uint8_t          buf[CD_SUBCH_SIZE],
+       bool            *crc_ok
+       )
+{
+
   const track_t *track;
   size_t tmp;
   uint16_t crc;
@@ -1150,22 +2088,19 @@ read_q (
   // CRC ok!!!
   *crc_ok= true;
   
-  if ( CUE(d)->current_sec >= CUE(d)->N ) return false;
-
   // NOTA!!!! No tenim subcanal en CUE així que vaig a assumir que
   // sempre torna ADDR=1 i no és ni LeadIn ni LeadOut.
-  val= CUE(d)->maps[CUE(d)->current_sec];
-  track= &(CUE(d)->tracks[val.track_id]);
+  track= &(d->core->tracks[val->track_id]);
 
   // En el primer byte fiquem els 2 bits de "Sub-channel
   // synchronization field".
   buf[0]= 0x00; // ¿¿????
   
   // Si tenim el mapa de sectors defectuosos gastem eixe.
-  if ( val.subq_ptr != -1 )
+  if ( val->subq_ptr != -1 )
     {
       for ( i= 3; i < LSD_ENTRY_SIZE; ++i )
-        buf[i-2]= CUE(d)->subq[val.subq_ptr][i];
+        buf[i-2]= d->core->subq[val->subq_ptr*LSD_ENTRY_SIZE + i];
       *crc_ok= false;
     }
 
@@ -1177,18 +2112,19 @@ read_q (
       // --> Assumisc ADR 1 in Data region
       buf[1]=
         (0x1) | // ADR
-        (track->type==AUDIO ? 0x00 : 0x40);
+        (track->type==AUDIO ? 0x00 : (CTRL_DATA<<4)) |
+        (track->flags<<4);
       
       // Track and index.
-      buf[2]= BCD ( val.track_id+1 );
-      buf[3]= val.index_id; // Ja està transformat i és 00 per als pregap
+      buf[2]= BCD ( val->track_id+1 );
+      buf[3]= val->index_id; // Ja està transformat i és 00 per als pregap
       
       // Track relative MSF address
-      if ( CUE(d)->current_sec >= track->sector_index01 )
-        tmp= CUE(d)->current_sec - track->sector_index01;
+      if ( sec >= track->sector_index01 )
+        tmp= sec - track->sector_index01;
       else // Distància a track->sector_index01 (estem en un pregap)
         // El -1 està copiat de mednafen.
-        tmp= track->sector_index01 - 1 - CUE(d)->current_sec;
+        tmp= track->sector_index01 - 1 - sec;
       buf[4]= BCD ( tmp/(60*75) ); tmp%= 60*75; // MM
       buf[5]= BCD ( tmp/75 ); tmp%= 75; // SS
       buf[6]= BCD ( tmp ); // FF (encara que serien sectors no
@@ -1198,7 +2134,7 @@ read_q (
       buf[7]= 0x00;
       
       // Absolute MSF address
-      tmp= CUE(d)->current_sec;
+      tmp= sec;
       buf[8]= BCD ( tmp/(60*75) ); tmp%= 60*75; // MM
       buf[9]= BCD ( tmp/75 ); tmp%= 75; // SS
       buf[10]= BCD ( tmp ); // FF
@@ -1209,7 +2145,514 @@ read_q (
       buf[11]= (crc>>8)&0xFF;
       buf[12]= crc&0xFF;
 
-    }
+    }
+  
+} // end get_q
+
+
+// Cal cridar-la cada vegada que es canvia la posició del cursor fora
+// de la lectura seqüencial.
+static void
+update_readahead (
+                  CD_CUE_Disc *d
+                  )
+{
+  if ( d->ra != NULL ) CD_readahead_restart ( d->ra, d->current_sec );
+} // end update_readahead
+
+
+static void
+free_core (
+           cue_core_t *core
+           )
+{
+
+  bin_file_t *p,*q;
+
+  
+  if ( core->idx_mem != NULL )
+    {
+      if ( core->idx_mapped ) CD_file_unmap ( core->idx_mem, core->idx_size );
+      else free ( (void *) core->idx_mem );
+    }
+  else
+    {
+      if ( core->subq != NULL ) free ( (void *) core->subq );
+      if ( core->lsd != NULL ) free ( (void *) core->lsd );
+    }
+  if ( core->exts != NULL ) free ( core->exts );
+  if ( core->entries != NULL ) free ( core->entries );
+  if ( core->tracks != NULL ) free ( core->tracks );
+  p= core->files;
+  while ( p != NULL )
+    {
+      q= p;
+      p= p->next;
+      if ( q->ecm != NULL ) CD_ecm_free ( q->ecm );
+      if ( q->pcm != NULL ) CD_pcm_free ( q->pcm );
+      CD_file_unmap ( q->mem, q->size );
+      CD_file_close ( q->fd );
+      free ( q->fn );
+      free ( q );
+    }
+  free ( core );
+  
+} // end free_core
+
+
+static cue_core_t *
+new_core (void)
+{
+
+  cue_core_t *core;
+
+  
+  core= mem_alloc ( cue_core_t, 1 );
+  atomic_init ( &(core->refs), 1 );
+  core->files= NULL;
+  core->tracks= NULL;
+  core->NT= 0;
+  core->entries= NULL;
+  core->NE= 0;
+  core->exts= NULL;
+  core->NX= 0;
+  core->N= 0;
+  core->lsd= NULL;
+  core->NL= 0;
+  core->subq= NULL;
+  core->NQ= 0;
+  core->idx_mem= NULL;
+  core->idx_size= 0;
+  core->idx_mapped= false;
+
+  return core;
+  
+} // end new_core
+
+
+// Llig el CUE, crea el mapa de sectors i llig el LSD si existeix.
+static bool
+load_cue (
+          cue_core_t  *core,
+          const char  *fn,
+          char       **err
+          )
+{
+
+  // Llig.
+  if ( !read_cue ( fn, core, err ) )
+    return false;
+
+  // Crea el mapa de sectors.
+  if ( !create_map_sectors ( core, err ) )
+    return false;
+
+  // Intenta llegir LSD.
+  if ( !try_read_lsd ( core, fn, err ) )
+    return false;
+
+  return true;
+  
+} // end load_cue
+
+
+// Crea un disc amb una única pista a partir del BIN (o ECM) FN. El
+// tipus de la pista es dedueix del primer sector.
+static bool
+load_bin (
+          cue_core_t  *core,
+          const char  *fn,
+          char       **err
+          )
+{
+
+  uint8_t head[16];
+  const bin_file_t *f;
+  
+
+  // Obri.
+  if ( !try_open_binary ( core, fn, -1, SEC_SIZE, FILE_BINARY ) )
+    {
+      CD_msgerror ( err, "unable to load '%s': invalid BIN/ECM file", fn );
+      return false;
+    }
+  f= core->files;
+  if ( f->bin_size == 0 ) goto error_read;
+  if ( f->mem != NULL ) memcpy ( head, f->mem, sizeof(head) );
+  else if ( !read_bin ( f, head, sizeof(head), 0 ) ) goto error_read;
+
+  // Track i índex.
+  core->tracks= mem_alloc ( track_t, 1 );
+  core->NT= 1;
+  if ( memcmp ( head, SYNC, sizeof(SYNC) ) ) core->tracks[0].type= AUDIO;
+  else core->tracks[0].type= head[15]==0x02 ? MODE2 : MODE1;
+  core->tracks[0].flags= 0;
+  core->tracks[0].sec_size= SEC_SIZE;
+  core->tracks[0].p= 0;
+  core->tracks[0].N= 1;
+  core->entries= mem_alloc ( entry_t, 1 );
+  core->NE= 1;
+  core->entries[0].type= INDEX;
+  core->entries[0].id= 1;
+  core->entries[0].time= 0;
+  core->entries[0].file= f;
+
+  return create_map_sectors ( core, err );
+
+ error_read:
+  CD_msgerror ( err, "unable to load '%s': empty or unreadable", fn );
+  return false;
+  
+} // end load_bin
+
+
+// Inventa en BUF el subcanal Q dels NSECS sectors de EXT a partir de
+// SEC. Com en 'get_q' s'assumeix ADR=1 i que no és ni LeadIn ni
+// LeadOut. Un extent sempre és d'un únic índex, però per si de cas es
+// talla també en l'índex 01.
+static void
+fill_q (
+        CD_CUE_Disc    *d,
+        const extent_t *ext,
+        const size_t    sec,
+        const size_t    nsecs,
+        uint8_t        *buf,
+        bool           *crc_ok
+        )
+{
+
+  const track_t *track;
+  CD_SubQRun run;
+  size_t done,nrun;
+  
+
+  track= &(d->core->tracks[ext->track_id]);
+  run.ctrl=
+    (0x1) | // ADR
+    (track->type==AUDIO ? 0x00 : (CTRL_DATA<<4)) |
+    (track->flags<<4);
+  run.track= BCD ( ext->track_id+1 );
+  run.index= ext->index_id;
+  for ( done= 0; done < nsecs; done+= nrun )
+    {
+      nrun= nsecs-done;
+      run.abs= sec+done;
+      if ( run.abs >= track->sector_index01 )
+        {
+          run.pregap= false;
+          run.rel= run.abs - track->sector_index01;
+        }
+      else
+        {
+          run.pregap= true;
+          run.rel= track->sector_index01 - 1 - run.abs; // Com en 'get_q'.
+          if ( nrun > track->sector_index01-run.abs )
+            nrun= track->sector_index01-run.abs;
+        }
+      CD_subq_fill ( buf + done*CD_SUBCH_SIZE, &run, nrun,
+                     crc_ok!=NULL ? &crc_ok[done] : NULL );
+    }
+  
+} // end fill_q
+
+
+// Sobreescriu en BUF (que comença en el sector FIRST) el subcanal Q
+// dels sectors [FIRST,END) que estan en el fitxer LSD.
+static void
+fill_lsd_q (
+            CD_CUE_Disc  *d,
+            const size_t  first,
+            const size_t  end,
+            uint8_t      *buf,
+            bool         *crc_ok
+            )
+{
+
+  const lsd_t *lsd;
+  size_t lo,hi,mid,i;
+  
+
+  // Primera entrada >= first.
+  lsd= d->core->lsd;
+  lo= 0; hi= d->core->NL;
+  while ( lo < hi )
+    {
+      mid= (lo+hi)/2;
+      if ( lsd[mid].sec < first ) lo= mid+1;
+      else                        hi= mid;
+    }
+  for ( ; lo < d->core->NL && lsd[lo].sec < end; ++lo )
+    {
+      i= lsd[lo].sec-first;
+      memcpy ( buf + i*CD_SUBCH_SIZE + 1,
+               &(d->core->subq[lsd[lo].subq_ptr*LSD_ENTRY_SIZE + 3]),
+               LSD_ENTRY_SIZE-3 );
+      if ( crc_ok != NULL ) crc_ok[i]= false;
+    }
+  
+} // end fill_lsd_q
+
+
+// Llig N sectors a partir de l'actual recorrent el mapa de sectors
+// una única vegada. Si Q no és NULL també s'hi llig el subcanal Q.
+static int
+read_secs (
+           CD_CUE_Disc *d,
+           uint8_t     *buf,
+           uint8_t     *q,
+           bool        *crc_ok,
+           bool        *audio,
+           const int    n,
+           const bool   move
+           )
+{
+
+  const extent_t *ext;
+  const bin_file_t *file;
+  const track_t *track;
+  size_t first,sec,end,run,nrun,nbytes,k,stride,off;
+  long offset;
+  bool is_audio;
+  uint8_t *data;
+  int ret;
+  
+  
+  if ( n < 0 ) return -1;
+  
+  // Rang a llegir.
+  first= sec= d->current_sec;
+  end= sec + (size_t) n;
+  if ( end > d->core->N ) end= d->core->N;
+  if ( sec > end ) first= sec= end;
+  ret= (int) (end-sec);
+
+  // Recorre els extents agrupant els que són consecutius en el mateix
+  // fitxer (o de pregap) per a fer una única còpia/lectura per
+  // tram. Si el fitxer no desa els sectors sencers el tram no canvia
+  // de track, perquè tots els sectors es reconstruïsquen igual.
+  while ( sec < end )
+    {
+
+      // Inici del tram.
+      ext= get_extent ( d, sec );
+      file= ext->file;
+      track= &(d->core->tracks[ext->track_id]);
+      stride= file!=NULL ? file->stride : SEC_SIZE;
+      offset= ext->offset==-1 ?
+        -1 : ext->offset + (long) ((sec-ext->first)*stride);
+      run= 0;
+      do {
+        nrun= ext->first + ext->nsecs - (sec+run);
+        if ( nrun > end-(sec+run) ) nrun= end-(sec+run);
+        if ( audio != NULL )
+          {
+            is_audio= d->core->tracks[ext->track_id].type==AUDIO;
+            for ( k= 0; k < nrun; ++k ) *(audio++)= is_audio;
+          }
+        if ( q != NULL )
+          fill_q ( d, ext, sec+run, nrun, q + (sec+run-first)*CD_SUBCH_SIZE,
+                   crc_ok!=NULL ? &crc_ok[sec+run-first] : NULL );
+        run+= nrun;
+        if ( sec+run == end ) break;
+        ext= get_extent ( d, sec+run );
+      } while ( offset == -1 ?
+                ext->offset == -1 :
+                (ext->file == file &&
+                 ext->offset == offset + (long) (run*stride) &&
+                 (stride == SEC_SIZE ||
+                  &(d->core->tracks[ext->track_id]) == track)) );
+      
+      // Llig. Els sectors incomplets es lligen tots junts al final del
+      // tram i després s'escampen cap avant (el destí de cada sector
+      // mai sobreescriu els que encara no s'han mogut) i es
+      // reconstrueixen.
+      nbytes= run*CD_SEC_SIZE;
+      data= buf + (nbytes - run*stride);
+      if ( offset == -1 ) memset ( buf, 0, nbytes );
+      else if ( file->mem != NULL )
+        memcpy ( data, file->mem + offset, run*stride );
+      else if ( !read_bin ( file, data, run*stride, offset ) )
+        return -1;
+      if ( offset != -1 && stride != SEC_SIZE )
+        {
+          off= raw_offset ( track );
+          for ( k= 0; k < run; ++k )
+            memmove ( &buf[k*CD_SEC_SIZE + off], &data[k*stride], stride );
+          for ( k= 0; k < run; ++k )
+            build_raw_sector ( track, sec+k, &buf[k*CD_SEC_SIZE] );
+        }
+      
+      buf+= nbytes;
+      sec+= run;
+      
+    }
+  if ( q != NULL ) fill_lsd_q ( d, first, end, q, crc_ok );
+  if ( move )
+    {
+      d->current_sec= sec;
+      update_readahead ( d );
+    }
+  
+  return ret;
+  
+} // end read_secs
+
+
+// Crea un nou cursor sobre CORE. No modifica les referències.
+static CD_CUE_Disc *
+new_cursor (
+            cue_core_t *core
+            );
+
+
+
+
+/***********/
+/* MÈTODES */
+/***********/
+
+static void
+free_ (
+       CD_Disc *d
+       )
+{
+
+  // L'últim cursor allibera les dades compartides.
+  if ( CUE(d)->ra != NULL ) CD_readahead_free ( CUE(d)->ra );
+  if ( CUE(d)->io != NULL ) CD_ioengine_free ( CUE(d)->io );
+  if ( atomic_fetch_sub ( &(CORE(d)->refs), 1 ) == 1 )
+    free_core ( CORE(d) );
+  free ( d );
+  
+} // end free_
+
+
+static bool
+move_to_session (
+        	 CD_Disc   *d,
+        	 const int  sess
+        	 )
+{
+
+  if ( sess != 1 ) return false;
+
+  CUE(d)->current_sec= IGAP; // Primer sector amb contingut primer track.
+  update_readahead ( CUE(d) );
+
+  return true;
+  
+} // end move_to_session
+
+
+static bool
+move_to_track (
+               CD_Disc   *d,
+               const int  track
+               )
+{
+
+  // NOTA!! Busque el primer no gap del track.
+  
+  const track_t *tp;
+  size_t e,end;
+  
+  
+  if ( track < 1 || (size_t) track > CORE(d)->NT ) return false;
+  
+  tp= &(CORE(d)->tracks[track-1]);
+  end= tp->p + tp->N;
+  for ( e= tp->p; e != end; ++e )
+    if ( CORE(d)->entries[e].type == INDEX )
+      break;
+  if ( e == end ) return false;
+  CUE(d)->current_sec= CORE(d)->entries[e].time;
+  update_readahead ( CUE(d) );
+
+  return true;
+  
+} // end move_to_track
+
+
+static void
+reset (
+       CD_Disc *d
+       )
+{
+  CUE(d)->current_sec= 0;
+  update_readahead ( CUE(d) );
+} // end reset
+
+
+static bool
+seek (
+      CD_Disc *d,
+      int      amm,
+      int      ass,
+      int      asect
+      )
+{
+
+  size_t pos;
+
+
+  pos= amm*60*75 + ass*75 + asect;
+  if ( pos < 0 || pos >= CORE(d)->N ) return false;
+
+  CUE(d)->current_sec= pos;
+  update_readahead ( CUE(d) );
+  
+  return true;
+  
+} // end seek
+
+
+static int
+get_num_sessions (
+        	  CD_Disc *d
+        	  )
+{
+  return 1;
+} // end get_num_sessions
+
+
+static bool
+read (
+      CD_Disc    *d,
+      uint8_t     buf[CD_SEC_SIZE],
+      bool       *audio,
+      const bool  move
+      )
+{
+
+  if ( CUE(d)->current_sec >= CORE(d)->N ) return false;
+
+  // Intenta llegir.
+  if ( !read_sector_ra ( CUE(d), buf, audio ) ) return false;
+  if ( move ) ++(CUE(d)->current_sec);
+  
+  return true;
+  
+} // end read
+
+
+static bool
+read_q (
+        CD_Disc    *d,
+        uint8_t     buf[CD_SUBCH_SIZE],
+        bool       *crc_ok,
+        const bool  move
+        )
+{
+
+  sec_map_t val;
+  
+
+  // CRC ok!!!
+  *crc_ok= true;
+  
+  if ( CUE(d)->current_sec >= CORE(d)->N ) return false;
+  get_sec_map ( CUE(d), CUE(d)->current_sec, &val );
+  get_q ( CUE(d), &val, CUE(d)->current_sec, buf, crc_ok );
   
   // Mou.
   if ( move ) ++(CUE(d)->current_sec);
@@ -1237,50 +2680,50 @@ get_info (
   // Reserva memòria.
   ret= mem_alloc ( CD_Info, 1 );
   ret->_mem_sessions= sess= mem_alloc ( CD_SessionInfo, 1 );
-  ret->_mem_tracks= tracks= mem_alloc ( CD_TrackInfo, CUE(d)->NT );
-  ret->_mem_indexes= indexes= mem_alloc ( CD_IndexInfo, CUE(d)->NE );
+  ret->_mem_tracks= tracks= mem_alloc ( CD_TrackInfo, CORE(d)->NT );
+  ret->_mem_indexes= indexes= mem_alloc ( CD_IndexInfo, CORE(d)->NE );
   
   // Sesions.
   ret->nsessions= 1;
   ret->sessions= sess;
-  sess[0].ntracks= CUE(d)->NT;
+  sess[0].ntracks= CORE(d)->NT;
   sess[0].tracks= tracks;
 
   // Tracks i entries.
-  ret->ntracks= CUE(d)->NT;
+  ret->ntracks= CORE(d)->NT;
   ret->tracks= tracks;
-  for ( t= 0; t < CUE(d)->NT; ++t )
+  for ( t= 0; t < CORE(d)->NT; ++t )
     {
-      tp= &(CUE(d)->tracks[t]);
+      tp= &(CORE(d)->tracks[t]);
       tracks[t].id= BCD ( t+1 );
       tracks[t].nindexes= tp->N;
       tracks[t].indexes= indexes;
       tracks[t].is_audio= (tp->type == AUDIO);
-      tracks[t].audio_four_channel= false;
-      tracks[t].audio_preemphasis= false;
-      tracks[t].digital_copy_allowed= true; // Per què no?
+      tracks[t].audio_four_channel= (tp->flags&CTRL_4CH)!=0;
+      tracks[t].audio_preemphasis= (tp->flags&CTRL_PRE)!=0;
+      tracks[t].digital_copy_allowed= (tp->flags&CTRL_DCP)!=0;
       if ( t > 0 )
         tracks[t-1].pos_last_sector=
-          CD_get_position ( CUE(d)->entries[tp->p].time - 1 );
+          CD_get_position ( CORE(d)->entries[tp->p].time - 1 );
       for ( e= tp->p; e != (size_t) (tp->p+tp->N); ++e, ++indexes )
         {
-          ep= &(CUE(d)->entries[e]);
+          ep= &(CORE(d)->entries[e]);
           indexes->id= ep->type==INDEX ? BCD ( ep->id ) : 0;
           indexes->pos= CD_get_position ( ep->time );
         }
     }
-  tracks[CUE(d)->NT-1].pos_last_sector= CD_get_position ( CUE(d)->N-1 );
+  tracks[CORE(d)->NT-1].pos_last_sector= CD_get_position ( CORE(d)->N-1 );
 
   // Disk type. (Açò és com un resum)
-  switch ( CUE(d)->tracks[0].type )
+  switch ( CORE(d)->tracks[0].type )
     {
     case AUDIO: ret->type= CD_DISK_TYPE_AUDIO; break;
     case MODE1: ret->type= CD_DISK_TYPE_MODE1; break;
     case MODE2: ret->type= CD_DISK_TYPE_MODE2; break;
     }
-  for ( t= 1; t < CUE(d)->NT; ++t )
+  for ( t= 1; t < CORE(d)->NT; ++t )
     {
-      tp= &(CUE(d)->tracks[t]);
+      tp= &(CORE(d)->tracks[t]);
       if ( ret->type == CD_DISK_TYPE_AUDIO ) // Sols audio
         {
           if ( tp->type != AUDIO )
@@ -1331,8 +2774,9 @@ get_current_track (
         	   )
 {
   return (int)
-    (CUE(d)->current_sec>=CUE(d)->N ?
-     CUE(d)->NT : (size_t) (CUE(d)->maps[CUE(d)->current_sec].track_id + 1));
+    (CUE(d)->current_sec>=CORE(d)->N ?
+     CORE(d)->NT :
+     (size_t) (get_extent ( CUE(d), CUE(d)->current_sec )->track_id + 1));
 } // end get_current_track
 
 
@@ -1341,8 +2785,8 @@ get_current_index (
         	   CD_Disc *d
         	   )
 {
-  return CUE(d)->current_sec>=CUE(d)->N ?
-    0x00 : CUE(d)->maps[CUE(d)->current_sec].index_id;
+  return CUE(d)->current_sec>=CORE(d)->N ?
+    0x00 : get_extent ( CUE(d), CUE(d)->current_sec )->index_id;
 } // end get_current_index
 
 
@@ -1355,6 +2799,7 @@ move_to_leadin (
   fprintf ( stderr, "[WW] lead-in not available in CUE/BIN format,"
             " moving to sector 0 (Track 1)\n" );
   CUE(d)->current_sec= 0;
+  update_readahead ( CUE(d) );
   
   return true;
   
@@ -1370,23 +2815,409 @@ tell (
 } // end tell
 
 
+static const uint8_t *
+read_view (
+           CD_Disc    *d,
+           bool       *audio,
+           const bool  move
+           )
+{
+
+  sec_map_t val;
+  const uint8_t *ret;
+  
+  
+  if ( CUE(d)->current_sec >= CORE(d)->N ) return NULL;
+  
+  // Obté el sector sense còpies si és possible. Amb lectura
+  // anticipada el sector es copia des de l'anell, i si el fitxer no
+  // desa el sector sencer cal reconstruir-lo.
+  get_sec_map ( CUE(d), CUE(d)->current_sec, &val );
+  *audio= CORE(d)->tracks[val.track_id].type==AUDIO;
+  if ( CUE(d)->ra != NULL )
+    {
+      if ( !read_sector_ra ( CUE(d), CUE(d)->sec_buf, audio ) ) return NULL;
+      ret= CUE(d)->sec_buf;
+    }
+  else if ( val.offset == -1 ) ret= ZERO_SEC;
+  else if ( val.file->mem != NULL && val.stride == SEC_SIZE )
+    ret= val.file->mem + val.offset;
+  else
+    {
+      if ( !read_sector ( CUE(d), CUE(d)->sec_buf, audio ) ) return NULL;
+      ret= CUE(d)->sec_buf;
+    }
+  if ( move ) ++(CUE(d)->current_sec);
+  
+  return ret;
+  
+} // end read_view
+
 
+static int
+read_n (
+        CD_Disc    *d,
+        uint8_t    *buf,
+        bool       *audio,
+        const int   n,
+        const bool  move
+        )
+{
+  return read_secs ( CUE(d), buf, NULL, NULL, audio, n, move );
+} // end read_n
 
-/**********************/
-/* FUNCIONS PÚBLIQUES */
-/**********************/
 
-CD_Disc *
-CD_cue_disc_new (
-        	 const char  *fn,
-        	 char       **err // Pot ser NULL
-        	 )
+static CD_Disc *
+clone (
+       CD_Disc *d
+       )
 {
 
   CD_CUE_Disc *new;
 
+  
+  atomic_fetch_add ( &(CORE(d)->refs), 1 );
+  new= new_cursor ( CORE(d) );
+  new->current_sec= CUE(d)->current_sec;
 
-  // Inicialitza.
+  return (CD_Disc *) new;
+  
+} // end clone
+
+
+static bool
+set_readahead (
+               CD_Disc   *d,
+               const int  depth
+               )
+{
+
+  CD_Disc *producer;
+  
+  
+  if ( CUE(d)->ra != NULL )
+    {
+      CD_readahead_free ( CUE(d)->ra );
+      CUE(d)->ra= NULL;
+    }
+  if ( depth <= 0 ) return true;
+
+  // El fil d'E/S llig amb el seu propi cursor.
+  producer= clone ( d );
+  CUE(d)->ra= CD_readahead_new ( producer, depth, CUE(d)->current_sec );
+  if ( CUE(d)->ra == NULL )
+    {
+      CD_disc_free ( producer );
+      return false;
+    }
+  
+  return true;
+  
+} // end set_readahead
+
+
+static void
+get_readahead_stats (
+                     CD_Disc           *d,
+                     CD_ReadAheadStats *stats
+                     )
+{
+
+  if ( CUE(d)->ra != NULL ) CD_readahead_get_stats ( CUE(d)->ra, stats );
+  else stats->hits= stats->misses= 0;
+  
+} // end get_readahead_stats
+
+
+static void
+read_batch_done (
+                 const int  req,
+                 const bool ok,
+                 void      *udata
+                 )
+{
+
+  batch_t *b;
+  CD_SectorReq *r;
+
+  
+  b= (batch_t *) udata;
+  r= &(b->reqs[b->ids[req]]);
+  r->ok= ok;
+  if ( ok && b->tracks[req] != NULL )
+    build_raw_sector ( b->tracks[req], (size_t) r->sec, r->buf );
+  
+} // end read_batch_done
+
+
+static int
+read_batch (
+            CD_Disc      *d,
+            CD_SectorReq *reqs,
+            const int     n
+            )
+{
+
+  CD_IOReq *io;
+  batch_t b;
+  sec_map_t val;
+  const track_t *track;
+  int i,nio,ret;
+  
+
+  if ( n <= 0 ) return 0;
+  if ( CUE(d)->io == NULL ) CUE(d)->io= CD_ioengine_new ( IO_DEPTH );
+  
+  // Prepara les lectures. Els sectors sense fitxer (pregaps) no cal
+  // llegir-los.
+  io= mem_alloc ( CD_IOReq, n );
+  b.reqs= reqs;
+  b.ids= mem_alloc ( int, n );
+  b.tracks= mem_alloc ( const track_t *, n );
+  for ( i= nio= 0; i < n; ++i )
+    {
+      reqs[i].ok= false;
+      reqs[i].audio= false;
+      if ( reqs[i].sec < 0 || (size_t) reqs[i].sec >= CORE(d)->N ) continue;
+      get_sec_map ( CUE(d), (size_t) reqs[i].sec, &val );
+      track= &(CORE(d)->tracks[val.track_id]);
+      reqs[i].audio= track->type==AUDIO;
+      if ( val.offset == -1 )
+        {
+          memset ( reqs[i].buf, 0, CD_SEC_SIZE );
+          reqs[i].ok= true;
+          continue;
+        }
+      // Cal descodificar-lo, no es pot llegir directament.
+      if ( val.file->ecm != NULL || val.file->pcm != NULL )
+        {
+          reqs[i].ok= read_bin ( val.file, &reqs[i].buf[raw_offset ( track )],
+                                 val.stride, val.offset );
+          if ( reqs[i].ok )
+            build_raw_sector ( track, (size_t) reqs[i].sec, reqs[i].buf );
+          continue;
+        }
+      io[nio].fd= val.file->fd;
+      io[nio].offset= val.offset;
+      io[nio].buf= &reqs[i].buf[raw_offset ( track )];
+      io[nio].size= val.stride;
+      b.tracks[nio]= val.stride!=SEC_SIZE ? track : NULL;
+      b.ids[nio++]= i;
+    }
+
+  // Llig.
+  CD_ioengine_read ( CUE(d)->io, io, nio, read_batch_done, &b );
+  free ( b.tracks );
+  free ( b.ids );
+  free ( io );
+  for ( i= ret= 0; i < n; ++i )
+    if ( reqs[i].ok ) ++ret;
+  
+  return ret;
+  
+} // end read_batch
+
+
+static int
+read_q_range (
+              CD_Disc    *d,
+              uint8_t    *buf,
+              bool       *crc_ok,
+              const int   n,
+              const bool  move
+              )
+{
+
+  const extent_t *ext;
+  size_t first,sec,end,nrun;
+  int ret;
+  
+
+  if ( n < 0 ) return -1;
+
+  // Rang.
+  first= CUE(d)->current_sec;
+  end= first + (size_t) n;
+  if ( end > CORE(d)->N ) end= CORE(d)->N;
+  if ( first > end ) first= end;
+  ret= (int) (end-first);
+
+  // Per trams.
+  for ( sec= first; sec < end; sec+= nrun )
+    {
+      ext= get_extent ( CUE(d), sec );
+      nrun= ext->first + ext->nsecs - sec;
+      if ( nrun > end-sec ) nrun= end-sec;
+      fill_q ( CUE(d), ext, sec, nrun, buf + (sec-first)*CD_SUBCH_SIZE,
+               crc_ok!=NULL ? &crc_ok[sec-first] : NULL );
+    }
+  fill_lsd_q ( CUE(d), first, end, buf, crc_ok );
+  
+  if ( move )
+    {
+      CUE(d)->current_sec= end;
+      update_readahead ( CUE(d) );
+    }
+  
+  return ret;
+  
+} // end read_q_range
+
+
+static bool
+read_pw (
+         CD_Disc    *d,
+         uint8_t     buf[CD_SUBPW_SIZE],
+         const bool  move
+         )
+{
+
+  uint8_t q[CD_SUBCH_SIZE];
+  bool crc_ok;
+  
+
+  // No hi ha subcanal desat, es sintetitza a partir del Q.
+  if ( !read_q ( d, q, &crc_ok, move ) ) return false;
+  CD_subq_to_pw ( q, buf );
+  
+  return true;
+  
+} // end read_pw
+
+
+static bool
+read_user_data (
+                CD_Disc    *d,
+                uint8_t     buf[CD_USER_DATA_SIZE],
+                int        *length,
+                const bool  move
+                )
+{
+
+  sec_map_t val;
+  const uint8_t *sec;
+  int offset;
+  uint8_t mode;
+  bool audio;
+  
+  
+  if ( CUE(d)->current_sec >= CORE(d)->N ) return false;
+
+  get_sec_map ( CUE(d), CUE(d)->current_sec, &val );
+  if ( CORE(d)->tracks[val.track_id].type == AUDIO ) return false;
+
+  // Amb lectura anticipada el sector ja està en l'anell.
+  if ( CUE(d)->ra != NULL )
+    {
+      if ( !read_sector_ra ( CUE(d), CUE(d)->sec_buf, &audio ) ) return false;
+      sec= CUE(d)->sec_buf;
+    }
+  else if ( val.offset == -1 ) return false; // Pregap buit (MODE 0).
+
+  // Si el fitxer no desa el sector sencer les dades d'usuari es
+  // copien directament, sense reconstruir-lo. En MODE2/2336 el fitxer
+  // comença per la subcapçalera.
+  else if ( val.stride != SEC_SIZE )
+    {
+      if ( val.file->mem != NULL ) sec= val.file->mem + val.offset;
+      else if ( !read_bin ( val.file, buf, val.stride, val.offset ) )
+        return false;
+      else sec= buf;
+      if ( val.stride == COOKED_SIZE )
+        {
+          *length= COOKED_SIZE;
+          offset= 0;
+        }
+      else
+        {
+          *length= CD_user_data_layout ( 0x02, sec[2], &offset );
+          offset-= 0x10;
+        }
+      memmove ( buf, &sec[offset], (size_t) *length );
+      sec= NULL;
+    }
+  else if ( val.file->mem != NULL ) sec= val.file->mem + val.offset;
+  
+  // Es llig des del byte del mode fins al final de les dades d'usuari,
+  // suposant que el mode és el del track, i després es desplacen les
+  // dades al principi de BUF. Si el mode no és l'esperat es llig el
+  // sector sencer.
+  else
+    {
+      mode= CORE(d)->tracks[val.track_id].type==MODE1 ? 0x01 : 0x02;
+      if ( !read_bin ( val.file, buf, mode==0x01 ? 1+2048 : 1+8+2324,
+                       val.offset+15 ) )
+        return false;
+      if ( buf[0] == mode )
+        {
+          *length= CD_user_data_layout ( mode, buf[3], &offset );
+          memmove ( buf, &buf[offset-15], (size_t) *length );
+          sec= NULL;
+        }
+      else
+        {
+          if ( !read_sector ( CUE(d), CUE(d)->sec_buf, &audio ) ) return false;
+          sec= CUE(d)->sec_buf;
+        }
+    }
+  if ( sec != NULL ) *length= CD_get_user_data ( sec, buf );
+  if ( *length == -1 ) return false;
+  if ( move ) ++(CUE(d)->current_sec);
+  
+  return true;
+  
+} // end read_user_data
+
+
+// Un únic sector (el cas habitual en un emulador) consulta el mapa
+// una sola vegada per a les dades i el subcanal Q, i passa per la
+// lectura anticipada com en 'read'. La resta es llig amb un únic
+// recorregut del mapa.
+static int
+read_with_q (
+             CD_Disc    *d,
+             uint8_t    *buf,
+             uint8_t    *q,
+             bool       *crc_ok,
+             bool       *audio,
+             const int   n,
+             const bool  move
+             )
+{
+
+  sec_map_t val;
+  bool au,ok;
+  
+
+  if ( n != 1 )
+    return read_secs ( CUE(d), buf, q, crc_ok, audio, n, move );
+  if ( CUE(d)->current_sec >= CORE(d)->N ) return 0;
+  get_sec_map ( CUE(d), CUE(d)->current_sec, &val );
+  if ( CUE(d)->ra != NULL )
+    {
+      if ( !read_sector_ra ( CUE(d), buf, &au ) ) return -1;
+    }
+  else if ( !read_sector_map ( CUE(d), &val, CUE(d)->current_sec, buf ) )
+    return -1;
+  if ( audio != NULL ) *audio= CORE(d)->tracks[val.track_id].type==AUDIO;
+  get_q ( CUE(d), &val, CUE(d)->current_sec, q,
+          crc_ok!=NULL ? crc_ok : &ok );
+  if ( move ) ++(CUE(d)->current_sec);
+  
+  return 1;
+  
+} // end read_with_q
+
+
+static CD_CUE_Disc *
+new_cursor (
+            cue_core_t *core
+            )
+{
+
+  CD_CUE_Disc *new;
+
+  
   new= mem_alloc ( CD_CUE_Disc, 1 );
   new->_m.free= free_;
   new->_m.move_to_session= move_to_session;
@@ -1402,29 +3233,106 @@ CD_cue_disc_new (
   new->_m.get_current_index= get_current_index;
   new->_m.move_to_leadin= move_to_leadin;
   new->_m.tell= tell;
-  new->files= NULL;
-  new->tracks= NULL;
-  new->entries= NULL;
-  new->maps= NULL;
+  new->_m.read_view= read_view;
+  new->_m.read_n= read_n;
+  new->_m.clone= clone;
+  new->_m.set_readahead= set_readahead;
+  new->_m.get_readahead_stats= get_readahead_stats;
+  new->_m.read_batch= read_batch;
+  new->_m.read_q_range= read_q_range;
+  new->_m.read_pw= read_pw;
+  new->_m.read_user_data= read_user_data;
+  new->_m.read_with_q= read_with_q;
+  new->core= core;
   new->current_sec= 0;
-  new->subq= NULL;
+  new->current_ext= 0;
+  new->ra= NULL;
+  new->io= NULL;
   
-  // Llig.
-  if ( !read_cue ( fn, new, err ) )
-    goto error;
+  return new;
+  
+} // end new_cursor
 
-  // Crea el mapa de sectors.
-  if ( !create_map_sectors ( new, err ) )
-    goto error;
 
-  // Intenta llegir LSD.
-  if ( !try_read_lsd ( new, fn, err ) )
-    goto error;
-  
-  return (CD_Disc *) new;
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+CD_Disc *
+CD_cue_disc_new (
+        	 const char  *fn,
+        	 char       **err // Pot ser NULL
+        	 )
+{
+
+  cue_core_t *core;
+
+
+  // Primer intenta l'índex binari.
+  core= new_core ();
+  if ( !try_read_index ( core, fn ) )
+    {
+      free_core ( core );
+      core= new_core ();
+      if ( !load_cue ( core, fn, err ) )
+        {
+          free_core ( core );
+          return NULL;
+        }
+    }
   
- error:
-  CD_disc_free ( (CD_Disc *) new );
-  return NULL;
+  return (CD_Disc *) new_cursor ( core );
   
 } // end CD_cue_disc_new
+
+
+CD_Disc *
+CD_cue_bin_disc_new (
+                     const char  *fn,
+                     char       **err
+                     )
+{
+
+  cue_core_t *core;
+
+  
+  core= new_core ();
+  if ( !load_bin ( core, fn, err ) )
+    {
+      free_core ( core );
+      return NULL;
+    }
+  
+  return (CD_Disc *) new_cursor ( core );
+  
+} // end CD_cue_bin_disc_new
+
+
+bool
+CD_cue_write_index (
+                    const char  *fn,
+                    char       **err
+                    )
+{
+
+  cue_core_t *core;
+  idx_header_t h;
+  bool ret;
+  
+  
+  // NOTA!! L'estat dels fitxers es consulta abans de llegir-los, així
+  // si canvien mentrestant l'índex no serà vàlid.
+  if ( !init_idx_header ( &h, fn ) )
+    {
+      CD_msgerror ( err, "cannot open '%s'", fn );
+      return false;
+    }
+  core= new_core ();
+  ret= load_cue ( core, fn, err ) && write_index ( core, &h, fn, err );
+  free_core ( core );
+  
+  return ret;
+  
+} // end CD_cue_write_index
@@ -71,4 +71,20 @@ CD_cue_disc_new (
         	 char       **err // Pot ser NULL
         	 );
 
+// Obri un BIN (o un BIN comprimit amb ECM) sense CUE com un disc amb
+// una única pista, MODE 1, MODE 2 o AUDIO segons el primer sector.
+// Torna NULL en cas d'error.
+CD_Disc *
+CD_cue_bin_disc_new (
+                     const char  *fn,
+                     char       **err // Pot ser NULL
+                     );
+
+// Crea l'índex binari FN.idx que després gasta CD_cue_disc_new.
+bool
+CD_cue_write_index (
+                    const char  *fn,
+                    char       **err // Pot ser NULL
+                    );
+
 #endif // __CD_CUE_H__
@@ -0,0 +1,754 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  deemph.c - Implementació de 'deemph.h'.
+ *
+ */
+/*
+ *  El filtre analògic H(s)=(1+s*T2)/(1+s*T1) es passa a digital amb la
+ *  transformació bilineal:
+ *
+ *    y[n]= B0*x[n] + B1*x[n-1] - A1*y[n-1]
+ *
+ *  La recurrència impedeix calcular molts frames alhora, però es pot
+ *  separar en una part sense dependències, u[n]=B0*x[n]+B1*x[n-1], i
+ *  la recurrència y[n]=u[n]-A1*y[n-1]. Desenvolupant-la, els quatre
+ *  frames d'un bloc depenen sols de y[n-1]:
+ *
+ *    y[n+k]= sum(j=0..k) (-A1)^j*u[n+k-j] + (-A1)^(k+1)*y[n-1]
+ *
+ *  Amb SSE2 cada vector té dos frames (esquerra i dreta intercalats),
+ *  la suma es calcula com un 'scan' i la cadena de dependències entre
+ *  iteracions és una multiplicació i una suma cada quatre frames.
+ */
+
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__SSE2__) && !defined(CD_NO_SSE2)
+#define CD_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "CD.h"
+#include "deemph.h"
+#include "utils.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+// Constants de temps (segons) i freqüència de mostreig.
+#define T1 50e-6
+#define T2 15e-6
+#define FS 44100.0
+
+#define K (2.0*FS)
+#define B0 ((float) ((1.0 + K*T2)/(1.0 + K*T1)))
+#define B1 ((float) ((1.0 - K*T2)/(1.0 + K*T1)))
+#define A1 ((float) ((1.0 - K*T1)/(1.0 + K*T1)))
+
+#define DDISC(DISC) ((CD_DeemphDisc *) (DISC))
+#define INNER(DISC) (DDISC(DISC)->disc)
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+// Sectors d'una pista amb preènfasi.
+typedef struct
+{
+
+  size_t first;
+  size_t last;
+  
+} range_t;
+
+typedef struct
+{
+
+  CD_DISC_CLS;
+
+  CD_Disc   *disc; // Disc embolicat.
+  range_t   *ranges;
+  int        nranges;
+  int        current_range; // Últim rang trobat.
+  bool       pos_ok; // Fals si no es coneix la posició (lead-in).
+  CD_Deemph  st;
+  CD_Deemph  st_prev; // Estat abans de filtrar l'últim sector.
+  size_t     next; // Sector que continua el filtre.
+  bool       filter; // Cert si 'st' és vàlid per a 'next'.
+  uint8_t    sec_buf[CD_SEC_SIZE]; // Per a 'read_view'.
+  
+} CD_DeemphDisc;
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+#ifndef CD_HAVE_SSE2
+static int16_t
+to_sample (
+           const float y
+           )
+{
+
+  float tmp;
+
+
+  tmp= y>=0 ? y+0.5f : y-0.5f;
+  if ( tmp >= 32767.0f ) return 32767;
+  else if ( tmp <= -32768.0f ) return -32768;
+  else return (int16_t) tmp;
+  
+} // end to_sample
+#endif // !CD_HAVE_SSE2
+
+
+static bool
+is_pre (
+        CD_DeemphDisc *d,
+        const size_t   sec
+        )
+{
+
+  const range_t *r;
+  int i;
+
+
+  r= &(d->ranges[d->current_range]);
+  if ( d->nranges > 0 && sec >= r->first && sec <= r->last ) return true;
+  for ( i= 0; i < d->nranges; ++i )
+    if ( sec >= d->ranges[i].first && sec <= d->ranges[i].last )
+      {
+        d->current_range= i;
+        return true;
+      }
+  
+  return false;
+  
+} // end is_pre
+
+
+// Filtra BUF si és un sector d'àudio d'una pista amb preènfasi. Si
+// es torna a llegir l'últim sector filtrat (lectures sense moure) es
+// parteix de l'estat anterior.
+static void
+filter_sec (
+            CD_DeemphDisc *d,
+            const size_t   sec,
+            uint8_t        buf[CD_SEC_SIZE],
+            const bool     audio
+            )
+{
+
+  if ( !audio || !is_pre ( d, sec ) ) { d->filter= false; return; }
+  if ( d->filter && sec+1 == d->next ) d->st= d->st_prev;
+  else if ( !d->filter || sec != d->next ) CD_deemph_reset ( &(d->st) );
+  d->st_prev= d->st;
+  CD_deemph_sector ( &(d->st), buf );
+  d->next= sec+1;
+  d->filter= true;
+  
+} // end filter_sec
+
+
+static size_t
+get_pos (
+         CD_DeemphDisc *d
+         )
+{
+  return CD_get_sec_ind ( CD_disc_tell ( d->disc ) );
+} // end get_pos
+
+
+static CD_DeemphDisc *
+new_deemph_disc (
+                 CD_Disc       *disc,
+                 const range_t *ranges,
+                 const int      nranges
+                 );
+
+
+
+
+/***********/
+/* MÈTODES */
+/***********/
+
+static void
+free_ (
+       CD_Disc *d
+       )
+{
+
+  CD_disc_free ( INNER(d) );
+  free ( DDISC(d)->ranges );
+  free ( d );
+  
+} // end free_
+
+
+static bool
+move_to_session (
+                 CD_Disc   *d,
+                 const int  sess
+                 )
+{
+
+  if ( !CD_disc_move_to_session ( INNER(d), sess ) ) return false;
+  DDISC(d)->pos_ok= true;
+
+  return true;
+  
+} // end move_to_session
+
+
+static bool
+move_to_track (
+               CD_Disc   *d,
+               const int  track
+               )
+{
+
+  if ( !CD_disc_move_to_track ( INNER(d), track ) ) return false;
+  DDISC(d)->pos_ok= true;
+
+  return true;
+  
+} // end move_to_track
+
+
+static void
+reset (
+       CD_Disc *d
+       )
+{
+
+  CD_disc_reset ( INNER(d) );
+  DDISC(d)->pos_ok= true;
+  
+} // end reset
+
+
+static bool
+seek (
+      CD_Disc *d,
+      int      amm,
+      int      ass,
+      int      asect
+      )
+{
+
+  if ( !CD_disc_seek ( INNER(d), amm, ass, asect ) ) return false;
+  DDISC(d)->pos_ok= true;
+  
+  return true;
+  
+} // end seek
+
+
+static int
+get_num_sessions (
+                  CD_Disc *d
+                  )
+{
+  return CD_disc_get_num_sessions ( INNER(d) );
+} // end get_num_sessions
+
+
+static bool
+read (
+      CD_Disc    *d,
+      uint8_t     buf[CD_SEC_SIZE],
+      bool       *audio,
+      const bool  move
+      )
+{
+
+  CD_DeemphDisc *dd;
+  size_t pos;
+
+  
+  dd= DDISC(d);
+  if ( !dd->pos_ok ) return CD_disc_read ( dd->disc, buf, audio, move );
+  pos= get_pos ( dd );
+  if ( !CD_disc_read ( dd->disc, buf, audio, move ) ) return false;
+  filter_sec ( dd, pos, buf, *audio );
+  
+  return true;
+  
+} // end read
+
+
+static bool
+read_q (
+        CD_Disc    *d,
+        uint8_t     buf[CD_SUBCH_SIZE],
+        bool       *crc_ok,
+        const bool  move
+        )
+{
+  return CD_disc_read_q ( INNER(d), buf, crc_ok, move );
+} // end read_q
+
+
+static CD_Info *
+get_info (
+          CD_Disc *d
+          )
+{
+  return CD_disc_get_info ( INNER(d) );
+} // end get_info
+
+
+static int
+get_current_session (
+                     CD_Disc *d
+                     )
+{
+  return CD_disc_get_current_session ( INNER(d) );
+} // end get_current_session
+
+
+static int
+get_current_track (
+                   CD_Disc *d
+                   )
+{
+  return CD_disc_get_current_track ( INNER(d) );
+} // end get_current_track
+
+
+static uint8_t
+get_current_index (
+                   CD_Disc *d
+                   )
+{
+  return CD_disc_get_current_index ( INNER(d) );
+} // end get_current_index
+
+
+static bool
+move_to_leadin (
+                CD_Disc *d
+                )
+{
+
+  if ( !CD_disc_move_to_leadin ( INNER(d) ) ) return false;
+  // NOTA!! Com en la cache, la posició dins del lead-in no té per
+  // què correspondre's amb un sector del disc. Fins al següent
+  // moviment no es filtra res.
+  DDISC(d)->pos_ok= false;
+  DDISC(d)->filter= false;
+  
+  return true;
+  
+} // end move_to_leadin
+
+
+static CD_Position
+tell (
+      CD_Disc *d
+      )
+{
+  return CD_disc_tell ( INNER(d) );
+} // end tell
+
+
+static const uint8_t *
+read_view (
+           CD_Disc    *d,
+           bool       *audio,
+           const bool  move
+           )
+{
+  return read ( d, DDISC(d)->sec_buf, audio, move ) ?
+    DDISC(d)->sec_buf : NULL;
+} // end read_view
+
+
+static int
+read_n (
+        CD_Disc    *d,
+        uint8_t    *buf,
+        bool       *audio,
+        const int   n,
+        const bool  move
+        )
+{
+
+  CD_DeemphDisc *dd;
+  size_t pos;
+  bool *au;
+  int i,ret;
+
+  
+  dd= DDISC(d);
+  if ( !dd->pos_ok || n <= 0 )
+    return CD_disc_read_n ( dd->disc, buf, audio, n, move );
+  
+  // Cal saber quins són d'àudio encara que l'usuari no ho demane.
+  au= audio != NULL ? audio : mem_alloc ( bool, n );
+  pos= get_pos ( dd );
+  ret= CD_disc_read_n ( dd->disc, buf, au, n, move );
+  for ( i= 0; i < ret; ++i )
+    filter_sec ( dd, pos+(size_t) i, buf+(size_t) i*CD_SEC_SIZE, au[i] );
+  if ( au != audio ) free ( au );
+  
+  return ret;
+  
+} // end read_n
+
+
+static CD_Disc *
+clone (
+       CD_Disc *d
+       )
+{
+
+  CD_DeemphDisc *new;
+
+
+  new= new_deemph_disc ( CD_disc_clone ( INNER(d) ),
+                         DDISC(d)->ranges, DDISC(d)->nranges );
+  new->pos_ok= DDISC(d)->pos_ok;
+  
+  return (CD_Disc *) new;
+  
+} // end clone
+
+
+static bool
+set_readahead (
+               CD_Disc   *d,
+               const int  depth
+               )
+{
+  return CD_disc_set_readahead ( INNER(d), depth );
+} // end set_readahead
+
+
+static void
+get_readahead_stats (
+                     CD_Disc           *d,
+                     CD_ReadAheadStats *stats
+                     )
+{
+  CD_disc_get_readahead_stats ( INNER(d), stats );
+} // end get_readahead_stats
+
+
+// Les peticions es filtren en l'ordre de REQS, l'estat sols es manté
+// si són consecutives.
+static int
+read_batch (
+            CD_Disc      *d,
+            CD_SectorReq *reqs,
+            const int     n
+            )
+{
+
+  int i,ret;
+  
+  
+  ret= CD_disc_read_batch ( INNER(d), reqs, n );
+  for ( i= 0; i < n; ++i )
+    if ( reqs[i].ok )
+      filter_sec ( DDISC(d), (size_t) reqs[i].sec,
+                   reqs[i].buf, reqs[i].audio );
+  
+  return ret;
+  
+} // end read_batch
+
+
+static int
+read_q_range (
+              CD_Disc    *d,
+              uint8_t    *buf,
+              bool       *crc_ok,
+              const int   n,
+              const bool  move
+              )
+{
+  return CD_disc_read_q_range ( INNER(d), buf, crc_ok, n, move );
+} // end read_q_range
+
+
+static bool
+read_pw (
+         CD_Disc    *d,
+         uint8_t     buf[CD_SUBPW_SIZE],
+         const bool  move
+         )
+{
+  return CD_disc_read_pw ( INNER(d), buf, move );
+} // end read_pw
+
+
+static bool
+read_user_data (
+                CD_Disc    *d,
+                uint8_t     buf[CD_USER_DATA_SIZE],
+                int        *length,
+                const bool  move
+                )
+{
+  return CD_disc_read_user_data ( INNER(d), buf, length, move );
+} // end read_user_data
+
+
+static int
+read_with_q (
+             CD_Disc    *d,
+             uint8_t    *buf,
+             uint8_t    *q,
+             bool       *crc_ok,
+             bool       *audio,
+             const int   n,
+             const bool  move
+             )
+{
+
+  CD_DeemphDisc *dd;
+  size_t pos;
+  bool *au;
+  int i,ret;
+  
+
+  dd= DDISC(d);
+  if ( !dd->pos_ok || n <= 0 )
+    return CD_disc_read_with_q ( dd->disc, buf, q, crc_ok, audio, n, move );
+  au= audio != NULL ? audio : mem_alloc ( bool, n );
+  pos= get_pos ( dd );
+  ret= CD_disc_read_with_q ( dd->disc, buf, q, crc_ok, au, n, move );
+  for ( i= 0; i < ret; ++i )
+    filter_sec ( dd, pos+(size_t) i, buf+(size_t) i*CD_SEC_SIZE, au[i] );
+  if ( au != audio ) free ( au );
+  
+  return ret;
+  
+} // end read_with_q
+
+
+static CD_DeemphDisc *
+new_deemph_disc (
+                 CD_Disc       *disc,
+                 const range_t *ranges,
+                 const int      nranges
+                 )
+{
+
+  CD_DeemphDisc *new;
+  int i;
+
+
+  new= mem_alloc ( CD_DeemphDisc, 1 );
+  new->disc= disc;
+  new->ranges= mem_alloc ( range_t, nranges>0 ? nranges : 1 );
+  for ( i= 0; i < nranges; ++i )
+    new->ranges[i]= ranges[i];
+  new->nranges= nranges;
+  new->current_range= 0;
+  new->pos_ok= true;
+  new->filter= false;
+  new->_m.free= free_;
+  new->_m.move_to_session= move_to_session;
+  new->_m.move_to_track= move_to_track;
+  new->_m.reset= reset;
+  new->_m.seek= seek;
+  new->_m.get_num_sessions= get_num_sessions;
+  new->_m.read= read;
+  new->_m.read_q= read_q;
+  new->_m.get_info= get_info;
+  new->_m.get_current_session= get_current_session;
+  new->_m.get_current_track= get_current_track;
+  new->_m.get_current_index= get_current_index;
+  new->_m.move_to_leadin= move_to_leadin;
+  new->_m.tell= tell;
+  new->_m.read_view= read_view;
+  new->_m.read_n= read_n;
+  new->_m.clone= clone;
+  new->_m.set_readahead= set_readahead;
+  new->_m.get_readahead_stats= get_readahead_stats;
+  new->_m.read_batch= read_batch;
+  new->_m.read_q_range= read_q_range;
+  new->_m.read_pw= read_pw;
+  new->_m.read_user_data= read_user_data;
+  new->_m.read_with_q= read_with_q;
+  
+  return new;
+  
+} // end new_deemph_disc
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+void
+CD_deemph_reset (
+                 CD_Deemph *st
+                 )
+{
+
+  st->x[0]= st->x[1]= 0.0f;
+  st->y[0]= st->y[1]= 0.0f;
+  
+} // end CD_deemph_reset
+
+
+void
+CD_deemph_sector (
+                  CD_Deemph *st,
+                  uint8_t    buf[CD_SEC_SIZE]
+                  )
+{
+
+#ifdef CD_HAVE_SSE2
+  __m128 b0,b1,na1,ca,cb,xa,xb,ua,ub,p,q,ya,yb;
+  __m128i v,lo,hi;
+  int i;
+  
+
+  // Carrils: [L(n),R(n),L(n+1),R(n+1)].
+  b0= _mm_set1_ps ( B0 );
+  b1= _mm_set1_ps ( B1 );
+  na1= _mm_set1_ps ( -A1 );
+  ca= _mm_setr_ps ( -A1, -A1, A1*A1, A1*A1 );
+  cb= _mm_setr_ps ( -A1*A1*A1, -A1*A1*A1, A1*A1*A1*A1, A1*A1*A1*A1 );
+  p= _mm_setr_ps ( st->x[0], st->x[1], st->x[0], st->x[1] ); // x[n-1]
+  q= _mm_setr_ps ( st->y[0], st->y[1], st->y[0], st->y[1] ); // y[n-1]
+  for ( i= 0; i < CD_SEC_SIZE; i+= 16 )
+    {
+
+      // 4 frames: xa=[x0,x1] i xb=[x2,x3].
+      v= _mm_loadu_si128 ( (const __m128i *) &(buf[i]) );
+      lo= _mm_srai_epi32 ( _mm_unpacklo_epi16 ( v, v ), 16 );
+      hi= _mm_srai_epi32 ( _mm_unpackhi_epi16 ( v, v ), 16 );
+      xa= _mm_cvtepi32_ps ( lo );
+      xb= _mm_cvtepi32_ps ( hi );
+      
+      // Part no recursiva: u[n]= B0*x[n] + B1*x[n-1].
+      ua= _mm_add_ps ( _mm_mul_ps ( b0, xa ),
+                       _mm_mul_ps ( b1, _mm_shuffle_ps ( p, xa,
+                                                         _MM_SHUFFLE(1,0,1,0) ) ) );
+      ub= _mm_add_ps ( _mm_mul_ps ( b0, xb ),
+                       _mm_mul_ps ( b1, _mm_shuffle_ps ( xa, xb,
+                                                         _MM_SHUFFLE(1,0,3,2) ) ) );
+      
+      // Recurrència amb y[n-1]=0: primer dins de cada parella i
+      // després de la primera a la segona.
+      ua= _mm_add_ps ( ua, _mm_mul_ps ( na1,
+                                        _mm_movelh_ps ( _mm_setzero_ps (), ua ) ) );
+      ub= _mm_add_ps ( ub, _mm_mul_ps ( na1,
+                                        _mm_movelh_ps ( _mm_setzero_ps (), ub ) ) );
+      ub= _mm_add_ps ( ub, _mm_mul_ps ( ca,
+                                        _mm_shuffle_ps ( ua, ua,
+                                                         _MM_SHUFFLE(3,2,3,2) ) ) );
+      
+      // Contribució de y[n-1], l'única dependència entre iteracions.
+      ya= _mm_add_ps ( ua, _mm_mul_ps ( ca, q ) );
+      yb= _mm_add_ps ( ub, _mm_mul_ps ( cb, q ) );
+      p= _mm_shuffle_ps ( xb, xb, _MM_SHUFFLE(3,2,3,2) );
+      q= _mm_shuffle_ps ( yb, yb, _MM_SHUFFLE(3,2,3,2) );
+
+      // Desa (amb saturació).
+      v= _mm_packs_epi32 ( _mm_cvtps_epi32 ( ya ), _mm_cvtps_epi32 ( yb ) );
+      _mm_storeu_si128 ( (__m128i *) &(buf[i]), v );
+      
+    }
+  _mm_storel_pi ( (__m64 *) st->x, p );
+  _mm_storel_pi ( (__m64 *) st->y, q );
+  
+#else
+  float x,y;
+  int i,c;
+  uint16_t s;
+
+
+  for ( i= 0; i < CD_SEC_SIZE; i+= 4 )
+    for ( c= 0; c < 2; ++c )
+      {
+        x= (float) (int16_t) (uint16_t)
+          (buf[i+2*c] | (buf[i+2*c+1]<<8));
+        y= B0*x + B1*st->x[c] - A1*st->y[c];
+        st->x[c]= x;
+        st->y[c]= y;
+        s= (uint16_t) to_sample ( y );
+        buf[i+2*c]= (uint8_t) s;
+        buf[i+2*c+1]= (uint8_t) (s>>8);
+      }
+  
+#endif // CD_HAVE_SSE2
+  
+} // end CD_deemph_sector
+
+
+CD_Disc *
+CD_deemph_disc_new (
+                    CD_Disc *disc
+                    )
+{
+
+  CD_DeemphDisc *new;
+  CD_Info *info;
+  const CD_TrackInfo *t;
+  range_t *ranges;
+  size_t first;
+  int i,n;
+  
+
+  // Sectors de cada pista: des del primer índex (o del final de
+  // l'anterior si no en té) fins a l'últim sector.
+  info= CD_disc_get_info ( disc );
+  ranges= mem_alloc ( range_t, info->ntracks>0 ? info->ntracks : 1 );
+  for ( i= n= 0, first= 0; i < info->ntracks; ++i )
+    {
+      t= &(info->tracks[i]);
+      if ( t->nindexes > 0 ) first= CD_get_sec_ind ( t->indexes[0].pos );
+      if ( t->is_audio && t->audio_preemphasis )
+        {
+          ranges[n].first= first;
+          ranges[n++].last= CD_get_sec_ind ( t->pos_last_sector );
+        }
+      first= CD_get_sec_ind ( t->pos_last_sector ) + 1;
+    }
+  CD_info_free ( info );
+  new= new_deemph_disc ( disc, ranges, n );
+  free ( ranges );
+  
+  return (CD_Disc *) new;
+  
+} // end CD_deemph_disc_new
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  deemph.h - Filtre de desènfasi per a l'àudio CD-DA.
+ *
+ */
+/*
+ * NOTA!! Les pistes d'àudio amb el bit de preènfasi (CTRL 0x1) estan
+ * gravades amb les altes freqüències reforçades (constants de temps
+ * de 50 i 15 us). Per a reproduir-les cal aplicar el filtre invers, un
+ * filtre de primer ordre que atenua fins a -10.5 dB les altes
+ * freqüències i deixa intactes les baixes.
+ */
+
+#ifndef __CD_DEEMPH_H__
+#define __CD_DEEMPH_H__
+
+#include <stdint.h>
+
+#include "CD.h"
+
+// Estat del filtre (últim frame d'entrada i d'eixida).
+typedef struct
+{
+
+  float x[2]; // Esquerra i dreta.
+  float y[2];
+  
+} CD_Deemph;
+
+// Buida l'estat. S'ha de cridar cada vegada que l'àudio no és
+// continu (seek, etc.).
+void
+CD_deemph_reset (
+                 CD_Deemph *st
+                 );
+
+// Aplica el filtre sobre els CD_STREAM_FRAMES frames (16 bits estèreo
+// en 'little endian') del sector BUF. En x86 es fa amb SSE2, quatre
+// frames alhora.
+void
+CD_deemph_sector (
+                  CD_Deemph *st,
+                  uint8_t    buf[CD_SEC_SIZE]
+                  );
+
+#endif // __CD_DEEMPH_H__
@@ -0,0 +1,324 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  ecc.c - Implementació de 'ecc.h'.
+ *
+ */
+/*
+ *  Les paritats es calculen sobre GF(2^8) (polinomi 0x11D). Per a no
+ *  encadenar cada byte amb l'anterior, les 86 columnes de P i les 52
+ *  diagonals de Q es calculen alhora fila a fila (la multiplicació
+ *  per 2 es fa sense taules), i el compilador pot vectoritzar els
+ *  bucles interns. Les diagonals de Q es copien primer a una matriu
+ *  on cada pas és una fila contigua. L'EDC es calcula amb 'slice-by-8'.
+ */
+
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "CD.h"
+#include "ecc.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define EDC_POLY 0xD8018001
+
+#define P_OFFSET 0x81C
+#define Q_OFFSET 0x8C8
+
+// P: 86 columnes (43 paraules) de 24 files.
+#define P_COLS 86
+#define P_ROWS 24
+
+// Q: 52 diagonals (26 paraules) de 43 elements. La matriu té 26
+// files de 86 bytes (capçalera, dades, EDC, zona intermèdia i P).
+#define Q_DIAGS 52
+#define Q_LEN   43
+#define Q_ROWS  26
+
+// Amplàries dels vectors de treball, arredonides a 32 bytes perquè
+// els bucles no tinguen cua.
+#define P_WIDTH 96
+#define Q_WIDTH 64
+
+
+
+
+/*********/
+/* ESTAT */
+/*********/
+
+static pthread_once_t _tables_once= PTHREAD_ONCE_INIT;
+static uint8_t _ecc_b[256];
+static uint32_t _edc[8][256];
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static void
+init_tables (void)
+{
+
+  uint32_t i,j,edc;
+
+  
+  for ( i= 0; i < 256; ++i )
+    {
+      j= (i<<1) ^ ((i&0x80) ? 0x11D : 0);
+      _ecc_b[i^j]= (uint8_t) i;
+      edc= i;
+      for ( j= 0; j < 8; ++j )
+        edc= (edc>>1) ^ ((edc&1) ? EDC_POLY : 0);
+      _edc[0][i]= edc;
+    }
+  for ( i= 0; i < 256; ++i )
+    for ( j= 1; j < 8; ++j )
+      _edc[j][i]= (_edc[j-1][i]>>8) ^ _edc[0][_edc[j-1][i]&0xFF];
+  
+} // end init_tables
+
+
+// Multiplica per 2 en GF(2^8).
+static inline uint8_t
+gf_mul2 (
+         const uint8_t x
+         )
+{
+  return (uint8_t) ((x<<1) ^ (((uint8_t) -(x>>7))&0x1D));
+} // end gf_mul2
+
+
+// Acumula una fila de WIDTH bytes en les paritats A i B.
+static inline void
+acc_row (
+         uint8_t       *a,
+         uint8_t       *b,
+         const uint8_t *row,
+         const int      width
+         )
+{
+
+  int i;
+  uint8_t tmp;
+
+  
+  for ( i= 0; i < width; ++i )
+    {
+      tmp= row[i];
+      b[i]^= tmp;
+      a[i]= gf_mul2 ( a[i]^tmp );
+    }
+  
+} // end acc_row
+
+
+// Desa en DST les COUNT parelles de paritats de A i B.
+static void
+store_parity (
+              const uint8_t *a,
+              const uint8_t *b,
+              const int      count,
+              uint8_t       *dst
+              )
+{
+
+  int i;
+  uint8_t tmp;
+
+  
+  for ( i= 0; i < count; ++i )
+    {
+      tmp= _ecc_b[gf_mul2 ( a[i] )^b[i]];
+      dst[i]= tmp;
+      dst[i+count]= tmp^b[i];
+    }
+  
+} // end store_parity
+
+
+// Calcula la paritat P de SRC (a partir de la capçalera). Les
+// columnes que sobren en l'última fila cauen dins del sector.
+static void
+compute_p (
+           const uint8_t *src,
+           uint8_t       *dst
+           )
+{
+
+  uint8_t a[P_WIDTH],b[P_WIDTH];
+  int row;
+
+  
+  memset ( a, 0, sizeof(a) );
+  memset ( b, 0, sizeof(b) );
+  for ( row= 0; row < P_ROWS; ++row )
+    acc_row ( a, b, &src[row*P_COLS], P_WIDTH );
+  store_parity ( a, b, P_COLS, dst );
+  
+} // end compute_p
+
+
+// Calcula la paritat Q de SRC (a partir de la capçalera). L'element K
+// de la diagonal J és la paraula K de la fila (J+K)%26.
+static void
+compute_q (
+           const uint8_t *src,
+           uint8_t       *dst
+           )
+{
+
+  uint8_t diag[Q_LEN][Q_WIDTH],a[Q_WIDTH],b[Q_WIDTH];
+  int k,j,row;
+
+  
+  for ( k= 0; k < Q_LEN; ++k )
+    {
+      for ( j= 0, row= k%Q_ROWS; j < Q_DIAGS/2; ++j )
+        {
+          diag[k][2*j]= src[row*P_COLS + 2*k];
+          diag[k][2*j+1]= src[row*P_COLS + 2*k + 1];
+          if ( ++row == Q_ROWS ) row= 0;
+        }
+      memset ( &diag[k][Q_DIAGS], 0, Q_WIDTH-Q_DIAGS );
+    }
+  memset ( a, 0, sizeof(a) );
+  memset ( b, 0, sizeof(b) );
+  for ( k= 0; k < Q_LEN; ++k )
+    acc_row ( a, b, diag[k], Q_WIDTH );
+  store_parity ( a, b, Q_DIAGS, dst );
+  
+} // end compute_q
+
+
+static void
+write_edc (
+           uint8_t        *dst,
+           const uint32_t  edc
+           )
+{
+
+  dst[0]= (uint8_t) edc;
+  dst[1]= (uint8_t) (edc>>8);
+  dst[2]= (uint8_t) (edc>>16);
+  dst[3]= (uint8_t) (edc>>24);
+  
+} // end write_edc
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+uint32_t
+CD_edc_calc (
+             uint32_t       edc,
+             const uint8_t *data,
+             size_t         size
+             )
+{
+
+  uint32_t lo;
+
+  
+  pthread_once ( &_tables_once, init_tables );
+  for ( ; size >= 8; size-= 8, data+= 8 )
+    {
+      lo= edc ^ ((uint32_t) data[0] | ((uint32_t) data[1]<<8) |
+                 ((uint32_t) data[2]<<16) | ((uint32_t) data[3]<<24));
+      edc=
+        _edc[7][lo&0xFF] ^ _edc[6][(lo>>8)&0xFF] ^
+        _edc[5][(lo>>16)&0xFF] ^ _edc[4][lo>>24] ^
+        _edc[3][data[4]] ^ _edc[2][data[5]] ^
+        _edc[1][data[6]] ^ _edc[0][data[7]];
+    }
+  for ( ; size > 0; --size )
+    edc= (edc>>8) ^ _edc[0][(edc^*(data++))&0xFF];
+  
+  return edc;
+  
+} // end CD_edc_calc
+
+
+void
+CD_ecc_generate (
+                 uint8_t    sec[CD_SEC_SIZE],
+                 const bool zero_address
+                 )
+{
+
+  uint8_t addr[4];
+
+  
+  pthread_once ( &_tables_once, init_tables );
+  memcpy ( addr, &sec[12], 4 );
+  if ( zero_address ) memset ( &sec[12], 0, 4 );
+  compute_p ( &sec[12], &sec[P_OFFSET] );
+  compute_q ( &sec[12], &sec[Q_OFFSET] );
+  if ( zero_address )
+    memcpy ( &sec[12], addr, 4 );
+  
+} // end CD_ecc_generate
+
+
+void
+CD_ecc_mode1 (
+              uint8_t sec[CD_SEC_SIZE]
+              )
+{
+
+  write_edc ( &sec[0x810], CD_edc_calc ( 0, sec, 0x810 ) );
+  memset ( &sec[0x814], 0, 8 );
+  CD_ecc_generate ( sec, false );
+  
+} // end CD_ecc_mode1
+
+
+void
+CD_ecc_mode2_form1 (
+                    uint8_t sec[CD_SEC_SIZE]
+                    )
+{
+  
+  write_edc ( &sec[0x818], CD_edc_calc ( 0, &sec[0x10], 0x808 ) );
+  CD_ecc_generate ( sec, true );
+  
+} // end CD_ecc_mode2_form1
+
+
+void
+CD_ecc_mode2_form2 (
+                    uint8_t sec[CD_SEC_SIZE]
+                    )
+{
+  write_edc ( &sec[0x92C], CD_edc_calc ( 0, &sec[0x10], 0x91C ) );
+} // end CD_ecc_mode2_form2
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  ecc.h - Generació de l'EDC i l'ECC (paritats P i Q) dels sectors
+ *          de dades.
+ *
+ */
+
+#ifndef __CD_ECC_H__
+#define __CD_ECC_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CD.h"
+
+// Calcula l'EDC (CRC-32 del CD-ROM) de SIZE bytes de DATA
+// començant per EDC (0 per al principi).
+uint32_t
+CD_edc_calc (
+             uint32_t       edc,
+             const uint8_t *data,
+             size_t         size
+             );
+
+// Calcula les paritats P i Q (Reed-Solomon) de SEC i les desa en el
+// seu lloc (0x81C..0x92F). Si ZERO_ADDRESS la capçalera es considera
+// a 0, com en els sectors MODE 2 FORM 1.
+void
+CD_ecc_generate (
+                 uint8_t    sec[CD_SEC_SIZE],
+                 const bool zero_address
+                 );
+
+// Completa un sector MODE 1 amb el 'Sync', la capçalera i les dades
+// ja escrites: EDC, zona intermèdia i paritats.
+void
+CD_ecc_mode1 (
+              uint8_t sec[CD_SEC_SIZE]
+              );
+
+// Completa un sector MODE 2 FORM 1 amb la subcapçalera i les dades
+// ja escrites: EDC i paritats.
+void
+CD_ecc_mode2_form1 (
+                    uint8_t sec[CD_SEC_SIZE]
+                    );
+
+// Completa un sector MODE 2 FORM 2 amb la subcapçalera i les dades
+// ja escrites: EDC.
+void
+CD_ecc_mode2_form2 (
+                    uint8_t sec[CD_SEC_SIZE]
+                    );
+
+#endif // __CD_ECC_H__
@@ -0,0 +1,480 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  ecm.c - Implementació de 'ecm.h'.
+ *
+ */
+/*
+ *  Format: "ECM\0" seguit de registres. Cada registre comença amb una
+ *  capçalera de longitud variable (tipus en els 2 bits baixos i
+ *  número d'elements menys 1 en la resta, 7 bits per byte addicional)
+ *  i els elements. Tipus: 0 bytes literals, 1 sectors MODE 1
+ *  (adreça+dades), 2 MODE 2 FORM 1 i 3 MODE 2 FORM 2 (subcapçalera
+ *  + dades, sense sync ni capçalera, que van en registres literals).
+ *  El número 0xFFFFFFFF marca el final, i després ve l'EDC de tot el
+ *  fitxer descodificat, que no es comprova.
+ *
+ *  L'índex té una entrada cada CHECKPOINT registres amb la posició de
+ *  la capçalera i la posició descodificada, de manera que per a
+ *  llegir sols cal recórrer les capçaleres a partir de l'entrada
+ *  anterior. Sols l'índex està protegit pel bloqueig, la
+ *  descodificació es fa fora.
+ */
+
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CD.h"
+#include "ecc.h"
+#include "ecm.h"
+#include "utils.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define MAGIC_SIZE 4
+
+#define HEADER_MAX 5
+
+#define CHECKPOINT 16
+
+#define END_MARK 0xFFFFFFFF
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+enum {
+  REC_RAW= 0,
+  REC_MODE1,
+  REC_MODE2_FORM1,
+  REC_MODE2_FORM2
+};
+
+typedef struct
+{
+
+  int      type;
+  uint64_t count; // Número d'elements.
+  long     data; // Offset del primer element en el fitxer.
+  long     next; // Offset de la capçalera del següent registre.
+  
+} record_t;
+
+typedef struct
+{
+
+  long     in; // Offset de la capçalera en el fitxer.
+  uint64_t out; // Offset descodificat.
+  
+} block_t;
+
+struct CD_ECM_
+{
+
+  int              fd;
+  const uint8_t   *mem; // Fitxer projectat en memòria (NULL si no es pot).
+  long             size;
+  pthread_mutex_t  mutex;
+
+  // Índex.
+  block_t         *index;
+  size_t           nindex;
+  size_t           capacity;
+
+  // Primer registre que no s'ha recorregut.
+  long             next_in;
+  uint64_t         next_out;
+  size_t           nrecords;
+  bool             end; // S'ha arribat a la marca final.
+  bool             error; // Fitxer mal format.
+  
+};
+
+
+
+
+/*************/
+/* CONSTANTS */
+/*************/
+
+static const uint8_t MAGIC[MAGIC_SIZE]= {'E','C','M','\0'};
+
+// Bytes de cada element en el fitxer i descodificats.
+static const long IN_SIZE[4]= {1,0x803,0x804,0x918};
+static const uint64_t OUT_SIZE[4]= {1,CD_SEC_SIZE,0x920,0x920};
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+// Torna un punter a SIZE bytes del fitxer a partir de OFFSET, que
+// poden acabar en TMP si no està projectat. Torna NULL en cas d'error.
+static const uint8_t *
+get_bytes (
+           const CD_ECM *ecm,
+           const long    offset,
+           const size_t  size,
+           uint8_t      *tmp
+           )
+{
+
+  if ( offset < 0 || offset + (long) size > ecm->size ) return NULL;
+  if ( ecm->mem != NULL ) return ecm->mem + offset;
+  if ( !CD_read_at ( ecm->fd, tmp, size, offset ) ) return NULL;
+  
+  return tmp;
+  
+} // end get_bytes
+
+
+// Llig la capçalera del registre que comença en IN. Torna 1 si tot ha
+// anat bé, 0 si és la marca final i -1 en cas d'error.
+static int
+read_record (
+             const CD_ECM *ecm,
+             const long    in,
+             record_t     *rec
+             )
+{
+
+  uint8_t tmp[HEADER_MAX];
+  const uint8_t *p;
+  uint64_t num;
+  size_t n,i;
+  int bits;
+  
+
+  n= ecm->size-in < HEADER_MAX ? (size_t) (ecm->size-in) : HEADER_MAX;
+  if ( in >= ecm->size || (p= get_bytes ( ecm, in, n, tmp )) == NULL )
+    return -1;
+  rec->type= p[0]&0x3;
+  num= (p[0]>>2)&0x1F;
+  for ( i= 0, bits= 5; p[i]&0x80; bits+= 7 )
+    {
+      if ( ++i == n ) return -1;
+      num|= ((uint64_t) (p[i]&0x7F))<<bits;
+    }
+  if ( num > END_MARK ) return -1;
+  if ( num == END_MARK ) return 0;
+  rec->count= num+1;
+  rec->data= in + (long) (i+1);
+  rec->next= rec->data + (long) rec->count*IN_SIZE[rec->type];
+  if ( rec->next > ecm->size ) return -1;
+  
+  return 1;
+  
+} // end read_record
+
+
+// Recorre registres fins que la part coneguda inclou OFFSET o s'arriba
+// al final. Cal tindre el bloqueig.
+static void
+extend_index (
+              CD_ECM         *ecm,
+              const uint64_t  offset
+              )
+{
+
+  record_t rec;
+  int ret;
+
+  
+  while ( !ecm->end && !ecm->error && ecm->next_out <= offset )
+    {
+      ret= read_record ( ecm, ecm->next_in, &rec );
+      if ( ret == -1 ) { ecm->error= true; break; }
+      else if ( ret == 0 ) { ecm->end= true; break; }
+      if ( ecm->nrecords%CHECKPOINT == 0 )
+        {
+          if ( ecm->nindex == ecm->capacity )
+            {
+              ecm->capacity*= 2;
+              ecm->index= mem_realloc ( block_t, ecm->index, ecm->capacity );
+            }
+          ecm->index[ecm->nindex].in= ecm->next_in;
+          ecm->index[ecm->nindex].out= ecm->next_out;
+          ++(ecm->nindex);
+        }
+      ++(ecm->nrecords);
+      ecm->next_in= rec.next;
+      ecm->next_out+= rec.count*OUT_SIZE[rec.type];
+    }
+  
+} // end extend_index
+
+
+// Torna l'última entrada de l'índex anterior a OFFSET (que ha d'estar
+// dins de la part coneguda). Cal tindre el bloqueig.
+static block_t
+find_block (
+            const CD_ECM   *ecm,
+            const uint64_t  offset
+            )
+{
+
+  size_t l,r,m;
+
+  
+  l= 0; r= ecm->nindex;
+  while ( r-l > 1 )
+    {
+      m= (l+r)/2;
+      if ( ecm->index[m].out <= offset ) l= m;
+      else r= m;
+    }
+  
+  return ecm->index[l];
+  
+} // end find_block
+
+
+// Reconstrueix en SEC l'element N del registre REC (no literal) i
+// torna on comencen les dades descodificades.
+static const uint8_t *
+decode_sector (
+               const CD_ECM   *ecm,
+               const record_t *rec,
+               const uint64_t  n,
+               uint8_t         sec[CD_SEC_SIZE]
+               )
+{
+
+  uint8_t tmp[0x918];
+  const uint8_t *p;
+  long size;
+  
+
+  size= IN_SIZE[rec->type];
+  p= get_bytes ( ecm, rec->data + (long) n*size, (size_t) size, tmp );
+  if ( p == NULL ) return NULL;
+  switch ( rec->type )
+    {
+    case REC_MODE1:
+      sec[0]= 0x00;
+      memset ( &sec[1], 0xFF, 10 );
+      sec[11]= 0x00;
+      memcpy ( &sec[0x0C], p, 3 );
+      sec[0x0F]= 0x01;
+      memcpy ( &sec[0x10], &p[3], 0x800 );
+      CD_ecc_mode1 ( sec );
+      return sec;
+    case REC_MODE2_FORM1:
+      memcpy ( &sec[0x14], p, 0x804 );
+      memcpy ( &sec[0x10], &sec[0x14], 4 );
+      CD_ecc_mode2_form1 ( sec );
+      return &sec[0x10];
+    default:
+      memcpy ( &sec[0x14], p, 0x918 );
+      memcpy ( &sec[0x10], &sec[0x14], 4 );
+      CD_ecc_mode2_form2 ( sec );
+      return &sec[0x10];
+    }
+  
+} // end decode_sector
+
+
+// Copia en DST SIZE bytes de REC a partir de SKIP bytes descodificats.
+static bool
+decode_record (
+               const CD_ECM   *ecm,
+               const record_t *rec,
+               uint64_t        skip,
+               uint8_t        *dst,
+               size_t          size
+               )
+{
+
+  uint8_t sec[CD_SEC_SIZE];
+  const uint8_t *p;
+  uint64_t n,off;
+  size_t nbytes;
+
+  
+  // Literal.
+  if ( rec->type == REC_RAW )
+    {
+      if ( ecm->mem != NULL )
+        {
+          memcpy ( dst, ecm->mem + rec->data + (long) skip, size );
+          return true;
+        }
+      return CD_read_at ( ecm->fd, dst, size, rec->data + (long) skip );
+    }
+
+  // Sectors.
+  n= skip/OUT_SIZE[rec->type];
+  off= skip%OUT_SIZE[rec->type];
+  for ( ; size > 0; ++n, off= 0 )
+    {
+      p= decode_sector ( ecm, rec, n, sec );
+      if ( p == NULL ) return false;
+      nbytes= (size_t) (OUT_SIZE[rec->type]-off);
+      if ( nbytes > size ) nbytes= size;
+      memcpy ( dst, p + off, nbytes );
+      dst+= nbytes;
+      size-= nbytes;
+    }
+
+  return true;
+  
+} // end decode_record
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+CD_ECM *
+CD_ecm_new (
+            const int  fd,
+            const long size
+            )
+{
+
+  CD_ECM *new;
+  uint8_t magic[MAGIC_SIZE];
+  
+
+  if ( size < MAGIC_SIZE || !CD_read_at ( fd, magic, MAGIC_SIZE, 0 ) ||
+       memcmp ( magic, MAGIC, MAGIC_SIZE ) )
+    return NULL;
+  new= mem_alloc ( CD_ECM, 1 );
+  new->fd= fd;
+  new->size= size;
+  new->mem= CD_file_map ( fd, (size_t) size );
+  pthread_mutex_init ( &(new->mutex), NULL );
+  new->capacity= 64;
+  new->index= mem_alloc ( block_t, new->capacity );
+  new->nindex= 0;
+  new->next_in= MAGIC_SIZE;
+  new->next_out= 0;
+  new->nrecords= 0;
+  new->end= false;
+  new->error= false;
+  
+  return new;
+  
+} // end CD_ecm_new
+
+
+void
+CD_ecm_free (
+             CD_ECM *ecm
+             )
+{
+
+  CD_file_unmap ( ecm->mem, (size_t) ecm->size );
+  pthread_mutex_destroy ( &(ecm->mutex) );
+  free ( ecm->index );
+  free ( ecm );
+  
+} // end CD_ecm_free
+
+
+bool
+CD_ecm_get_size (
+                 CD_ECM *ecm,
+                 size_t *size
+                 )
+{
+
+  bool ret;
+
+  
+  pthread_mutex_lock ( &(ecm->mutex) );
+  extend_index ( ecm, UINT64_MAX );
+  ret= ecm->end;
+  *size= (size_t) ecm->next_out;
+  pthread_mutex_unlock ( &(ecm->mutex) );
+  
+  return ret;
+  
+} // end CD_ecm_get_size
+
+
+bool
+CD_ecm_read_at (
+                CD_ECM       *ecm,
+                void         *buf,
+                const size_t  size,
+                const long    offset
+                )
+{
+
+  block_t b;
+  record_t rec;
+  uint64_t pos,end,rec_size;
+  uint8_t *p;
+  size_t n;
+  
+
+  if ( size == 0 ) return true;
+  if ( offset < 0 ) return false;
+  
+  // Busca en l'índex.
+  pos= (uint64_t) offset;
+  end= pos + size;
+  pthread_mutex_lock ( &(ecm->mutex) );
+  extend_index ( ecm, end-1 );
+  if ( end > ecm->next_out )
+    {
+      pthread_mutex_unlock ( &(ecm->mutex) );
+      return false;
+    }
+  b= find_block ( ecm, pos );
+  pthread_mutex_unlock ( &(ecm->mutex) );
+
+  // Descodifica.
+  p= (uint8_t *) buf;
+  while ( pos < end )
+    {
+      if ( read_record ( ecm, b.in, &rec ) != 1 ) return false;
+      rec_size= rec.count*OUT_SIZE[rec.type];
+      if ( pos < b.out + rec_size )
+        {
+          n= (size_t) (b.out + rec_size - pos);
+          if ( n > end-pos ) n= (size_t) (end-pos);
+          if ( !decode_record ( ecm, &rec, pos-b.out, p, n ) ) return false;
+          p+= n;
+          pos+= n;
+        }
+      b.in= rec.next;
+      b.out+= rec_size;
+    }
+  
+  return true;
+  
+} // end CD_ecm_read_at
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  ecm.h - Lectura de fitxers ECM (Error Code Modeler).
+ *
+ */
+/*
+ * NOTA!! Un fitxer ECM és un BIN on els camps que es poden calcular
+ * (sync, EDC i ECC) s'han eliminat. Es descodifica sota demanda, i
+ * per a no haver de començar des del principi es va construint un
+ * índex dels registres a mesura que es recorre el fitxer. Un mateix
+ * CD_ECM es pot gastar des de diversos fils.
+ */
+
+#ifndef __CD_ECM_H__
+#define __CD_ECM_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct CD_ECM_ CD_ECM;
+
+// Crea un lector per al fitxer obert FD de SIZE bytes. Torna NULL si
+// no és un fitxer ECM. El descriptor no passa a ser propietat del
+// lector, però ha d'estar obert mentre s'utilitze.
+CD_ECM *
+CD_ecm_new (
+            const int  fd,
+            const long size
+            );
+
+void
+CD_ecm_free (
+             CD_ECM *ecm
+             );
+
+// Desa en SIZE la grandària en bytes del fitxer descodificat. Cal
+// recórrer tots els registres (però no descodificar-los). Torna fals
+// si el fitxer està mal format.
+bool
+CD_ecm_get_size (
+                 CD_ECM *ecm,
+                 size_t *size
+                 );
+
+// Com CD_read_at però sobre el fitxer descodificat.
+bool
+CD_ecm_read_at (
+                CD_ECM       *ecm,
+                void         *buf,
+                const size_t  size,
+                const long    offset
+                );
+
+#endif // __CD_ECM_H__
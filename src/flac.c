@@ -0,0 +1,631 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  flac.c - Implementació de 'flac.h'.
+ *
+ */
+/*
+ *  Segueix la descripció del format de RFC 9639. Els canals laterals
+ *  ('side') de 32 bits necessitarien 33 bits i no estan suportats.
+ */
+
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CD.h"
+#include "flac.h"
+#include "utils.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define SYNC 0x3FFE
+
+#define MAX_LPC_ORDER 32
+#define MAX_FIXED_ORDER 4
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+// Lector de bits (primer el bit més significatiu).
+typedef struct
+{
+
+  const uint8_t *buf;
+  size_t         size; // Bytes.
+  size_t         pos; // Bits.
+  bool           error; // S'ha intentat llegir fora del buffer.
+  
+} bits_t;
+
+// Assignació de canals.
+enum {
+  CH_INDEPENDENT,
+  CH_LEFT_SIDE,
+  CH_SIDE_RIGHT,
+  CH_MID_SIDE
+};
+
+
+
+
+/*************/
+/* CONSTANTS */
+/*************/
+
+static const int SAMPLE_RATES[12]=
+  {
+    0, 88200, 176400, 192000, 8000, 16000,
+    22050, 24000, 32000, 44100, 48000, 96000
+  };
+
+static const int SAMPLE_SIZES[8]= { 0, 8, 12, -1, 16, 20, 24, 32 };
+
+
+
+
+/*********/
+/* ESTAT */
+/*********/
+
+static pthread_once_t _tables_once= PTHREAD_ONCE_INIT;
+static uint8_t _crc8[256];
+static uint16_t _crc16[256];
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static void
+init_tables (void)
+{
+
+  int i,j;
+  uint8_t c8;
+  uint16_t c16;
+  
+  
+  for ( i= 0; i < 256; ++i )
+    {
+      c8= (uint8_t) i;
+      c16= (uint16_t) (i<<8);
+      for ( j= 0; j < 8; ++j )
+        {
+          c8= (c8&0x80) ? (uint8_t) ((c8<<1)^0x07) : (uint8_t) (c8<<1);
+          c16= (c16&0x8000) ?
+            (uint16_t) ((c16<<1)^0x8005) : (uint16_t) (c16<<1);
+        }
+      _crc8[i]= c8;
+      _crc16[i]= c16;
+    }
+  
+} // end init_tables
+
+
+static uint8_t
+crc8 (
+      const uint8_t *buf,
+      const size_t   size
+      )
+{
+
+  size_t i;
+  uint8_t ret;
+
+  
+  for ( ret= 0, i= 0; i < size; ++i )
+    ret= _crc8[ret^buf[i]];
+  
+  return ret;
+  
+} // end crc8
+
+
+static uint16_t
+crc16 (
+       const uint8_t *buf,
+       const size_t   size
+       )
+{
+
+  size_t i;
+  uint16_t ret;
+
+  
+  for ( ret= 0, i= 0; i < size; ++i )
+    ret= (uint16_t) ((ret<<8) ^ _crc16[(ret>>8)^buf[i]]);
+  
+  return ret;
+  
+} // end crc16
+
+
+// Llig N bits (0..32) sense signe.
+static uint32_t
+read_bits (
+           bits_t    *b,
+           const int  n
+           )
+{
+
+  uint64_t v;
+  size_t byte;
+  int off,nbytes,i;
+
+  
+  if ( n == 0 ) return 0;
+  if ( b->pos + (size_t) n > b->size*8 )
+    {
+      b->error= true;
+      return 0;
+    }
+  byte= b->pos>>3;
+  off= (int) (b->pos&7);
+  nbytes= (off+n+7)>>3;
+  for ( v= 0, i= 0; i < nbytes; ++i )
+    v= (v<<8) | b->buf[byte+i];
+  v>>= nbytes*8 - off - n;
+  b->pos+= (size_t) n;
+  
+  return (uint32_t) (v & ((((uint64_t) 1)<<n)-1));
+  
+} // end read_bits
+
+
+// Llig N bits (0..32) amb signe.
+static int32_t
+read_sbits (
+            bits_t    *b,
+            const int  n
+            )
+{
+
+  uint32_t v;
+
+  
+  if ( n == 0 ) return 0;
+  v= read_bits ( b, n );
+  if ( n < 32 && (v&(1u<<(n-1))) ) v|= ~((1u<<n)-1);
+  
+  return (int32_t) v;
+  
+} // end read_sbits
+
+
+// Llig un número en unari (zeros acabats en un 1).
+static uint32_t
+read_unary (
+            bits_t *b
+            )
+{
+
+  uint32_t ret;
+  unsigned int byte;
+  int off;
+  
+
+  ret= 0;
+  for (;;)
+    {
+      if ( b->pos >= b->size*8 || ret > (1u<<24) )
+        {
+          b->error= true;
+          return 0;
+        }
+      off= (int) (b->pos&7);
+      byte= (b->buf[b->pos>>3]<<off)&0xFF;
+      if ( byte != 0 )
+        {
+          off= __builtin_clz ( byte ) - 24;
+          b->pos+= (size_t) off + 1;
+          return ret + (uint32_t) off;
+        }
+      ret+= (uint32_t) (8-off);
+      b->pos+= (size_t) (8-off);
+    }
+  
+} // end read_unary
+
+
+// Llig el residu de la predicció d'ordre ORDER en OUT[ORDER..].
+static bool
+read_residual (
+               bits_t        *b,
+               const int      block_size,
+               const int      order,
+               int32_t       *out
+               )
+{
+
+  int method,porder,nparts,p,n,i,param,escape,nbits;
+  uint32_t v;
+  
+  
+  method= (int) read_bits ( b, 2 );
+  if ( method > 1 ) return false;
+  nbits= method==0 ? 4 : 5;
+  escape= method==0 ? 15 : 31;
+  porder= (int) read_bits ( b, 4 );
+  nparts= 1<<porder;
+  if ( (block_size>>porder)<<porder != block_size ||
+       (block_size>>porder) < order )
+    return false;
+  out+= order;
+  for ( p= 0; p < nparts; ++p )
+    {
+      n= (block_size>>porder) - (p==0 ? order : 0);
+      param= (int) read_bits ( b, nbits );
+      if ( param == escape )
+        {
+          param= (int) read_bits ( b, 5 );
+          for ( i= 0; i < n; ++i )
+            *(out++)= read_sbits ( b, param );
+        }
+      else
+        for ( i= 0; i < n; ++i )
+          {
+            v= (read_unary ( b )<<param) | read_bits ( b, param );
+            *(out++)= (int32_t) (v>>1) ^ -(int32_t) (v&1);
+          }
+      if ( b->error ) return false;
+    }
+  
+  return true;
+  
+} // end read_residual
+
+
+static bool
+decode_fixed (
+              bits_t    *b,
+              const int  block_size,
+              const int  bps,
+              const int  order,
+              int32_t   *out
+              )
+{
+
+  int i;
+  
+
+  if ( order > block_size ) return false;
+  for ( i= 0; i < order; ++i )
+    out[i]= read_sbits ( b, bps );
+  if ( !read_residual ( b, block_size, order, out ) ) return false;
+  switch ( order )
+    {
+    case 1:
+      for ( i= 1; i < block_size; ++i ) out[i]+= out[i-1];
+      break;
+    case 2:
+      for ( i= 2; i < block_size; ++i )
+        out[i]+= 2*out[i-1] - out[i-2];
+      break;
+    case 3:
+      for ( i= 3; i < block_size; ++i )
+        out[i]+= 3*out[i-1] - 3*out[i-2] + out[i-3];
+      break;
+    case 4:
+      for ( i= 4; i < block_size; ++i )
+        out[i]+= 4*out[i-1] - 6*out[i-2] + 4*out[i-3] - out[i-4];
+      break;
+    default: break;
+    }
+  
+  return true;
+  
+} // end decode_fixed
+
+
+static bool
+decode_lpc (
+            bits_t    *b,
+            const int  block_size,
+            const int  bps,
+            const int  order,
+            int32_t   *out
+            )
+{
+
+  int32_t coefs[MAX_LPC_ORDER];
+  int i,j,precision,shift;
+  int64_t sum;
+  
+
+  if ( order > block_size ) return false;
+  for ( i= 0; i < order; ++i )
+    out[i]= read_sbits ( b, bps );
+  precision= (int) read_bits ( b, 4 );
+  if ( precision == 15 ) return false;
+  ++precision;
+  shift= read_sbits ( b, 5 );
+  if ( shift < 0 ) return false;
+  for ( i= 0; i < order; ++i )
+    coefs[i]= read_sbits ( b, precision );
+  if ( !read_residual ( b, block_size, order, out ) ) return false;
+  for ( i= order; i < block_size; ++i )
+    {
+      sum= 0;
+      for ( j= 0; j < order; ++j )
+        sum+= (int64_t) coefs[j] * out[i-j-1];
+      out[i]+= (int32_t) (sum>>shift);
+    }
+  
+  return true;
+  
+} // end decode_lpc
+
+
+static bool
+decode_subframe (
+                 bits_t    *b,
+                 const int  block_size,
+                 int        bps,
+                 int32_t   *out
+                 )
+{
+
+  int type,wasted,i;
+  int32_t v;
+  bool ok;
+  
+
+  // Capçalera.
+  if ( read_bits ( b, 1 ) != 0 ) return false;
+  type= (int) read_bits ( b, 6 );
+  wasted= 0;
+  if ( read_bits ( b, 1 ) )
+    wasted= (int) read_unary ( b ) + 1;
+  bps-= wasted;
+  if ( bps <= 0 || bps > 32 || b->error ) return false;
+
+  // Dades.
+  if ( type == 0 ) // CONSTANT
+    {
+      v= read_sbits ( b, bps );
+      for ( i= 0; i < block_size; ++i ) out[i]= v;
+      ok= true;
+    }
+  else if ( type == 1 ) // VERBATIM
+    {
+      for ( i= 0; i < block_size; ++i )
+        out[i]= read_sbits ( b, bps );
+      ok= true;
+    }
+  else if ( type >= 8 && type < 8+MAX_FIXED_ORDER+1 )
+    ok= decode_fixed ( b, block_size, bps, type-8, out );
+  else if ( type >= 32 )
+    ok= decode_lpc ( b, block_size, bps, type-31, out );
+  else ok= false;
+  if ( !ok || b->error ) return false;
+
+  // Bits desaprofitats.
+  if ( wasted > 0 )
+    for ( i= 0; i < block_size; ++i )
+      out[i]= (int32_t) ((uint32_t) out[i]<<wasted);
+  
+  return true;
+  
+} // end decode_subframe
+
+
+// Llig el número de frame o mostra codificat com UTF-8.
+static bool
+skip_coded_number (
+                   bits_t *b
+                   )
+{
+
+  uint32_t first;
+  int n;
+
+  
+  first= read_bits ( b, 8 );
+  if ( (first&0x80) == 0 ) return !b->error;
+  for ( n= 0; n < 7 && (first&(0x80>>n)); ++n );
+  if ( n == 1 || n == 7 ) return false;
+  for ( --n; n > 0; --n )
+    if ( (read_bits ( b, 8 )&0xC0) != 0x80 ) return false;
+  
+  return !b->error;
+  
+} // end skip_coded_number
+
+
+static void
+reserve (
+         CD_FlacFrame *frame,
+         const int     block_size
+         )
+{
+
+  int i;
+
+  
+  if ( block_size <= frame->capacity ) return;
+  for ( i= 0; i < CD_FLAC_MAX_CHANNELS; ++i )
+    frame->samples[i]= mem_realloc ( int32_t, frame->samples[i], block_size );
+  frame->capacity= block_size;
+  
+} // end reserve
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+CD_FlacFrame *
+CD_flac_frame_new (void)
+{
+
+  CD_FlacFrame *ret;
+  int i;
+  
+
+  pthread_once ( &_tables_once, init_tables );
+  ret= mem_alloc ( CD_FlacFrame, 1 );
+  ret->channels= 0;
+  ret->bps= 0;
+  ret->sample_rate= 0;
+  ret->block_size= 0;
+  ret->capacity= 0;
+  for ( i= 0; i < CD_FLAC_MAX_CHANNELS; ++i )
+    ret->samples[i]= NULL;
+
+  return ret;
+  
+} // end CD_flac_frame_new
+
+
+void
+CD_flac_frame_free (
+                    CD_FlacFrame *frame
+                    )
+{
+
+  int i;
+
+  
+  for ( i= 0; i < CD_FLAC_MAX_CHANNELS; ++i )
+    free ( frame->samples[i] );
+  free ( frame );
+  
+} // end CD_flac_frame_free
+
+
+size_t
+CD_flac_decode_frame (
+                      CD_FlacFrame  *frame,
+                      const uint8_t *buf,
+                      const size_t   size,
+                      const int      bps,
+                      const int      sample_rate
+                      )
+{
+
+  bits_t b;
+  int bs_code,sr_code,ch_code,ss_code,assign,ch,i,ch_bps;
+  int32_t *s0,*s1,mid,side;
+  size_t hsize;
+  
+
+  b.buf= buf; b.size= size; b.pos= 0; b.error= false;
+  
+  // Capçalera.
+  if ( read_bits ( &b, 14 ) != SYNC || read_bits ( &b, 1 ) != 0 )
+    return 0;
+  read_bits ( &b, 1 ); // Estratègia de bloc.
+  bs_code= (int) read_bits ( &b, 4 );
+  sr_code= (int) read_bits ( &b, 4 );
+  ch_code= (int) read_bits ( &b, 4 );
+  ss_code= (int) read_bits ( &b, 3 );
+  if ( read_bits ( &b, 1 ) != 0 || !skip_coded_number ( &b ) ) return 0;
+  if ( bs_code == 0 ) return 0;
+  else if ( bs_code == 1 ) frame->block_size= 192;
+  else if ( bs_code <= 5 ) frame->block_size= 576<<(bs_code-2);
+  else if ( bs_code == 6 ) frame->block_size= (int) read_bits ( &b, 8 ) + 1;
+  else if ( bs_code == 7 ) frame->block_size= (int) read_bits ( &b, 16 ) + 1;
+  else frame->block_size= 256<<(bs_code-8);
+  if ( sr_code == 0 ) frame->sample_rate= sample_rate;
+  else if ( sr_code < 12 ) frame->sample_rate= SAMPLE_RATES[sr_code];
+  else if ( sr_code == 12 )
+    frame->sample_rate= (int) read_bits ( &b, 8 )*1000;
+  else if ( sr_code == 13 ) frame->sample_rate= (int) read_bits ( &b, 16 );
+  else if ( sr_code == 14 )
+    frame->sample_rate= (int) read_bits ( &b, 16 )*10;
+  else return 0;
+  if ( ch_code < 8 )
+    {
+      frame->channels= ch_code+1;
+      assign= CH_INDEPENDENT;
+    }
+  else if ( ch_code <= 10 )
+    {
+      frame->channels= 2;
+      assign= CH_LEFT_SIDE + (ch_code-8);
+    }
+  else return 0;
+  frame->bps= ss_code==0 ? bps : SAMPLE_SIZES[ss_code];
+  if ( frame->bps <= 0 || frame->bps > 32 ) return 0;
+  hsize= b.pos>>3;
+  if ( b.error || read_bits ( &b, 8 ) != crc8 ( buf, hsize ) ) return 0;
+
+  // Subframes.
+  reserve ( frame, frame->block_size );
+  for ( ch= 0; ch < frame->channels; ++ch )
+    {
+      ch_bps= frame->bps;
+      if ( (assign == CH_LEFT_SIDE && ch == 1) ||
+           (assign == CH_SIDE_RIGHT && ch == 0) ||
+           (assign == CH_MID_SIDE && ch == 1) )
+        ++ch_bps;
+      if ( ch_bps > 32 ) return 0;
+      if ( !decode_subframe ( &b, frame->block_size, ch_bps,
+                              frame->samples[ch] ) )
+        return 0;
+    }
+
+  // Peu.
+  b.pos= (b.pos+7)&~((size_t) 7);
+  hsize= b.pos>>3;
+  if ( read_bits ( &b, 16 ) != crc16 ( buf, hsize ) || b.error ) return 0;
+
+  // Decorrelació.
+  s0= frame->samples[0];
+  s1= frame->samples[1];
+  switch ( assign )
+    {
+    case CH_LEFT_SIDE:
+      for ( i= 0; i < frame->block_size; ++i ) s1[i]= s0[i] - s1[i];
+      break;
+    case CH_SIDE_RIGHT:
+      for ( i= 0; i < frame->block_size; ++i ) s0[i]+= s1[i];
+      break;
+    case CH_MID_SIDE:
+      for ( i= 0; i < frame->block_size; ++i )
+        {
+          side= s1[i];
+          mid= (int32_t) (((uint32_t) s0[i]<<1) | (side&1));
+          s0[i]= (mid + side)>>1;
+          s1[i]= (mid - side)>>1;
+        }
+      break;
+    default: break;
+    }
+  
+  return hsize+2;
+  
+} // end CD_flac_decode_frame
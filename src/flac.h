@@ -0,0 +1,74 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  flac.h - Decodificador mínim de frames FLAC.
+ *
+ */
+/*
+ * NOTA!! Sols decodifica frames (capçalera, subframes i CRC), no
+ * llig metadades ni busca sincronització. És el que cal per a les
+ * dades d'àudio comprimides dins d'altres formats, on el contenidor
+ * ja indica on comença cada frame.
+ */
+
+#ifndef __CD_FLAC_H__
+#define __CD_FLAC_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CD_FLAC_MAX_CHANNELS 8
+
+// Frame decodificat. Els buffers de mostres es reaprofiten entre
+// frames.
+typedef struct
+{
+
+  int      channels;
+  int      bps; // Bits per mostra.
+  int      sample_rate;
+  int      block_size; // Mostres per canal.
+  int32_t *samples[CD_FLAC_MAX_CHANNELS]; // Mostres de cada canal.
+  int      capacity; // Mostres reservades per canal.
+  
+} CD_FlacFrame;
+
+CD_FlacFrame *
+CD_flac_frame_new (void);
+
+void
+CD_flac_frame_free (
+                    CD_FlacFrame *frame
+                    );
+
+// Decodifica en FRAME el frame que comença en BUF (com a màxim SIZE
+// bytes). BPS i SAMPLE_RATE són els valors del STREAMINFO, que es
+// gasten quan la capçalera del frame no els indica. Torna el número
+// de bytes del frame o 0 si no és vàlid (inclosos els CRC).
+size_t
+CD_flac_decode_frame (
+                      CD_FlacFrame  *frame,
+                      const uint8_t *buf,
+                      const size_t   size,
+                      const int      bps,
+                      const int      sample_rate
+                      );
+
+#endif // __CD_FLAC_H__
@@ -0,0 +1,1695 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  img.c - Implementació de 'img.h'.
+ *
+ */
+/*
+ *  Els sectors desats es lligen directament del fitxer projectat en
+ *  memòria quan estan en cru, i la resta es completen amb el 'Sync',
+ *  la capçalera i l'EDC/ECC. El subcanal pot estar intercalat després
+ *  de cada sector o en un fitxer a part, i quan no hi és (o és tot
+ *  zeros) s'inventa a partir del TOC.
+ */
+
+
+#include <ctype.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CD.h"
+#include "crc.h"
+#include "ecc.h"
+#include "img.h"
+#include "readahead.h"
+#include "subq.h"
+#include "utils.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define BCD(NUM) ((uint8_t) (((NUM)/10)*0x10 + (NUM)%10))
+
+// Grandària del lead-in de les sessions posteriors a la primera.
+#define LEADIN_SIZE (60*75)
+
+// Posició del canal Q en cada entrada d'un subcanal no intercalat.
+#define SUB_Q 12
+
+#define POINT_FIRST 0xA0
+#define POINT_LAST 0xA1
+#define POINT_LEADOUT 0xA2
+
+// Cada entrada del TOC es repeteix 3 vegades en el lead-in.
+#define LEADIN_REPEAT 3
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+// Cursor. Cada fil ha de tindre el seu.
+typedef struct
+{
+
+  CD_DISC_CLS;
+
+  // Dades del disc.
+  CD_ImgCore *core;
+
+  // Posició actual.
+  size_t current_sec;
+  size_t current_ext; // Últim extent consultat.
+
+  // Buffer per a 'read_view' quan no es pot llegir directament.
+  uint8_t sec_buf[CD_SEC_SIZE];
+
+  // Lectura anticipada (NULL si no està activada).
+  CD_ReadAhead *ra;
+  
+} CD_IMG_Disc;
+
+#define IMG(DISC) ((CD_IMG_Disc *) (DISC))
+#define CORE(DISC) (IMG(DISC)->core)
+
+
+
+
+/*************/
+/* CONSTANTS */
+/*************/
+
+// Sector buit per a 'read_view' en els sectors no desats.
+static const uint8_t ZERO_SEC[CD_SEC_SIZE]= {0};
+
+// Subcapçalera dels sectors MODE 2 FORM 1 de dades.
+static const uint8_t SUBHEADER_FORM1[8]=
+  { 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x08, 0x00 };
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+// Afegeix els sectors [A,B) del track T separant la part desada.
+static void
+add_range (
+           CD_ImgCore    *core,
+           const size_t   t,
+           const size_t   a,
+           const size_t   b,
+           const uint8_t  index_id
+           )
+{
+
+  const CD_ImgTrack *track;
+  size_t x,y;
+  
+
+  track= &(core->tracks[t]);
+  x= track->stored_first < a ? a : track->stored_first;
+  if ( x > b ) x= b;
+  y= track->stored_first + track->nstored;
+  if ( y > b ) y= b;
+  if ( y < x ) y= x;
+  CD_img_add_extent ( core, a, x-a, -1, (int) t, index_id, CD_IMG_DATA );
+  CD_img_add_extent ( core, x, y-x,
+                      (long) (track->offset +
+                              (uint64_t) (x-track->stored_first)*
+                              track->stride),
+                      (int) t, index_id, CD_IMG_DATA );
+  CD_img_add_extent ( core, y, b-y, -1, (int) t, index_id, CD_IMG_DATA );
+  
+} // end add_range
+
+
+// Torna l'extent que conté el sector SEC (< N). Com les lectures
+// solen ser seqüencials primer es comprova l'últim extent consultat
+// pel cursor i el següent, i si no es fa una cerca binària.
+static const CD_ImgExtent *
+get_extent (
+            CD_IMG_Disc  *d,
+            const size_t  sec
+            )
+{
+
+  const CD_ImgExtent *exts;
+  size_t lo,hi,mid;
+  
+  
+  exts= d->core->exts;
+  lo= d->current_ext;
+  if ( sec >= exts[lo].first )
+    {
+      if ( sec < exts[lo].first + exts[lo].nsecs ) return &(exts[lo]);
+      if ( lo+1 < d->core->NX && sec < exts[lo+1].first + exts[lo+1].nsecs )
+        {
+          d->current_ext= lo+1;
+          return &(exts[lo+1]);
+        }
+    }
+  
+  // Cerca binària.
+  lo= 0; hi= d->core->NX;
+  while ( hi-lo > 1 )
+    {
+      mid= (lo+hi)/2;
+      if ( exts[mid].first <= sec ) lo= mid;
+      else                          hi= mid;
+    }
+  d->current_ext= lo;
+  
+  return &(exts[lo]);
+  
+} // end get_extent
+
+
+// Posició en el fitxer del sector SEC de EXT (que ha d'estar desat).
+static long
+sec_offset (
+            CD_IMG_Disc        *d,
+            const CD_ImgExtent *ext,
+            const size_t        sec
+            )
+{
+  return ext->offset +
+    (long) ((sec-ext->first)*d->core->tracks[ext->track_id].stride);
+} // end sec_offset
+
+
+// Indica si el sector en cru es pot llegir directament del fitxer.
+static bool
+is_raw (
+        CD_IMG_Disc        *d,
+        const CD_ImgExtent *ext
+        )
+{
+  return ext->offset != -1 && d->core->tracks[ext->track_id].format == CD_IMG_RAW;
+} // end is_raw
+
+
+// Completa en BUF el sector SEC a partir de les dades desades en SRC.
+static void
+to_raw (
+        const CD_ImgTrack *track,
+        const uint8_t     *src,
+        const size_t       sec,
+        uint8_t            buf[CD_SEC_SIZE]
+        )
+{
+
+  CD_Position pos;
+  int i;
+  
+  
+  if ( track->format == CD_IMG_RAW )
+    {
+      memcpy ( buf, src, CD_SEC_SIZE );
+      return;
+    }
+
+  // Sync i capçalera.
+  buf[0]= 0x00;
+  for ( i= 1; i < 11; i++ ) buf[i]= 0xff;
+  buf[11]= 0x00;
+  pos= CD_get_position ( sec );
+  buf[12]= pos.mm;
+  buf[13]= pos.ss;
+  buf[14]= pos.sec;
+  buf[15]= track->format == CD_IMG_MODE1_2048 ? 0x01 : 0x02;
+
+  // Dades.
+  switch ( track->format )
+    {
+    case CD_IMG_MODE1_2048:
+      memcpy ( &buf[16], src, 2048 );
+      CD_ecc_mode1 ( buf );
+      break;
+    case CD_IMG_MODE2_FORM1_2048:
+      memcpy ( &buf[16], SUBHEADER_FORM1, sizeof(SUBHEADER_FORM1) );
+      memcpy ( &buf[24], src, 2048 );
+      CD_ecc_mode2_form1 ( buf );
+      break;
+    case CD_IMG_MODE2_2336:
+    default:
+      memcpy ( &buf[16], src, 2336 );
+    }
+  
+} // end to_raw
+
+
+static bool
+is_audio (
+          CD_IMG_Disc        *d,
+          const CD_ImgExtent *ext
+          )
+{
+  return ext->area == CD_IMG_DATA && d->core->tracks[ext->track_id].type==CD_IMG_AUDIO;
+} // end is_audio
+
+
+// Llig el sector SEC (< N) sense passar per la lectura anticipada.
+static bool
+read_sector (
+             CD_IMG_Disc  *d,
+             const size_t  sec,
+             uint8_t       buf[CD_SEC_SIZE],
+             bool         *audio
+             )
+{
+
+  const CD_ImgExtent *ext;
+  const CD_ImgTrack *track;
+  uint8_t tmp[CD_SEC_SIZE];
+  long offset;
+  
+
+  ext= get_extent ( d, sec );
+  *audio= is_audio ( d, ext );
+  if ( ext->offset == -1 )
+    memset ( buf, 0, CD_SEC_SIZE );
+  else
+    {
+      track= &(d->core->tracks[ext->track_id]);
+      offset= sec_offset ( d, ext, sec );
+      if ( d->core->mem != NULL )
+        to_raw ( track, d->core->mem + offset, sec, buf );
+      else if ( track->format == CD_IMG_RAW )
+        {
+          if ( !CD_read_at ( d->core->fd, buf, CD_SEC_SIZE, offset ) )
+            return false;
+        }
+      else
+        {
+          if ( !CD_read_at ( d->core->fd, tmp, track->data_size, offset ) )
+            return false;
+          to_raw ( track, tmp, sec, buf );
+        }
+    }
+  
+  return true;
+  
+} // end read_sector
+
+
+// Llig en BUF els NSECS sectors de EXT a partir de SEC sense passar
+// per la lectura anticipada. Si estan desats en cru un darrere de
+// l'altre es copien d'una vegada.
+static bool
+read_run (
+          CD_IMG_Disc        *d,
+          const CD_ImgExtent *ext,
+          const size_t        sec,
+          const size_t        nsecs,
+          uint8_t            *buf
+          )
+{
+
+  const CD_ImgTrack *track;
+  long offset;
+  size_t i;
+  bool au;
+  
+
+  if ( ext->offset == -1 )
+    {
+      memset ( buf, 0, nsecs*CD_SEC_SIZE );
+      return true;
+    }
+  track= &(d->core->tracks[ext->track_id]);
+  if ( track->format == CD_IMG_RAW && track->stride == CD_SEC_SIZE )
+    {
+      offset= sec_offset ( d, ext, sec );
+      if ( d->core->mem != NULL )
+        memcpy ( buf, d->core->mem + offset, nsecs*CD_SEC_SIZE );
+      else if ( !CD_read_at ( d->core->fd, buf, nsecs*CD_SEC_SIZE, offset ) )
+        return false;
+    }
+  else
+    for ( i= 0; i < nsecs; ++i )
+      if ( !read_sector ( d, sec+i, buf + i*CD_SEC_SIZE, &au ) )
+        return false;
+  
+  return true;
+  
+} // end read_run
+
+
+// Llig el sector actual. Si la lectura anticipada està activada
+// l'intenta agafar de l'anell i si no està el llig i reinicia la
+// lectura anticipada a partir del següent.
+static bool
+read_sector_ra (
+                CD_IMG_Disc *d,
+                uint8_t      buf[CD_SEC_SIZE],
+                bool        *audio
+                )
+{
+  
+  if ( d->ra == NULL ) return read_sector ( d, d->current_sec, buf, audio );
+  if ( CD_readahead_pop ( d->ra, d->current_sec, buf, audio ) ) return true;
+  if ( !read_sector ( d, d->current_sec, buf, audio ) ) return false;
+  CD_readahead_restart ( d->ra, d->current_sec+1 );
+  
+  return true;
+  
+} // end read_sector_ra
+
+
+// Cal cridar-la cada vegada que es canvia la posició del cursor fora
+// de la lectura seqüencial.
+static void
+update_readahead (
+                  CD_IMG_Disc *d
+                  )
+{
+  if ( d->ra != NULL ) CD_readahead_restart ( d->ra, d->current_sec );
+} // end update_readahead
+
+
+// Indica si els sectors de EXT tenen el subcanal desat.
+static bool
+has_sub (
+         CD_IMG_Disc        *d,
+         const CD_ImgExtent *ext
+         )
+{
+  return ext->offset != -1 &&
+    (d->core->sub != NULL || d->core->tracks[ext->track_id].sub);
+} // end has_sub
+
+
+// Torna el subcanal P-W desat del sector SEC (NULL si no està desat o
+// no s'ha pogut llegir). Si està en un fitxer a part els canals no
+// estan intercalats. Si la imatge no està projectada es llig en BUF.
+static const uint8_t *
+get_sub (
+         CD_IMG_Disc        *d,
+         const CD_ImgExtent *ext,
+         const size_t        sec,
+         uint8_t             buf[CD_SUBPW_SIZE]
+         )
+{
+
+  long offset;
+
+  
+  if ( !has_sub ( d, ext ) ) return NULL;
+  offset= sec_offset ( d, ext, sec );
+  if ( d->core->sub != NULL )
+    return d->core->sub + ((size_t) offset/CD_SEC_SIZE)*CD_SUBPW_SIZE;
+  offset+= CD_SEC_SIZE;
+  if ( d->core->mem != NULL ) return d->core->mem + offset;
+  if ( !CD_read_at ( d->core->fd, buf, CD_SUBPW_SIZE, offset ) ) return NULL;
+  
+  return buf;
+  
+} // end get_sub
+
+
+static bool
+is_zero_q (
+           const uint8_t q[12]
+           )
+{
+
+  uint8_t nz;
+  int i;
+
+  
+  for ( nz= 0, i= 0; i < 12; ++i ) nz|= q[i];
+  
+  return nz == 0;
+  
+} // end is_zero_q
+
+
+// Copia en BUF el subcanal Q desat del sector SEC. Torna fals si no
+// n'hi ha o és tot zeros.
+static bool
+get_stored_q (
+              CD_IMG_Disc        *d,
+              const CD_ImgExtent *ext,
+              const size_t        sec,
+              uint8_t             buf[CD_SUBCH_SIZE]
+              )
+{
+
+  const uint8_t *sub;
+  uint8_t pw[CD_SUBPW_SIZE],q[12];
+  
+
+  sub= get_sub ( d, ext, sec, pw );
+  if ( sub == NULL ) return false;
+  if ( d->core->sub != NULL ) memcpy ( q, sub + SUB_Q, 12 );
+  else                        CD_subpw_get_q ( sub, q );
+  if ( is_zero_q ( q ) ) return false;
+  memcpy ( &buf[1], q, 12 );
+  
+  return true;
+  
+} // end get_stored_q
+
+
+// Prepara en RUN el subcanal Q inventat a partir del sector SEC de
+// EXT (que no pot ser del lead-in). Torna el número de sectors on és
+// vàlid.
+static size_t
+get_run (
+         CD_IMG_Disc        *d,
+         const CD_ImgExtent *ext,
+         const size_t        sec,
+         CD_SubQRun         *run
+         )
+{
+
+  const CD_ImgTrack *track;
+  size_t ret;
+  
+
+  track= &(d->core->tracks[ext->track_id]);
+  ret= ext->first + ext->nsecs - sec;
+  run->ctrl= (uint8_t) ((track->ctrl<<4) | 0x1); // ADR 1
+  run->abs= sec;
+  if ( ext->area == CD_IMG_LEADOUT )
+    {
+      run->track= 0xAA;
+      run->index= 0x01;
+      run->pregap= false;
+      run->rel= sec - d->core->sessions[track->session].leadout;
+    }
+  else
+    {
+      run->track= BCD ( ext->track_id+1 );
+      run->index= ext->index_id;
+      if ( sec >= track->sector_index01 )
+        {
+          run->pregap= false;
+          run->rel= sec - track->sector_index01;
+        }
+      else // El -1 està copiat de mednafen.
+        {
+          run->pregap= true;
+          run->rel= track->sector_index01 - 1 - sec;
+          if ( ret > track->sector_index01-sec )
+            ret= track->sector_index01-sec;
+        }
+    }
+  
+  return ret;
+  
+} // end get_run
+
+
+// Inventa en BUF el subcanal Q del sector SEC del lead-in que hi ha
+// abans de la sessió S. Les entrades del TOC (A0, A1, A2 i els tracks)
+// es repeteixen cíclicament.
+static void
+get_leadin_q (
+              CD_IMG_Disc  *d,
+              const int     s,
+              const size_t  sec,
+              uint8_t       buf[CD_SUBCH_SIZE]
+              )
+{
+
+  const CD_ImgSession *sess;
+  const CD_ImgTrack *track;
+  CD_Position pos;
+  size_t k;
+  uint16_t crc;
+  int t,last;
+  
+
+  sess= &(d->core->sessions[s]);
+  last= sess->first_track + sess->ntracks - 1;
+  k= sec - sess->leadin;
+  t= (int) ((k/LEADIN_REPEAT) % (size_t) (sess->ntracks+3));
+  buf[0]= 0x00;
+  buf[2]= 0x00; // TNO
+  pos= CD_get_position ( k );
+  buf[4]= pos.mm; buf[5]= pos.ss; buf[6]= pos.sec;
+  buf[7]= 0x00;
+  if ( t == 0 )
+    {
+      track= &(d->core->tracks[sess->first_track]);
+      buf[3]= POINT_FIRST;
+      buf[8]= BCD ( sess->first_track+1 );
+      buf[9]= sess->disc_type;
+      buf[10]= 0x00;
+    }
+  else if ( t == 1 )
+    {
+      track= &(d->core->tracks[last]);
+      buf[3]= POINT_LAST;
+      buf[8]= BCD ( last+1 );
+      buf[9]= buf[10]= 0x00;
+    }
+  else
+    {
+      if ( t == 2 )
+        {
+          track= &(d->core->tracks[last]);
+          buf[3]= POINT_LEADOUT;
+          pos= CD_get_position ( sess->leadout );
+        }
+      else
+        {
+          t+= sess->first_track - 3;
+          track= &(d->core->tracks[t]);
+          buf[3]= BCD ( t+1 );
+          pos= CD_get_position ( track->sector_index01 );
+        }
+      buf[8]= pos.mm; buf[9]= pos.ss; buf[10]= pos.sec;
+    }
+  buf[1]= (uint8_t) ((track->ctrl<<4) | 0x1); // ADR 1
+  crc= CD_crc_subq_calc ( buf );
+  buf[11]= (crc>>8)&0xFF;
+  buf[12]= crc&0xFF;
+  
+} // end get_leadin_q
+
+
+// Omple en BUF el subcanal Q dels NSECS sectors de EXT a partir de
+// SEC. El desat s'extrau i es comprova el CRC de tot el tram, i si
+// està intercalat en la imatge projectada s'extrau d'una vegada.
+static void
+fill_q (
+        CD_IMG_Disc        *d,
+        const CD_ImgExtent *ext,
+        const size_t        sec,
+        const size_t        nsecs,
+        uint8_t            *buf,
+        bool               *crc_ok
+        )
+{
+
+  CD_SubQRun run;
+  size_t done,nrun,i;
+  uint8_t *p;
+  bool batch;
+  
+
+  for ( done= 0; done < nsecs; done+= nrun )
+    {
+      p= buf + done*CD_SUBCH_SIZE;
+      
+      // Lead-in no desat.
+      if ( ext->area == CD_IMG_LEADIN && !has_sub ( d, ext ) )
+        {
+          nrun= nsecs-done;
+          for ( i= 0; i < nrun; ++i )
+            {
+              get_leadin_q ( d, d->core->tracks[ext->track_id].session,
+                             sec+done+i, p + i*CD_SUBCH_SIZE );
+              if ( crc_ok != NULL ) crc_ok[done+i]= true;
+            }
+          continue;
+        }
+      if ( ext->area == CD_IMG_LEADIN ) nrun= nsecs-done;
+      else                              nrun= get_run ( d, ext, sec+done, &run );
+      if ( nrun > nsecs-done ) nrun= nsecs-done;
+
+      // Desat.
+      if ( has_sub ( d, ext ) )
+        {
+          batch= d->core->sub == NULL && d->core->mem != NULL;
+          if ( batch )
+            CD_subpw_get_q_batch ( d->core->mem +
+                                   sec_offset ( d, ext, sec+done ) +
+                                   CD_SEC_SIZE,
+                                   nrun,
+                                   d->core->tracks[ext->track_id].stride,
+                                   p+1, CD_SUBCH_SIZE );
+          for ( i= 0; i < nrun; ++i )
+            {
+              p[i*CD_SUBCH_SIZE]= 0x00;
+              if ( batch ?
+                   !is_zero_q ( p + i*CD_SUBCH_SIZE + 1 ) :
+                   get_stored_q ( d, ext, sec+done+i, p + i*CD_SUBCH_SIZE ) )
+                continue;
+              if ( ext->area == CD_IMG_LEADIN )
+                get_leadin_q ( d, d->core->tracks[ext->track_id].session,
+                               sec+done+i, p + i*CD_SUBCH_SIZE );
+              else
+                {
+                  get_run ( d, ext, sec+done+i, &run );
+                  CD_subq_fill ( p + i*CD_SUBCH_SIZE, &run, 1, NULL );
+                }
+            }
+          if ( crc_ok != NULL )
+            CD_crc_subq_check_batch ( p+1, nrun, CD_SUBCH_SIZE,
+                                      &crc_ok[done] );
+        }
+
+      // Inventat.
+      else CD_subq_fill ( p, &run, nrun,
+                          crc_ok!=NULL ? &crc_ok[done] : NULL );
+    }
+  
+} // end fill_q
+
+
+// Llig N sectors a partir de l'actual recorrent el mapa de sectors
+// una única vegada. Si Q no és NULL també s'hi llig el subcanal Q.
+static int
+read_secs (
+           CD_IMG_Disc *d,
+           uint8_t     *buf,
+           uint8_t     *q,
+           bool        *crc_ok,
+           bool        *audio,
+           const int    n,
+           const bool   move
+           )
+{
+
+  const CD_ImgExtent *ext;
+  size_t first,sec,end,nrun,i;
+  bool au;
+  int ret;
+  
+  
+  if ( n < 0 ) return -1;
+  
+  // Rang a llegir.
+  first= d->current_sec;
+  end= first + (size_t) n;
+  if ( end > d->core->N ) end= d->core->N;
+  if ( first > end ) first= end;
+  ret= (int) (end-first);
+
+  // Per trams.
+  for ( sec= first; sec < end; sec+= nrun )
+    {
+      ext= get_extent ( d, sec );
+      nrun= ext->first + ext->nsecs - sec;
+      if ( nrun > end-sec ) nrun= end-sec;
+      if ( !read_run ( d, ext, sec, nrun, buf + (sec-first)*CD_SEC_SIZE ) )
+        return -1;
+      if ( audio != NULL )
+        for ( au= is_audio ( d, ext ), i= 0; i < nrun; ++i )
+          audio[sec-first+i]= au;
+      if ( q != NULL )
+        fill_q ( d, ext, sec, nrun, q + (sec-first)*CD_SUBCH_SIZE,
+                 crc_ok!=NULL ? &crc_ok[sec-first] : NULL );
+    }
+  if ( move )
+    {
+      d->current_sec= end;
+      update_readahead ( d );
+    }
+  
+  return ret;
+  
+} // end read_secs
+
+
+// Crea un nou cursor sobre CORE. No modifica les referències.
+static CD_IMG_Disc *
+new_cursor (
+            CD_ImgCore *core
+            );
+
+
+
+
+/***********/
+/* MÈTODES */
+/***********/
+
+static void
+free_ (
+       CD_Disc *d
+       )
+{
+
+  if ( IMG(d)->ra != NULL ) CD_readahead_free ( IMG(d)->ra );
+  
+  // L'últim cursor allibera les dades compartides.
+  if ( atomic_fetch_sub ( &(CORE(d)->refs), 1 ) == 1 )
+    CD_img_core_free ( CORE(d) );
+  free ( d );
+  
+} // end free_
+
+
+static bool
+move_to_session (
+                 CD_Disc   *d,
+                 const int  sess
+                 )
+{
+
+  const CD_ImgSession *s;
+
+  
+  if ( sess < 1 || (size_t) sess > CORE(d)->NS ) return false;
+  s= &(CORE(d)->sessions[sess-1]);
+  
+  // Primer sector amb contingut del primer track.
+  IMG(d)->current_sec= CORE(d)->tracks[s->first_track].sector_index01;
+  update_readahead ( IMG(d) );
+
+  return true;
+  
+} // end move_to_session
+
+
+static bool
+move_to_track (
+               CD_Disc   *d,
+               const int  track
+               )
+{
+
+  if ( track < 1 || (size_t) track > CORE(d)->NT ) return false;
+  IMG(d)->current_sec= track == 1 ?
+    CORE(d)->tracks[0].sector_index01 : CORE(d)->tracks[track-1].first;
+  update_readahead ( IMG(d) );
+
+  return true;
+  
+} // end move_to_track
+
+
+static void
+reset (
+       CD_Disc *d
+       )
+{
+  IMG(d)->current_sec= 0;
+  update_readahead ( IMG(d) );
+} // end reset
+
+
+static bool
+seek (
+      CD_Disc *d,
+      int      amm,
+      int      ass,
+      int      asect
+      )
+{
+
+  long pos;
+
+
+  pos= amm*60*75 + ass*75 + asect;
+  if ( pos < 0 || (size_t) pos >= CORE(d)->N ) return false;
+
+  IMG(d)->current_sec= (size_t) pos;
+  update_readahead ( IMG(d) );
+  
+  return true;
+  
+} // end seek
+
+
+static int
+get_num_sessions (
+                  CD_Disc *d
+                  )
+{
+  return (int) CORE(d)->NS;
+} // end get_num_sessions
+
+
+static bool
+read_ (
+       CD_Disc    *d,
+       uint8_t     buf[CD_SEC_SIZE],
+       bool       *audio,
+       const bool  move
+       )
+{
+
+  if ( IMG(d)->current_sec >= CORE(d)->N ) return false;
+
+  // Intenta llegir.
+  if ( !read_sector_ra ( IMG(d), buf, audio ) ) return false;
+  if ( move ) ++(IMG(d)->current_sec);
+  
+  return true;
+  
+} // end read_
+
+
+static bool
+read_q (
+        CD_Disc    *d,
+        uint8_t     buf[CD_SUBCH_SIZE],
+        bool       *crc_ok,
+        const bool  move
+        )
+{
+
+  const CD_ImgExtent *ext;
+  CD_SubQRun run;
+  size_t sec;
+  uint16_t crc;
+  
+
+  // CRC ok!!!
+  *crc_ok= true;
+  
+  sec= IMG(d)->current_sec;
+  if ( sec >= CORE(d)->N ) return false;
+  ext= get_extent ( IMG(d), sec );
+
+  // En el primer byte fiquem els 2 bits de "Sub-channel
+  // synchronization field".
+  buf[0]= 0x00;
+
+  // Si el subcanal està desat gastem eixe.
+  if ( get_stored_q ( IMG(d), ext, sec, buf ) )
+    {
+      crc= CD_crc_subq_calc ( buf );
+      *crc_ok= buf[11] == ((crc>>8)&0xFF) && buf[12] == (crc&0xFF);
+    }
+
+  // Invenció (pregap no desat, lead-in, lead-out, o track sense
+  // subcanal).
+  else if ( ext->area == CD_IMG_LEADIN )
+    get_leadin_q ( IMG(d), CORE(d)->tracks[ext->track_id].session, sec, buf );
+  else
+    {
+      get_run ( IMG(d), ext, sec, &run );
+      CD_subq_fill ( buf, &run, 1, NULL );
+    }
+  
+  // Mou.
+  if ( move ) ++(IMG(d)->current_sec);
+  
+  return true;
+  
+} // end read_q
+
+
+static CD_Info *
+get_info (
+          CD_Disc *d
+          )
+{
+
+  CD_Info *ret;
+  CD_SessionInfo *sess;
+  CD_TrackInfo *tracks;
+  CD_IndexInfo *indexes;
+  size_t t,s;
+  const CD_ImgTrack *tp;
+  const CD_ImgIndex *idx;
+  int i;
+  
+  
+  // Reserva memòria.
+  ret= mem_alloc ( CD_Info, 1 );
+  ret->_mem_sessions= sess= mem_alloc ( CD_SessionInfo, CORE(d)->NS );
+  ret->_mem_tracks= tracks= mem_alloc ( CD_TrackInfo, CORE(d)->NT );
+  ret->_mem_indexes= indexes= mem_alloc ( CD_IndexInfo, CORE(d)->NI );
+  
+  // Sesions.
+  ret->nsessions= (int) CORE(d)->NS;
+  ret->sessions= sess;
+  for ( s= 0; s < CORE(d)->NS; ++s )
+    {
+      sess[s].ntracks= CORE(d)->sessions[s].ntracks;
+      sess[s].tracks= &(tracks[CORE(d)->sessions[s].first_track]);
+    }
+
+  // Tracks i índexs.
+  ret->ntracks= (int) CORE(d)->NT;
+  ret->tracks= tracks;
+  for ( t= 0; t < CORE(d)->NT; ++t )
+    {
+      tp= &(CORE(d)->tracks[t]);
+      tracks[t].id= BCD ( t+1 );
+      tracks[t].nindexes= 0;
+      tracks[t].indexes= indexes;
+      tracks[t].pos_last_sector= CD_get_position ( tp->end - 1 );
+      tracks[t].is_audio= (tp->type == CD_IMG_AUDIO);
+      tracks[t].audio_four_channel= (tp->ctrl&0x8)!=0;
+      tracks[t].audio_preemphasis= (tp->ctrl&0x1)!=0;
+      tracks[t].digital_copy_allowed= (tp->ctrl&0x2)!=0;
+      for ( i= 0; i < tp->N; ++i )
+        {
+          idx= &(CORE(d)->indexes[tp->p+i]);
+          indexes->id= idx->id;
+          indexes->pos= CD_get_position ( idx->sec );
+          // Com en CUE, el pregap inicial de 2 segons no compta.
+          if ( t == 0 && idx->id == 0x00 )
+            {
+              if ( tp->sector_index01 <= CD_IMG_IGAP ) continue;
+              indexes->pos= CD_get_position ( CD_IMG_IGAP );
+            }
+          ++indexes; ++(tracks[t].nindexes);
+        }
+    }
+
+  // Disk type. (Açò és com un resum)
+  switch ( CORE(d)->tracks[0].type )
+    {
+    case CD_IMG_AUDIO: ret->type= CD_DISK_TYPE_AUDIO; break;
+    case CD_IMG_MODE1: ret->type= CD_DISK_TYPE_MODE1; break;
+    case CD_IMG_MODE2: ret->type= CD_DISK_TYPE_MODE2; break;
+    }
+  for ( t= 1; t < CORE(d)->NT; ++t )
+    {
+      tp= &(CORE(d)->tracks[t]);
+      if ( ret->type == CD_DISK_TYPE_AUDIO ) // Sols audio
+        {
+          if ( tp->type != CD_IMG_AUDIO )
+            {
+              ret->type= CD_DISK_TYPE_UNK;
+              break;
+            }
+        }
+      else if ( ret->type == CD_DISK_TYPE_MODE1 ||
+                ret->type == CD_DISK_TYPE_MODE1_AUDIO )
+        {
+          if ( tp->type == CD_IMG_AUDIO ) ret->type= CD_DISK_TYPE_MODE1_AUDIO;
+          else if ( tp->type == CD_IMG_MODE2 )
+            {
+              ret->type= CD_DISK_TYPE_UNK;
+              break;
+            }
+        }
+      else if ( ret->type == CD_DISK_TYPE_MODE2 ||
+                ret->type == CD_DISK_TYPE_MODE2_AUDIO )
+        {
+          if ( tp->type == CD_IMG_AUDIO ) ret->type= CD_DISK_TYPE_MODE2_AUDIO;
+          else if ( tp->type == CD_IMG_MODE1 )
+            {
+              ret->type= CD_DISK_TYPE_UNK;
+              break;
+            }
+        }
+    }
+  
+  return ret;
+  
+} // end get_info
+
+
+static int
+get_current_session (
+                     CD_Disc *d
+                     )
+{
+
+  int s;
+
+  
+  // El lead-out és de la sessió anterior i el lead-in de la següent.
+  for ( s= (int) CORE(d)->NS-1;
+        s > 0 && IMG(d)->current_sec < CORE(d)->sessions[s].leadin;
+        --s );
+  
+  return s;
+  
+} // end get_current_session
+
+
+static int
+get_current_track (
+                   CD_Disc *d
+                   )
+{
+  return (int)
+    (IMG(d)->current_sec>=CORE(d)->N ?
+     CORE(d)->NT :
+     (size_t) (get_extent ( IMG(d), IMG(d)->current_sec )->track_id + 1));
+} // end get_current_track
+
+
+static uint8_t
+get_current_index (
+                   CD_Disc *d
+                   )
+{
+  return IMG(d)->current_sec>=CORE(d)->N ?
+    0x00 : get_extent ( IMG(d), IMG(d)->current_sec )->index_id;
+} // end get_current_index
+
+
+static bool
+move_to_leadin (
+                CD_Disc *d
+                )
+{
+
+  int s;
+
+  
+  // NOTA!! El lead-in de la primera sessió no està en la imatge. El de
+  // la resta sí que està en l'espai de sectors (encara que la imatge
+  // no el continga).
+  s= get_current_session ( d );
+  if ( s == 0 )
+    fprintf ( stderr, "[WW] lead-in not available in %s format,"
+              " moving to sector 0 (Track 1)\n", CORE(d)->name );
+  IMG(d)->current_sec= CORE(d)->sessions[s].leadin;
+  update_readahead ( IMG(d) );
+  
+  return true;
+  
+} // end move_to_leadin
+
+
+static CD_Position
+tell (
+      CD_Disc *d
+      )
+{
+  return CD_get_position ( IMG(d)->current_sec );
+} // end tell
+
+
+static const uint8_t *
+read_view (
+           CD_Disc    *d,
+           bool       *audio,
+           const bool  move
+           )
+{
+
+  const uint8_t *ret;
+  const CD_ImgExtent *ext;
+  
+  
+  if ( IMG(d)->current_sec >= CORE(d)->N ) return NULL;
+
+  // Sense còpia si no hi ha lectura anticipada i el sector està en
+  // cru (o no està desat).
+  ext= get_extent ( IMG(d), IMG(d)->current_sec );
+  if ( IMG(d)->ra == NULL &&
+       (ext->offset == -1 || (CORE(d)->mem != NULL && is_raw ( IMG(d), ext ))) )
+    {
+      *audio= is_audio ( IMG(d), ext );
+      ret= ext->offset == -1 ?
+        ZERO_SEC :
+        CORE(d)->mem + sec_offset ( IMG(d), ext, IMG(d)->current_sec );
+    }
+  else
+    {
+      if ( !read_sector_ra ( IMG(d), IMG(d)->sec_buf, audio ) ) return NULL;
+      ret= IMG(d)->sec_buf;
+    }
+  if ( move ) ++(IMG(d)->current_sec);
+  
+  return ret;
+  
+} // end read_view
+
+
+static int
+read_n (
+        CD_Disc    *d,
+        uint8_t    *buf,
+        bool       *audio,
+        const int   n,
+        const bool  move
+        )
+{
+  return read_secs ( IMG(d), buf, NULL, NULL, audio, n, move );
+} // end read_n
+
+
+static CD_Disc *
+clone (
+       CD_Disc *d
+       )
+{
+
+  CD_IMG_Disc *new;
+
+  
+  atomic_fetch_add ( &(CORE(d)->refs), 1 );
+  new= new_cursor ( CORE(d) );
+  new->current_sec= IMG(d)->current_sec;
+
+  return (CD_Disc *) new;
+  
+} // end clone
+
+
+static bool
+set_readahead (
+               CD_Disc   *d,
+               const int  depth
+               )
+{
+
+  CD_Disc *producer;
+  
+  
+  if ( IMG(d)->ra != NULL )
+    {
+      CD_readahead_free ( IMG(d)->ra );
+      IMG(d)->ra= NULL;
+    }
+  if ( depth <= 0 ) return true;
+
+  // El fil d'E/S llig amb el seu propi cursor.
+  producer= clone ( d );
+  IMG(d)->ra= CD_readahead_new ( producer, depth, IMG(d)->current_sec );
+  if ( IMG(d)->ra == NULL )
+    {
+      CD_disc_free ( producer );
+      return false;
+    }
+  
+  return true;
+  
+} // end set_readahead
+
+
+static void
+get_readahead_stats (
+                     CD_Disc           *d,
+                     CD_ReadAheadStats *stats
+                     )
+{
+
+  if ( IMG(d)->ra != NULL ) CD_readahead_get_stats ( IMG(d)->ra, stats );
+  else stats->hits= stats->misses= 0;
+  
+} // end get_readahead_stats
+
+
+static int
+read_batch (
+            CD_Disc      *d,
+            CD_SectorReq *reqs,
+            const int     n
+            )
+{
+
+  int i,ret;
+  
+
+  // NOTA!! Normalment la imatge està projectada en memòria, per tant
+  // no val la pena agrupar les lectures.
+  for ( i= ret= 0; i < n; ++i )
+    {
+      reqs[i].ok= false;
+      reqs[i].audio= false;
+      if ( reqs[i].sec < 0 || (size_t) reqs[i].sec >= CORE(d)->N ) continue;
+      reqs[i].ok= read_sector ( IMG(d), (size_t) reqs[i].sec,
+                                reqs[i].buf, &(reqs[i].audio) );
+      if ( reqs[i].ok ) ++ret;
+    }
+  
+  return ret;
+  
+} // end read_batch
+
+
+static int
+read_q_range (
+              CD_Disc    *d,
+              uint8_t    *buf,
+              bool       *crc_ok,
+              const int   n,
+              const bool  move
+              )
+{
+
+  const CD_ImgExtent *ext;
+  size_t first,sec,end,nrun;
+  int ret;
+  
+
+  if ( n < 0 ) return -1;
+
+  // Rang.
+  first= IMG(d)->current_sec;
+  end= first + (size_t) n;
+  if ( end > CORE(d)->N ) end= CORE(d)->N;
+  if ( first > end ) first= end;
+  ret= (int) (end-first);
+
+  // Per trams.
+  for ( sec= first; sec < end; sec+= nrun )
+    {
+      ext= get_extent ( IMG(d), sec );
+      nrun= ext->first + ext->nsecs - sec;
+      if ( nrun > end-sec ) nrun= end-sec;
+      fill_q ( IMG(d), ext, sec, nrun, buf + (sec-first)*CD_SUBCH_SIZE,
+               crc_ok!=NULL ? &crc_ok[sec-first] : NULL );
+    }
+  
+  if ( move )
+    {
+      IMG(d)->current_sec= end;
+      update_readahead ( IMG(d) );
+    }
+  
+  return ret;
+  
+} // end read_q_range
+
+
+static bool
+read_pw (
+         CD_Disc    *d,
+         uint8_t     buf[CD_SUBPW_SIZE],
+         const bool  move
+         )
+{
+
+  const CD_ImgExtent *ext;
+  const uint8_t *sub;
+  uint8_t q[CD_SUBCH_SIZE];
+  bool crc_ok;
+  
+
+  if ( IMG(d)->current_sec >= CORE(d)->N ) return false;
+  ext= get_extent ( IMG(d), IMG(d)->current_sec );
+  sub= get_sub ( IMG(d), ext, IMG(d)->current_sec, buf );
+  if ( sub != NULL )
+    {
+      if ( CORE(d)->sub != NULL ) CD_subpw_interleave ( sub, buf );
+      else if ( sub != buf )      memcpy ( buf, sub, CD_SUBPW_SIZE );
+      if ( move ) ++(IMG(d)->current_sec);
+    }
+
+  // Sintetitzat a partir del Q.
+  else
+    {
+      if ( !read_q ( d, q, &crc_ok, move ) ) return false;
+      CD_subq_to_pw ( q, buf );
+    }
+  
+  return true;
+  
+} // end read_pw
+
+
+static bool
+read_user_data (
+                CD_Disc    *d,
+                uint8_t     buf[CD_USER_DATA_SIZE],
+                int        *length,
+                const bool  move
+                )
+{
+
+  const uint8_t *sec;
+  const CD_ImgExtent *ext;
+  const CD_ImgTrack *track;
+  long offset;
+  bool audio;
+  
+  
+  if ( IMG(d)->current_sec >= CORE(d)->N ) return false;
+
+  // Les pistes de 2048 bytes sols tenen les dades d'usuari, es
+  // lligen directament sense reconstruir el sector.
+  ext= get_extent ( IMG(d), IMG(d)->current_sec );
+  track= &(CORE(d)->tracks[ext->track_id]);
+  if ( IMG(d)->ra == NULL && ext->offset != -1 &&
+       !is_audio ( IMG(d), ext ) &&
+       (track->format == CD_IMG_MODE1_2048 || track->format == CD_IMG_MODE2_FORM1_2048) )
+    {
+      offset= sec_offset ( IMG(d), ext, IMG(d)->current_sec );
+      if ( CORE(d)->mem != NULL )
+        memcpy ( buf, CORE(d)->mem + offset, 2048 );
+      else if ( !CD_read_at ( CORE(d)->fd, buf, 2048, offset ) ) return false;
+      *length= 2048;
+    }
+  else
+    {
+      sec= read_view ( d, &audio, false );
+      if ( sec == NULL || audio ) return false;
+      *length= CD_get_user_data ( sec, buf );
+      if ( *length == -1 ) return false;
+    }
+  if ( move ) ++(IMG(d)->current_sec);
+  
+  return true;
+  
+} // end read_user_data
+
+
+// Un únic sector (el cas habitual en un emulador) es llig com en
+// 'read_' i 'read_q' però amb una única crida, passant per la lectura
+// anticipada. La resta es llig amb un únic recorregut del mapa.
+static int
+read_with_q (
+             CD_Disc    *d,
+             uint8_t    *buf,
+             uint8_t    *q,
+             bool       *crc_ok,
+             bool       *audio,
+             const int   n,
+             const bool  move
+             )
+{
+
+  bool au,ok;
+  
+
+  if ( n != 1 )
+    return read_secs ( IMG(d), buf, q, crc_ok, audio, n, move );
+  if ( IMG(d)->current_sec >= CORE(d)->N ) return 0;
+  if ( !read_sector_ra ( IMG(d), buf, &au ) ) return -1;
+  if ( audio != NULL ) *audio= au;
+  read_q ( d, q, crc_ok!=NULL ? crc_ok : &ok, move );
+  
+  return 1;
+  
+} // end read_with_q
+
+
+static CD_IMG_Disc *
+new_cursor (
+            CD_ImgCore *core
+            )
+{
+
+  CD_IMG_Disc *new;
+  
+  
+  new= mem_alloc ( CD_IMG_Disc, 1 );
+  new->_m.free= free_;
+  new->_m.move_to_session= move_to_session;
+  new->_m.move_to_track= move_to_track;
+  new->_m.reset= reset;
+  new->_m.seek= seek;
+  new->_m.get_num_sessions= get_num_sessions;
+  new->_m.read= read_;
+  new->_m.read_q= read_q;
+  new->_m.get_info= get_info;
+  new->_m.get_current_session= get_current_session;
+  new->_m.get_current_track= get_current_track;
+  new->_m.get_current_index= get_current_index;
+  new->_m.move_to_leadin= move_to_leadin;
+  new->_m.tell= tell;
+  new->_m.read_view= read_view;
+  new->_m.read_n= read_n;
+  new->_m.clone= clone;
+  new->_m.set_readahead= set_readahead;
+  new->_m.get_readahead_stats= get_readahead_stats;
+  new->_m.read_batch= read_batch;
+  new->_m.read_q_range= read_q_range;
+  new->_m.read_pw= read_pw;
+  new->_m.read_user_data= read_user_data;
+  new->_m.read_with_q= read_with_q;
+  new->core= core;
+  new->current_sec= 0;
+  new->current_ext= 0;
+  new->ra= NULL;
+  
+  return new;
+  
+} // end new_cursor
+
+
+
+
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+CD_ImgCore *
+CD_img_core_new (
+                 const char *name
+                 )
+{
+
+  CD_ImgCore *core;
+
+  
+  core= mem_alloc ( CD_ImgCore, 1 );
+  atomic_init ( &(core->refs), 1 );
+  core->name= name;
+  core->fd= -1;
+  core->mem= NULL;
+  core->size= 0;
+  core->sub_fd= -1;
+  core->sub= NULL;
+  core->sub_size= 0;
+  core->sub_mapped= false;
+  core->tracks= NULL;
+  core->NT= 0;
+  core->indexes= NULL;
+  core->NI= 0;
+  core->sessions= NULL;
+  core->NS= 0;
+  core->exts= NULL;
+  core->NX= 0;
+  core->N= 0;
+  
+  return core;
+  
+} // end CD_img_core_new
+
+
+void
+CD_img_core_free (
+                  CD_ImgCore *core
+                  )
+{
+
+  if ( core->sub_mapped ) CD_file_unmap ( core->sub, core->sub_size );
+  else free ( (void *) core->sub );
+  CD_file_close ( core->sub_fd );
+  CD_file_unmap ( core->mem, core->size );
+  CD_file_close ( core->fd );
+  free ( core->exts );
+  free ( core->sessions );
+  free ( core->indexes );
+  free ( core->tracks );
+  free ( core );
+  
+} // end CD_img_core_free
+
+
+void
+CD_img_add_index (
+                  CD_ImgCore    *core,
+                  CD_ImgTrack   *track,
+                  const uint8_t  id,
+                  const size_t   sec
+                  )
+{
+
+  core->indexes[core->NI].id= id;
+  core->indexes[core->NI].sec= sec;
+  ++(core->NI);
+  ++(track->N);
+  
+} // end CD_img_add_index
+
+
+bool
+CD_img_build_toc (
+                  CD_ImgCore *core,
+                  const bool  guess_disc_type
+                  )
+{
+
+  CD_ImgSession *sess;
+  CD_ImgTrack *track;
+  size_t s,t;
+
+
+  for ( t= 0; t+1 < core->NT; ++t )
+    if ( core->tracks[t+1].session == core->tracks[t].session )
+      core->tracks[t].end= core->tracks[t+1].first;
+  for ( s= 0; s < core->NS; ++s )
+    {
+      sess= &(core->sessions[s]);
+      if ( sess->ntracks == 0 ) return false;
+      if ( s > 0 &&
+           sess->first_track != (core->sessions[s-1].first_track +
+                                  core->sessions[s-1].ntracks) )
+        return false;
+      sess->first= s == 0 ? 0 : core->tracks[sess->first_track].first;
+      t= sess->first_track + sess->ntracks - 1;
+      track= &(core->tracks[t]);
+      track->end= sess->leadout;
+      if ( core->indexes[track->p+track->N-1].sec >= sess->leadout )
+        return false;
+      if ( s > 0 && sess->first < core->sessions[s-1].leadout )
+        return false;
+      if ( s == 0 ) sess->leadin= 0;
+      else if ( sess->first - core->sessions[s-1].leadout > LEADIN_SIZE )
+        sess->leadin= sess->first - LEADIN_SIZE;
+      else sess->leadin= core->sessions[s-1].leadout;
+      if ( guess_disc_type ) sess->disc_type= CD_IMG_DISC_TYPE_CDROM;
+      for ( t= (size_t) sess->first_track;
+            t < (size_t) (sess->first_track + sess->ntracks); ++t )
+        {
+          if ( core->tracks[t].first >= core->tracks[t].end ) return false;
+          if ( guess_disc_type && core->tracks[t].type == CD_IMG_MODE2 )
+            sess->disc_type= CD_IMG_DISC_TYPE_XA;
+        }
+    }
+  core->N= core->sessions[core->NS-1].leadout;
+  
+  return true;
+  
+} // end CD_img_build_toc
+
+
+void
+CD_img_add_extent (
+                   CD_ImgCore       *core,
+                   const size_t      first,
+                   const size_t      nsecs,
+                   const long        offset,
+                   const int         track_id,
+                   const uint8_t     index_id,
+                   const CD_ImgArea  area
+                   )
+{
+
+  CD_ImgExtent *ext;
+
+  
+  if ( nsecs == 0 ) return;
+  ext= &(core->exts[core->NX++]);
+  ext->first= first;
+  ext->nsecs= nsecs;
+  ext->offset= offset;
+  ext->track_id= track_id;
+  ext->index_id= index_id;
+  ext->area= area;
+  
+} // end CD_img_add_extent
+
+
+void
+CD_img_add_gaps (
+                 CD_ImgCore   *core,
+                 const size_t  t
+                 )
+{
+
+  const CD_ImgSession *sess,*next;
+  size_t s;
+  
+
+  s= (size_t) core->tracks[t].session;
+  sess= &(core->sessions[s]);
+  if ( t == (size_t) (sess->first_track + sess->ntracks - 1) &&
+       s+1 < core->NS )
+    {
+      next= &(core->sessions[s+1]);
+      CD_img_add_extent ( core, sess->leadout, next->leadin - sess->leadout,
+                          -1, (int) t, 0x01, CD_IMG_LEADOUT );
+      CD_img_add_extent ( core, next->leadin, next->first - next->leadin,
+                          -1, next->first_track, 0x00, CD_IMG_LEADIN );
+    }
+  
+} // end CD_img_add_gaps
+
+
+bool
+CD_img_build_extents (
+                      CD_ImgCore     *core,
+                      const uint64_t  data_size
+                      )
+{
+
+  const CD_ImgTrack *track;
+  const CD_ImgIndex *idx;
+  size_t t,end;
+  int i;
+  
+  
+  core->exts= mem_alloc ( CD_ImgExtent, 3*core->NI + 2*core->NS );
+  core->NX= 0;
+  for ( t= 0; t < core->NT; ++t )
+    {
+      track= &(core->tracks[t]);
+      if ( track->offset > data_size ||
+           (uint64_t) track->nstored*track->stride > data_size - track->offset )
+        return false;
+      for ( i= 0; i < track->N; ++i )
+        {
+          idx= &(core->indexes[track->p+i]);
+          end= i+1 < track->N ? idx[1].sec : track->end;
+          add_range ( core, t, idx->sec, end, idx->id );
+        }
+      CD_img_add_gaps ( core, t );
+    }
+  
+  return true;
+  
+} // end CD_img_build_extents
+
+
+int
+CD_img_open_companion (
+                       const char *fn,
+                       const char *ext,
+                       long       *size
+                       )
+{
+
+  char *aux;
+  size_t len;
+  int fd,i;
+
+  
+  len= strlen ( fn );
+  if ( len > 4 && fn[len-4] == '.' ) len-= 4;
+  aux= mem_alloc ( char, len+strlen(ext)+1 );
+  memcpy ( aux, fn, len );
+  strcpy ( &aux[len], ext );
+  fd= CD_file_open ( aux, size );
+  if ( fd == -1 )
+    {
+      for ( i= (int) len; aux[i] != '\0'; ++i )
+        aux[i]= (char) toupper ( (unsigned char) aux[i] );
+      fd= CD_file_open ( aux, size );
+    }
+  free ( aux );
+  
+  return fd;
+  
+} // end CD_img_open_companion
+
+
+CD_Disc *
+CD_img_disc_new (
+                 CD_ImgCore *core
+                 )
+{
+  return (CD_Disc *) new_cursor ( core );
+} // end CD_img_disc_new
@@ -0,0 +1,253 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  img.h - Nucli comú de les imatges amb TOC multisessió (CCD, MDS,
+ *          NRG i CDI).
+ *
+ */
+/*
+ * NOTA!! Cada format sols ha de llegir el seu fitxer i omplir el
+ * nucli: els tracks (amb el format i la posició dels sectors desats),
+ * els índexs, el lead-out de cada sessió i el mapa de sectors. La
+ * resta (subcanal Q inventat, lead-in, lectura anticipada i tots els
+ * mètodes de CD_Disc) és comú. El mapa de sectors està dividit en
+ * trams ('extents') d'un mateix índex desats de manera contigua.
+ */
+
+#ifndef __CD_IMG_H__
+#define __CD_IMG_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CD.h"
+
+// Els 2 segons inicials.
+#define CD_IMG_IGAP (2*75)
+
+#define CD_IMG_MAX_TRACKS 99
+
+// Tipus de disc (PSEC de l'entrada A0).
+#define CD_IMG_DISC_TYPE_CDROM 0x00
+#define CD_IMG_DISC_TYPE_XA 0x20
+
+typedef enum
+  {
+    CD_IMG_AUDIO,
+    CD_IMG_MODE1,
+    CD_IMG_MODE2
+  } CD_ImgTrackType;
+
+// Format dels sectors desats.
+typedef enum
+  {
+    CD_IMG_RAW, // 2352
+    CD_IMG_MODE1_2048,
+    CD_IMG_MODE2_FORM1_2048,
+    CD_IMG_MODE2_2336
+  } CD_ImgFormat;
+
+typedef enum
+  {
+    CD_IMG_DATA,
+    CD_IMG_LEADOUT,
+    CD_IMG_LEADIN
+  } CD_ImgArea;
+
+typedef struct
+{
+
+  CD_ImgTrackType type;
+  uint8_t         ctrl; // Camp 'Control' del TOC (4 bits).
+  int             session; // Començant per 0.
+  size_t          first; // Primer sector (pregap inclòs).
+  size_t          sector_index01; // Primer sector de l'índex 01.
+  size_t          end; // Sector següent a l'últim.
+  int             p; // Posició del primer índex en 'indexes'.
+  int             N; // Número d'índexs.
+
+  // Dades en el fitxer.
+  CD_ImgFormat    format;
+  size_t          data_size; // Bytes de dades de cada sector desat.
+  size_t          stride; // Grandària de cada sector desat.
+  bool            sub; // Cada sector inclou el subcanal P-W intercalat.
+  uint64_t        offset; // Posició del primer sector desat.
+  size_t          stored_first; // Primer sector desat.
+  size_t          nstored; // Sectors desats.
+
+} CD_ImgTrack;
+
+typedef struct
+{
+
+  uint8_t id; // BCD
+  size_t  sec;
+
+} CD_ImgIndex;
+
+typedef struct
+{
+
+  int     first_track;
+  int     ntracks;
+  uint8_t disc_type; // PSEC de l'entrada A0.
+  size_t  leadin; // Primer sector del lead-in (0 en la primera sessió).
+  size_t  first; // Primer sector (0 en la primera sessió).
+  size_t  leadout; // Primer sector del lead-out.
+
+} CD_ImgSession;
+
+// Tram de sectors consecutius d'un mateix índex (o del lead-out o
+// lead-in entre dos sessions) desats de manera contigua.
+typedef struct
+{
+
+  size_t     first; // Primer sector (absolut).
+  size_t     nsecs; // Número de sectors.
+  long       offset; // Posició en el fitxer del primer (-1 si no està
+                     // desat).
+  int        track_id; // En el lead-out l'últim de la sessió i en el
+                       // lead-in el primer.
+  uint8_t    index_id;
+  CD_ImgArea area;
+
+} CD_ImgExtent;
+
+// Part immutable del disc, compartida per tots els cursors.
+typedef struct
+{
+
+  // Referències.
+  atomic_int refs;
+
+  // Nom del format (per als avisos).
+  const char *name;
+
+  // Imatge.
+  int            fd;
+  const uint8_t *mem; // Fitxer projectat en memòria (NULL si no es pot).
+  size_t         size;
+
+  // Subcanal en un fitxer a part (NULL si no n'hi ha), amb els canals
+  // P-W un darrere de l'altre com en el .sub de CloneCD. Sols per a
+  // imatges amb tots els sectors en cru i sense subcanal intercalat:
+  // el sector desat en la posició OFFSET té el subcanal en
+  // (OFFSET/CD_SEC_SIZE)*CD_SUBPW_SIZE.
+  int            sub_fd;
+  const uint8_t *sub;
+  size_t         sub_size;
+  bool           sub_mapped;
+
+  // TOC.
+  CD_ImgTrack   *tracks;
+  size_t         NT;
+  CD_ImgIndex   *indexes;
+  size_t         NI;
+  CD_ImgSession *sessions;
+  size_t         NS;
+
+  // Mapa sectors (ordenat per sector).
+  CD_ImgExtent *exts;
+  size_t        NX;
+  size_t        N; // Sectors totals.
+
+} CD_ImgCore;
+
+// Crea un nucli buit. NAME ha de ser una cadena constant.
+CD_ImgCore *
+CD_img_core_new (
+                 const char *name
+                 );
+
+// Sols s'ha de cridar si no s'ha creat cap disc amb el nucli.
+void
+CD_img_core_free (
+                  CD_ImgCore *core
+                  );
+
+// Afegeix l'índex ID, que comença en SEC, al final de TRACK.
+void
+CD_img_add_index (
+                  CD_ImgCore    *core,
+                  CD_ImgTrack   *track,
+                  const uint8_t  id,
+                  const size_t   sec
+                  );
+
+// Completa el TOC a partir dels tracks (amb els índexs) i del lead-out
+// de cada sessió: el final de cada track, el primer sector i el
+// lead-in de cada sessió, i el número total de sectors. Si
+// GUESS_DISC_TYPE el tipus de cada sessió es dedueix dels tracks
+// (CD-ROM o CD-ROM XA). Torna fals si no és coherent.
+bool
+CD_img_build_toc (
+                  CD_ImgCore *core,
+                  const bool  guess_disc_type
+                  );
+
+// Afegeix un tram al mapa de sectors (no fa res si NSECS és 0). El
+// mapa ha d'estar reservat.
+void
+CD_img_add_extent (
+                   CD_ImgCore       *core,
+                   const size_t      first,
+                   const size_t      nsecs,
+                   const long        offset,
+                   const int         track_id,
+                   const uint8_t     index_id,
+                   const CD_ImgArea  area
+                   );
+
+// Afegeix el lead-out de la sessió del track T i el lead-in de la
+// següent si T és l'últim track d'una sessió que no és l'última.
+void
+CD_img_add_gaps (
+                 CD_ImgCore   *core,
+                 const size_t  t
+                 );
+
+// Crea el mapa de sectors a partir dels sectors desats de cada track
+// ('offset', 'stored_first' i 'nstored'). Els lead-out i lead-in entre
+// sessions no estan desats. Torna fals si els sectors desats no estan
+// dins dels DATA_SIZE primers bytes del fitxer.
+bool
+CD_img_build_extents (
+                      CD_ImgCore     *core,
+                      const uint64_t  data_size
+                      );
+
+// Obri FN canviant l'extensió per EXT (primer en minúscules i després
+// en majúscules). Torna -1 si no existeix.
+int
+CD_img_open_companion (
+                       const char *fn,
+                       const char *ext,
+                       long       *size
+                       );
+
+// Crea el primer cursor sobre CORE, que passa a ser propietat del
+// disc.
+CD_Disc *
+CD_img_disc_new (
+                 CD_ImgCore *core
+                 );
+
+#endif // __CD_IMG_H__
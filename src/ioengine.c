@@ -0,0 +1,609 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  ioengine.c - Implementació de 'ioengine.h'.
+ *
+ */
+/*
+ *  io_uring es fa servir directament amb les crides al sistema (no
+ *  cal 'liburing'). Cada lectura en vol és una operació READV que pot
+ *  agrupar diverses peticions, i el camp 'user_data' és l'índex de
+ *  l'operació. La cua d'enviament mai té més operacions que DEPTH,
+ *  per tant la cua de finalització no es pot desbordar.
+ */
+
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#if defined(__linux__) && !defined(CD_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define CD_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#endif
+
+#include "CD.h"
+#include "ioengine.h"
+#include "utils.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define MAX_DEPTH 256
+
+// Número màxim de peticions fusionades en una operació.
+#define MAX_IOV 64
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+// Lectura en vol (una o més peticions contigües).
+typedef struct
+{
+
+  int          first; // Primera petició.
+  int          n; // Número de peticions.
+  int          fd;
+  long         offset;
+  size_t       size; // Bytes totals.
+  struct iovec iov[MAX_IOV];
+  
+} op_t;
+
+#ifdef CD_HAVE_IO_URING
+typedef struct
+{
+
+  int                  fd;
+  void                *sq_ptr;
+  size_t               sq_size;
+  void                *cq_ptr;
+  size_t               cq_size;
+  struct io_uring_sqe *sqes;
+  size_t               sqes_size;
+  unsigned            *sq_head;
+  unsigned            *sq_tail;
+  unsigned            *sq_mask;
+  unsigned            *sq_array;
+  unsigned            *cq_head;
+  unsigned            *cq_tail;
+  unsigned            *cq_mask;
+  struct io_uring_cqe *cqes;
+  
+} ring_t;
+#endif
+
+struct CD_IOEngine_
+{
+
+  int   depth;
+  op_t *ops;
+  int  *free_ops; // Pila d'operacions lliures.
+  int   nfree;
+#ifdef CD_HAVE_IO_URING
+  bool   async;
+  ring_t ring;
+#endif
+  
+};
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+// Prepara en OP la següent operació a partir de la petició FIRST.
+static void
+build_op (
+          op_t           *op,
+          const CD_IOReq *reqs,
+          const int       n,
+          const int       first
+          )
+{
+
+  int i;
+
+  
+  op->first= first;
+  op->fd= reqs[first].fd;
+  op->offset= reqs[first].offset;
+  op->size= 0;
+  for ( i= first; i < n && i-first < MAX_IOV; ++i )
+    {
+      if ( i > first &&
+           (reqs[i].fd != op->fd ||
+            reqs[i].offset != op->offset + (long) op->size) )
+        break;
+      op->iov[i-first].iov_base= reqs[i].buf;
+      op->iov[i-first].iov_len= reqs[i].size;
+      op->size+= reqs[i].size;
+    }
+  op->n= i-first;
+  
+} // end build_op
+
+
+// Llig de manera síncrona OP a partir del byte SKIP. Modifica
+// 'op->iov'.
+static bool
+read_op_sync (
+              op_t   *op,
+              size_t  skip
+              )
+{
+
+  struct iovec *iov;
+  int niov;
+  long offset;
+  
+
+  offset= op->offset + (long) skip;
+  iov= op->iov; niov= op->n;
+  while ( niov > 0 && skip >= iov->iov_len )
+    {
+      skip-= iov->iov_len;
+      ++iov; --niov;
+    }
+  if ( niov == 0 ) return true;
+  iov->iov_base= ((uint8_t *) iov->iov_base) + skip;
+  iov->iov_len-= skip;
+  
+  return CD_readv_at ( op->fd, iov, niov, offset );
+  
+} // end read_op_sync
+
+
+static void
+finish_op (
+           const op_t *op,
+           const bool  ok,
+           CD_IODone  *done,
+           void       *udata
+           )
+{
+
+  int i;
+
+  
+  if ( done != NULL )
+    for ( i= 0; i < op->n; ++i )
+      done ( op->first+i, ok, udata );
+  
+} // end finish_op
+
+
+// Llig les peticions FIRST..N-1 de REQS.
+static bool
+read_sync (
+           CD_IOEngine    *eng,
+           const CD_IOReq *reqs,
+           const int       first,
+           const int       n,
+           CD_IODone      *done,
+           void           *udata
+           )
+{
+
+  op_t *op;
+  int next;
+  bool ret,ok;
+  
+  
+  ret= true;
+  op= &(eng->ops[0]);
+  for ( next= first; next < n; next+= op->n )
+    {
+      build_op ( op, reqs, n, next );
+      ok= read_op_sync ( op, 0 );
+      if ( !ok ) ret= false;
+      finish_op ( op, ok, done, udata );
+    }
+  
+  return ret;
+  
+} // end read_sync
+
+
+#ifdef CD_HAVE_IO_URING
+static void
+ring_free (
+           ring_t *r
+           )
+{
+
+  if ( r->sqes != NULL ) munmap ( r->sqes, r->sqes_size );
+  if ( r->cq_ptr != NULL && r->cq_ptr != r->sq_ptr )
+    munmap ( r->cq_ptr, r->cq_size );
+  if ( r->sq_ptr != NULL ) munmap ( r->sq_ptr, r->sq_size );
+  if ( r->fd >= 0 ) close ( r->fd );
+  r->fd= -1;
+  
+} // end ring_free
+
+
+static void *
+ring_map (
+          const int    fd,
+          const size_t size,
+          const off_t  offset
+          )
+{
+
+  void *ret;
+
+  
+  ret= mmap ( NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+              fd, offset );
+  
+  return ret==MAP_FAILED ? NULL : ret;
+  
+} // end ring_map
+
+
+// Torna cert si s'ha pogut crear la cua.
+static bool
+ring_init (
+           ring_t         *r,
+           const unsigned  entries
+           )
+{
+
+  struct io_uring_params p;
+  uint8_t *sq,*cq;
+  
+
+  memset ( r, 0, sizeof(*r) );
+  memset ( &p, 0, sizeof(p) );
+  r->fd= (int) syscall ( __NR_io_uring_setup, entries, &p );
+  if ( r->fd < 0 ) return false;
+
+  // Projecta les cues.
+  r->sq_size= p.sq_off.array + p.sq_entries*sizeof(unsigned);
+  r->cq_size= p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+  if ( p.features&IORING_FEAT_SINGLE_MMAP )
+    {
+      if ( r->cq_size > r->sq_size ) r->sq_size= r->cq_size;
+      r->cq_size= r->sq_size;
+    }
+  r->sq_ptr= ring_map ( r->fd, r->sq_size, IORING_OFF_SQ_RING );
+  if ( r->sq_ptr == NULL ) goto error;
+  if ( p.features&IORING_FEAT_SINGLE_MMAP ) r->cq_ptr= r->sq_ptr;
+  else
+    {
+      r->cq_ptr= ring_map ( r->fd, r->cq_size, IORING_OFF_CQ_RING );
+      if ( r->cq_ptr == NULL ) goto error;
+    }
+  r->sqes_size= p.sq_entries*sizeof(struct io_uring_sqe);
+  r->sqes= (struct io_uring_sqe *) ring_map ( r->fd, r->sqes_size,
+                                              IORING_OFF_SQES );
+  if ( r->sqes == NULL ) goto error;
+
+  // Camps.
+  sq= (uint8_t *) r->sq_ptr;
+  r->sq_head= (unsigned *) (sq + p.sq_off.head);
+  r->sq_tail= (unsigned *) (sq + p.sq_off.tail);
+  r->sq_mask= (unsigned *) (sq + p.sq_off.ring_mask);
+  r->sq_array= (unsigned *) (sq + p.sq_off.array);
+  cq= (uint8_t *) r->cq_ptr;
+  r->cq_head= (unsigned *) (cq + p.cq_off.head);
+  r->cq_tail= (unsigned *) (cq + p.cq_off.tail);
+  r->cq_mask= (unsigned *) (cq + p.cq_off.ring_mask);
+  r->cqes= (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+  
+  return true;
+
+ error:
+  ring_free ( r );
+  return false;
+  
+} // end ring_init
+
+
+// Afig OP a la cua d'enviament.
+static void
+ring_push (
+           ring_t     *r,
+           const op_t *op,
+           const int   k
+           )
+{
+
+  unsigned tail,idx;
+  struct io_uring_sqe *sqe;
+  
+  
+  tail= *(r->sq_tail);
+  idx= tail & *(r->sq_mask);
+  sqe= &(r->sqes[idx]);
+  memset ( sqe, 0, sizeof(*sqe) );
+  sqe->opcode= IORING_OP_READV;
+  sqe->fd= op->fd;
+  sqe->off= (uint64_t) op->offset;
+  sqe->addr= (uint64_t) (uintptr_t) op->iov;
+  sqe->len= (unsigned) op->n;
+  sqe->user_data= (uint64_t) k;
+  r->sq_array[idx]= idx;
+  __atomic_store_n ( r->sq_tail, tail+1, __ATOMIC_RELEASE );
+  
+} // end ring_push
+
+
+// Recull totes les finalitzacions disponibles. Torna el número
+// d'operacions acabades.
+static int
+ring_reap (
+           CD_IOEngine *eng,
+           CD_IODone   *done,
+           void        *udata,
+           bool        *ret
+           )
+{
+
+  ring_t *r;
+  op_t *op;
+  const struct io_uring_cqe *cqe;
+  unsigned head,tail;
+  int k,nops;
+  bool ok;
+  
+
+  r= &(eng->ring);
+  head= *(r->cq_head);
+  tail= __atomic_load_n ( r->cq_tail, __ATOMIC_ACQUIRE );
+  for ( nops= 0; head != tail; ++head, ++nops )
+    {
+      cqe= &(r->cqes[head & *(r->cq_mask)]);
+      k= (int) cqe->user_data;
+      op= &(eng->ops[k]);
+      if ( cqe->res >= 0 && (size_t) cqe->res == op->size ) ok= true;
+      else if ( cqe->res > 0 ) // Lectura parcial.
+        ok= read_op_sync ( op, (size_t) cqe->res );
+      else if ( cqe->res == -EINTR || cqe->res == -EAGAIN )
+        ok= read_op_sync ( op, 0 );
+      else ok= false;
+      if ( !ok ) *ret= false;
+      finish_op ( op, ok, done, udata );
+      eng->free_ops[(eng->nfree)++]= k;
+    }
+  __atomic_store_n ( r->cq_head, head, __ATOMIC_RELEASE );
+
+  return nops;
+  
+} // end ring_reap
+
+
+// Es crida quan 'io_uring_enter' falla. Les operacions que el nucli
+// no ha arreplegat de la cua d'enviament es lligen amb 'pread', i per
+// a la resta cal esperar que acaben, ja que escriuen en els buffers
+// de les peticions. Torna el número d'operacions acabades.
+static int
+ring_abort (
+            CD_IOEngine *eng,
+            int          inflight,
+            CD_IODone   *done,
+            void        *udata,
+            bool        *ret
+            )
+{
+
+  static const struct timespec WAIT= {0,100000};
+  
+  ring_t *r;
+  op_t *op;
+  unsigned head,tail;
+  int k,nops;
+  long ret_enter;
+  bool ok;
+  
+
+  // Retira el que no s'ha enviat.
+  r= &(eng->ring);
+  nops= 0;
+  head= __atomic_load_n ( r->sq_head, __ATOMIC_ACQUIRE );
+  tail= *(r->sq_tail);
+  __atomic_store_n ( r->sq_tail, head, __ATOMIC_RELEASE );
+  for ( ; head != tail; ++head, ++nops )
+    {
+      k= (int) r->sqes[r->sq_array[head & *(r->sq_mask)]].user_data;
+      op= &(eng->ops[k]);
+      ok= read_op_sync ( op, 0 );
+      if ( !ok ) *ret= false;
+      finish_op ( op, ok, done, udata );
+      eng->free_ops[(eng->nfree)++]= k;
+    }
+  inflight-= nops;
+
+  // Espera la resta. Si no es pot esperar amb 'io_uring_enter' es
+  // consulta periòdicament la cua de finalització.
+  while ( inflight > 0 )
+    {
+      k= ring_reap ( eng, done, udata, ret );
+      inflight-= k; nops+= k;
+      if ( inflight == 0 ) break;
+      ret_enter= syscall ( __NR_io_uring_enter, r->fd, 0, 1,
+                           IORING_ENTER_GETEVENTS, NULL, 0 );
+      if ( ret_enter < 0 && errno != EINTR )
+        nanosleep ( &WAIT, NULL );
+    }
+  
+  return nops;
+  
+} // end ring_abort
+
+
+static bool
+read_async (
+            CD_IOEngine    *eng,
+            const CD_IOReq *reqs,
+            const int       n,
+            CD_IODone      *done,
+            void           *udata
+            )
+{
+
+  ring_t *r;
+  op_t *op;
+  unsigned pending;
+  int next,inflight,k;
+  long ret_enter;
+  bool ret;
+  
+  
+  r= &(eng->ring);
+  ret= true;
+  next= 0; inflight= 0; pending= 0;
+  while ( next < n || inflight > 0 )
+    {
+
+      // Ompli la cua d'enviament.
+      while ( next < n && eng->nfree > 0 )
+        {
+          k= eng->free_ops[--(eng->nfree)];
+          op= &(eng->ops[k]);
+          build_op ( op, reqs, n, next );
+          next+= op->n;
+          ring_push ( r, op, k );
+          ++pending; ++inflight;
+        }
+
+      // Envia el pendent i espera almenys una finalització.
+      ret_enter= syscall ( __NR_io_uring_enter, r->fd, pending, 1,
+                           IORING_ENTER_GETEVENTS, NULL, 0 );
+      if ( ret_enter >= 0 ) pending-= (unsigned) ret_enter;
+      else if ( errno != EINTR && errno != EAGAIN && errno != EBUSY )
+        {
+          // A partir d'ara s'usa 'pread' (la cua s'allibera amb el
+          // motor). Abans de tornar no pot quedar res en vol, i les
+          // peticions que falten es lligen també amb 'pread'.
+          eng->async= false;
+          ring_abort ( eng, inflight, done, udata, &ret );
+          if ( !read_sync ( eng, reqs, next, n, done, udata ) ) ret= false;
+          return ret;
+        }
+
+      // Recull en ordre de finalització.
+      inflight-= ring_reap ( eng, done, udata, &ret );
+      
+    }
+  
+  return ret;
+  
+} // end read_async
+#endif // CD_HAVE_IO_URING
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+CD_IOEngine *
+CD_ioengine_new (
+                 const int depth
+                 )
+{
+
+  CD_IOEngine *new;
+  int i;
+
+  
+  new= mem_alloc ( CD_IOEngine, 1 );
+  new->depth= depth<1 ? 1 : (depth>MAX_DEPTH ? MAX_DEPTH : depth);
+  new->ops= mem_alloc ( op_t, new->depth );
+  new->free_ops= mem_alloc ( int, new->depth );
+  for ( i= 0; i < new->depth; ++i )
+    new->free_ops[i]= i;
+  new->nfree= new->depth;
+#ifdef CD_HAVE_IO_URING
+  new->async= ring_init ( &(new->ring), (unsigned) new->depth );
+#endif
+  
+  return new;
+  
+} // end CD_ioengine_new
+
+
+void
+CD_ioengine_free (
+                  CD_IOEngine *eng
+                  )
+{
+
+#ifdef CD_HAVE_IO_URING
+  ring_free ( &(eng->ring) );
+#endif
+  free ( eng->free_ops );
+  free ( eng->ops );
+  free ( eng );
+  
+} // end CD_ioengine_free
+
+
+bool
+CD_ioengine_is_async (
+                      const CD_IOEngine *eng
+                      )
+{
+#ifdef CD_HAVE_IO_URING
+  return eng->async;
+#else
+  return false;
+#endif
+} // end CD_ioengine_is_async
+
+
+bool
+CD_ioengine_read (
+                  CD_IOEngine    *eng,
+                  const CD_IOReq *reqs,
+                  const int       n,
+                  CD_IODone      *done,
+                  void           *udata
+                  )
+{
+
+#ifdef CD_HAVE_IO_URING
+  if ( eng->async )
+    return read_async ( eng, reqs, n, done, udata );
+#endif
+  
+  return read_sync ( eng, reqs, 0, n, done, udata );
+  
+} // end CD_ioengine_read
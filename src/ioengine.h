@@ -0,0 +1,86 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  ioengine.h - Motor d'E/S per a lectures en bloc.
+ *
+ */
+/*
+ * NOTA!! En Linux les peticions s'envien totes alhora amb io_uring i
+ * es recullen en l'ordre en què es completen. Si io_uring no està
+ * disponible (plataforma, nucli antic, 'seccomp', etc.) es fa servir
+ * 'pread' petició a petició. Les peticions consecutives sobre el
+ * mateix fitxer i contigües es fusionen en una única lectura
+ * vectorial. Un motor no s'ha de compartir entre fils.
+ */
+
+#ifndef __CD_IOENGINE_H__
+#define __CD_IOENGINE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct CD_IOEngine_ CD_IOEngine;
+
+// Petició de lectura.
+typedef struct
+{
+
+  int      fd;
+  long     offset;
+  uint8_t *buf;
+  size_t   size;
+  
+} CD_IOReq;
+
+// Es crida una vegada per cada petició (REQ és l'índex) quan es
+// completa. OK indica si s'han llegit tots els bytes.
+typedef void (CD_IODone) (const int req,const bool ok,void *udata);
+
+// Crea un motor amb fins a DEPTH lectures en vol. Mai torna NULL, si
+// io_uring no està disponible el motor llig amb 'pread'.
+CD_IOEngine *
+CD_ioengine_new (
+                 const int depth
+                 );
+
+void
+CD_ioengine_free (
+                  CD_IOEngine *eng
+                  );
+
+// Torna cert si el motor fa servir io_uring.
+bool
+CD_ioengine_is_async (
+                      const CD_IOEngine *eng
+                      );
+
+// Llig les N peticions de REQS i crida a DONE (si no és NULL) per a
+// cadascuna en ordre de finalització. Torna cert si totes s'han
+// llegit correctament.
+bool
+CD_ioengine_read (
+                  CD_IOEngine    *eng,
+                  const CD_IOReq *reqs,
+                  const int       n,
+                  CD_IODone      *done,
+                  void           *udata
+                  );
+
+#endif // __CD_IOENGINE_H__
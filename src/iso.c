@@ -26,10 +26,16 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
 
 #include "CD.h"
 #include "crc.h"
+#include "ecc.h"
+#include "ioengine.h"
 #include "iso.h"
+#include "readahead.h"
+#include "subq.h"
 #include "utils.h"
 
 
@@ -43,6 +49,9 @@
 
 #define IGAP (2*75)
 
+// Lectures en vol de 'read_batch'.
+#define IO_DEPTH 64
+
 #define BCD(NUM) ((uint8_t) (((NUM)/10)*0x10 + (NUM)%10))
 
 
@@ -52,18 +61,56 @@
 /* TIPUS */
 /*********/
 
+// Part immutable del disc, compartida per tots els cursors.
+typedef struct
+{
+
+  atomic_int     refs; // Referències
+  int            fd; // Fitxer
+  const uint8_t *mem; // Fitxer projectat en memòria (NULL si no es pot).
+  size_t         num_secs; // Nombre de sectors (No inclou el IGAP)
+  
+} iso_core_t;
+
+// Cursor. Cada fil ha de tindre el seu.
 typedef struct
 {
 
   CD_DISC_CLS;
 
-  FILE   *f; // Fitxer
-  size_t  num_secs; // Nombre de sectors (No inclou el IGAP)
-  size_t  current_sec;
+  iso_core_t   *core;
+  size_t        current_sec;
+  uint8_t       sec_buf[CD_SEC_SIZE]; // Sector sintetitzat per a
+                                      // 'read_view'.
+  uint8_t       ra_buf[CD_SEC_SIZE]; // Sector tret de l'anell (no es
+                                     // pot gastar 'sec_buf' perquè els
+                                     // pregaps en borrarien el 'Sync').
+  CD_ReadAhead *ra; // Lectura anticipada (NULL si no està activada).
+  CD_IOEngine  *io; // Motor per a 'read_batch' (es crea quan cal).
   
 } CD_ISO_Disc;
 
+// Estat de 'read_batch'.
+typedef struct
+{
+
+  CD_SectorReq *reqs;
+  int          *ids; // Petició de cada lectura.
+  
+} batch_t;
+
 #define ISO(DISC) ((CD_ISO_Disc *) (DISC))
+#define CORE(DISC) (ISO(DISC)->core)
+
+
+
+
+/*************/
+/* CONSTANTS */
+/*************/
+
+// Sector buit retornat per 'read_view' en el pregap.
+static const uint8_t ZERO_SEC[CD_SEC_SIZE]= {0};
 
 
 
@@ -75,9 +122,9 @@ typedef struct
 // Torna cert si tot ha anat bé.
 static bool
 read_iso (
-          const char   *fn,
-          CD_ISO_Disc  *d,
-          char        **err
+          const char  *fn,
+          iso_core_t  *d,
+          char       **err
           )
 {
 
@@ -85,23 +132,12 @@ read_iso (
 
   
   // Obri.
-  d->f= fopen ( fn, "rb" );
-  if ( d->f == NULL )
+  d->fd= CD_file_open ( fn, &size );
+  if ( d->fd == -1 )
     {
       CD_msgerror ( err, "cannot open '%s'", fn );
       return false;
     }
-  if ( fseek ( d->f, 0, SEEK_END ) == -1 )
-    {
-      CD_msgerror ( err, "unable to load '%s'", fn );
-      return false;
-    }
-  size= ftell ( d->f );
-  if ( size == -1 )
-    {
-      CD_msgerror ( err, "unable to load '%s'", fn );
-      return false;
-    }
   if ( size%SEC_SIZE != 0 )
     {
       CD_msgerror ( err, "unable to load '%s': invalid size"
@@ -109,33 +145,275 @@ read_iso (
       return false;
     }
   d->num_secs= size/SEC_SIZE;
+  d->mem= CD_file_map ( d->fd, (size_t) size );
   
   return true;
 
 } // end read_iso
 
 
-// Força un seek en el fitxer, torna fals en cas d'error.
-static bool
-force_seek (
-            CD_ISO_Disc *d
+// Escriu en BUF el 'Sync' d'un sector de dades.
+static void
+write_sync (
+            uint8_t buf[CD_SEC_SIZE]
             )
 {
 
-  long offset,coffset;
+  int i;
+
+  
+  buf[0]= 0x00;
+  for ( i= 1; i < 11; i++ ) buf[i]= 0xff;
+  buf[11]= 0x00;
+  
+} // end write_sync
+
+
+// Escriu en BUF la capçalera MODE 01 del sector NSEC.
+static void
+write_header (
+              const size_t nsec,
+              uint8_t      buf[CD_SEC_SIZE]
+              )
+{
+
+  int mm,ss,sec;
+  size_t tmp;
+
+  
+  mm= nsec/(60*75);
+  tmp= nsec%(60*75);
+  ss= tmp/75;
+  sec= tmp%75;
+  buf[12]= BCD(mm);
+  buf[13]= BCD(ss);
+  buf[14]= BCD(sec);
+  buf[15]= 0x01; // Mode 01
+  
+} // end write_header
+
+
+// Copia en BUF les dades del sector actual (que no pot ser del
+// pregap). Torna fals en cas d'error.
+static bool
+read_sector_data (
+                  const CD_ISO_Disc *d,
+                  uint8_t            buf[SEC_SIZE]
+                  )
+{
+
+  long offset;
 
   
-  if ( d->current_sec >= (d->num_secs+IGAP) ) return true;
-  if ( d->current_sec < IGAP ) return true;
   offset= ((long) (d->current_sec-IGAP))*((long) SEC_SIZE);
-  coffset= ftell ( d->f );
-  if ( offset != coffset &&
-       fseek ( d->f, offset, SEEK_SET ) != 0 )
+  if ( d->core->mem != NULL )
+    memcpy ( buf, d->core->mem + offset, SEC_SIZE );
+  else if ( !CD_read_at ( d->core->fd, buf, SEC_SIZE, offset ) )
     return false;
 
   return true;
   
-} // end force_seek
+} // end read_sector_data
+
+
+static void
+free_core (
+           iso_core_t *core
+           )
+{
+
+  CD_file_unmap ( core->mem, core->num_secs*SEC_SIZE );
+  CD_file_close ( core->fd );
+  free ( core );
+  
+} // end free_core
+
+
+// Llig el sector actual sense passar per la lectura anticipada.
+static bool
+read_sector (
+             CD_ISO_Disc *d,
+             uint8_t      buf[CD_SEC_SIZE]
+             )
+{
+
+  if ( d->current_sec < IGAP )
+    memset ( buf, 0, CD_SEC_SIZE ); // TODO?!!!
+  else
+    {
+
+      // Llig dades.
+      if ( !read_sector_data ( d, &buf[16] ) ) return false;
+
+      // Emule sectors MODE 01: Sync, Header, EDC, Intermediate,
+      // P-Parity i Q-Parity.
+      write_sync ( buf );
+      write_header ( d->current_sec, buf );
+      CD_ecc_mode1 ( buf );
+      
+    }
+
+  return true;
+  
+} // end read_sector
+
+
+// Llig el sector actual. Si la lectura anticipada està activada
+// l'intenta agafar de l'anell i si no està el llig i reinicia la
+// lectura anticipada a partir del següent.
+static bool
+read_sector_ra (
+                CD_ISO_Disc *d,
+                uint8_t      buf[CD_SEC_SIZE]
+                )
+{
+
+  bool audio;
+  
+  
+  if ( d->ra == NULL ) return read_sector ( d, buf );
+  if ( CD_readahead_pop ( d->ra, d->current_sec, buf, &audio ) ) return true;
+  if ( !read_sector ( d, buf ) ) return false;
+  CD_readahead_restart ( d->ra, d->current_sec+1 );
+  
+  return true;
+  
+} // end read_sector_ra
+
+
+// Cal cridar-la cada vegada que es canvia la posició del cursor fora
+// de la lectura seqüencial.
+static void
+update_readahead (
+                  CD_ISO_Disc *d
+                  )
+{
+  if ( d->ra != NULL ) CD_readahead_restart ( d->ra, d->current_sec );
+} // end update_readahead
+
+
+// Inventa en BUF el subcanal Q dels sectors [FIRST,END). Hi ha dos
+// trams: el pregap i la resta (com en 'read_q').
+static void
+fill_q (
+        const size_t  first,
+        const size_t  end,
+        uint8_t      *buf,
+        bool         *crc_ok
+        )
+{
+
+  CD_SubQRun run;
+  size_t sec,nrun;
+  
+
+  run.ctrl= 0x41;
+  run.track= BCD ( 1 );
+  for ( sec= first; sec < end; sec+= nrun )
+    {
+      run.abs= sec;
+      if ( sec >= IGAP )
+        {
+          nrun= end-sec;
+          run.index= 0x01;
+          run.pregap= false;
+          run.rel= sec - IGAP;
+        }
+      else
+        {
+          nrun= (end < IGAP ? end : IGAP) - sec;
+          run.index= 0x00;
+          run.pregap= true;
+          run.rel= IGAP - 1 - sec;
+        }
+      CD_subq_fill ( buf + (sec-first)*CD_SUBCH_SIZE, &run, nrun,
+                     crc_ok!=NULL ? &crc_ok[sec-first] : NULL );
+    }
+  
+} // end fill_q
+
+
+// Llig N sectors a partir de l'actual, i el seu subcanal Q si Q no és
+// NULL, calculant el rang una única vegada.
+static int
+read_secs (
+           CD_ISO_Disc *d,
+           uint8_t     *buf,
+           uint8_t     *q,
+           bool        *crc_ok,
+           bool        *audio,
+           const int    n,
+           const bool   move
+           )
+{
+
+  struct iovec *iov;
+  size_t sec,end,beg,k;
+  uint8_t *p;
+  bool ok;
+  int ret;
+  
+  
+  if ( n < 0 ) return -1;
+  
+  // Rang a llegir.
+  sec= d->current_sec;
+  end= sec + (size_t) n;
+  if ( end > (d->core->num_secs+IGAP) ) end= d->core->num_secs+IGAP;
+  if ( sec > end ) sec= end;
+  ret= (int) (end-sec);
+  if ( audio != NULL )
+    for ( k= 0; k < (size_t) ret; ++k ) audio[k]= false;
+  if ( q != NULL ) fill_q ( sec, end, q, crc_ok );
+
+  // Pregap.
+  for ( ; sec < end && sec < IGAP; ++sec, buf+= CD_SEC_SIZE )
+    memset ( buf, 0, CD_SEC_SIZE );
+  
+  // Dades. Les dades són contigües en el fitxer, per tant es fa una
+  // única lectura repartint cada sector en el seu lloc.
+  if ( sec < end )
+    {
+      beg= sec-IGAP;
+      if ( d->core->mem != NULL )
+        for ( k= 0, p= buf; k < end-sec; ++k, p+= CD_SEC_SIZE )
+          memcpy ( &p[16], d->core->mem + (beg+k)*SEC_SIZE, SEC_SIZE );
+      else
+        {
+          iov= mem_alloc ( struct iovec, end-sec );
+          for ( k= 0, p= buf; k < end-sec; ++k, p+= CD_SEC_SIZE )
+            {
+              iov[k].iov_base= &p[16];
+              iov[k].iov_len= SEC_SIZE;
+            }
+          ok= CD_readv_at ( d->core->fd, iov, (int) (end-sec),
+                            (long) (beg*SEC_SIZE) );
+          free ( iov );
+          if ( !ok ) return -1;
+        }
+      for ( ; sec < end; ++sec, buf+= CD_SEC_SIZE )
+        {
+          write_sync ( buf );
+          write_header ( sec, buf );
+          CD_ecc_mode1 ( buf );
+        }
+    }
+  if ( move )
+    {
+      d->current_sec= end;
+      update_readahead ( d );
+    }
+  
+  return ret;
+  
+} // end read_secs
+
+
+// Crea un nou cursor sobre CORE. No modifica les referències.
+static CD_ISO_Disc *
+new_cursor (
+            iso_core_t *core
+            );
 
 
 
@@ -150,7 +428,11 @@ free_ (
        )
 {
 
-  if ( ISO(d)->f != NULL ) fclose ( ISO(d)->f );
+  // L'últim cursor allibera les dades compartides.
+  if ( ISO(d)->ra != NULL ) CD_readahead_free ( ISO(d)->ra );
+  if ( ISO(d)->io != NULL ) CD_ioengine_free ( ISO(d)->io );
+  if ( atomic_fetch_sub ( &(CORE(d)->refs), 1 ) == 1 )
+    free_core ( CORE(d) );
   free ( d );
   
 } // end free_
@@ -166,6 +448,7 @@ move_to_session (
   if ( sess != 1 ) return false;
 
   ISO(d)->current_sec= IGAP; // Primer sector amb contingut primer track.
+  update_readahead ( ISO(d) );
   
   return true;
   
@@ -184,6 +467,7 @@ move_to_track (
   if ( track != 1 ) return false;
   
   ISO(d)->current_sec= IGAP; // Primer sector amb contingut primer track.
+  update_readahead ( ISO(d) );
   
   return true;
   
@@ -196,6 +480,7 @@ reset (
        )
 {
   ISO(d)->current_sec= 0;
+  update_readahead ( ISO(d) );
 } // end reset
 
 
@@ -212,11 +497,10 @@ seek (
   
   
   pos= amm*60*75 + ass*75 + asect;
-  if ( pos < 0 || pos >= (ISO(d)->num_secs+IGAP) ) return false;
+  if ( pos < 0 || pos >= (CORE(d)->num_secs+IGAP) ) return false;
 
   ISO(d)->current_sec= pos;
-  if ( !force_seek ( ISO(d) ) )
-    return false;
+  update_readahead ( ISO(d) );
   
   return true;
   
@@ -241,42 +525,11 @@ read (
       )
 {
 
-  int i,mm,ss,sec;
-  size_t tmp;
-  
-  
-  if ( ISO(d)->current_sec >= (ISO(d)->num_secs+IGAP) ) return false;
+  if ( ISO(d)->current_sec >= (CORE(d)->num_secs+IGAP) ) return false;
 
   // Intenta llegir.
   *audio= false;
-  if ( ISO(d)->current_sec <= IGAP )
-    memset ( buf, 0, CD_SEC_SIZE ); // TODO?!!!
-  else
-    {
-
-      // Llig dades.
-      if ( !force_seek ( ISO(d) ) ) return false;
-      if ( fread ( &buf[16], SEC_SIZE, 1, ISO(d)->f ) != 1 )
-        return false;
-
-      // Emule sectors MODE 01 i Header (La resta de camps els deixe a 0)
-      // --> Sync
-      buf[0]= 0x00;
-      for ( i= 1; i < 11; i++ ) buf[i]= 0xff;
-      buf[11]= 0x00;
-      // --> Header
-      mm= (ISO(d)->current_sec)/(60*75);
-      tmp= (ISO(d)->current_sec)%(60*75);
-      ss= tmp/75;
-      sec= tmp%75;
-      buf[12]= BCD(mm);
-      buf[13]= BCD(ss);
-      buf[14]= BCD(sec);
-      buf[15]= 0x01; // Mode 01
-      // --> EDC, Intermediate, P-Parity, Q-Parity (TODO??!!!)
-      for ( i= 2064; i < CD_SEC_SIZE; i++ ) buf[i]= 0x00;
-      
-    }
+  if ( !read_sector_ra ( ISO(d), buf ) ) return false;
   if ( move ) ++(ISO(d)->current_sec);
   
   return true;
@@ -302,7 +555,7 @@ read_q (
   // CRC ok!!!
   *crc_ok= true;
   
-  if ( ISO(d)->current_sec >= (ISO(d)->num_secs+IGAP) ) return false;
+  if ( ISO(d)->current_sec >= (CORE(d)->num_secs+IGAP) ) return false;
 
   // En el primer byte fiquem els 2 bits de "Sub-channel
   // synchronization field".
@@ -388,7 +641,7 @@ get_info (
   indexes[0].pos= CD_get_position ( 0 );
   indexes[0].id= BCD(1);
   indexes[0].pos= CD_get_position ( IGAP );
-  tracks[0].pos_last_sector= CD_get_position ( (ISO(d)->num_secs+IGAP) - 1 );
+  tracks[0].pos_last_sector= CD_get_position ( (CORE(d)->num_secs+IGAP) - 1 );
 
   // Tipus.
   ret->type= CD_DISK_TYPE_MODE1;
@@ -422,7 +675,7 @@ get_current_index (
                    )
 {
   return
-    (ISO(d)->current_sec>=(ISO(d)->num_secs+IGAP) || ISO(d)->current_sec<IGAP) ?
+    (ISO(d)->current_sec>=(CORE(d)->num_secs+IGAP) || ISO(d)->current_sec<IGAP) ?
     0x00 : 0x01;
 } // end get_current_index
 
@@ -435,6 +688,7 @@ move_to_leadin (
 
   fprintf ( stderr, "[WW] lead-in not available in ISO format\n" );
   ISO(d)->current_sec= 0;
+  update_readahead ( ISO(d) );
   
   return true;
   
@@ -450,26 +704,329 @@ tell (
 } // end tell
 
 
+static const uint8_t *
+read_view (
+           CD_Disc    *d,
+           bool       *audio,
+           const bool  move
+           )
+{
 
+  const uint8_t *ret;
+  
+  
+  if ( ISO(d)->current_sec >= (CORE(d)->num_secs+IGAP) ) return NULL;
+  
+  // NOTA!! El 'Sync' de 'sec_buf' no canvia mai (s'inicialitza en
+  // 'new_cursor'), sols cal actualitzar la capçalera, les dades i
+  // l'EDC/ECC.
+  *audio= false;
+  if ( ISO(d)->ra != NULL ) // Amb lectura anticipada es copia de l'anell.
+    {
+      if ( !read_sector_ra ( ISO(d), ISO(d)->ra_buf ) ) return NULL;
+      ret= ISO(d)->ra_buf;
+    }
+  else if ( ISO(d)->current_sec < IGAP ) ret= ZERO_SEC;
+  else
+    {
+      if ( !read_sector_data ( ISO(d), &(ISO(d)->sec_buf[16]) ) )
+        return NULL;
+      write_header ( ISO(d)->current_sec, ISO(d)->sec_buf );
+      CD_ecc_mode1 ( ISO(d)->sec_buf );
+      ret= ISO(d)->sec_buf;
+    }
+  if ( move ) ++(ISO(d)->current_sec);
+  
+  return ret;
+  
+} // end read_view
 
-/**********************/
-/* FUNCIONS PÚBLIQUES */
-/**********************/
 
-CD_Disc *
-CD_iso_disc_new (
-                 const char  *fn,
-                 char       **err
-                 )
+static int
+read_n (
+        CD_Disc    *d,
+        uint8_t    *buf,
+        bool       *audio,
+        const int   n,
+        const bool  move
+        )
+{
+  return read_secs ( ISO(d), buf, NULL, NULL, audio, n, move );
+} // end read_n
+
+
+static CD_Disc *
+clone (
+       CD_Disc *d
+       )
 {
 
   CD_ISO_Disc *new;
 
+  
+  atomic_fetch_add ( &(CORE(d)->refs), 1 );
+  new= new_cursor ( CORE(d) );
+  new->current_sec= ISO(d)->current_sec;
+
+  return (CD_Disc *) new;
+  
+} // end clone
+
+
+static bool
+set_readahead (
+               CD_Disc   *d,
+               const int  depth
+               )
+{
+
+  CD_Disc *producer;
+  
+  
+  if ( ISO(d)->ra != NULL )
+    {
+      CD_readahead_free ( ISO(d)->ra );
+      ISO(d)->ra= NULL;
+    }
+  if ( depth <= 0 ) return true;
+
+  // El fil d'E/S llig amb el seu propi cursor.
+  producer= clone ( d );
+  ISO(d)->ra= CD_readahead_new ( producer, depth, ISO(d)->current_sec );
+  if ( ISO(d)->ra == NULL )
+    {
+      CD_disc_free ( producer );
+      return false;
+    }
+  
+  return true;
+  
+} // end set_readahead
+
 
+static void
+get_readahead_stats (
+                     CD_Disc           *d,
+                     CD_ReadAheadStats *stats
+                     )
+{
+
+  if ( ISO(d)->ra != NULL ) CD_readahead_get_stats ( ISO(d)->ra, stats );
+  else stats->hits= stats->misses= 0;
+  
+} // end get_readahead_stats
+
+
+// Completa el sector quan arriben les dades.
+static void
+read_batch_done (
+                 const int  req,
+                 const bool ok,
+                 void      *udata
+                 )
+{
+
+  batch_t *b;
+  CD_SectorReq *r;
+  
+  
+  b= (batch_t *) udata;
+  r= &(b->reqs[b->ids[req]]);
+  r->ok= ok;
+  if ( ok )
+    {
+      write_sync ( r->buf );
+      write_header ( (size_t) r->sec, r->buf );
+      CD_ecc_mode1 ( r->buf );
+    }
+  
+} // end read_batch_done
+
+
+static int
+read_batch (
+            CD_Disc      *d,
+            CD_SectorReq *reqs,
+            const int     n
+            )
+{
+
+  CD_IOReq *io;
+  batch_t b;
+  int i,nio,ret;
+  
+
+  if ( n <= 0 ) return 0;
+  if ( ISO(d)->io == NULL ) ISO(d)->io= CD_ioengine_new ( IO_DEPTH );
+  
+  // Prepara les lectures.
+  io= mem_alloc ( CD_IOReq, n );
+  b.reqs= reqs;
+  b.ids= mem_alloc ( int, n );
+  for ( i= nio= 0; i < n; ++i )
+    {
+      reqs[i].ok= false;
+      reqs[i].audio= false;
+      if ( reqs[i].sec < 0 ||
+           (size_t) reqs[i].sec >= (CORE(d)->num_secs+IGAP) )
+        continue;
+      if ( reqs[i].sec < IGAP )
+        {
+          memset ( reqs[i].buf, 0, CD_SEC_SIZE );
+          reqs[i].ok= true;
+          continue;
+        }
+      io[nio].fd= CORE(d)->fd;
+      io[nio].offset= (long) (reqs[i].sec-IGAP)*SEC_SIZE;
+      io[nio].buf= &(reqs[i].buf[16]);
+      io[nio].size= SEC_SIZE;
+      b.ids[nio++]= i;
+    }
+
+  // Llig.
+  CD_ioengine_read ( ISO(d)->io, io, nio, read_batch_done, &b );
+  free ( b.ids );
+  free ( io );
+  for ( i= ret= 0; i < n; ++i )
+    if ( reqs[i].ok ) ++ret;
+  
+  return ret;
+  
+} // end read_batch
+
+
+static int
+read_q_range (
+              CD_Disc    *d,
+              uint8_t    *buf,
+              bool       *crc_ok,
+              const int   n,
+              const bool  move
+              )
+{
+
+  size_t first,end;
+  int ret;
+  
+
+  if ( n < 0 ) return -1;
+
+  // Rang.
+  first= ISO(d)->current_sec;
+  end= first + (size_t) n;
+  if ( end > CORE(d)->num_secs+IGAP ) end= CORE(d)->num_secs+IGAP;
+  if ( first > end ) first= end;
+  ret= (int) (end-first);
+  fill_q ( first, end, buf, crc_ok );
+  
+  if ( move )
+    {
+      ISO(d)->current_sec= end;
+      update_readahead ( ISO(d) );
+    }
+  
+  return ret;
+  
+} // end read_q_range
+
+
+static bool
+read_pw (
+         CD_Disc    *d,
+         uint8_t     buf[CD_SUBPW_SIZE],
+         const bool  move
+         )
+{
+
+  uint8_t q[CD_SUBCH_SIZE];
+  bool crc_ok;
+  
+
+  // No hi ha subcanal desat, es sintetitza a partir del Q.
+  if ( !read_q ( d, q, &crc_ok, move ) ) return false;
+  CD_subq_to_pw ( q, buf );
+  
+  return true;
+  
+} // end read_pw
+
+
+static bool
+read_user_data (
+                CD_Disc    *d,
+                uint8_t     buf[CD_USER_DATA_SIZE],
+                int        *length,
+                const bool  move
+                )
+{
+
+  // El pregap no té dades (MODE 0).
+  if ( ISO(d)->current_sec >= (CORE(d)->num_secs+IGAP) ||
+       ISO(d)->current_sec < IGAP )
+    return false;
+
+  // Amb lectura anticipada el sector ja està en l'anell, si no es
+  // llig directament en BUF.
+  if ( ISO(d)->ra != NULL )
+    {
+      if ( !read_sector_ra ( ISO(d), ISO(d)->ra_buf ) ) return false;
+      memcpy ( buf, &(ISO(d)->ra_buf[16]), SEC_SIZE );
+    }
+  else if ( !read_sector_data ( ISO(d), buf ) ) return false;
+  *length= SEC_SIZE;
+  if ( move ) ++(ISO(d)->current_sec);
+  
+  return true;
+  
+} // end read_user_data
+
+
+// Un únic sector (el cas habitual en un emulador) es llig com en
+// 'read' i 'read_q' però amb una única crida, passant per la lectura
+// anticipada. La resta es llig d'una vegada amb les dades.
+static int
+read_with_q (
+             CD_Disc    *d,
+             uint8_t    *buf,
+             uint8_t    *q,
+             bool       *crc_ok,
+             bool       *audio,
+             const int   n,
+             const bool  move
+             )
+{
+
+  bool ok;
+  
+
+  if ( n != 1 )
+    return read_secs ( ISO(d), buf, q, crc_ok, audio, n, move );
+  if ( ISO(d)->current_sec >= (CORE(d)->num_secs+IGAP) ) return 0;
+  if ( !read_sector_ra ( ISO(d), buf ) ) return -1;
+  if ( audio != NULL ) *audio= false;
+  read_q ( d, q, crc_ok!=NULL ? crc_ok : &ok, move );
+  
+  return 1;
+  
+} // end read_with_q
+
+
+static CD_ISO_Disc *
+new_cursor (
+            iso_core_t *core
+            )
+{
+
+  CD_ISO_Disc *new;
+
+  
   new= mem_alloc ( CD_ISO_Disc, 1 );
-  new->f= NULL;
-  new->num_secs= 0;
+  new->core= core;
   new->current_sec= IGAP; // Primera posició amb contingut.
+  new->ra= NULL;
+  new->io= NULL;
+  memset ( new->sec_buf, 0, CD_SEC_SIZE );
+  write_sync ( new->sec_buf );
   new->_m.free= free_;
   new->_m.move_to_session= move_to_session;
   new->_m.move_to_track= move_to_track;
@@ -484,9 +1041,48 @@ CD_iso_disc_new (
   new->_m.get_current_index= get_current_index;
   new->_m.move_to_leadin= move_to_leadin;
   new->_m.tell= tell;
+  new->_m.read_view= read_view;
+  new->_m.read_n= read_n;
+  new->_m.clone= clone;
+  new->_m.set_readahead= set_readahead;
+  new->_m.get_readahead_stats= get_readahead_stats;
+  new->_m.read_batch= read_batch;
+  new->_m.read_q_range= read_q_range;
+  new->_m.read_pw= read_pw;
+  new->_m.read_user_data= read_user_data;
+  new->_m.read_with_q= read_with_q;
+  
+  return new;
+  
+} // end new_cursor
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+CD_Disc *
+CD_iso_disc_new (
+                 const char  *fn,
+                 char       **err
+                 )
+{
+
+  CD_ISO_Disc *new;
+  iso_core_t *core;
+
+
+  core= mem_alloc ( iso_core_t, 1 );
+  atomic_init ( &(core->refs), 1 );
+  core->fd= -1;
+  core->mem= NULL;
+  core->num_secs= 0;
+  new= new_cursor ( core );
   
   // Llig.
-  if ( !read_iso ( fn, new, err ) )
+  if ( !read_iso ( fn, core, err ) )
     goto error;
 
   return (CD_Disc *) new;
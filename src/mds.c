@@ -0,0 +1,433 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  mds.c - Implementació de 'mds.h'.
+ *
+ */
+/*
+ *  El .mds és un fitxer binari (little-endian) amb una capçalera, un
+ *  bloc per sessió i un bloc de dades per cada entrada del TOC
+ *  (tracks i punts A0-A2). Cada bloc de track indica on comença en el
+ *  .mdf, la grandària de cada sector desat (2352 o 2352+96 si
+ *  inclou el subcanal P-W intercalat) i, en un bloc extra, el pregap
+ *  i la longitud. El .mdf es projecta en memòria i es llig
+ *  directament amb la grandària de sector de cada track, de manera
+ *  que el subcanal Q s'extrau del mateix .mdf sense conversions.
+ *
+ *  El pregap del primer track no sol estar desat en el .mdf, i el
+ *  lead-out i lead-in entre sessions mai. Si el pregap d'un track
+ *  està desat o no es dedueix de l'espai que hi ha fins al següent
+ *  track.
+ *
+ *  Ací sols es llig el .mds i es calcula on està cada sector, la resta
+ *  està en 'img.c'.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CD.h"
+#include "img.h"
+#include "mds.h"
+#include "utils.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define POINT_FIRST 0xA0
+
+// Format del .mds.
+#define MDS_SIGNATURE "MEDIA DESCRIPTOR"
+#define HEADER_SIZE 0x58
+#define SESSION_SIZE 0x18
+#define BLOCK_SIZE 0x50
+#define EXTRA_SIZE 0x08
+
+// Tipus de mitjà a partir del qual són DVDs.
+#define MEDIUM_DVD 0x10
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+// Bloc extra de cada track.
+typedef struct
+{
+
+  size_t pregap; // Sectors del pregap.
+  size_t length; // Sectors a partir de l'índex 01.
+  
+} extra_t;
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static uint16_t
+get_u16 (
+         const uint8_t *p
+         )
+{
+  return (uint16_t) (p[0] | (p[1]<<8));
+} // end get_u16
+
+
+static uint32_t
+get_u32 (
+         const uint8_t *p
+         )
+{
+  return ((uint32_t) p[0]) | (((uint32_t) p[1])<<8) |
+    (((uint32_t) p[2])<<16) | (((uint32_t) p[3])<<24);
+} // end get_u32
+
+
+static uint64_t
+get_u64 (
+         const uint8_t *p
+         )
+{
+  return ((uint64_t) get_u32 ( p )) | (((uint64_t) get_u32 ( p+4 ))<<32);
+} // end get_u64
+
+
+// Torna el bloc de LEN bytes que comença en OFFSET del .mds, o NULL
+// si no cap.
+static const uint8_t *
+get_block (
+           const uint8_t  *mds,
+           const size_t    size,
+           const uint32_t  offset,
+           const size_t    len
+           )
+{
+  return (size_t) offset > size || size-(size_t) offset < len ?
+    NULL : mds + offset;
+} // end get_block
+
+
+// Llig un bloc de track.
+static bool
+parse_track (
+             CD_ImgTrack   *track,
+             extra_t       *extra,
+             const uint8_t *block,
+             const uint8_t *mds,
+             const size_t   size
+             )
+{
+
+  const uint8_t *eb;
+  
+
+  // ADR en els 4 bits alts i Control en els baixos.
+  track->ctrl= block[0x02]&0xF;
+  switch ( block[0x00]&0xF )
+    {
+    case 0x0:
+      track->type= (track->ctrl&0x4) ? CD_IMG_MODE1 : CD_IMG_AUDIO;
+      break;
+    case 0x9: track->type= CD_IMG_AUDIO; break;
+    case 0xA: track->type= CD_IMG_MODE1; break;
+    case 0xB:
+    case 0xC:
+    case 0xD: track->type= CD_IMG_MODE2; break;
+    default: return false;
+    }
+  track->format= CD_IMG_RAW;
+  track->data_size= CD_SEC_SIZE;
+  track->sub= block[0x01] != 0x00;
+  track->stride= get_u16 ( &block[0x10] );
+  track->offset= get_u64 ( &block[0x28] );
+  // MSF absolut en binari (inclou els 2 segons inicials).
+  track->sector_index01= ((size_t) block[0x09]*60 + block[0x0a])*75 +
+    block[0x0b];
+  
+  // Pregap i longitud.
+  eb= get_block ( mds, size, get_u32 ( &block[0x0c] ), EXTRA_SIZE );
+  if ( eb == NULL ) return false;
+  extra->pregap= get_u32 ( &eb[0] );
+  extra->length= get_u32 ( &eb[4] );
+  if ( extra->pregap > track->sector_index01 ) return false;
+  
+  return true;
+  
+} // end parse_track
+
+
+// Crea els tracks, índexs i sessions a partir dels blocs del
+// .mds. Torna fals si no són coherents.
+static bool
+build_toc (
+           CD_ImgCore    *core,
+           extra_t       *extras,
+           const uint8_t *mds,
+           const size_t   size
+           )
+{
+
+  const uint8_t *points[CD_IMG_MAX_TRACKS],*sb,*tb;
+  int tsess[CD_IMG_MAX_TRACKS];
+  CD_ImgTrack *track;
+  CD_ImgSession *sess;
+  size_t t,s,prev;
+  uint32_t tb_off;
+  long lba;
+  int b,nblocks;
+  
+  
+  // Sessions i blocs.
+  core->NS= get_u16 ( &mds[0x14] );
+  if ( core->NS == 0 || core->NS > CD_IMG_MAX_TRACKS ) return false;
+  core->sessions= mem_alloc ( CD_ImgSession, core->NS );
+  memset ( points, 0, sizeof(points) );
+  for ( s= 0; s < core->NS; ++s )
+    {
+      sb= get_block ( mds, size,
+                      get_u32 ( &mds[0x50] ) + (uint32_t) (s*SESSION_SIZE),
+                      SESSION_SIZE );
+      if ( sb == NULL ) return false;
+      sess= &(core->sessions[s]);
+      sess->ntracks= 0;
+      sess->disc_type= CD_IMG_DISC_TYPE_CDROM;
+      lba= (long) (int32_t) get_u32 ( &sb[0x04] );
+      if ( lba < 0 ) return false;
+      sess->leadout= (size_t) lba + CD_IMG_IGAP;
+      nblocks= sb[0x0a];
+      tb_off= get_u32 ( &sb[0x14] );
+      for ( b= 0; b < nblocks; ++b )
+        {
+          tb= get_block ( mds, size, tb_off + (uint32_t) (b*BLOCK_SIZE),
+                          BLOCK_SIZE );
+          if ( tb == NULL ) return false;
+          if ( tb[0x04] == POINT_FIRST ) sess->disc_type= tb[0x0a];
+          else if ( tb[0x04] >= 1 && tb[0x04] <= CD_IMG_MAX_TRACKS )
+            {
+              if ( points[tb[0x04]-1] != NULL ) return false;
+              points[tb[0x04]-1]= tb;
+              tsess[tb[0x04]-1]= (int) s;
+            }
+        }
+    }
+  for ( core->NT= 0;
+        core->NT < CD_IMG_MAX_TRACKS && points[core->NT] != NULL;
+        ++(core->NT) );
+  if ( core->NT == 0 ) return false;
+  for ( t= core->NT; t < CD_IMG_MAX_TRACKS; ++t )
+    if ( points[t] != NULL ) return false;
+
+  // Tracks i índexs. Les sessions han d'estar en ordre.
+  core->tracks= mem_alloc ( CD_ImgTrack, core->NT );
+  core->indexes= mem_alloc ( CD_ImgIndex, 2*core->NT );
+  core->NI= 0;
+  prev= 0;
+  for ( t= 0; t < core->NT; ++t )
+    {
+      track= &(core->tracks[t]);
+      s= (size_t) tsess[t];
+      sess= &(core->sessions[s]);
+      if ( (t == 0 && s != 0) ||
+           (t > 0 && (int) s != core->tracks[t-1].session &&
+            (int) s != core->tracks[t-1].session+1) )
+        return false;
+      if ( sess->ntracks++ == 0 ) sess->first_track= (int) t;
+      track->session= (int) s;
+      if ( !parse_track ( track, &(extras[t]), points[t], mds, size ) )
+        return false;
+      track->first= t == 0 ? 0 : track->sector_index01 - extras[t].pregap;
+      if ( track->first < prev ) return false;
+      track->p= (int) core->NI;
+      track->N= 0;
+      if ( track->first < track->sector_index01 )
+        CD_img_add_index ( core, track, 0x00, track->first );
+      CD_img_add_index ( core, track, 0x01, track->sector_index01 );
+      prev= track->sector_index01+1;
+    }
+  
+  return CD_img_build_toc ( core, false );
+  
+} // end build_toc
+
+
+// Decideix quins sectors de cada track estan desats en el .mdf i crea
+// el mapa de sectors. El pregap està desat si hi ha espai fins al
+// següent track. Torna fals si el .mdf és massa menut.
+static bool
+build_extents (
+               CD_ImgCore    *core,
+               const extra_t *extras
+               )
+{
+
+  CD_ImgTrack *track;
+  uint64_t avail,need;
+  size_t t,sp,n,m;
+  
+  
+  for ( t= 0; t < core->NT; ++t )
+    {
+      track= &(core->tracks[t]);
+      if ( track->offset > (uint64_t) core->size ) return false;
+      avail= (uint64_t) core->size - track->offset;
+      if ( t+1 < core->NT && core->tracks[t+1].offset > track->offset &&
+           core->tracks[t+1].offset - track->offset < avail )
+        avail= core->tracks[t+1].offset - track->offset;
+      avail/= track->stride;
+      n= track->end - track->sector_index01;
+      m= extras[t].length < n ? extras[t].length : n;
+      sp= extras[t].pregap > 0 &&
+        avail >= (uint64_t) (extras[t].pregap + extras[t].length) ?
+        extras[t].pregap : 0;
+      need= (uint64_t) (sp + m);
+      if ( avail < need ) return false;
+
+      // Els sectors que no estan desats es lligen com a zeros.
+      track->stored_first= track->sector_index01 - sp;
+      track->nstored= sp + m;
+    }
+  
+  return CD_img_build_extents ( core, (uint64_t) core->size );
+  
+} // end build_extents
+
+
+static bool
+load_mds (
+          CD_ImgCore  *core,
+          const char  *fn,
+          char       **err
+          )
+{
+
+  extra_t extras[CD_IMG_MAX_TRACKS];
+  uint8_t *mds;
+  long size;
+  size_t t;
+  int fd;
+  bool ret;
+  
+
+  // Fitxer MDS.
+  mds= NULL;
+  ret= false;
+  fd= CD_file_open ( fn, &size );
+  if ( fd == -1 )
+    {
+      CD_msgerror ( err, "unable to open '%s'", fn );
+      return false;
+    }
+  if ( size < HEADER_SIZE )
+    {
+      CD_msgerror ( err, "unable to load '%s': not a MDS file", fn );
+      goto end;
+    }
+  mds= mem_alloc ( uint8_t, (size_t) size );
+  if ( !CD_read_at ( fd, mds, (size_t) size, 0 ) )
+    {
+      CD_msgerror ( err, "error while reading '%s'", fn );
+      goto end;
+    }
+  if ( memcmp ( mds, MDS_SIGNATURE, strlen ( MDS_SIGNATURE ) ) )
+    {
+      CD_msgerror ( err, "unable to load '%s': not a MDS file", fn );
+      goto end;
+    }
+  if ( get_u16 ( &mds[0x12] ) >= MEDIUM_DVD )
+    {
+      CD_msgerror ( err, "unable to load '%s': only CDs are supported", fn );
+      goto end;
+    }
+  if ( !build_toc ( core, extras, mds, (size_t) size ) )
+    {
+      CD_msgerror ( err, "unable to load '%s': invalid TOC", fn );
+      goto end;
+    }
+  for ( t= 0; t < core->NT; ++t )
+    if ( core->tracks[t].stride !=
+         CD_SEC_SIZE + (core->tracks[t].sub ? CD_SUBPW_SIZE : 0) )
+      {
+        CD_msgerror ( err, "unable to load '%s': track %d has an"
+                      " unsupported sector size (%lu)", fn, (int) t+1,
+                      (unsigned long) core->tracks[t].stride );
+        goto end;
+      }
+
+  // Imatge.
+  core->fd= CD_img_open_companion ( fn, ".mdf", &size );
+  if ( core->fd == -1 )
+    {
+      CD_msgerror ( err, "unable to load '%s': MDF file not found", fn );
+      goto end;
+    }
+  core->size= (size_t) size;
+  if ( !build_extents ( core, extras ) )
+    {
+      CD_msgerror ( err, "unable to load '%s': MDF file too small", fn );
+      goto end;
+    }
+  core->mem= CD_file_map ( core->fd, core->size );
+  ret= true;
+  
+ end:
+  free ( mds );
+  CD_file_close ( fd );
+  return ret;
+  
+} // end load_mds
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+CD_Disc *
+CD_mds_disc_new (
+                 const char  *fn,
+                 char       **err // Pot ser NULL
+                 )
+{
+
+  CD_ImgCore *core;
+
+
+  core= CD_img_core_new ( "MDS" );
+  if ( !load_mds ( core, fn, err ) )
+    {
+      CD_img_core_free ( core );
+      return NULL;
+    }
+  
+  return CD_img_disc_new ( core );
+  
+} // end CD_mds_disc_new
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  mds.h - Imatges d'Alcohol 120% (MDS/MDF).
+ *
+ */
+/*
+ * NOTA!! El fitxer .mds descriu les sessions i tracks, i el .mdf
+ * (amb el mateix nom) conté els sectors en cru (2352 bytes) de cada
+ * track, seguits opcionalment dels 96 bytes de subcanal P-W
+ * intercalat.
+ */
+
+
+#ifndef __CD_MDS_H__
+#define __CD_MDS_H__
+
+#include "CD.h"
+
+// Torna NULL en cas d'error
+CD_Disc *
+CD_mds_disc_new (
+                 const char  *fn,
+                 char       **err // Pot ser NULL
+                 );
+
+#endif // __CD_MDS_H__
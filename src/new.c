@@ -30,8 +30,13 @@
 #include "CD.h"
 #include "utils.h"
 
+#include "ccd.h"
+#include "cdi.h"
+#include "chd.h"
 #include "cue.h"
 #include "iso.h"
+#include "mds.h"
+#include "nrg.h"
 
 
 
@@ -87,6 +92,12 @@ CD_disc_new (
   ext= get_ext ( fn );
   if ( !strcmp ( ext, "CUE" ) ) return CD_cue_disc_new ( fn, err );
   else if ( !strcmp ( ext, "ISO" ) ) return CD_iso_disc_new ( fn, err );
+  else if ( !strcmp ( ext, "CHD" ) ) return CD_chd_disc_new ( fn, err );
+  else if ( !strcmp ( ext, "CCD" ) ) return CD_ccd_disc_new ( fn, err );
+  else if ( !strcmp ( ext, "MDS" ) ) return CD_mds_disc_new ( fn, err );
+  else if ( !strcmp ( ext, "NRG" ) ) return CD_nrg_disc_new ( fn, err );
+  else if ( !strcmp ( ext, "CDI" ) ) return CD_cdi_disc_new ( fn, err );
+  else if ( !strcmp ( ext, "ECM" ) ) return CD_cue_bin_disc_new ( fn, err );
   else
     {
       CD_msgerror ( err, "unknown extension" );
@@ -94,3 +105,24 @@ CD_disc_new (
     }
   
 } // end CD_disc_new
+
+
+bool
+CD_disc_write_index (
+                     const char  *fn,
+                     char       **err
+                     )
+{
+
+  const char *ext;
+
+
+  ext= get_ext ( fn );
+  if ( !strcmp ( ext, "CUE" ) ) return CD_cue_write_index ( fn, err );
+  else
+    {
+      CD_msgerror ( err, "index not supported for this format" );
+      return false;
+    }
+  
+} // end CD_disc_write_index
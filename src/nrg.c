@@ -0,0 +1,689 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  nrg.c - Implementació de 'nrg.h'.
+ *
+ */
+/*
+ *  Els blocs de la cua del fitxer són big-endian. En les imatges DAO
+ *  cada sessió té un bloc CUEX (índexs de cada track, en LBA) i un
+ *  bloc DAOX (format i posició en el fitxer de cada track), i en les
+ *  TAO un únic bloc ETNF amb tots els tracks i un SINF per sessió amb
+ *  el número de tracks. Les versions antigues (NERO) gasten CUES, DAOI
+ *  i ETNF amb camps de 32 bits.
+ *
+ *  Cada track té el seu format: 2048 (MODE 1 o MODE 2 FORM 1), 2336
+ *  (MODE 2 sense capçalera) o 2352 bytes, opcionalment seguits de 96
+ *  bytes de subcanal P-W intercalat. Ací sols es lligen els blocs, la
+ *  lectura dels sectors (i la reconstrucció dels que no estan en cru)
+ *  està en 'img.c'.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CD.h"
+#include "img.h"
+#include "nrg.h"
+#include "utils.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define BCD(NUM) ((uint8_t) (((NUM)/10)*0x10 + (NUM)%10))
+#define BCD2DEC(NUM) ((((NUM)>>4)*10) + ((NUM)&0xF))
+
+#define MAX_INDEXES 100
+
+// Track del lead-out en els blocs CUEX.
+#define TRACK_LEADOUT 0xAA
+
+// Grandària dels blocs.
+#define CHUNK_HEADER 8
+#define CUE_ENTRY 8
+#define DAO_HEADER 22
+#define DAOI_ENTRY 30
+#define DAOX_ENTRY 42
+#define ETNF_ENTRY 20
+#define ETN2_ENTRY 32
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+// Entrada d'un bloc CUEX/CUES.
+typedef struct
+{
+
+  int     session; // Començant per 0.
+  uint8_t adr_ctl;
+  uint8_t track; // BCD
+  uint8_t index; // BCD
+  long    lba;
+  
+} cue_entry_t;
+
+// Entrada d'un bloc DAOX/DAOI o ETNF/ETN2.
+typedef struct
+{
+
+  int      session; // Començant per 0 (sols DAO).
+  int      track; // Començant per 1 (sols DAO).
+  uint32_t mode;
+  size_t   sector_size;
+  uint64_t offset0; // Pregap (sols DAO).
+  uint64_t offset1; // Índex 01.
+  uint64_t end;
+  long     lba; // Índex 01 (sols TAO).
+  
+} data_entry_t;
+
+// Contingut dels blocs del fitxer NRG.
+typedef struct
+{
+
+  cue_entry_t  *cues;
+  int           NC;
+  int           cues_size;
+  data_entry_t *datas;
+  int           ND;
+  int           datas_size;
+  bool          tao;
+  int           ncue_chunks;
+  int           ndao_chunks;
+  long          sinf[CD_IMG_MAX_TRACKS]; // Tracks per sessió.
+  int           NSI;
+  
+} nrg_t;
+
+// Índexs d'un track en els blocs CUEX.
+typedef struct
+{
+
+  long    lba[MAX_INDEXES];
+  bool    has[MAX_INDEXES];
+  int     session;
+  uint8_t adr_ctl;
+  
+} cue_track_t;
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static uint32_t
+get_u32 (
+         const uint8_t *p
+         )
+{
+  return (((uint32_t) p[0])<<24) | (((uint32_t) p[1])<<16) |
+    (((uint32_t) p[2])<<8) | ((uint32_t) p[3]);
+} // end get_u32
+
+
+static uint64_t
+get_u64 (
+         const uint8_t *p
+         )
+{
+  return (((uint64_t) get_u32 ( p ))<<32) | ((uint64_t) get_u32 ( p+4 ));
+} // end get_u64
+
+
+// Converteix una adreça MSF (BCD) de CUES en LBA.
+static long
+msf2lba (
+         const uint8_t *p
+         )
+{
+  return (BCD2DEC ( p[1] )*60 + BCD2DEC ( p[2] ))*75 +
+    BCD2DEC ( p[3] ) - CD_IMG_IGAP;
+} // end msf2lba
+
+
+static void
+add_cue (
+         nrg_t         *nrg,
+         const uint8_t *e,
+         const bool     old
+         )
+{
+
+  cue_entry_t *cue;
+  
+
+  if ( nrg->NC == nrg->cues_size )
+    {
+      nrg->cues_size*= 2;
+      nrg->cues= mem_realloc ( cue_entry_t, nrg->cues, nrg->cues_size );
+    }
+  cue= &(nrg->cues[nrg->NC++]);
+  cue->session= nrg->ncue_chunks;
+  cue->adr_ctl= e[0];
+  cue->track= e[1];
+  cue->index= e[2];
+  cue->lba= old ? msf2lba ( &e[4] ) : (long) (int32_t) get_u32 ( &e[4] );
+  
+} // end add_cue
+
+
+static data_entry_t *
+new_data (
+          nrg_t *nrg
+          )
+{
+
+  data_entry_t *ret;
+
+  
+  if ( nrg->ND == nrg->datas_size )
+    {
+      nrg->datas_size*= 2;
+      nrg->datas= mem_realloc ( data_entry_t, nrg->datas, nrg->datas_size );
+    }
+  ret= &(nrg->datas[nrg->ND++]);
+  memset ( ret, 0, sizeof(data_entry_t) );
+  
+  return ret;
+  
+} // end new_data
+
+
+// Grandària dels sectors a partir del codi de mode (els blocs ETNF no
+// la indiquen).
+static size_t
+get_sector_size (
+                 const uint32_t mode
+                 )
+{
+
+  switch ( mode )
+    {
+    case 0x00:
+    case 0x02: return 2048;
+    case 0x03: return 2336;
+    case 0x0F:
+    case 0x10:
+    case 0x11: return CD_SEC_SIZE + CD_SUBPW_SIZE;
+    default: return CD_SEC_SIZE;
+    }
+  
+} // end get_sector_size
+
+
+// Llig els blocs de BUF. Torna fals si no són vàlids.
+static bool
+parse_chunks (
+              nrg_t         *nrg,
+              const uint8_t *buf,
+              const size_t   size
+              )
+{
+
+  const uint8_t *id,*data,*e;
+  data_entry_t *de;
+  size_t p,csize,i,n,step;
+  bool x;
+  
+
+  for ( p= 0; size-p >= CHUNK_HEADER; p+= CHUNK_HEADER+csize )
+    {
+      id= &buf[p];
+      csize= get_u32 ( &buf[p+4] );
+      data= &buf[p+CHUNK_HEADER];
+      if ( !memcmp ( id, "END!", 4 ) ) return true;
+      if ( csize > size-p-CHUNK_HEADER ) return false;
+
+      // Índexs.
+      if ( !memcmp ( id, "CUEX", 4 ) || !memcmp ( id, "CUES", 4 ) )
+        {
+          for ( i= 0; i+CUE_ENTRY <= csize; i+= CUE_ENTRY )
+            add_cue ( nrg, &data[i], id[3] == 'S' );
+          ++(nrg->ncue_chunks);
+        }
+
+      // Tracks DAO.
+      else if ( !memcmp ( id, "DAOX", 4 ) || !memcmp ( id, "DAOI", 4 ) )
+        {
+          if ( csize < DAO_HEADER ) return false;
+          x= id[3] == 'X';
+          step= x ? DAOX_ENTRY : DAOI_ENTRY;
+          n= (csize-DAO_HEADER)/step;
+          for ( i= 0; i < n; ++i )
+            {
+              e= &data[DAO_HEADER + i*step];
+              de= new_data ( nrg );
+              de->session= nrg->ndao_chunks;
+              de->track= data[20] + (int) i;
+              de->sector_size= (size_t) ((e[12]<<8) | e[13]);
+              de->mode= e[14];
+              de->offset0= x ? get_u64 ( &e[18] ) : get_u32 ( &e[18] );
+              de->offset1= x ? get_u64 ( &e[26] ) : get_u32 ( &e[22] );
+              de->end= x ? get_u64 ( &e[34] ) : get_u32 ( &e[26] );
+            }
+          ++(nrg->ndao_chunks);
+        }
+
+      // Tracks TAO.
+      else if ( !memcmp ( id, "ETN2", 4 ) || !memcmp ( id, "ETNF", 4 ) )
+        {
+          x= id[3] == '2';
+          step= x ? ETN2_ENTRY : ETNF_ENTRY;
+          for ( i= 0; i+step <= csize; i+= step )
+            {
+              e= &data[i];
+              de= new_data ( nrg );
+              de->offset1= x ? get_u64 ( &e[0] ) : get_u32 ( &e[0] );
+              de->end= de->offset1 + (x ? get_u64 ( &e[8] ) : get_u32 ( &e[4] ));
+              de->mode= get_u32 ( &e[x ? 16 : 8] );
+              de->lba= (long) (int32_t) get_u32 ( &e[x ? 20 : 12] );
+              de->sector_size= get_sector_size ( de->mode );
+            }
+          nrg->tao= true;
+        }
+
+      // Sessions.
+      else if ( !memcmp ( id, "SINF", 4 ) )
+        {
+          if ( csize < 4 || nrg->NSI == CD_IMG_MAX_TRACKS ) return false;
+          nrg->sinf[nrg->NSI++]= (long) get_u32 ( data );
+        }
+    }
+  
+  return false;
+  
+} // end parse_chunks
+
+
+// Assigna el tipus i el format del track a partir del codi de mode i
+// la grandària dels sectors. Torna fals si no es suporta.
+static bool
+set_format (
+            CD_ImgTrack    *track,
+            const uint32_t  mode,
+            size_t          sector_size
+            )
+{
+
+  switch ( mode )
+    {
+    case 0x07:
+    case 0x10: track->type= CD_IMG_AUDIO; break;
+    case 0x02:
+    case 0x03:
+    case 0x06:
+    case 0x11: track->type= CD_IMG_MODE2; break;
+    default: track->type= CD_IMG_MODE1;
+    }
+  track->sub= false;
+  track->stride= sector_size;
+  if ( sector_size == CD_SEC_SIZE + CD_SUBPW_SIZE )
+    {
+      track->sub= true;
+      sector_size= CD_SEC_SIZE;
+    }
+  track->data_size= sector_size;
+  switch ( sector_size )
+    {
+    case CD_SEC_SIZE: track->format= CD_IMG_RAW; break;
+    case 2336:
+      if ( track->type != CD_IMG_MODE2 ) return false;
+      track->format= CD_IMG_MODE2_2336;
+      break;
+    case 2048:
+      if ( track->type == CD_IMG_AUDIO ) return false;
+      track->format= track->type==CD_IMG_MODE2 ? CD_IMG_MODE2_FORM1_2048 : CD_IMG_MODE1_2048;
+      break;
+    default: return false;
+    }
+  
+  return true;
+  
+} // end set_format
+
+
+// Crea els tracks a partir dels blocs CUEX i DAOX.
+static bool
+build_tracks_dao (
+                  CD_ImgCore  *core,
+                  const nrg_t *nrg
+                  )
+{
+
+  cue_track_t *cts,*ct;
+  const cue_entry_t *c;
+  const data_entry_t *de;
+  CD_ImgTrack *track;
+  CD_ImgSession *sess;
+  size_t t,prev,npg;
+  long leadout[CD_IMG_MAX_TRACKS];
+  int i,n,idx;
+  bool ret;
+  
+
+  // Índexs de cada track.
+  if ( nrg->ncue_chunks != nrg->ndao_chunks || nrg->ncue_chunks == 0 ||
+       nrg->ncue_chunks > CD_IMG_MAX_TRACKS )
+    return false;
+  core->NS= (size_t) nrg->ncue_chunks;
+  for ( i= 0; i < (int) core->NS; ++i ) leadout[i]= -1;
+  cts= mem_alloc ( cue_track_t, CD_IMG_MAX_TRACKS );
+  for ( i= 0; i < CD_IMG_MAX_TRACKS; ++i )
+    {
+      memset ( cts[i].has, 0, sizeof(cts[i].has) );
+      cts[i].session= -1;
+    }
+  ret= false;
+  for ( i= 0; i < nrg->NC; ++i )
+    {
+      c= &(nrg->cues[i]);
+      if ( c->track == TRACK_LEADOUT ) leadout[c->session]= c->lba;
+      else if ( c->track != 0x00 )
+        {
+          n= BCD2DEC ( c->track );
+          idx= BCD2DEC ( c->index );
+          if ( n < 1 || n > CD_IMG_MAX_TRACKS || idx >= MAX_INDEXES ) goto end;
+          ct= &(cts[n-1]);
+          if ( ct->session != -1 && ct->session != c->session ) goto end;
+          ct->session= c->session;
+          ct->lba[idx]= c->lba;
+          ct->has[idx]= true;
+          if ( idx == 1 ) ct->adr_ctl= c->adr_ctl;
+        }
+    }
+
+  // Tracks.
+  core->NT= (size_t) nrg->ND;
+  if ( core->NT == 0 || core->NT > CD_IMG_MAX_TRACKS ) goto end;
+  core->tracks= mem_alloc ( CD_ImgTrack, core->NT );
+  core->indexes= mem_alloc ( CD_ImgIndex, core->NT*MAX_INDEXES );
+  core->sessions= mem_alloc ( CD_ImgSession, core->NS );
+  core->NI= 0;
+  for ( t= 0; t < core->NS; ++t )
+    {
+      if ( leadout[t] < -CD_IMG_IGAP ) goto end;
+      core->sessions[t].leadout= (size_t) (leadout[t] + CD_IMG_IGAP);
+      core->sessions[t].ntracks= 0;
+    }
+  prev= 0;
+  for ( t= 0; t < core->NT; ++t )
+    {
+      de= &(nrg->datas[t]);
+      ct= &(cts[t]);
+      track= &(core->tracks[t]);
+      if ( de->track != (int) t+1 || ct->session != de->session ||
+           !ct->has[1] || ct->lba[1] < -CD_IMG_IGAP )
+        goto end;
+      track->session= de->session;
+      sess= &(core->sessions[track->session]);
+      if ( sess->ntracks++ == 0 ) sess->first_track= (int) t;
+      
+      // Depenent de la versió ADR i Control estan en un ordre o
+      // l'altre, però ADR sempre és 1.
+      track->ctrl= (ct->adr_ctl&0xF) == 0x1 ?
+        ct->adr_ctl>>4 : ct->adr_ctl&0xF;
+      if ( !set_format ( track, de->mode, de->sector_size ) ) goto end;
+
+      // Índexs.
+      track->sector_index01= (size_t) (ct->lba[1] + CD_IMG_IGAP);
+      if ( t == 0 ) track->first= 0;
+      else if ( ct->has[0] )
+        {
+          if ( ct->lba[0] < -CD_IMG_IGAP ) goto end;
+          track->first= (size_t) (ct->lba[0] + CD_IMG_IGAP);
+        }
+      else track->first= track->sector_index01;
+      if ( track->first < prev || track->first > track->sector_index01 )
+        goto end;
+      track->p= (int) core->NI;
+      track->N= 0;
+      if ( track->first < track->sector_index01 )
+        CD_img_add_index ( core, track, 0x00, track->first );
+      CD_img_add_index ( core, track, 0x01, track->sector_index01 );
+      prev= track->sector_index01;
+      for ( i= 2; i < MAX_INDEXES; ++i )
+        if ( ct->has[i] )
+          {
+            if ( ct->lba[i] < -CD_IMG_IGAP || (size_t) (ct->lba[i]+CD_IMG_IGAP) <= prev )
+              goto end;
+            prev= (size_t) (ct->lba[i] + CD_IMG_IGAP);
+            CD_img_add_index ( core, track, BCD ( i ), prev );
+          }
+      prev++;
+      
+      // Sectors desats. El pregap pot estar-ho o no.
+      if ( de->offset1 < de->offset0 || de->end < de->offset1 ) goto end;
+      npg= (size_t) ((de->offset1 - de->offset0)/track->stride);
+      if ( npg > track->sector_index01 - track->first ) goto end;
+      track->offset= de->offset0;
+      track->stored_first= track->sector_index01 - npg;
+      track->nstored= npg + (size_t) ((de->end - de->offset1)/track->stride);
+    }
+  ret= true;
+  
+ end:
+  free ( cts );
+  return ret;
+  
+} // end build_tracks_dao
+
+
+// Crea els tracks a partir dels blocs ETNF i SINF. Els pregaps no
+// estan desats.
+static bool
+build_tracks_tao (
+                  CD_ImgCore  *core,
+                  const nrg_t *nrg
+                  )
+{
+
+  const data_entry_t *de;
+  CD_ImgTrack *track;
+  CD_ImgSession *sess;
+  size_t t,s,prev;
+  long n;
+  
+
+  // Sessions.
+  core->NT= (size_t) nrg->ND;
+  if ( core->NT == 0 || core->NT > CD_IMG_MAX_TRACKS ) return false;
+  core->NS= nrg->NSI > 0 ? (size_t) nrg->NSI : 1;
+  core->tracks= mem_alloc ( CD_ImgTrack, core->NT );
+  core->indexes= mem_alloc ( CD_ImgIndex, 2*core->NT );
+  core->sessions= mem_alloc ( CD_ImgSession, core->NS );
+  core->NI= 0;
+  for ( s= 0, t= 0; s < core->NS; ++s )
+    {
+      n= nrg->NSI > 0 ? nrg->sinf[s] : (long) core->NT;
+      if ( n <= 0 || (size_t) n > core->NT - t ) return false;
+      core->sessions[s].first_track= (int) t;
+      core->sessions[s].ntracks= (int) n;
+      t+= (size_t) n;
+    }
+  if ( t != core->NT ) return false;
+
+  // Tracks.
+  prev= 0;
+  for ( s= 0; s < core->NS; ++s )
+    {
+      sess= &(core->sessions[s]);
+      for ( t= (size_t) sess->first_track;
+            t < (size_t) (sess->first_track + sess->ntracks); ++t )
+        {
+          de= &(nrg->datas[t]);
+          track= &(core->tracks[t]);
+          track->session= (int) s;
+          if ( !set_format ( track, de->mode, de->sector_size ) ||
+               de->lba < 0 )
+            return false;
+          track->ctrl= track->type == CD_IMG_AUDIO ? 0x0 : 0x4;
+          track->sector_index01= (size_t) de->lba + CD_IMG_IGAP;
+          if ( track->sector_index01 < prev ) return false;
+          if ( t == 0 ) track->first= 0;
+          else if ( t == (size_t) sess->first_track )
+            track->first= track->sector_index01 - CD_IMG_IGAP < prev ?
+              prev : track->sector_index01 - CD_IMG_IGAP;
+          else track->first= prev;
+          track->p= (int) core->NI;
+          track->N= 0;
+          if ( track->first < track->sector_index01 )
+            CD_img_add_index ( core, track, 0x00, track->first );
+          CD_img_add_index ( core, track, 0x01, track->sector_index01 );
+          track->offset= de->offset1;
+          track->stored_first= track->sector_index01;
+          track->nstored= (size_t) ((de->end - de->offset1)/track->stride);
+          prev= track->sector_index01 + track->nstored;
+        }
+      sess->leadout= prev;
+    }
+  
+  return true;
+  
+} // end build_tracks_tao
+
+
+static bool
+load_nrg (
+          CD_ImgCore  *core,
+          const char  *fn,
+          char       **err
+          )
+{
+
+  uint8_t footer[12],*buf;
+  nrg_t nrg;
+  uint64_t offset;
+  size_t data_size;
+  long size;
+  bool ret;
+  
+
+  // Peu.
+  buf= NULL;
+  memset ( &nrg, 0, sizeof(nrg) );
+  ret= false;
+  core->fd= CD_file_open ( fn, &size );
+  if ( core->fd == -1 )
+    {
+      CD_msgerror ( err, "unable to open '%s'", fn );
+      return false;
+    }
+  core->size= (size_t) size;
+  if ( size < (long) sizeof(footer) ||
+       !CD_read_at ( core->fd, footer, sizeof(footer),
+                     size - (long) sizeof(footer) ) )
+    goto not_nrg;
+  if ( !memcmp ( footer, "NER5", 4 ) )
+    {
+      offset= get_u64 ( &footer[4] );
+      data_size= core->size - 12;
+    }
+  else if ( !memcmp ( &footer[4], "NERO", 4 ) )
+    {
+      offset= get_u32 ( &footer[8] );
+      data_size= core->size - 8;
+    }
+  else goto not_nrg;
+  if ( offset >= (uint64_t) data_size ) goto not_nrg;
+  
+  // Blocs.
+  buf= mem_alloc ( uint8_t, data_size - (size_t) offset );
+  if ( !CD_read_at ( core->fd, buf, data_size - (size_t) offset,
+                     (long) offset ) )
+    {
+      CD_msgerror ( err, "error while reading '%s'", fn );
+      goto end;
+    }
+  nrg.cues_size= nrg.datas_size= 8;
+  nrg.cues= mem_alloc ( cue_entry_t, nrg.cues_size );
+  nrg.datas= mem_alloc ( data_entry_t, nrg.datas_size );
+  if ( !parse_chunks ( &nrg, buf, data_size - (size_t) offset ) )
+    {
+      CD_msgerror ( err, "unable to load '%s': invalid chunk list", fn );
+      goto end;
+    }
+  data_size= (size_t) offset;
+  if ( !(nrg.tao ?
+         build_tracks_tao ( core, &nrg ) :
+         build_tracks_dao ( core, &nrg )) ||
+       !CD_img_build_toc ( core, true ) )
+    {
+      CD_msgerror ( err, "unable to load '%s': invalid TOC or unsupported"
+                    " track format", fn );
+      goto end;
+    }
+  if ( !CD_img_build_extents ( core, (uint64_t) data_size ) )
+    {
+      CD_msgerror ( err, "unable to load '%s': track data out of bounds",
+                    fn );
+      goto end;
+    }
+  core->mem= CD_file_map ( core->fd, core->size );
+  ret= true;
+  
+ end:
+  free ( nrg.datas );
+  free ( nrg.cues );
+  free ( buf );
+  return ret;
+
+ not_nrg:
+  CD_msgerror ( err, "unable to load '%s': not a NRG file", fn );
+  return false;
+  
+} // end load_nrg
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+CD_Disc *
+CD_nrg_disc_new (
+                 const char  *fn,
+                 char       **err // Pot ser NULL
+                 )
+{
+
+  CD_ImgCore *core;
+
+
+  core= CD_img_core_new ( "NRG" );
+  if ( !load_nrg ( core, fn, err ) )
+    {
+      CD_img_core_free ( core );
+      return NULL;
+    }
+  
+  return CD_img_disc_new ( core );
+  
+} // end CD_nrg_disc_new
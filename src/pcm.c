@@ -0,0 +1,874 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  pcm.c - Implementació de 'pcm.h'.
+ *
+ */
+/*
+ *  WAVE: es busquen els blocs "fmt " i "data" i les mostres es lligen
+ *  directament. MOTOROLA: com un BIN però intercanviant els bytes de
+ *  cada mostra.
+ *
+ *  FLAC: de les metadades sols es gasten STREAMINFO i SEEKTABLE. Per
+ *  a trobar el frame que conté una mostra es parteix del punt
+ *  anterior més pròxim de l'índex (inicialment els de la SEEKTABLE,
+ *  i després es van afegint els frames que es descodifiquen) i es
+ *  descodifica cap avant. Els frames descodificats es guarden en una
+ *  xicoteta cache, i un fil manté descodificats els AHEAD frames
+ *  següents a l'última lectura, de manera que en la reproducció les
+ *  lectures no han d'esperar a la descodificació. L'estat està
+ *  protegit pel bloqueig, però el fil descodifica fora d'ell.
+ */
+
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CD.h"
+#include "flac.h"
+#include "pcm.h"
+#include "utils.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define SAMPLE_RATE 44100
+#define BPS 16
+#define SAMPLE_SIZE 4 // 2 canals de 16 bits.
+
+// Frames descodificats per avançat i grandària de la cache.
+#define AHEAD 16
+#define NSLOTS (AHEAD+4)
+
+// Distància mínima (en mostres) entre dos punts de l'índex que no
+// són de la SEEKTABLE.
+#define POINT_DIST SAMPLE_RATE
+
+#define WAVE_HEADER_SIZE 12
+#define CHUNK_HEADER_SIZE 8
+#define FMT_SIZE 16
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+#define FLAC_MAGIC_SIZE 4
+#define FLAC_BLOCK_HEADER_SIZE 4
+#define FLAC_STREAMINFO 0
+#define FLAC_SEEKTABLE 3
+#define STREAMINFO_SIZE 34
+#define SEEKPOINT_SIZE 18
+#define SEEKPOINT_PLACEHOLDER UINT64_MAX
+
+// Bytes de capçalera i peu d'un frame (com a màxim).
+#define FRAME_OVERHEAD 64
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+enum {
+  TYPE_WAVE,
+  TYPE_MOTOROLA,
+  TYPE_FLAC
+};
+
+// Frame FLAC del qual se sap on comença.
+typedef struct
+{
+
+  uint64_t sample; // Primera mostra.
+  uint64_t offset; // Posició en el fitxer.
+  
+} point_t;
+
+// Frame FLAC descodificat.
+typedef struct
+{
+
+  bool      valid;
+  uint64_t  sample; // Primera mostra.
+  size_t    nsamples;
+  uint64_t  next; // Posició en el fitxer del frame següent.
+  uint64_t  used; // Última vegada que s'ha gastat.
+  uint8_t  *data; // Mostres en format CD-DA.
+  size_t    capacity; // Mostres reservades.
+  
+} slot_t;
+
+// Descodificador. Cada fil té el seu.
+typedef struct
+{
+
+  CD_FlacFrame *frame;
+  uint8_t      *buf; // Per a llegir el frame si no està projectat.
+  
+} decoder_t;
+
+struct CD_PCM_
+{
+
+  int              type;
+  int              fd;
+  const uint8_t   *mem; // Fitxer projectat en memòria (NULL si no es pot).
+  size_t           file_size;
+  uint64_t         data; // Posició de les mostres (o del primer frame).
+  uint64_t         size; // Bytes de mostres.
+
+  // FLAC.
+  uint64_t         nsamples;
+  size_t           max_frame; // Bytes.
+  pthread_mutex_t  mutex;
+  pthread_cond_t   cond;
+  point_t         *points; // Índex (ordenat per mostra).
+  size_t           npoints;
+  size_t           capacity;
+  slot_t           slots[NSLOTS];
+  uint64_t         clock;
+  decoder_t        dec; // Per a les lectures.
+
+  // Descodificació per avançat.
+  pthread_t        thread;
+  bool             running; // El fil s'ha creat.
+  bool             quit;
+  uint64_t         pos; // Mostra següent a l'última lectura.
+  uint64_t         failed; // Posició de l'últim frame que el fil no ha
+                           // pogut descodificar.
+  
+};
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static uint16_t
+get_u16le (
+           const uint8_t *p
+           )
+{
+  return (uint16_t) (p[0] | (p[1]<<8));
+} // end get_u16le
+
+
+static uint32_t
+get_u32le (
+           const uint8_t *p
+           )
+{
+  return ((uint32_t) p[0]) | (((uint32_t) p[1])<<8) |
+    (((uint32_t) p[2])<<16) | (((uint32_t) p[3])<<24);
+} // end get_u32le
+
+
+static uint32_t
+get_u32be (
+           const uint8_t *p
+           )
+{
+  return (((uint32_t) p[0])<<24) | (((uint32_t) p[1])<<16) |
+    (((uint32_t) p[2])<<8) | ((uint32_t) p[3]);
+} // end get_u32be
+
+
+static uint64_t
+get_u64be (
+           const uint8_t *p
+           )
+{
+  return (((uint64_t) get_u32be ( p ))<<32) | ((uint64_t) get_u32be ( p+4 ));
+} // end get_u64be
+
+
+// Busca els blocs "fmt " i "data". Torna fals si no és un WAVE amb
+// el format d'un CD-DA.
+static bool
+parse_wave (
+            CD_PCM *pcm
+            )
+{
+
+  uint8_t buf[FMT_SIZE];
+  uint64_t pos,size;
+  uint16_t tag;
+  bool fmt;
+  
+
+  if ( pcm->file_size < WAVE_HEADER_SIZE ||
+       !CD_read_at ( pcm->fd, buf, WAVE_HEADER_SIZE, 0 ) ||
+       memcmp ( buf, "RIFF", 4 ) || memcmp ( &buf[8], "WAVE", 4 ) )
+    return false;
+  fmt= false;
+  for ( pos= WAVE_HEADER_SIZE;
+        pos + CHUNK_HEADER_SIZE <= pcm->file_size;
+        pos+= CHUNK_HEADER_SIZE + size + (size&1) )
+    {
+      if ( !CD_read_at ( pcm->fd, buf, CHUNK_HEADER_SIZE, (long) pos ) )
+        return false;
+      size= get_u32le ( &buf[4] );
+      if ( !memcmp ( buf, "fmt ", 4 ) )
+        {
+          if ( size < FMT_SIZE ||
+               !CD_read_at ( pcm->fd, buf, FMT_SIZE,
+                             (long) (pos + CHUNK_HEADER_SIZE) ) )
+            return false;
+          tag= get_u16le ( buf );
+          if ( (tag != WAVE_FORMAT_PCM && tag != WAVE_FORMAT_EXTENSIBLE) ||
+               get_u16le ( &buf[2] ) != 2 ||
+               get_u32le ( &buf[4] ) != SAMPLE_RATE ||
+               get_u16le ( &buf[14] ) != BPS )
+            return false;
+          fmt= true;
+        }
+      else if ( !memcmp ( buf, "data", 4 ) )
+        {
+          if ( !fmt ) return false;
+          pcm->data= pos + CHUNK_HEADER_SIZE;
+          pcm->size= pcm->file_size - pcm->data;
+          if ( size < pcm->size ) pcm->size= size;
+          return true;
+        }
+    }
+  
+  return false;
+  
+} // end parse_wave
+
+
+// Torna l'índex del punt anterior més pròxim a SAMPLE.
+static size_t
+find_point (
+            const CD_PCM   *pcm,
+            const uint64_t  sample
+            )
+{
+
+  size_t lo,hi,mid;
+
+
+  lo= 0; hi= pcm->npoints;
+  while ( hi-lo > 1 )
+    {
+      mid= (lo+hi)/2;
+      if ( pcm->points[mid].sample <= sample ) lo= mid;
+      else                                      hi= mid;
+    }
+  
+  return lo;
+  
+} // end find_point
+
+
+// Afegeix a l'índex el frame que comença en la mostra SAMPLE si no
+// està a menys de DIST mostres d'un altre punt.
+static void
+add_point (
+           CD_PCM         *pcm,
+           const uint64_t  sample,
+           const uint64_t  offset,
+           const uint64_t  dist
+           )
+{
+
+  size_t i;
+
+
+  if ( pcm->npoints > 0 )
+    {
+      i= find_point ( pcm, sample );
+      if ( pcm->points[i].sample > sample ) i= 0;
+      else
+        {
+          if ( sample - pcm->points[i].sample < dist ||
+               pcm->points[i].sample == sample )
+            return;
+          ++i;
+        }
+      if ( i < pcm->npoints && pcm->points[i].sample - sample < dist )
+        return;
+    }
+  else i= 0;
+  if ( pcm->npoints == pcm->capacity )
+    {
+      pcm->capacity*= 2;
+      pcm->points= mem_realloc ( point_t, pcm->points, pcm->capacity );
+    }
+  memmove ( &(pcm->points[i+1]), &(pcm->points[i]),
+            (pcm->npoints-i)*sizeof(point_t) );
+  pcm->points[i].sample= sample;
+  pcm->points[i].offset= offset;
+  ++(pcm->npoints);
+  
+} // end add_point
+
+
+// Llig les metadades. Torna fals si no és un FLAC amb el format d'un
+// CD-DA.
+static bool
+parse_flac (
+            CD_PCM *pcm
+            )
+{
+
+  uint8_t buf[STREAMINFO_SIZE],*table;
+  const uint8_t *b;
+  uint64_t pos,sample,offset;
+  uint32_t size,n,i;
+  unsigned int max_block;
+  bool last,info;
+  
+
+  if ( pcm->file_size < FLAC_MAGIC_SIZE ||
+       !CD_read_at ( pcm->fd, buf, FLAC_MAGIC_SIZE, 0 ) ||
+       memcmp ( buf, "fLaC", FLAC_MAGIC_SIZE ) )
+    return false;
+  info= false;
+  table= NULL;
+  n= 0;
+  for ( pos= FLAC_MAGIC_SIZE, last= false; !last;
+        pos+= FLAC_BLOCK_HEADER_SIZE + size )
+    {
+      if ( pos + FLAC_BLOCK_HEADER_SIZE > pcm->file_size ||
+           !CD_read_at ( pcm->fd, buf, FLAC_BLOCK_HEADER_SIZE, (long) pos ) )
+        goto error;
+      last= (buf[0]&0x80)!=0;
+      size= get_u32be ( buf )&0xFFFFFF;
+      if ( (uint64_t) size > pcm->file_size - pos - FLAC_BLOCK_HEADER_SIZE )
+        goto error;
+      if ( (buf[0]&0x7F) == FLAC_STREAMINFO )
+        {
+          if ( size < STREAMINFO_SIZE ||
+               !CD_read_at ( pcm->fd, buf, STREAMINFO_SIZE,
+                             (long) (pos + FLAC_BLOCK_HEADER_SIZE) ) )
+            goto error;
+          max_block= (unsigned int) ((buf[2]<<8) | buf[3]);
+          pcm->max_frame= get_u32be ( &buf[6] )&0xFFFFFF;
+          if ( pcm->max_frame == 0 )
+            pcm->max_frame= (max_block ? max_block : 0xFFFF)*(2*BPS+1)/8 +
+              FRAME_OVERHEAD;
+          b= &buf[10];
+          if ( ((b[0]<<12) | (b[1]<<4) | (b[2]>>4)) != SAMPLE_RATE ||
+               ((b[2]>>1)&0x7) != 1 || // 2 canals
+               (((b[2]&0x1)<<4) | (b[3]>>4)) != BPS-1 )
+            goto error;
+          pcm->nsamples= (((uint64_t) (b[3]&0xF))<<32) | get_u32be ( &b[4] );
+          info= true;
+        }
+      else if ( (buf[0]&0x7F) == FLAC_SEEKTABLE && table == NULL )
+        {
+          n= size/SEEKPOINT_SIZE;
+          table= mem_alloc ( uint8_t, size );
+          if ( !CD_read_at ( pcm->fd, table, size,
+                             (long) (pos + FLAC_BLOCK_HEADER_SIZE) ) )
+            goto error;
+        }
+    }
+
+  // Sense el número de mostres no es pot saber la grandària.
+  if ( !info || pcm->nsamples == 0 ) goto error;
+  pcm->data= pos;
+  pcm->size= pcm->nsamples*SAMPLE_SIZE;
+
+  // Índex.
+  add_point ( pcm, 0, pcm->data, 0 );
+  for ( i= 0; i < n; ++i )
+    {
+      sample= get_u64be ( &table[i*SEEKPOINT_SIZE] );
+      offset= get_u64be ( &table[i*SEEKPOINT_SIZE+8] );
+      if ( sample != SEEKPOINT_PLACEHOLDER && sample < pcm->nsamples &&
+           offset < pcm->file_size - pcm->data )
+        add_point ( pcm, sample, pcm->data + offset, 1 );
+    }
+  free ( table );
+  
+  return true;
+
+ error:
+  free ( table );
+  return false;
+  
+} // end parse_flac
+
+
+static void
+init_decoder (
+              const CD_PCM *pcm,
+              decoder_t    *dec
+              )
+{
+
+  dec->frame= CD_flac_frame_new ();
+  dec->buf= pcm->mem==NULL ? mem_alloc ( uint8_t, pcm->max_frame ) : NULL;
+  
+} // end init_decoder
+
+
+static void
+free_decoder (
+              decoder_t *dec
+              )
+{
+
+  CD_flac_frame_free ( dec->frame );
+  free ( dec->buf );
+  
+} // end free_decoder
+
+
+// Descodifica en DEC el frame que comença en OFFSET. Torna la seua
+// grandària en bytes, o 0 si no és vàlid.
+static size_t
+decode (
+        const CD_PCM   *pcm,
+        decoder_t      *dec,
+        const uint64_t  offset
+        )
+{
+
+  const uint8_t *p;
+  size_t avail,ret;
+  
+
+  if ( offset >= pcm->file_size ) return 0;
+  avail= pcm->file_size - (size_t) offset;
+  if ( pcm->mem != NULL ) p= pcm->mem + offset;
+  else
+    {
+      if ( avail > pcm->max_frame ) avail= pcm->max_frame;
+      if ( !CD_read_at ( pcm->fd, dec->buf, avail, (long) offset ) )
+        return 0;
+      p= dec->buf;
+    }
+  ret= CD_flac_decode_frame ( dec->frame, p, avail, BPS, SAMPLE_RATE );
+  if ( ret == 0 || dec->frame->channels != 2 || dec->frame->bps != BPS ||
+       dec->frame->sample_rate != SAMPLE_RATE || dec->frame->block_size <= 0 )
+    return 0;
+  
+  return ret;
+  
+} // end decode
+
+
+// Torna el frame de la cache que conté SAMPLE (NULL si no hi és).
+static slot_t *
+find_slot (
+           CD_PCM         *pcm,
+           const uint64_t  sample
+           )
+{
+
+  int i;
+
+  
+  for ( i= 0; i < NSLOTS; ++i )
+    if ( pcm->slots[i].valid && sample >= pcm->slots[i].sample &&
+         sample < pcm->slots[i].sample + pcm->slots[i].nsamples )
+      return &(pcm->slots[i]);
+  
+  return NULL;
+  
+} // end find_slot
+
+
+// Desa en la cache el frame descodificat FRAME, que comença en la
+// mostra SAMPLE, reemplaçant el menys usat.
+static slot_t *
+store_slot (
+            CD_PCM             *pcm,
+            const CD_FlacFrame *frame,
+            const uint64_t      sample,
+            const uint64_t      next
+            )
+{
+
+  slot_t *ret;
+  uint8_t *p;
+  int16_t l,r;
+  size_t i;
+  
+
+  // Busca.
+  ret= &(pcm->slots[0]);
+  for ( i= 0; i < NSLOTS && ret->valid; ++i )
+    if ( !pcm->slots[i].valid || pcm->slots[i].used < ret->used )
+      ret= &(pcm->slots[i]);
+
+  // Desa.
+  ret->sample= sample;
+  ret->nsamples= (size_t) frame->block_size;
+  if ( ret->nsamples > pcm->nsamples - sample )
+    ret->nsamples= (size_t) (pcm->nsamples - sample);
+  ret->next= next;
+  if ( ret->capacity < ret->nsamples )
+    {
+      ret->capacity= (size_t) frame->block_size;
+      ret->data= mem_realloc ( uint8_t, ret->data,
+                               ret->capacity*SAMPLE_SIZE );
+    }
+  for ( i= 0, p= ret->data; i < ret->nsamples; ++i, p+= SAMPLE_SIZE )
+    {
+      l= (int16_t) frame->samples[0][i];
+      r= (int16_t) frame->samples[1][i];
+      p[0]= (uint8_t) l; p[1]= (uint8_t) (l>>8);
+      p[2]= (uint8_t) r; p[3]= (uint8_t) (r>>8);
+    }
+  ret->valid= true;
+  ret->used= ++(pcm->clock);
+  
+  return ret;
+  
+} // end store_slot
+
+
+// Descodifica el frame que conté SAMPLE i el desa en la cache. Cal
+// tindre el bloqueig. Torna NULL si el fitxer està mal format.
+static slot_t *
+decode_frame (
+              CD_PCM         *pcm,
+              const uint64_t  sample
+              )
+{
+
+  const point_t *point;
+  uint64_t cur,off,end;
+  size_t nbytes;
+  int i;
+  
+
+  // Punt de partida: el punt de l'índex o el final d'un frame de la
+  // cache més pròxim.
+  point= &(pcm->points[find_point ( pcm, sample )]);
+  cur= point->sample;
+  off= point->offset;
+  for ( i= 0; i < NSLOTS; ++i )
+    if ( pcm->slots[i].valid )
+      {
+        end= pcm->slots[i].sample + pcm->slots[i].nsamples;
+        if ( end <= sample && end > cur )
+          {
+            cur= end;
+            off= pcm->slots[i].next;
+          }
+      }
+
+  // Descodifica.
+  for (;;)
+    {
+      nbytes= decode ( pcm, &(pcm->dec), off );
+      if ( nbytes == 0 ) return NULL;
+      add_point ( pcm, cur, off, POINT_DIST );
+      if ( sample < cur + (uint64_t) pcm->dec.frame->block_size )
+        return store_slot ( pcm, pcm->dec.frame, cur, off + nbytes );
+      cur+= (uint64_t) pcm->dec.frame->block_size;
+      off+= nbytes;
+    }
+  
+} // end decode_frame
+
+
+// Busca el següent frame que ha de descodificar per avançat el
+// fil. Torna fals si ja estan tots.
+static bool
+next_frame (
+            CD_PCM   *pcm,
+            uint64_t *sample,
+            uint64_t *offset
+            )
+{
+
+  const slot_t *slot,*next;
+  uint64_t end;
+  int n;
+  
+
+  slot= find_slot ( pcm, pcm->pos );
+  if ( slot == NULL && pcm->pos > 0 ) slot= find_slot ( pcm, pcm->pos-1 );
+  if ( slot == NULL ) return false;
+  for ( n= 0; n < AHEAD; ++n )
+    {
+      end= slot->sample + slot->nsamples;
+      if ( end >= pcm->nsamples ) return false;
+      next= find_slot ( pcm, end );
+      if ( next == NULL )
+        {
+          if ( slot->next == pcm->failed ) return false;
+          *sample= end;
+          *offset= slot->next;
+          return true;
+        }
+      slot= next;
+    }
+  
+  return false;
+  
+} // end next_frame
+
+
+static void *
+decode_ahead (
+              void *data
+              )
+{
+
+  CD_PCM *pcm;
+  decoder_t dec;
+  uint64_t sample,offset;
+  size_t nbytes;
+  
+
+  pcm= (CD_PCM *) data;
+  init_decoder ( pcm, &dec );
+  pthread_mutex_lock ( &(pcm->mutex) );
+  while ( !pcm->quit )
+    {
+      if ( !next_frame ( pcm, &sample, &offset ) )
+        {
+          pthread_cond_wait ( &(pcm->cond), &(pcm->mutex) );
+          continue;
+        }
+      pthread_mutex_unlock ( &(pcm->mutex) );
+      nbytes= decode ( pcm, &dec, offset );
+      pthread_mutex_lock ( &(pcm->mutex) );
+      if ( nbytes == 0 ) pcm->failed= offset;
+      else if ( find_slot ( pcm, sample ) == NULL )
+        {
+          add_point ( pcm, sample, offset, POINT_DIST );
+          store_slot ( pcm, dec.frame, sample, offset + nbytes );
+        }
+    }
+  pthread_mutex_unlock ( &(pcm->mutex) );
+  free_decoder ( &dec );
+  
+  return NULL;
+  
+} // end decode_ahead
+
+
+static bool
+read_flac (
+           CD_PCM   *pcm,
+           uint8_t  *buf,
+           uint64_t  pos,
+           size_t    size
+           )
+{
+
+  slot_t *slot;
+  uint64_t sample,off;
+  size_t n;
+  
+
+  pthread_mutex_lock ( &(pcm->mutex) );
+  while ( size > 0 )
+    {
+      sample= pos/SAMPLE_SIZE;
+      slot= find_slot ( pcm, sample );
+      if ( slot == NULL && (slot= decode_frame ( pcm, sample )) == NULL )
+        {
+          pthread_mutex_unlock ( &(pcm->mutex) );
+          return false;
+        }
+      slot->used= ++(pcm->clock);
+      off= pos - slot->sample*SAMPLE_SIZE;
+      n= slot->nsamples*SAMPLE_SIZE - (size_t) off;
+      if ( n > size ) n= size;
+      memcpy ( buf, slot->data + off, n );
+      buf+= n;
+      pos+= n;
+      size-= n;
+    }
+
+  // Continua descodificant per avançat des d'ací.
+  pcm->pos= pos/SAMPLE_SIZE;
+  if ( !pcm->running )
+    pcm->running= pthread_create ( &(pcm->thread), NULL,
+                                   decode_ahead, pcm ) == 0;
+  pthread_cond_signal ( &(pcm->cond) );
+  pthread_mutex_unlock ( &(pcm->mutex) );
+  
+  return true;
+  
+} // end read_flac
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+CD_PCM *
+CD_pcm_new (
+            const int        fd,
+            const long       size,
+            const CD_PCMType type
+            )
+{
+
+  CD_PCM *new;
+  bool ok;
+  int i;
+  
+
+  new= mem_alloc ( CD_PCM, 1 );
+  new->fd= fd;
+  new->mem= NULL;
+  new->file_size= (size_t) size;
+  new->data= 0;
+  new->size= 0;
+  new->nsamples= 0;
+  new->max_frame= 0;
+  new->capacity= 64;
+  new->points= mem_alloc ( point_t, new->capacity );
+  new->npoints= 0;
+  for ( i= 0; i < NSLOTS; ++i )
+    {
+      new->slots[i].valid= false;
+      new->slots[i].data= NULL;
+      new->slots[i].capacity= 0;
+    }
+  new->clock= 0;
+  new->running= false;
+  new->quit= false;
+  new->pos= 0;
+  new->failed= UINT64_MAX;
+  
+  // Format.
+  if ( type == CD_PCM_MOTOROLA )
+    {
+      new->type= TYPE_MOTOROLA;
+      new->size= new->file_size;
+      ok= true;
+    }
+  else if ( parse_wave ( new ) )
+    {
+      new->type= TYPE_WAVE;
+      ok= true;
+    }
+  else
+    {
+      new->type= TYPE_FLAC;
+      ok= parse_flac ( new );
+    }
+  if ( !ok )
+    {
+      free ( new->points );
+      free ( new );
+      return NULL;
+    }
+  new->mem= CD_file_map ( fd, new->file_size );
+  pthread_mutex_init ( &(new->mutex), NULL );
+  pthread_cond_init ( &(new->cond), NULL );
+  if ( new->type == TYPE_FLAC ) init_decoder ( new, &(new->dec) );
+  
+  return new;
+  
+} // end CD_pcm_new
+
+
+void
+CD_pcm_free (
+             CD_PCM *pcm
+             )
+{
+
+  int i;
+
+  
+  if ( pcm->running )
+    {
+      pthread_mutex_lock ( &(pcm->mutex) );
+      pcm->quit= true;
+      pthread_cond_signal ( &(pcm->cond) );
+      pthread_mutex_unlock ( &(pcm->mutex) );
+      pthread_join ( pcm->thread, NULL );
+    }
+  if ( pcm->type == TYPE_FLAC ) free_decoder ( &(pcm->dec) );
+  for ( i= 0; i < NSLOTS; ++i ) free ( pcm->slots[i].data );
+  pthread_cond_destroy ( &(pcm->cond) );
+  pthread_mutex_destroy ( &(pcm->mutex) );
+  CD_file_unmap ( pcm->mem, pcm->file_size );
+  free ( pcm->points );
+  free ( pcm );
+  
+} // end CD_pcm_free
+
+
+size_t
+CD_pcm_get_size (
+                 const CD_PCM *pcm
+                 )
+{
+  return (size_t) pcm->size;
+} // end CD_pcm_get_size
+
+
+bool
+CD_pcm_read_at (
+                CD_PCM       *pcm,
+                void         *buf,
+                const size_t  size,
+                const long    offset
+                )
+{
+
+  uint8_t *p,tmp;
+  uint64_t pos;
+  size_t n,i;
+  
+
+  if ( offset < 0 ) return false;
+  
+  // Mostres.
+  p= (uint8_t *) buf;
+  pos= (uint64_t) offset;
+  n= pos < pcm->size ? (size_t) (pcm->size - pos) : 0;
+  if ( n > size ) n= size;
+  if ( n > 0 )
+    {
+      if ( pcm->type == TYPE_FLAC )
+        {
+          if ( !read_flac ( pcm, p, pos, n ) ) return false;
+        }
+      else if ( pcm->mem != NULL ) memcpy ( p, pcm->mem + pcm->data + pos, n );
+      else if ( !CD_read_at ( pcm->fd, p, n, (long) (pcm->data + pos) ) )
+        return false;
+      if ( pcm->type == TYPE_MOTOROLA )
+        for ( i= 0; i+1 < n; i+= 2 )
+          {
+            tmp= p[i]; p[i]= p[i+1]; p[i+1]= tmp;
+          }
+    }
+
+  // Final.
+  memset ( p + n, 0, size - n );
+  
+  return true;
+  
+} // end CD_pcm_read_at
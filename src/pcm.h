@@ -0,0 +1,81 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  pcm.h - Lectura de fitxers d'àudio (WAVE, FLAC i PCM big-endian)
+ *          com a dades de CD-DA.
+ *
+ */
+/*
+ * NOTA!! Els fitxers es veuen com un BIN d'àudio: mostres de 16 bits
+ * little-endian, estèreo i a 44100 Hz. Sols s'accepten fitxers amb
+ * eixe format (no es fa cap conversió). Els FLAC es descodifiquen
+ * sota demanda i, durant la reproducció, un fil descodifica per
+ * avançat els frames següents a l'última lectura. Un mateix CD_PCM
+ * es pot gastar des de diversos fils.
+ */
+
+#ifndef __CD_PCM_H__
+#define __CD_PCM_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct CD_PCM_ CD_PCM;
+
+typedef enum
+  {
+    CD_PCM_WAVE, // RIFF WAVE o FLAC (es detecta per la capçalera).
+    CD_PCM_MOTOROLA // Mostres big-endian sense capçalera.
+  } CD_PCMType;
+
+// Crea un lector per al fitxer obert FD de SIZE bytes. Torna NULL si
+// el fitxer no és del tipus TYPE o no té el format d'un CD-DA. El
+// descriptor no passa a ser propietat del lector, però ha d'estar
+// obert mentre s'utilitze.
+CD_PCM *
+CD_pcm_new (
+            const int        fd,
+            const long       size,
+            const CD_PCMType type
+            );
+
+void
+CD_pcm_free (
+             CD_PCM *pcm
+             );
+
+// Grandària en bytes de les mostres.
+size_t
+CD_pcm_get_size (
+                 const CD_PCM *pcm
+                 );
+
+// Com CD_read_at però sobre les mostres. Els bytes posteriors a
+// l'última mostra es tornen a 0 (l'últim sector pot estar
+// incomplet). En CD_PCM_MOTOROLA OFFSET ha de ser parell.
+bool
+CD_pcm_read_at (
+                CD_PCM       *pcm,
+                void         *buf,
+                const size_t  size,
+                const long    offset
+                );
+
+#endif // __CD_PCM_H__
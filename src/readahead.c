@@ -0,0 +1,383 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  readahead.c - Implementació de 'readahead.h'.
+ *
+ */
+/*
+ *  El productor sols escriu 'head' i el consumidor sols escriu
+ *  'tail', per tant l'anell no necessita bloquejos. L'únic bloqueig
+ *  és per a adormir el productor quan l'anell està ple o s'ha arribat
+ *  al final del disc, i el consumidor sols el toca si el productor
+ *  està dormint.
+ */
+
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CD.h"
+#include "readahead.h"
+#include "utils.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define CACHE_LINE 64
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+typedef struct
+{
+
+  size_t  sec;
+  int     gen;
+  bool    audio;
+  uint8_t buf[CD_SEC_SIZE];
+
+} slot_t;
+
+struct CD_ReadAhead_
+{
+
+  // Configuració.
+  slot_t          *slots;
+  size_t           depth;
+  CD_Disc         *disc; // Cursor del productor.
+  pthread_t        thread;
+  pthread_mutex_t  mutex;
+  pthread_cond_t   cond;
+
+  // Comunicació.
+  atomic_bool   quit;
+  atomic_bool   sleeping; // Productor dormint.
+  atomic_int    gen; // Generació demanada pel consumidor.
+  atomic_size_t start; // Primer sector de la generació 'gen'.
+  atomic_int    pgen; // Generació del productor.
+  atomic_size_t next; // Sector que està llegint el productor.
+
+  // Productor.
+  _Alignas(CACHE_LINE) atomic_size_t head;
+
+  // Consumidor.
+  _Alignas(CACHE_LINE) atomic_size_t tail;
+  int      cgen;
+  uint64_t hits;
+  uint64_t misses;
+
+};
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static bool
+seek_sec (
+          CD_Disc      *disc,
+          const size_t  sec
+          )
+{
+  return CD_disc_seek ( disc, (int) (sec/(60*75)), (int) ((sec/75)%60),
+                        (int) (sec%75) );
+} // end seek_sec
+
+
+// Desperta al productor si està dormint.
+static void
+wake_producer (
+               CD_ReadAhead *ra
+               )
+{
+
+  if ( atomic_load ( &(ra->sleeping) ) )
+    {
+      pthread_mutex_lock ( &(ra->mutex) );
+      pthread_cond_signal ( &(ra->cond) );
+      pthread_mutex_unlock ( &(ra->mutex) );
+    }
+
+} // end wake_producer
+
+
+// Adorm el productor mentre no canvie la situació.
+static void
+wait_consumer (
+               CD_ReadAhead *ra,
+               const int     gen,
+               const size_t  head,
+               const bool    eof
+               )
+{
+
+  pthread_mutex_lock ( &(ra->mutex) );
+  atomic_store ( &(ra->sleeping), true );
+  if ( !atomic_load ( &(ra->quit) ) && atomic_load ( &(ra->gen) ) == gen &&
+       (eof || head - atomic_load ( &(ra->tail) ) >= ra->depth) )
+    pthread_cond_wait ( &(ra->cond), &(ra->mutex) );
+  atomic_store ( &(ra->sleeping), false );
+  pthread_mutex_unlock ( &(ra->mutex) );
+
+} // end wait_consumer
+
+
+static void *
+producer (
+          void *arg
+          )
+{
+
+  CD_ReadAhead *ra;
+  slot_t *slot;
+  size_t pos,head;
+  int gen,g;
+  bool eof;
+
+
+  ra= (CD_ReadAhead *) arg;
+  gen= -1; pos= 0; eof= true;
+  head= atomic_load ( &(ra->head) );
+  while ( !atomic_load ( &(ra->quit) ) )
+    {
+
+      // Canvi de generació.
+      g= atomic_load ( &(ra->gen) );
+      if ( g != gen )
+        {
+          gen= g;
+          pos= atomic_load ( &(ra->start) );
+          eof= !seek_sec ( ra->disc, pos );
+          atomic_store ( &(ra->next), eof ? SIZE_MAX : pos );
+          atomic_store ( &(ra->pgen), gen );
+        }
+
+      // Espera si no hi ha res a fer.
+      if ( eof ||
+           head - atomic_load_explicit ( &(ra->tail),
+                                         memory_order_acquire ) >= ra->depth )
+        {
+          wait_consumer ( ra, gen, head, eof );
+          continue;
+        }
+
+      // Llig.
+      atomic_store ( &(ra->next), pos );
+      slot= &(ra->slots[head%ra->depth]);
+      if ( !CD_disc_read ( ra->disc, slot->buf, &(slot->audio), true ) )
+        {
+          eof= true;
+          atomic_store ( &(ra->next), SIZE_MAX );
+          continue;
+        }
+      slot->sec= pos++;
+      slot->gen= gen;
+      atomic_store_explicit ( &(ra->head), ++head, memory_order_release );
+
+    }
+
+  return NULL;
+
+} // end producer
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+CD_ReadAhead *
+CD_readahead_new (
+                  CD_Disc      *disc,
+                  const int     depth,
+                  const size_t  pos
+                  )
+{
+
+  CD_ReadAhead *new;
+
+
+  new= mem_alloc ( CD_ReadAhead, 1 );
+  new->depth= depth>0 ? (size_t) depth : 1;
+  new->slots= mem_alloc ( slot_t, new->depth );
+  new->disc= disc;
+  atomic_init ( &(new->quit), false );
+  atomic_init ( &(new->sleeping), false );
+  atomic_init ( &(new->gen), 0 );
+  atomic_init ( &(new->start), pos );
+  atomic_init ( &(new->pgen), -1 );
+  atomic_init ( &(new->next), SIZE_MAX );
+  atomic_init ( &(new->head), 0 );
+  atomic_init ( &(new->tail), 0 );
+  new->cgen= 0;
+  new->hits= 0;
+  new->misses= 0;
+  pthread_mutex_init ( &(new->mutex), NULL );
+  pthread_cond_init ( &(new->cond), NULL );
+  if ( pthread_create ( &(new->thread), NULL, producer, new ) != 0 )
+    {
+      pthread_cond_destroy ( &(new->cond) );
+      pthread_mutex_destroy ( &(new->mutex) );
+      free ( new->slots );
+      free ( new );
+      return NULL;
+    }
+
+  return new;
+
+} // end CD_readahead_new
+
+
+void
+CD_readahead_free (
+                   CD_ReadAhead *ra
+                   )
+{
+
+  pthread_mutex_lock ( &(ra->mutex) );
+  atomic_store ( &(ra->quit), true );
+  pthread_cond_signal ( &(ra->cond) );
+  pthread_mutex_unlock ( &(ra->mutex) );
+  pthread_join ( ra->thread, NULL );
+  pthread_cond_destroy ( &(ra->cond) );
+  pthread_mutex_destroy ( &(ra->mutex) );
+  CD_disc_free ( ra->disc );
+  free ( ra->slots );
+  free ( ra );
+
+} // end CD_readahead_free
+
+
+bool
+CD_readahead_pop (
+                  CD_ReadAhead *ra,
+                  const size_t  sec,
+                  uint8_t       buf[CD_SEC_SIZE],
+                  bool         *audio
+                  )
+{
+
+  size_t tail,head;
+  const slot_t *slot;
+  bool hit;
+
+
+  tail= atomic_load_explicit ( &(ra->tail), memory_order_relaxed );
+  for (;;)
+    {
+
+      // Buit. Si el productor està llegint justament este sector (o
+      // va a començar per ell) s'espera, llegir-lo ací sols duplicaria
+      // la lectura.
+      head= atomic_load_explicit ( &(ra->head), memory_order_acquire );
+      if ( tail == head )
+        {
+          if ( atomic_load ( &(ra->pgen) ) == ra->cgen ?
+               atomic_load ( &(ra->next) ) == sec :
+               atomic_load ( &(ra->start) ) == sec )
+            {
+              sched_yield ();
+              continue;
+            }
+          ++(ra->misses);
+          return false;
+        }
+
+      // Comprova el sector.
+      slot= &(ra->slots[tail%ra->depth]);
+      if ( slot->gen == ra->cgen && slot->sec > sec ) // Anell avançat.
+        {
+          ++(ra->misses);
+          return false;
+        }
+      hit= (slot->gen == ra->cgen && slot->sec == sec);
+      if ( hit )
+        {
+          memcpy ( buf, slot->buf, CD_SEC_SIZE );
+          *audio= slot->audio;
+          ++(ra->hits);
+        }
+
+      // Allibera (el sector llegit o un sector descartat).
+      atomic_store ( &(ra->tail), ++tail );
+      wake_producer ( ra );
+      if ( hit ) return true;
+
+    }
+
+} // end CD_readahead_pop
+
+
+void
+CD_readahead_restart (
+                      CD_ReadAhead *ra,
+                      const size_t  pos
+                      )
+{
+
+  size_t tail,next,first;
+  
+  
+  // Si POS ja està en l'anell o és el que està llegint el productor
+  // no cal descartar res.
+  if ( atomic_load ( &(ra->pgen) ) == ra->cgen )
+    {
+      next= atomic_load ( &(ra->next) );
+      tail= atomic_load_explicit ( &(ra->tail), memory_order_relaxed );
+      if ( atomic_load_explicit ( &(ra->head), memory_order_acquire ) != tail &&
+           ra->slots[tail%ra->depth].gen == ra->cgen )
+        first= ra->slots[tail%ra->depth].sec;
+      else first= next;
+      if ( next != SIZE_MAX && first <= pos && pos <= next ) return;
+    }
+  
+  atomic_store ( &(ra->start), pos );
+  atomic_store ( &(ra->gen), ++(ra->cgen) );
+  wake_producer ( ra );
+
+} // end CD_readahead_restart
+
+
+void
+CD_readahead_get_stats (
+                        const CD_ReadAhead *ra,
+                        CD_ReadAheadStats  *stats
+                        )
+{
+
+  stats->hits= ra->hits;
+  stats->misses= ra->misses;
+
+} // end CD_readahead_get_stats
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  readahead.h - Lectura anticipada en segon pla.
+ *
+ */
+/*
+ * NOTA!! Un fil d'E/S llig sectors de manera seqüencial amb un cursor
+ * propi (CD_disc_clone) i els deixa en un anell SPSC sense
+ * bloquejos. El consumidor és el cursor original, que sols pot
+ * gastar-se des d'un fil. Cada sector de l'anell està etiquetat amb
+ * el seu número i amb una generació, de manera que invalidar l'anell
+ * (seek, etc.) és tan senzill com incrementar la generació.
+ */
+
+#ifndef __CD_READAHEAD_H__
+#define __CD_READAHEAD_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CD.h"
+
+typedef struct CD_ReadAhead_ CD_ReadAhead;
+
+// Crea el motor i comença a llegir des del sector POS. El motor passa
+// a ser el propietari de DISC, que ha de ser un cursor sense lectura
+// anticipada. DEPTH és el número de sectors de l'anell. Torna NULL si
+// no s'ha pogut crear el fil (DISC no s'allibera en eixe cas).
+CD_ReadAhead *
+CD_readahead_new (
+                  CD_Disc      *disc,
+                  const int     depth,
+                  const size_t  pos
+                  );
+
+void
+CD_readahead_free (
+                   CD_ReadAhead *ra
+                   );
+
+// Intenta obtindre el sector SEC de l'anell. Torna cert si s'ha
+// obtingut, en cas contrari el consumidor ha de llegir-lo directament
+// i cridar a CD_readahead_restart.
+bool
+CD_readahead_pop (
+                  CD_ReadAhead *ra,
+                  const size_t  sec,
+                  uint8_t       buf[CD_SEC_SIZE],
+                  bool         *audio
+                  );
+
+// Descarta el contingut de l'anell i continua llegint des de POS.
+void
+CD_readahead_restart (
+                      CD_ReadAhead *ra,
+                      const size_t  pos
+                      );
+
+void
+CD_readahead_get_stats (
+                        const CD_ReadAhead *ra,
+                        CD_ReadAheadStats  *stats
+                        );
+
+#endif // __CD_READAHEAD_H__
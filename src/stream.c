@@ -0,0 +1,489 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  stream.c - Implementa 'CD_Stream'.
+ *
+ */
+/*
+ *  Com en 'readahead.c', el fil sols escriu 'head' i el consumidor
+ *  sols escriu 'tail', per tant l'anell no necessita bloquejos. Cada
+ *  sector porta la pista, l'índex i la posició que tenia el cursor
+ *  abans de llegir-lo, i el consumidor detecta els canvis comparant
+ *  amb l'últim sector tornat. El consumidor sols intenta agafar el
+ *  bloqueig (sense esperar) quan el fil està dormint. Si no pot, el
+ *  fil es despertarà en la següent crida a CD_stream_pull. El filtre
+ *  de desènfasi s'aplica en el fil, abans de publicar el sector.
+ */
+
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CD.h"
+#include "deemph.h"
+#include "utils.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define CACHE_LINE 64
+
+#define DEFAULT_DEPTH 32
+
+#define SEC(AMM,ASS,ASECT) ((size_t) ((AMM)*60*75 + (ASS)*75 + (ASECT)))
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+typedef struct
+{
+
+  int         gen;
+  bool        end; // Fi del flux, no té àudio.
+  int         track;
+  uint8_t     index;
+  CD_Position pos;
+  uint8_t     buf[CD_SEC_SIZE];
+
+} slot_t;
+
+struct CD_Stream_
+{
+
+  // Configuració.
+  slot_t          *slots;
+  size_t           depth;
+  CD_Disc         *disc; // Cursor del fil.
+  bool            *pre; // Pistes amb preènfasi.
+  int              ntracks;
+  pthread_t        thread;
+  pthread_mutex_t  mutex;
+  pthread_cond_t   cond;
+
+  // Comunicació.
+  atomic_bool   quit;
+  atomic_bool   sleeping; // Fil dormint.
+  atomic_int    gen; // Generació demanada pel consumidor.
+  atomic_size_t start; // Primer sector de la generació 'gen'.
+  atomic_bool   deemph; // Aplica el filtre de desènfasi.
+
+  // Productor.
+  _Alignas(CACHE_LINE) atomic_size_t head;
+
+  // Consumidor.
+  _Alignas(CACHE_LINE) atomic_size_t tail;
+  int      cgen;
+  int      frame; // Frames ja tornats del sector de 'tail'.
+  bool     ended;
+  int      track; // Últim canvi tornat (-1 si cap).
+  uint8_t  index;
+  uint64_t frames;
+  uint64_t underruns;
+
+};
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static bool
+seek_sec (
+          CD_Disc      *disc,
+          const size_t  sec
+          )
+{
+  return CD_disc_seek ( disc, (int) (sec/(60*75)), (int) ((sec/75)%60),
+                        (int) (sec%75) );
+} // end seek_sec
+
+
+// Desperta al fil si està dormint. Si no és BLOCK i el bloqueig està
+// ocupat no fa res.
+static void
+wake_producer (
+               CD_Stream  *s,
+               const bool  block
+               )
+{
+
+  if ( atomic_load ( &(s->sleeping) ) )
+    {
+      if ( block ) pthread_mutex_lock ( &(s->mutex) );
+      else if ( pthread_mutex_trylock ( &(s->mutex) ) != 0 ) return;
+      pthread_cond_signal ( &(s->cond) );
+      pthread_mutex_unlock ( &(s->mutex) );
+    }
+
+} // end wake_producer
+
+
+// Adorm el fil mentre no canvie la situació.
+static void
+wait_consumer (
+               CD_Stream    *s,
+               const int     gen,
+               const size_t  head,
+               const bool    eof
+               )
+{
+
+  pthread_mutex_lock ( &(s->mutex) );
+  atomic_store ( &(s->sleeping), true );
+  if ( !atomic_load ( &(s->quit) ) && atomic_load ( &(s->gen) ) == gen &&
+       (eof || head - atomic_load ( &(s->tail) ) >= s->depth) )
+    pthread_cond_wait ( &(s->cond), &(s->mutex) );
+  atomic_store ( &(s->sleeping), false );
+  pthread_mutex_unlock ( &(s->mutex) );
+
+} // end wait_consumer
+
+
+static void *
+producer (
+          void *arg
+          )
+{
+
+  CD_Stream *s;
+  slot_t *slot;
+  size_t head;
+  int gen,g;
+  bool eof,fail,audio,filter;
+  CD_Deemph st;
+
+
+  s= (CD_Stream *) arg;
+  gen= -1; eof= true; fail= false; filter= false;
+  head= atomic_load ( &(s->head) );
+  while ( !atomic_load ( &(s->quit) ) )
+    {
+
+      // Canvi de generació. Si el seek falla es publica el final.
+      g= atomic_load ( &(s->gen) );
+      if ( g != gen )
+        {
+          gen= g;
+          fail= !seek_sec ( s->disc, atomic_load ( &(s->start) ) );
+          eof= false;
+          filter= false;
+        }
+
+      // Espera si no hi ha res a fer.
+      if ( eof ||
+           head - atomic_load_explicit ( &(s->tail),
+                                         memory_order_acquire ) >= s->depth )
+        {
+          wait_consumer ( s, gen, head, eof );
+          continue;
+        }
+
+      // Llig.
+      slot= &(s->slots[head%s->depth]);
+      slot->gen= gen;
+      slot->track= CD_disc_get_current_track ( s->disc );
+      slot->index= CD_disc_get_current_index ( s->disc );
+      slot->pos= CD_disc_tell ( s->disc );
+      slot->end= fail ||
+        !CD_disc_read ( s->disc, slot->buf, &audio, true ) || !audio;
+      if ( slot->end ) eof= true;
+
+      // Desènfasi. L'estat del filtre es manté mentre els sectors
+      // filtrats són consecutius.
+      else if ( atomic_load ( &(s->deemph) ) &&
+                slot->track >= 1 && slot->track <= s->ntracks &&
+                s->pre[slot->track-1] )
+        {
+          if ( !filter ) { CD_deemph_reset ( &st ); filter= true; }
+          CD_deemph_sector ( &st, slot->buf );
+        }
+      else filter= false;
+      atomic_store_explicit ( &(s->head), ++head, memory_order_release );
+
+    }
+
+  return NULL;
+
+} // end producer
+
+
+static void
+copy_frames (
+             int16_t       *dst,
+             const uint8_t *src,
+             const int      nframes
+             )
+{
+
+  int i;
+
+
+  // Les mostres del sector estan en 'little endian'.
+  for ( i= 0; i < nframes*2; ++i )
+    dst[i]= (int16_t) (uint16_t) (src[2*i] | (src[2*i+1]<<8));
+
+} // end copy_frames
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+CD_Stream *
+CD_stream_new (
+               CD_Disc    *disc,
+               const int   amm,
+               const int   ass,
+               const int   asect,
+               const int   nsecs,
+               char      **err
+               )
+{
+
+  CD_Stream *new;
+  CD_Disc *cursor;
+  CD_Info *info;
+  int t;
+
+
+  // Cursor propi.
+  cursor= CD_disc_clone ( disc );
+  if ( cursor == NULL )
+    {
+      CD_msgerror ( err, "unable to create a new cursor" );
+      return NULL;
+    }
+  if ( !CD_disc_seek ( cursor, amm, ass, asect ) )
+    {
+      CD_msgerror ( err, "invalid position %02d:%02d:%02d",
+                    amm, ass, asect );
+      CD_disc_free ( cursor );
+      return NULL;
+    }
+  
+  // Crea.
+  new= mem_alloc ( CD_Stream, 1 );
+  new->depth= nsecs>0 ? (size_t) nsecs : DEFAULT_DEPTH;
+  new->slots= mem_alloc ( slot_t, new->depth );
+  new->disc= cursor;
+  info= CD_disc_get_info ( cursor );
+  new->ntracks= info->ntracks;
+  new->pre= mem_alloc ( bool, info->ntracks>0 ? info->ntracks : 1 );
+  for ( t= 0; t < info->ntracks; ++t )
+    new->pre[t]= info->tracks[t].audio_preemphasis;
+  CD_info_free ( info );
+  atomic_init ( &(new->quit), false );
+  atomic_init ( &(new->sleeping), false );
+  atomic_init ( &(new->gen), 0 );
+  atomic_init ( &(new->start), SEC ( amm, ass, asect ) );
+  atomic_init ( &(new->deemph), false );
+  atomic_init ( &(new->head), 0 );
+  atomic_init ( &(new->tail), 0 );
+  new->cgen= 0;
+  new->frame= 0;
+  new->ended= false;
+  new->track= -1;
+  new->index= 0x00;
+  new->frames= 0;
+  new->underruns= 0;
+  pthread_mutex_init ( &(new->mutex), NULL );
+  pthread_cond_init ( &(new->cond), NULL );
+  if ( pthread_create ( &(new->thread), NULL, producer, new ) != 0 )
+    {
+      CD_msgerror ( err, "unable to create the stream thread" );
+      pthread_cond_destroy ( &(new->cond) );
+      pthread_mutex_destroy ( &(new->mutex) );
+      CD_disc_free ( cursor );
+      free ( new->pre );
+      free ( new->slots );
+      free ( new );
+      return NULL;
+    }
+  
+  return new;
+  
+} // end CD_stream_new
+
+
+void
+CD_stream_free (
+                CD_Stream *stream
+                )
+{
+
+  pthread_mutex_lock ( &(stream->mutex) );
+  atomic_store ( &(stream->quit), true );
+  pthread_cond_signal ( &(stream->cond) );
+  pthread_mutex_unlock ( &(stream->mutex) );
+  pthread_join ( stream->thread, NULL );
+  pthread_cond_destroy ( &(stream->cond) );
+  pthread_mutex_destroy ( &(stream->mutex) );
+  CD_disc_free ( stream->disc );
+  free ( stream->pre );
+  free ( stream->slots );
+  free ( stream );
+  
+} // end CD_stream_free
+
+
+int
+CD_stream_pull (
+                CD_Stream     *stream,
+                int16_t       *buf,
+                const int      n,
+                CD_StreamMark *marks,
+                int           *nmarks
+                )
+{
+
+  const slot_t *slot;
+  CD_StreamMark *mark;
+  size_t tail,head;
+  int ret,nm,max_marks,m;
+  bool starved;
+  
+  
+  max_marks= marks!=NULL ? *nmarks : INT_MAX;
+  nm= 0; ret= 0; starved= false;
+  tail= atomic_load_explicit ( &(stream->tail), memory_order_relaxed );
+  head= atomic_load_explicit ( &(stream->head), memory_order_acquire );
+  while ( ret < n && !stream->ended )
+    {
+      
+      // Buit.
+      if ( tail == head )
+        {
+          head= atomic_load_explicit ( &(stream->head), memory_order_acquire );
+          if ( tail == head ) { starved= true; break; }
+        }
+      
+      // Sectors d'abans d'un seek.
+      slot= &(stream->slots[tail%stream->depth]);
+      if ( slot->gen != stream->cgen )
+        {
+          atomic_store ( &(stream->tail), ++tail );
+          continue;
+        }
+      
+      // Canvi de pista, d'índex o final.
+      if ( stream->frame == 0 &&
+           (slot->end || slot->track != stream->track ||
+            slot->index != stream->index) )
+        {
+          if ( nm == max_marks ) break;
+          if ( marks != NULL )
+            {
+              mark= &(marks[nm]);
+              mark->frame= ret;
+              mark->track= slot->end ? 0 : slot->track;
+              mark->index= slot->end ? 0x00 : slot->index;
+              mark->pos= slot->pos;
+            }
+          ++nm;
+          if ( slot->end ) { stream->ended= true; break; }
+          stream->track= slot->track;
+          stream->index= slot->index;
+        }
+      
+      // Copia.
+      m= CD_STREAM_FRAMES - stream->frame;
+      if ( m > n-ret ) m= n-ret;
+      copy_frames ( &(buf[ret*2]), &(slot->buf[stream->frame*4]), m );
+      ret+= m;
+      stream->frame+= m;
+      if ( stream->frame == CD_STREAM_FRAMES )
+        {
+          stream->frame= 0;
+          atomic_store ( &(stream->tail), ++tail );
+        }
+      
+    }
+  // Es desperta al fil cada vegada que l'anell no està ple, i no sols
+  // quan s'ha consumit alguna cosa: si el 'trylock' falla mentre el fil
+  // s'està adormint, els pulls següents (encara que tornen buit) ho
+  // tornen a intentar.
+  if ( !stream->ended && head - tail < stream->depth )
+    wake_producer ( stream, false );
+  if ( starved ) ++(stream->underruns);
+  stream->frames+= (uint64_t) ret;
+  if ( marks != NULL ) *nmarks= nm;
+  
+  return ret;
+  
+} // end CD_stream_pull
+
+
+void
+CD_stream_seek (
+                CD_Stream *stream,
+                const int  amm,
+                const int  ass,
+                const int  asect
+                )
+{
+
+  stream->frame= 0;
+  stream->ended= false;
+  stream->track= -1;
+  stream->index= 0x00;
+  atomic_store ( &(stream->start), SEC ( amm, ass, asect ) );
+  atomic_store ( &(stream->gen), ++(stream->cgen) );
+  wake_producer ( stream, true );
+  
+} // end CD_stream_seek
+
+
+void
+CD_stream_set_deemphasis (
+                          CD_Stream  *stream,
+                          const bool  enable
+                          )
+{
+  atomic_store ( &(stream->deemph), enable );
+} // end CD_stream_set_deemphasis
+
+
+void
+CD_stream_get_stats (
+                     const CD_Stream *stream,
+                     CD_StreamStats  *stats
+                     )
+{
+
+  stats->frames= stream->frames;
+  stats->underruns= stream->underruns;
+  
+} // end CD_stream_get_stats
@@ -0,0 +1,380 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  subq.c - Implementació de 'subq.h'.
+ *
+ */
+/*
+ *  Per a desintercalar els subcanals P-W amb SSE2 es giren els bytes
+ *  de cada grup de 8 i es gasta _mm_movemask_epi8, que arreplega el
+ *  bit alt de 16 bytes alhora. Duplicant els bytes (v+v) es passa al
+ *  següent canal.
+ */
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) && !defined(CD_NO_SSE2)
+#define CD_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "CD.h"
+#include "crc.h"
+#include "subq.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define BCD(NUM) ((uint8_t) (((NUM)/10)*0x10 + (NUM)%10))
+
+// Blocs pels quals es calcula el CRC alhora.
+#define CRC_CHUNK 256
+
+// Bytes de cada canal en CD_SUBPW_SIZE.
+#define CHANNEL_SIZE 12
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+#ifdef CD_HAVE_SSE2
+// Inverteix l'ordre dels bytes de cada meitat de V, així el primer byte
+// de cada grup de 8 acaba en el bit més significatiu de la màscara.
+static inline __m128i
+reverse_bytes64 (
+                 const __m128i v
+                 )
+{
+
+  __m128i w;
+
+  
+  w= _mm_shufflehi_epi16 ( _mm_shufflelo_epi16 ( v, 0x1B ), 0x1B );
+  
+  return _mm_or_si128 ( _mm_slli_epi16 ( w, 8 ), _mm_srli_epi16 ( w, 8 ) );
+  
+} // end reverse_bytes64
+#endif // CD_HAVE_SSE2
+
+
+static inline void
+get_q (
+       const uint8_t *pw,
+       uint8_t       *q
+       )
+{
+
+#ifdef CD_HAVE_SSE2
+  __m128i v;
+  int i,m;
+
+  
+  for ( i= 0; i < CD_SUBPW_SIZE/16; ++i )
+    {
+      v= reverse_bytes64 ( _mm_loadu_si128 ( (const __m128i *) &pw[16*i] ) );
+      m= _mm_movemask_epi8 ( _mm_add_epi8 ( v, v ) ); // Bit 6.
+      q[2*i]= (uint8_t) m;
+      q[2*i+1]= (uint8_t) (m>>8);
+    }
+#else
+  uint8_t v;
+  int i,j;
+
+  
+  for ( i= 0; i < CHANNEL_SIZE; ++i, pw+= 8 )
+    {
+      for ( v= 0, j= 0; j < 8; ++j )
+        v= (uint8_t) ((v<<1) | ((pw[j]>>6)&1));
+      q[i]= v;
+    }
+#endif
+  
+} // end get_q
+
+
+static inline void
+deinterleave (
+              const uint8_t *pw,
+              uint8_t       *packed
+              )
+{
+
+#ifdef CD_HAVE_SSE2
+  __m128i v;
+  int i,c,m;
+
+  
+  for ( i= 0; i < CD_SUBPW_SIZE/16; ++i )
+    {
+      v= reverse_bytes64 ( _mm_loadu_si128 ( (const __m128i *) &pw[16*i] ) );
+      for ( c= 0; c < 8; ++c, v= _mm_add_epi8 ( v, v ) )
+        {
+          m= _mm_movemask_epi8 ( v );
+          packed[c*CHANNEL_SIZE + 2*i]= (uint8_t) m;
+          packed[c*CHANNEL_SIZE + 2*i+1]= (uint8_t) (m>>8);
+        }
+    }
+#else
+  uint64_t x,t;
+  int i,j,c;
+
+  
+  // Cada grup de 8 bytes és una matriu de 8x8 bits que es
+  // transposa. Després la fila C té els bits del canal C.
+  for ( i= 0; i < CHANNEL_SIZE; ++i, pw+= 8 )
+    {
+      for ( x= 0, j= 0; j < 8; ++j ) x= (x<<8) | pw[j];
+      t= (x ^ (x>>7)) & 0x00AA00AA00AA00AAULL; x^= t ^ (t<<7);
+      t= (x ^ (x>>14)) & 0x0000CCCC0000CCCCULL; x^= t ^ (t<<14);
+      t= (x ^ (x>>28)) & 0x00000000F0F0F0F0ULL; x^= t ^ (t<<28);
+      for ( c= 0; c < 8; ++c )
+        packed[c*CHANNEL_SIZE + i]= (uint8_t) (x>>(56-8*c));
+    }
+#endif
+  
+} // end deinterleave
+
+
+static void
+set_msf (
+         uint8_t msf[3],
+         size_t  sec
+         )
+{
+
+  msf[0]= BCD ( sec/(60*75) ); sec%= 60*75;
+  msf[1]= BCD ( sec/75 ); sec%= 75;
+  msf[2]= BCD ( sec );
+  
+} // end set_msf
+
+
+static inline uint8_t
+bcd_inc (
+         const uint8_t v
+         )
+{
+  return (uint8_t) ((v&0xF) == 0x9 ? v+7 : v+1);
+} // end bcd_inc
+
+
+static inline uint8_t
+bcd_dec (
+         const uint8_t v
+         )
+{
+  return (uint8_t) ((v&0xF) == 0x0 ? v-7 : v-1);
+} // end bcd_dec
+
+
+// NOTA!! Els minuts no tenen límit, igual que en BCD(NUM) es
+// desborden de la mateixa manera.
+static void
+msf_inc (
+         uint8_t msf[3]
+         )
+{
+
+  if ( msf[2] != 0x74 ) { msf[2]= bcd_inc ( msf[2] ); return; }
+  msf[2]= 0x00;
+  if ( msf[1] != 0x59 ) { msf[1]= bcd_inc ( msf[1] ); return; }
+  msf[1]= 0x00;
+  msf[0]= bcd_inc ( msf[0] );
+  
+} // end msf_inc
+
+
+static void
+msf_dec (
+         uint8_t msf[3]
+         )
+{
+
+  if ( msf[2] != 0x00 ) { msf[2]= bcd_dec ( msf[2] ); return; }
+  msf[2]= 0x74;
+  if ( msf[1] != 0x00 ) { msf[1]= bcd_dec ( msf[1] ); return; }
+  msf[1]= 0x59;
+  msf[0]= bcd_dec ( msf[0] );
+  
+} // end msf_dec
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+void
+CD_subq_fill (
+              uint8_t          *buf,
+              const CD_SubQRun *run,
+              const size_t      n,
+              bool             *crc_ok
+              )
+{
+
+  uint16_t crc[CRC_CHUNK];
+  uint8_t rel[3],abs[3],*p;
+  size_t i,j,m;
+  
+  
+  set_msf ( rel, run->rel );
+  set_msf ( abs, run->abs );
+  for ( i= 0, p= buf; i < n; ++i, p+= CD_SUBCH_SIZE )
+    {
+      p[0]= 0x00; // Sincronització.
+      p[1]= run->ctrl;
+      p[2]= run->track;
+      p[3]= run->index;
+      memcpy ( &p[4], rel, 3 );
+      p[7]= 0x00; // Reserved
+      memcpy ( &p[8], abs, 3 );
+      if ( run->pregap ) msf_dec ( rel );
+      else               msf_inc ( rel );
+      msf_inc ( abs );
+    }
+
+  // CRC.
+  for ( i= 0, p= buf; i < n; i+= m )
+    {
+      m= n-i < CRC_CHUNK ? n-i : CRC_CHUNK;
+      CD_crc_subq_calc_batch ( &p[1], m, CD_SUBCH_SIZE, crc );
+      for ( j= 0; j < m; ++j, p+= CD_SUBCH_SIZE )
+        {
+          p[11]= (uint8_t) (crc[j]>>8);
+          p[12]= (uint8_t) (crc[j]&0xFF);
+        }
+    }
+  
+  if ( crc_ok != NULL )
+    for ( i= 0; i < n; ++i )
+      crc_ok[i]= true;
+  
+} // end CD_subq_fill
+
+
+void
+CD_subq_to_pw (
+               const uint8_t q[CD_SUBCH_SIZE],
+               uint8_t       pw[CD_SUBPW_SIZE]
+               )
+{
+
+  uint8_t p;
+  int i;
+  
+
+  // Com fa mednafen, P sols s'activa en els pregaps.
+  p= ((q[1]&0x0F) == 0x1 && q[3] == 0x00) ? 0x80 : 0x00;
+  for ( i= 0; i < CD_SUBPW_SIZE; ++i )
+    pw[i]= p | (uint8_t) (((q[1+(i>>3)]>>(7-(i&7)))&1)<<6);
+  
+} // end CD_subq_to_pw
+
+
+void
+CD_subpw_interleave (
+                     const uint8_t packed[CD_SUBPW_SIZE],
+                     uint8_t       pw[CD_SUBPW_SIZE]
+                     )
+{
+
+  uint8_t v;
+  int i,c;
+
+  
+  for ( i= 0; i < CD_SUBPW_SIZE; ++i )
+    {
+      v= 0;
+      for ( c= 0; c < 8; ++c )
+        v|= (uint8_t)
+          (((packed[c*CHANNEL_SIZE + (i>>3)]>>(7-(i&7)))&1)<<(7-c));
+      pw[i]= v;
+    }
+  
+} // end CD_subpw_interleave
+
+
+void
+CD_subpw_get_q (
+                const uint8_t pw[CD_SUBPW_SIZE],
+                uint8_t       q[12]
+                )
+{
+  get_q ( pw, q );
+} // end CD_subpw_get_q
+
+
+void
+CD_subpw_get_q_batch (
+                      const uint8_t *pw,
+                      const size_t   n,
+                      const size_t   stride,
+                      uint8_t       *q,
+                      const size_t   q_stride
+                      )
+{
+
+  size_t i;
+
+  
+  for ( i= 0; i < n; ++i, pw+= stride, q+= q_stride )
+    get_q ( pw, q );
+  
+} // end CD_subpw_get_q_batch
+
+
+void
+CD_subpw_deinterleave (
+                       const uint8_t pw[CD_SUBPW_SIZE],
+                       uint8_t       packed[CD_SUBPW_SIZE]
+                       )
+{
+  deinterleave ( pw, packed );
+} // end CD_subpw_deinterleave
+
+
+void
+CD_subpw_deinterleave_batch (
+                             const uint8_t *pw,
+                             const size_t   n,
+                             const size_t   stride,
+                             uint8_t       *packed
+                             )
+{
+
+  size_t i;
+
+  
+  for ( i= 0; i < n; ++i, pw+= stride, packed+= CD_SUBPW_SIZE )
+    deinterleave ( pw, packed );
+  
+} // end CD_subpw_deinterleave_batch
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  subq.h - Generació del subcanal Q per trams de sectors.
+ *
+ */
+
+#ifndef __CD_SUBQ_H__
+#define __CD_SUBQ_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CD.h"
+
+// Tram de sectors consecutius d'un mateix track i índex en la zona de
+// dades (ADR 1).
+typedef struct
+{
+
+  uint8_t ctrl; // ADR/Control.
+  uint8_t track; // Número de track en BCD.
+  uint8_t index; // Índex en BCD.
+  bool    pregap; // Cert si l'adreça relativa decreix (compte enrere
+                  // fins a l'índex 01).
+  size_t  rel; // Adreça relativa del primer sector (en sectors).
+  size_t  abs; // Adreça absoluta del primer sector (en sectors).
+  
+} CD_SubQRun;
+
+// Omple en BUF[N*CD_SUBCH_SIZE] el subcanal Q dels N sectors de RUN,
+// CRC inclòs. Les adreces s'incrementen directament en BCD, sense
+// divisions. Si CRC_OK no és NULL es fiquen a cert els seus N
+// elements.
+void
+CD_subq_fill (
+              uint8_t          *buf,
+              const CD_SubQRun *run,
+              const size_t      n,
+              bool             *crc_ok
+              );
+
+// Sintetitza els subcanals P-W (intercalats) a partir del subcanal Q
+// (format CD_SUBCH_SIZE). El canal P s'activa en les pauses (índex 00)
+// i la resta de canals es deixen a 0.
+void
+CD_subq_to_pw (
+               const uint8_t q[CD_SUBCH_SIZE],
+               uint8_t       pw[CD_SUBPW_SIZE]
+               );
+
+// Intercala els subcanals P-W desats un darrere de l'altre (12 bytes
+// per canal, com en els fitxers .sub de CloneCD) en PW.
+void
+CD_subpw_interleave (
+                     const uint8_t packed[CD_SUBPW_SIZE],
+                     uint8_t       pw[CD_SUBPW_SIZE]
+                     );
+
+// Extrau en Q els 12 bytes del subcanal Q (sense el byte de
+// sincronització) dels subcanals P-W intercalats de PW (bit 6 de cada
+// byte). En x86 es fa amb SSE2.
+void
+CD_subpw_get_q (
+                const uint8_t pw[CD_SUBPW_SIZE],
+                uint8_t       q[12]
+                );
+
+// Com CD_subpw_get_q per a N sectors. Els subcanals estan separats
+// STRIDE bytes en PW i el Q de cada sector s'escriu cada Q_STRIDE
+// bytes en Q.
+void
+CD_subpw_get_q_batch (
+                      const uint8_t *pw,
+                      const size_t   n,
+                      const size_t   stride,
+                      uint8_t       *q,
+                      const size_t   q_stride
+                      );
+
+// Inversa de CD_subpw_interleave: separa els 8 canals de PW en PACKED
+// (12 bytes per canal, de P a W).
+void
+CD_subpw_deinterleave (
+                       const uint8_t pw[CD_SUBPW_SIZE],
+                       uint8_t       packed[CD_SUBPW_SIZE]
+                       );
+
+// Com CD_subpw_deinterleave per a N sectors separats STRIDE bytes en
+// PW. Els resultats es desen un darrere de l'altre en PACKED.
+void
+CD_subpw_deinterleave_batch (
+                             const uint8_t *pw,
+                             const size_t   n,
+                             const size_t   stride,
+                             uint8_t       *packed
+                             );
+
+#endif // __CD_SUBQ_H__
@@ -28,6 +28,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CD_HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
 #include "CD.h"
 #include "utils.h"
@@ -43,6 +54,10 @@
 
 #define BCD(NUM) ((uint8_t) (((NUM)/10)*0x10 + (NUM)%10))
 
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
 
 
 
@@ -133,6 +148,168 @@ CD_mem_realloc__ (
 } // CD_mem_realloc__
 
 
+int
+CD_file_open (
+              const char *fn,
+              long       *size
+              )
+{
+
+  int fd;
+  struct stat st;
+  
+  
+  fd= open ( fn, O_RDONLY );
+  if ( fd == -1 ) return -1;
+  if ( fstat ( fd, &st ) == -1 )
+    {
+      close ( fd );
+      return -1;
+    }
+  *size= (long) st.st_size;
+  
+  return fd;
+  
+} // end CD_file_open
+
+
+void
+CD_file_close (
+               const int fd
+               )
+{
+  if ( fd != -1 ) close ( fd );
+} // end CD_file_close
+
+
+bool
+CD_file_stat (
+              const char *fn,
+              long       *size,
+              int64_t    *mtime
+              )
+{
+
+  struct stat st;
+
+  
+  if ( stat ( fn, &st ) == -1 ) return false;
+  *size= (long) st.st_size;
+#ifdef __APPLE__
+  *mtime= (int64_t) st.st_mtimespec.tv_sec*1000000000 +
+    st.st_mtimespec.tv_nsec;
+#else
+  *mtime= (int64_t) st.st_mtim.tv_sec*1000000000 + st.st_mtim.tv_nsec;
+#endif
+  
+  return true;
+  
+} // end CD_file_stat
+
+
+const uint8_t *
+CD_file_map (
+             const int    fd,
+             const size_t size
+             )
+{
+  
+#ifdef CD_HAVE_MMAP
+  void *ret;
+  
+  
+  if ( size == 0 ) return NULL;
+  ret= mmap ( NULL, size, PROT_READ, MAP_SHARED, fd, 0 );
+  if ( ret == MAP_FAILED ) return NULL;
+  
+  return (const uint8_t *) ret;
+#else
+  return NULL;
+#endif
+  
+} // end CD_file_map
+
+
+void
+CD_file_unmap (
+               const uint8_t *mem,
+               const size_t   size
+               )
+{
+  
+#ifdef CD_HAVE_MMAP
+  if ( mem != NULL ) munmap ( (void *) mem, size );
+#endif
+  
+} // end CD_file_unmap
+
+
+bool
+CD_read_at (
+            const int     fd,
+            void         *buf,
+            const size_t  size,
+            const long    offset
+            )
+{
+
+  size_t done;
+  ssize_t ret;
+  
+  
+  for ( done= 0; done < size; done+= (size_t) ret )
+    {
+      ret= pread ( fd, ((uint8_t *) buf) + done, size-done,
+                   (off_t) (offset + (long) done) );
+      if ( ret == -1 && errno == EINTR ) { ret= 0; continue; }
+      if ( ret <= 0 ) return false;
+    }
+  
+  return true;
+  
+} // end CD_read_at
+
+
+bool
+CD_readv_at (
+             const int     fd,
+             struct iovec *iov,
+             int           niov,
+             const long    offset
+             )
+{
+
+  long pos;
+  ssize_t ret;
+  size_t nbytes;
+  
+  
+  pos= offset;
+  while ( niov > 0 )
+    {
+      ret= preadv ( fd, iov, niov < IOV_MAX ? niov : IOV_MAX, (off_t) pos );
+      if ( ret == -1 && errno == EINTR ) continue;
+      if ( ret <= 0 ) return false;
+      pos+= (long) ret;
+      // Bota els buffers plens i ajusta el primer incomplet.
+      nbytes= (size_t) ret;
+      while ( niov > 0 && nbytes >= iov->iov_len )
+        {
+          nbytes-= iov->iov_len;
+          ++iov; --niov;
+        }
+      if ( niov > 0 )
+        {
+          iov->iov_base= ((uint8_t *) iov->iov_base) + nbytes;
+          iov->iov_len-= nbytes;
+        }
+    }
+  
+  return true;
+  
+} // end CD_readv_at
+
+
 CD_Buffer *
 CD_buffer_new (void)
 {
@@ -190,6 +367,47 @@ CD_gline (
 } // end CD_gline
 
 
+int
+CD_user_data_layout (
+                     const uint8_t  mode,
+                     const uint8_t  submode,
+                     int           *offset
+                     )
+{
+
+  switch ( mode )
+    {
+    case 0x01:
+      *offset= 16;
+      return 2048;
+    case 0x02: // Bit 5 del 'submode': Form 2.
+      *offset= 24;
+      return (submode&0x20) ? 2324 : 2048;
+    default:
+      return -1;
+    }
+  
+} // end CD_user_data_layout
+
+
+int
+CD_get_user_data (
+                  const uint8_t *sec,
+                  uint8_t       *buf
+                  )
+{
+
+  int offset,length;
+  
+
+  length= CD_user_data_layout ( sec[15], sec[18], &offset );
+  if ( length != -1 ) memcpy ( buf, &sec[offset], (size_t) length );
+  
+  return length;
+  
+} // end CD_get_user_data
+
+
 CD_Position
 CD_get_position (
                  const size_t sec_ind
@@ -214,3 +432,21 @@ CD_get_position (
   return ret;
   
 } // end CD_get_position
+
+
+size_t
+CD_get_sec_ind (
+                const CD_Position pos
+                )
+{
+
+  size_t mm,ss,sec;
+
+
+  mm= (pos.mm>>4)*10 + (pos.mm&0xF);
+  ss= (pos.ss>>4)*10 + (pos.ss&0xF);
+  sec= (pos.sec>>4)*10 + (pos.sec&0xF);
+  
+  return (mm*60 + ss)*75 + sec;
+  
+} // end CD_get_sec_ind
@@ -24,9 +24,12 @@
 #ifndef __CD_UTILS_H__
 #define __CD_UTILS_H__
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/uio.h>
 
 /* ERROR */
 
@@ -50,6 +53,72 @@ void * CD_mem_realloc__ ( void * ptr, size_t nbytes );
   ((type *) CD_mem_realloc__ ( ptr, sizeof(type) * (size) ))
 
 
+/* FITXERS */
+
+// Obri el fitxer FN en mode lectura i desa en SIZE la seua grandària
+// en bytes. Torna el descriptor o -1 en cas d'error.
+int
+CD_file_open (
+              const char *fn,
+              long       *size
+              );
+
+void
+CD_file_close (
+               const int fd
+               );
+
+// Desa en SIZE la grandària en bytes del fitxer FN i en MTIME la data
+// de l'última modificació en nanosegons. Torna fals si no existeix.
+bool
+CD_file_stat (
+              const char *fn,
+              long       *size,
+              int64_t    *mtime
+              );
+
+
+/* MAP */
+
+// Projecta en memòria (sols lectura) els primers SIZE bytes del
+// fitxer obert FD. Torna NULL si no és possible (plataforma sense
+// suport, fitxer buit, etc.), en eixe cas cal llegir amb E/S normal.
+const uint8_t *
+CD_file_map (
+             const int    fd,
+             const size_t size
+             );
+
+void
+CD_file_unmap (
+               const uint8_t *mem,
+               const size_t   size
+               );
+
+
+/* E/S */
+
+// Llig SIZE bytes de FD a partir de OFFSET sense modificar la posició
+// del fitxer. Torna fals si no s'han pogut llegir tots els bytes.
+bool
+CD_read_at (
+            const int     fd,
+            void         *buf,
+            const size_t  size,
+            const long    offset
+            );
+
+// Com CD_read_at però repartint les dades en els NIOV buffers de
+// IOV. ATENCIÓ!!! IOV es modifica.
+bool
+CD_readv_at (
+             const int     fd,
+             struct iovec *iov,
+             int           niov,
+             const long    offset
+             );
+
+
 /* BUFFER */
 
 typedef struct
@@ -73,10 +142,37 @@ CD_gline (
           CD_Buffer *b
           );
 
+/* DADES D'USUARI */
+
+// Torna la grandària de les dades d'usuari d'un sector en mode MODE
+// (byte 15) i desa en OFFSET on comencen dins del sector. En MODE 2 la
+// forma es mira en el 'submode' del subheader XA (SUBMODE, byte 18).
+// Torna -1 si no és un sector de dades (MODE 0 o desconegut).
+int
+CD_user_data_layout (
+                     const uint8_t  mode,
+                     const uint8_t  submode,
+                     int           *offset
+                     );
+
+// Copia en BUF les dades d'usuari del sector SEC (CD_SEC_SIZE
+// bytes). Torna la grandària o -1 si no és un sector de dades.
+int
+CD_get_user_data (
+                  const uint8_t *sec,
+                  uint8_t       *buf
+                  );
+
 // Transforma un número de sector a CD_Position
 CD_Position
 CD_get_position (
                  const size_t sec_ind
                  );
 
+// Transforma una CD_Position a número de sector.
+size_t
+CD_get_sec_ind (
+                const CD_Position pos
+                );
+
 #endif // __CD_UTILS_H__
@@ -0,0 +1,402 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  verify.c - Implementa 'CD_disc_verify'.
+ *
+ */
+/*
+ *  Els sectors de dades de totes les pistes (sense pregap) es
+ *  reparteixen en blocs de CHUNK sectors. Cada fil té el seu cursor i
+ *  va agafant el següent bloc lliure amb un comptador atòmic, de
+ *  manera que els fils no s'esperen entre ells i cada bloc es llig
+ *  amb una única lectura (CD_disc_read_n).
+ */
+
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "CD.h"
+#include "ecc.h"
+#include "utils.h"
+
+
+
+
+/**********/
+/* MACROS */
+/**********/
+
+#define CHUNK 512
+
+#define MAX_THREADS 64
+
+
+
+
+/*********/
+/* TIPUS */
+/*********/
+
+typedef struct
+{
+
+  size_t sec;
+  int    n;
+  
+} chunk_t;
+
+typedef struct
+{
+
+  CD_Disc       *disc; // Cursor propi.
+  const chunk_t *chunks;
+  int            nchunks;
+  atomic_int    *next; // Següent bloc lliure (compartit).
+  uint8_t       *buf;
+  bool          *audio;
+  CD_BadSector  *bad;
+  int            nbad;
+  int            size;
+  long           checked;
+  long           skipped;
+  
+} worker_t;
+
+
+
+
+/*************/
+/* CONSTANTS */
+/*************/
+
+static const uint8_t SYNC[12]=
+  {0x00,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0x00};
+
+
+
+
+/*********************/
+/* FUNCIONS PRIVADES */
+/*********************/
+
+static uint32_t
+get_edc (
+         const uint8_t *p
+         )
+{
+  return
+    (uint32_t) p[0] | ((uint32_t) p[1]<<8) |
+    ((uint32_t) p[2]<<16) | ((uint32_t) p[3]<<24);
+} // end get_edc
+
+
+// Comprova les paritats P i Q de SEC.
+static bool
+check_ecc (
+           const uint8_t *sec,
+           const bool     zero_address
+           )
+{
+
+  uint8_t tmp[CD_SEC_SIZE];
+
+  
+  memcpy ( tmp, sec, CD_SEC_SIZE );
+  CD_ecc_generate ( tmp, zero_address );
+  
+  return !memcmp ( &tmp[0x81C], &sec[0x81C], CD_SEC_SIZE-0x81C );
+  
+} // end check_ecc
+
+
+// Torna els errors (CD_VERIFY_*) de SEC o -1 si no és un sector de
+// dades que es puga comprovar.
+static int
+check_sector (
+              const uint8_t *sec
+              )
+{
+
+  int ret;
+  uint32_t edc;
+  
+
+  if ( memcmp ( sec, SYNC, 12 ) ) return CD_VERIFY_SYNC;
+  ret= 0;
+  switch ( sec[15] )
+    {
+    case 0x01:
+      if ( CD_edc_calc ( 0, sec, 0x810 ) != get_edc ( &sec[0x810] ) )
+        ret|= CD_VERIFY_EDC;
+      if ( !check_ecc ( sec, false ) ) ret|= CD_VERIFY_ECC;
+      break;
+    case 0x02:
+      if ( sec[0x12]&0x20 ) // Form 2 (l'EDC és opcional).
+        {
+          edc= get_edc ( &sec[0x92C] );
+          if ( edc != 0 && CD_edc_calc ( 0, &sec[0x10], 0x91C ) != edc )
+            ret|= CD_VERIFY_EDC;
+        }
+      else
+        {
+          if ( CD_edc_calc ( 0, &sec[0x10], 0x808 ) != get_edc ( &sec[0x818] ) )
+            ret|= CD_VERIFY_EDC;
+          if ( !check_ecc ( sec, true ) ) ret|= CD_VERIFY_ECC;
+        }
+      break;
+    default: ret= -1;
+    }
+
+  return ret;
+  
+} // end check_sector
+
+
+static void
+add_bad (
+         worker_t     *w,
+         const size_t  sec,
+         const int     errors
+         )
+{
+
+  if ( w->nbad == w->size )
+    {
+      w->size= w->size==0 ? 16 : w->size*2;
+      w->bad= mem_realloc ( CD_BadSector, w->bad, w->size );
+    }
+  w->bad[w->nbad].sec= (int) sec;
+  w->bad[w->nbad].errors= errors;
+  ++(w->nbad);
+  
+} // end add_bad
+
+
+static void *
+run_worker (
+            void *arg
+            )
+{
+
+  worker_t *w;
+  const chunk_t *c;
+  int i,k,n,errors;
+  
+  
+  w= (worker_t *) arg;
+  while ( (i= atomic_fetch_add ( w->next, 1 )) < w->nchunks )
+    {
+      c= &(w->chunks[i]);
+      n= -1;
+      if ( CD_disc_seek ( w->disc, (int) (c->sec/(60*75)),
+                          (int) ((c->sec/75)%60), (int) (c->sec%75) ) )
+        n= CD_disc_read_n ( w->disc, w->buf, w->audio, c->n, false );
+      if ( n < 0 ) n= 0;
+      for ( k= 0; k < c->n; ++k )
+        {
+          if ( k >= n ) errors= CD_VERIFY_READ;
+          else if ( w->audio[k] ) errors= -1;
+          else errors= check_sector ( &(w->buf[k*CD_SEC_SIZE]) );
+          if ( errors == -1 ) ++(w->skipped);
+          else
+            {
+              ++(w->checked);
+              if ( errors != 0 ) add_bad ( w, c->sec+k, errors );
+            }
+        }
+    }
+
+  return NULL;
+  
+} // end run_worker
+
+
+// Divideix les pistes de dades de INFO (a partir de l'índex 01) en
+// blocs. Torna el número de blocs.
+static int
+get_chunks (
+            const CD_Info  *info,
+            chunk_t       **chunks
+            )
+{
+
+  const CD_TrackInfo *t;
+  size_t sec,last;
+  int i,j,n,size;
+  
+
+  *chunks= NULL;
+  n= size= 0;
+  for ( i= 0; i < info->ntracks; ++i )
+    {
+      t= &(info->tracks[i]);
+      if ( t->is_audio || t->nindexes == 0 ) continue;
+      sec= CD_get_sec_ind ( t->indexes[0].pos );
+      for ( j= 0; j < t->nindexes; ++j )
+        if ( t->indexes[j].id == 0x01 )
+          sec= CD_get_sec_ind ( t->indexes[j].pos );
+      last= CD_get_sec_ind ( t->pos_last_sector );
+      for ( ; sec <= last; sec+= CHUNK )
+        {
+          if ( n == size )
+            {
+              size= size==0 ? 64 : size*2;
+              *chunks= mem_realloc ( chunk_t, *chunks, size );
+            }
+          (*chunks)[n].sec= sec;
+          (*chunks)[n].n= last-sec+1 < CHUNK ? (int) (last-sec+1) : CHUNK;
+          ++n;
+        }
+    }
+
+  return n;
+  
+} // end get_chunks
+
+
+static int
+cmp_bad (
+         const void *a,
+         const void *b
+         )
+{
+
+  int sa,sb;
+
+  
+  sa= ((const CD_BadSector *) a)->sec;
+  sb= ((const CD_BadSector *) b)->sec;
+  
+  return sa<sb ? -1 : (sa>sb ? 1 : 0);
+  
+} // end cmp_bad
+
+
+
+
+/**********************/
+/* FUNCIONS PÚBLIQUES */
+/**********************/
+
+CD_VerifyReport *
+CD_disc_verify (
+                CD_Disc   *disc,
+                const int  nthreads
+                )
+{
+
+  CD_VerifyReport *ret;
+  CD_Info *info;
+  chunk_t *chunks;
+  worker_t *w;
+  pthread_t *threads;
+  bool *started;
+  atomic_int next;
+  int nchunks,nw,i,nbad;
+  long tmp;
+  
+
+  // Blocs.
+  info= CD_disc_get_info ( disc );
+  nchunks= get_chunks ( info, &chunks );
+  CD_info_free ( info );
+
+  // Fils.
+  if ( nthreads > 0 ) nw= nthreads;
+  else
+    {
+      tmp= sysconf ( _SC_NPROCESSORS_ONLN );
+      nw= tmp > 0 ? (int) tmp : 1;
+    }
+  if ( nw > MAX_THREADS ) nw= MAX_THREADS;
+  if ( nw > nchunks ) nw= nchunks > 0 ? nchunks : 1;
+  
+  // Treballadors. El primer s'executa en aquest fil, i si no es pot
+  // crear algun fil la resta de treballadors fan la seua part.
+  atomic_init ( &next, 0 );
+  w= mem_alloc ( worker_t, nw );
+  threads= mem_alloc ( pthread_t, nw );
+  started= mem_alloc ( bool, nw );
+  for ( i= 0; i < nw; ++i )
+    {
+      w[i].disc= CD_disc_clone ( disc );
+      w[i].chunks= chunks;
+      w[i].nchunks= nchunks;
+      w[i].next= &next;
+      w[i].buf= mem_alloc ( uint8_t, CHUNK*CD_SEC_SIZE );
+      w[i].audio= mem_alloc ( bool, CHUNK );
+      w[i].bad= NULL;
+      w[i].nbad= w[i].size= 0;
+      w[i].checked= w[i].skipped= 0;
+      started[i]= i > 0 &&
+        pthread_create ( &(threads[i]), NULL, run_worker, &(w[i])) == 0;
+    }
+  run_worker ( &(w[0]) );
+  for ( i= 1; i < nw; ++i )
+    if ( started[i] ) pthread_join ( threads[i], NULL );
+
+  // Informe.
+  ret= mem_alloc ( CD_VerifyReport, 1 );
+  ret->checked= ret->skipped= 0;
+  for ( i= nbad= 0; i < nw; ++i )
+    {
+      ret->checked+= w[i].checked;
+      ret->skipped+= w[i].skipped;
+      nbad+= w[i].nbad;
+    }
+  ret->nbad= nbad;
+  ret->bad= mem_alloc ( CD_BadSector, nbad>0 ? nbad : 1 );
+  for ( i= nbad= 0; i < nw; ++i )
+    {
+      if ( w[i].nbad > 0 )
+        memcpy ( &(ret->bad[nbad]), w[i].bad,
+                 sizeof(CD_BadSector)*w[i].nbad );
+      nbad+= w[i].nbad;
+      free ( w[i].bad );
+      free ( w[i].audio );
+      free ( w[i].buf );
+      CD_disc_free ( w[i].disc );
+    }
+  qsort ( ret->bad, (size_t) nbad, sizeof(CD_BadSector), cmp_bad );
+  free ( started );
+  free ( threads );
+  free ( w );
+  free ( chunks );
+  
+  return ret;
+  
+} // end CD_disc_verify
+
+
+void
+CD_verify_report_free (
+                       CD_VerifyReport *report
+                       )
+{
+
+  free ( report->bad );
+  free ( report );
+  
+} // end CD_verify_report_free
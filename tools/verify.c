@@ -0,0 +1,118 @@
+/*
+ * Copyright 2023 Adrià Giménez Pastor.
+ *
+ * This file is part of adriagipas/CD.
+ *
+ * adriagipas/CD is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * adriagipas/CD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with adriagipas/CD.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/*
+ *  verify.c - Comprova l'EDC/ECC de tots els sectors de dades d'una
+ *             imatge i mostra els sectors erronis.
+ *
+ *  Cal compilar-lo amb tots els fitxers de 'src' (i -lpthread -lz
+ *  -llzma).
+ *
+ */
+
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "CD.h"
+
+
+static double
+now ( void )
+{
+
+  struct timespec ts;
+
+
+  clock_gettime ( CLOCK_MONOTONIC, &ts );
+
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+
+}
+
+static void
+print_range (
+             const int first,
+             const int last,
+             const int errors
+             )
+{
+
+  printf ( "  %02d:%02d:%02d (LBA %d)", first/(60*75), (first/75)%60,
+           first%75, first-150 );
+  if ( last != first )
+    printf ( " - %02d:%02d:%02d (LBA %d)", last/(60*75), (last/75)%60,
+             last%75, last-150 );
+  printf ( ":%s%s%s%s\n",
+           errors&CD_VERIFY_READ ? " READ" : "",
+           errors&CD_VERIFY_SYNC ? " SYNC" : "",
+           errors&CD_VERIFY_EDC ? " EDC" : "",
+           errors&CD_VERIFY_ECC ? " ECC" : "" );
+
+}
+
+int main ( int argc, const char *argv[] )
+{
+
+  char *err;
+  CD_Disc *d;
+  CD_VerifyReport *r;
+  double t;
+  int i,first;
+
+
+  if ( argc < 2 || argc > 3 )
+    {
+      fprintf ( stderr, "%s <image> [<threads>]\n", argv[0] );
+      return EXIT_FAILURE;
+    }
+  d= CD_disc_new ( argv[1], &err );
+  if ( d == NULL )
+    {
+      fprintf ( stderr, "[EE] %s\n", err );
+      free ( err );
+      return EXIT_FAILURE;
+    }
+
+  t= now ();
+  r= CD_disc_verify ( d, argc == 3 ? atoi ( argv[2] ) : 0 );
+  t= now ()-t;
+
+  // Agrupa els sectors erronis consecutius amb els mateixos errors.
+  printf ( "Checked: %ld Skipped: %ld Bad: %d (%.2f s, %.1f MB/s)\n",
+           r->checked, r->skipped, r->nbad, t,
+           (r->checked+r->skipped)*(double) CD_SEC_SIZE/1e6/t );
+  for ( i= 0; i < r->nbad; )
+    {
+      first= i;
+      while ( i+1 < r->nbad && r->bad[i+1].sec == r->bad[i].sec+1 &&
+              r->bad[i+1].errors == r->bad[first].errors )
+        ++i;
+      print_range ( r->bad[first].sec, r->bad[i].sec, r->bad[first].errors );
+      ++i;
+    }
+  i= r->nbad;
+  CD_verify_report_free ( r );
+  CD_disc_free ( d );
+
+  return i == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}